@@ -8,8 +8,30 @@
 #include <setjmp.h>
 #include <stdio.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BON_SEARCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BON_SEARCH_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Name arrays of at most this many entries are searched with a linear (SIMD) scan. Larger arrays are
+ * bisected down to a window of this size which is then scanned. */
+#if defined(BON_SEARCH_AVX2)
+#define BON_LINEAR_SEARCH_MAX_COUNT     32
+#elif defined(BON_SEARCH_SSE2)
+#define BON_LINEAR_SEARCH_MAX_COUNT     16
+#else
+#define BON_LINEAR_SEARCH_MAX_COUNT     8
+#endif
+
 #define BON_VALUE_TYPE(v)       ((int)(*(v) & 0x7ull))
-#define BON_VALUE_PTR(v)        ((void*)((uint8_t*)(v) + (*((int32_t*)(v) + 1))))
+#define BON_VALUE_OFFSET(v)     ((int64_t)*((const int32_t*)(v) + 1) + (int64_t)(*(const int32_t*)(v) >> 8) * 0x100000000ll)   /* See BonWideRecordHeader */
+#define BON_VALUE_PTR(v)        ((void*)((uint8_t*)(v) + BON_VALUE_OFFSET(v)))
 
 /*---------------------------------------------------------------------------*/
 /* Utilities */
@@ -26,7 +48,7 @@ Hash32(const void *data, uint32_t nbytes) {
         const uint32_t c1 = 0xcc9e2d51;
         const uint32_t c2 = 0x1b873593;
         const int nblocks = nbytes / 4;
-        const uint32_t *blocks = (const uint32_t *)(data);
+        const uint8_t *blocks = (const uint8_t *)(data);
         const uint8_t *tail = (const uint8_t *)data + (nblocks * 4);
         uint32_t h = 0;
         int i;
@@ -36,7 +58,7 @@ Hash32(const void *data, uint32_t nbytes) {
                 return 0;
 
         for (i = 0; i < nblocks; i++) {
-                k = blocks[i];
+                memcpy(&k, blocks + i * 4, sizeof(k));                         /* Names can start at any address */
 
                 k *= c1;
                 k = (k << 15) | (k >> (32 - 15));
@@ -72,6 +94,53 @@ Hash32(const void *data, uint32_t nbytes) {
         return h;
 }
 
+#if defined(BON_SEARCH_AVX2) || defined(BON_SEARCH_SSE2)
+static int
+CountTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* Return index of value in names[0..nameCount) or -1. The array does not need to be sorted. */
+static int
+LinearSearchName(const BonName* names, int nameCount, BonName value) {
+        int i = 0;
+#if defined(BON_SEARCH_AVX2)
+        const __m256i key8 = _mm256_set1_epi32((int)value);
+        for (; i + 8 <= nameCount; i += 8) {
+                const __m256i block = _mm256_loadu_si256((const __m256i*)(names + i));
+                const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, key8)));
+                if (mask) {
+                        return i + CountTrailingZeros((uint32_t)mask);
+                }
+        }
+#endif
+#if defined(BON_SEARCH_AVX2) || defined(BON_SEARCH_SSE2)
+        {
+                const __m128i key4 = _mm_set1_epi32((int)value);
+                for (; i + 4 <= nameCount; i += 4) {
+                        const __m128i block = _mm_loadu_si128((const __m128i*)(names + i));
+                        const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, key4)));
+                        if (mask) {
+                                return i + CountTrailingZeros((uint32_t)mask);
+                        }
+                }
+        }
+#endif
+        for (; i < nameCount; ++i) {
+                if (names[i] == value) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
 static int 
 NameCompare(const void * a, const void * b) {
         uint32_t aname = ((BonNameAndOffset*)a)->name;
@@ -83,6 +152,29 @@ NameCompare(const void * a, const void * b) {
 
 /*---------------------------------------------------------------------------*/
 
+static const BonWideRecordHeader*
+GetWideHeader(const BonRecord* br) {
+        return br->magic == BON_WIDE_RECORD_MAGIC ? (const BonWideRecordHeader*)&br[1] : 0;
+}
+
+/* Offsets relative to the record of the first container, the first value string and the name lookup table */
+static size_t
+GetContainersBegin(const BonRecord* br) {
+        return GetWideHeader(br) ? sizeof(BonRecord) + sizeof(BonWideRecordHeader) : sizeof(BonRecord);
+}
+
+static size_t
+GetValueStringsBegin(const BonRecord* br) {
+        const BonWideRecordHeader* wide = GetWideHeader(br);
+        return wide ? (size_t)wide->valueStringOffset : (size_t)((int64_t)offsetof(BonRecord, valueStringOffset) + br->valueStringOffset);
+}
+
+static size_t
+GetNameLookupOffset(const BonRecord* br) {
+        const BonWideRecordHeader* wide = GetWideHeader(br);
+        return wide ? (size_t)wide->nameLookupTableOffset : (size_t)((int64_t)offsetof(BonRecord, nameLookupTableOffset) + br->nameLookupTableOffset);
+}
+
 BonBool                         
 BonIsAValidRecord(const BonRecord* br, size_t brSizeInBytes) {
         const char* magicChars;
@@ -98,33 +190,318 @@ BonIsAValidRecord(const BonRecord* br, size_t brSizeInBytes) {
                 return BON_FALSE;
         }
         magicChars = (const char*)&br->magic;
-        if (!(magicChars[0] == 'B' && magicChars[1] == 'O' && magicChars[2] == 'N' && magicChars[3] == ' ')) {
+        if (!(magicChars[0] == 'B' && magicChars[1] == 'O' && magicChars[2] == 'N' && (magicChars[3] == ' ' || magicChars[3] == 'W'))) {
+                return BON_FALSE;
+        }
+        if (GetWideHeader(br) && brSizeInBytes > 0 && brSizeInBytes < sizeof(BonRecord) + sizeof(BonWideRecordHeader)) {
                 return BON_FALSE;
         }
-        if (brSizeInBytes > 0 && br->recordSize != brSizeInBytes) {
+        if (brSizeInBytes > 0 && BonGetRecordSize(br) != brSizeInBytes) {
                 return BON_FALSE;
         }
         return BON_TRUE;
 }
 
-uint32_t                        
+uint64_t                        
 BonGetRecordSize(const BonRecord* br) {
-        return br->recordSize;
+        const BonWideRecordHeader* wide = GetWideHeader(br);
+        return wide ? wide->recordSize : br->recordSize;
 }
 
-const char*
-BonGetNameString(const BonRecord* br, BonName name) {
-        BonContainerHeader*     header          = (BonContainerHeader*)((uint8_t*)&br->nameLookupTableOffset + br->nameLookupTableOffset);
-        BonNameAndOffset*       nameLookup      = (BonNameAndOffset*)(&header[1]);
+static const BonNameAndOffset*
+GetNameLookupTable(const BonRecord* br, int* count) {
+        static const BonNameAndOffset   s_noNames[1];
+        const BonContainerHeader*       header;
+        if (br->flags & BON_RECORD_FLAG_NO_NAMES) {                             /* Stripped, there is no table to point into */
+                *count = 0;
+                return s_noNames;
+        }
+        header = (const BonContainerHeader*)((const uint8_t*)br + GetNameLookupOffset(br));
+        *count = header->count;
+        return (const BonNameAndOffset*)&header[1];
+}
+
+static const char*
+GetNameAndOffsetString(const BonNameAndOffset* item) {
+        return (const char*)((const uint8_t*)&item->offset + item->offset);
+}
+
+/* Byte count of a string of a record with the given flags */
+static size_t
+GetStringLength(uint32_t recordFlags, const char* string) {
+        if (recordFlags & BON_RECORD_FLAG_STRING_LENGTHS) {
+                return *((const uint32_t*)string - 1);
+        }
+        return strlen(string);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Names */
+
+typedef struct BonNameDictionaryEntry {
+        uint32_t                id;
+        const BonRecord*        dictionary;
+} BonNameDictionaryEntry;
+
+static BonNameDictionaryEntry   s_nameDictionaries[BON_MAX_NAME_DICTIONARIES];
+
+uint32_t
+BonGetNameDictionaryId(const BonRecord* dictionary) {
+        int                     count;
+        const BonNameAndOffset* table   = GetNameLookupTable(dictionary, &count);
+        uint32_t                id      = 2166136261u;                          /* FNV-1a over the names */
+        int                     i;
+        for (i = 0; i < count; ++i) {
+                id = (id ^ table[i].name) * 16777619u;
+        }
+        return id ? id : 1;
+}
+
+BonBool
+BonRegisterNameDictionary(const BonRecord* dictionary) {
+        int i;
+        for (i = 0; i < BON_MAX_NAME_DICTIONARIES; ++i) {
+                if (!s_nameDictionaries[i].dictionary) {
+                        s_nameDictionaries[i].id                = BonGetNameDictionaryId(dictionary);
+                        s_nameDictionaries[i].dictionary        = dictionary;
+                        return BON_TRUE;
+                }
+        }
+        return BON_FALSE;
+}
+
+void
+BonUnregisterNameDictionary(const BonRecord* dictionary) {
+        int i;
+        for (i = 0; i < BON_MAX_NAME_DICTIONARIES; ++i) {
+                if (s_nameDictionaries[i].dictionary == dictionary) {
+                        s_nameDictionaries[i].id                = 0;
+                        s_nameDictionaries[i].dictionary        = 0;
+                }
+        }
+}
+
+const BonRecord*
+BonGetNameDictionary(const BonRecord* br) {
+        int i;
+        if (br->nameDictionaryId == 0)
+                return 0;
+        for (i = 0; i < BON_MAX_NAME_DICTIONARIES; ++i) {
+                if (s_nameDictionaries[i].dictionary && s_nameDictionaries[i].id == br->nameDictionaryId) {
+                        return s_nameDictionaries[i].dictionary;
+                }
+        }
+        return 0;
+}
+
+static const char*
+FindNameString(const BonRecord* br, BonName name) {
+        int                     count;
+        const BonNameAndOffset* nameLookup      = GetNameLookupTable(br, &count);
         BonNameAndOffset        key;
         BonNameAndOffset*       item;
         key.name                = name;
         key.offset              = 0;
-        item = bsearch(&key, nameLookup, header->count, sizeof(BonNameAndOffset), NameCompare);
+        item = bsearch(&key, nameLookup, count, sizeof(BonNameAndOffset), NameCompare);
         if (!item) {
                 return 0;
         }
-        return (const char*)((uint8_t*)&item->offset + item->offset);
+        return GetNameAndOffsetString(item);
+}
+
+const char*
+BonGetNameString(const BonRecord* br, BonName name) {
+        const char*             string          = FindNameString(br, name);
+        const BonRecord*        dictionary;
+        if (!string && (dictionary = BonGetNameDictionary(br)) != 0) {
+                string = FindNameString(dictionary, name);
+        }
+        return string;
+}
+
+const char*
+BonGetNameStringWithLength(const BonRecord* br, BonName name, size_t* byteCount) {
+        const BonRecord*        owner           = br;
+        const char*             string          = FindNameString(br, name);
+        if (!string && (owner = BonGetNameDictionary(br)) != 0) {
+                string = FindNameString(owner, name);
+        }
+        *byteCount = string ? GetStringLength(owner->flags, string) : 0;
+        return string;
+}
+
+/* Resolve sortedNames against table with one merge pass. If onlyMissing, strings that are already
+ * resolved are left alone. Return the number of strings resolved. */
+static int
+MergeNameStrings(const BonNameAndOffset* table, int count, const BonName* sortedNames, int nameCount, const char** strings, BonBool onlyMissing) {
+        int                     t               = 0;
+        int                     found           = 0;
+        int                     i;
+
+        for (i = 0; i < nameCount; ++i) {
+                const BonName name = sortedNames[i];
+                int step = 1;
+                int hi;
+
+                if (onlyMissing && strings[i]) {
+                        continue;
+                }
+
+                /* Gallop ahead so that a few names against a large table don't degrade to a linear 
+                 * walk of the table, then bisect the last step. */
+                while (t + step < count && table[t + step].name < name) {
+                        t += step;
+                        step *= 2;
+                }
+                hi = (t + step < count) ? t + step : count;
+                while (t < hi) {
+                        const int m = t + (hi - t) / 2;
+                        if (table[m].name < name) {
+                                t = m + 1;
+                        } else {
+                                hi = m;
+                        }
+                }
+
+                if (t < count && table[t].name == name) {
+                        strings[i] = GetNameAndOffsetString(&table[t]);
+                        ++found;
+                } else {
+                        strings[i] = 0;
+                }
+        }
+        return found;
+}
+
+int
+BonGetNameStrings(const BonRecord* br, const BonName* sortedNames, int nameCount, const char** strings) {
+        int                     count;
+        const BonNameAndOffset* table           = GetNameLookupTable(br, &count);
+        const BonRecord*        dictionary;
+        int                     found           = MergeNameStrings(table, count, sortedNames, nameCount, strings, BON_FALSE);
+
+        if (found < nameCount && (dictionary = BonGetNameDictionary(br)) != 0) {
+                table = GetNameLookupTable(dictionary, &count);
+                found += MergeNameStrings(table, count, sortedNames, nameCount, strings, BON_TRUE);
+        }
+        return found;
+}
+
+typedef struct BonNameIndexSlot {
+        BonName                 name;
+        uint32_t                tableIndex;                                     /* Index in the name lookup tables + 1. 0 means empty slot. */
+} BonNameIndexSlot;
+
+typedef struct BonNameIndex {
+        const BonNameAndOffset* table;
+        const BonNameAndOffset* dictionaryTable;                                /* Indexed after the record's own table */
+        uint32_t                tableCount;
+        uint32_t                tableFlags;                                     /* BonRecord::flags of the record and of the dictionary */
+        uint32_t                dictionaryFlags;
+        uint32_t                mask;
+        BonNameIndexSlot        slots[1];
+} BonNameIndex;
+
+static uint32_t
+NameIndexSlotCount(int nameCount) {
+        uint32_t slotCount = 1;
+        while (slotCount < (uint32_t)nameCount * 2u) {                          /* Keep load factor <= 0.5 */
+                slotCount *= 2;
+        }
+        return slotCount;
+}
+
+static int
+NameIndexNameCount(const BonRecord* br) {
+        int                     count;
+        int                     dictionaryCount = 0;
+        const BonRecord*        dictionary      = BonGetNameDictionary(br);
+        GetNameLookupTable(br, &count);
+        if (dictionary) {
+                GetNameLookupTable(dictionary, &dictionaryCount);
+        }
+        return count + dictionaryCount;
+}
+
+size_t
+BonGetNameIndexSize(const BonRecord* br) {
+        return offsetof(BonNameIndex, slots) + NameIndexSlotCount(NameIndexNameCount(br)) * sizeof(BonNameIndexSlot);
+}
+
+static void
+InsertNamesInIndex(BonNameIndex* index, const BonNameAndOffset* table, int count, uint32_t firstTableIndex) {
+        int i;
+        /* Names are already murmur3 hashes so the low bits are used as is */
+        for (i = 0; i < count; ++i) {
+                uint32_t slot = table[i].name & index->mask;
+                while (index->slots[slot].tableIndex && index->slots[slot].name != table[i].name) {
+                        slot = (slot + 1) & index->mask;
+                }
+                if (!index->slots[slot].tableIndex) {                           /* The record's own names win over the dictionary's */
+                        index->slots[slot].name         = table[i].name;
+                        index->slots[slot].tableIndex   = firstTableIndex + (uint32_t)i + 1;
+                }
+        }
+}
+
+struct BonNameIndex*
+BonCreateNameIndex(const BonRecord* br, void* memory) {
+        BonNameIndex*           index           = (BonNameIndex*)memory;
+        int                     count;
+        int                     dictionaryCount = 0;
+        const BonNameAndOffset* table           = GetNameLookupTable(br, &count);
+        const BonRecord*        dictionary      = BonGetNameDictionary(br);
+        const uint32_t          slotCount       = NameIndexSlotCount(NameIndexNameCount(br));
+
+        index->table            = table;
+        index->dictionaryTable  = dictionary ? GetNameLookupTable(dictionary, &dictionaryCount) : 0;
+        index->tableCount       = (uint32_t)count;
+        index->tableFlags       = br->flags;
+        index->dictionaryFlags  = dictionary ? dictionary->flags : 0;
+        index->mask             = slotCount - 1;
+        memset(index->slots, 0, slotCount * sizeof(BonNameIndexSlot));
+
+        InsertNamesInIndex(index, table, count, 0);
+        InsertNamesInIndex(index, index->dictionaryTable, dictionaryCount, (uint32_t)count);
+        return index;
+}
+
+/* Return the table entry of name, or null. flags receives the BonRecord::flags of the table's record. */
+static const BonNameAndOffset*
+FindNameInIndex(const BonNameIndex* index, BonName name, uint32_t* flags) {
+        uint32_t slot = name & index->mask;
+        for (;;) {
+                const BonNameIndexSlot* s = &index->slots[slot];
+                if (s->name == name && s->tableIndex) {
+                        const uint32_t i = s->tableIndex - 1;
+                        if (i < index->tableCount) {
+                                *flags = index->tableFlags;
+                                return &index->table[i];
+                        }
+                        *flags = index->dictionaryFlags;
+                        return &index->dictionaryTable[i - index->tableCount];
+                }
+                if (!s->tableIndex) {
+                        return 0;
+                }
+                slot = (slot + 1) & index->mask;
+        }
+}
+
+const char*
+BonNameIndexGetString(const struct BonNameIndex* index, BonName name) {
+        uint32_t                flags;
+        const BonNameAndOffset* item            = FindNameInIndex(index, name, &flags);
+        return item ? GetNameAndOffsetString(item) : 0;
+}
+
+const char*
+BonNameIndexGetStringWithLength(const struct BonNameIndex* index, BonName name, size_t* byteCount) {
+        uint32_t                flags;
+        const BonNameAndOffset* item            = FindNameInIndex(index, name, &flags);
+        const char*             string          = item ? GetNameAndOffsetString(item) : 0;
+        *byteCount = string ? GetStringLength(flags, string) : 0;
+        return string;
 }
 
 const BonValue*
@@ -192,6 +569,19 @@ BonAsString(const BonValue* bv) {
         return (const char*)BON_VALUE_PTR(bv);
 }
 
+const char*
+BonAsStringWithLength(const BonValue* bv, size_t* byteCount) {
+        const char* string;
+        if (BON_VALUE_TYPE(bv) != BON_VT_STRING) {
+                assert(0 && "Expected BON_VT_STRING");
+                *byteCount = 0;
+                return "";
+        }
+        string = (const char*)BON_VALUE_PTR(bv);
+        *byteCount = GetStringLength((*bv & BON_STRING_FLAG_LENGTH) ? BON_RECORD_FLAG_STRING_LENGTHS : 0, string);
+        return string;
+}
+
 BonBool                         
 BonAsBool(const BonValue* bv) {
         if (BON_VALUE_TYPE(bv) != BON_VT_BOOL) {
@@ -216,6 +606,88 @@ BonAsNumberArray(const BonValue* bv) {
         return o;
 }
 
+/* Return BON_TRUE if the type tag of every value is BON_VT_NUMBER (0) */
+static BonBool
+AreAllNumbers(const BonValue* values, int count) {
+        int             i       = 0;
+        uint64_t        tags    = 0;
+#if defined(BON_SEARCH_AVX2)
+        {
+                const __m256i mask = _mm256_set1_epi64x(0x7);
+                for (; i + 16 <= count; i += 16) {
+                        __m256i acc = _mm256_loadu_si256((const __m256i*)(values + i));
+                        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*)(values + i + 4)));
+                        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*)(values + i + 8)));
+                        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i*)(values + i + 12)));
+                        if (!_mm256_testz_si256(acc, mask)) {
+                                return BON_FALSE;
+                        }
+                }
+        }
+#endif
+#if defined(BON_SEARCH_AVX2) || defined(BON_SEARCH_SSE2)
+        {
+                const __m128i mask = _mm_set1_epi64x(0x7);
+                const __m128i zero = _mm_setzero_si128();
+                for (; i + 8 <= count; i += 8) {
+                        __m128i acc = _mm_loadu_si128((const __m128i*)(values + i));
+                        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(values + i + 2)));
+                        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(values + i + 4)));
+                        acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i*)(values + i + 6)));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(acc, mask), zero)) != 0xffff) {
+                                return BON_FALSE;
+                        }
+                }
+        }
+#endif
+        for (; i < count; ++i) {
+                tags |= values[i];
+        }
+        return (tags & 0x7ull) == 0;
+}
+
+BonBool
+BonTryAsNumberArray(const BonValue* bv, BonNumberArray* numbers) {
+        const BonContainerHeader* header = (const BonContainerHeader*)BON_VALUE_PTR(bv);
+        if (BON_VALUE_TYPE(bv) != BON_VT_ARRAY) {
+                return BON_FALSE;
+        }
+        if (!(*bv & BON_ARRAY_FLAG_NUMBERS) && !AreAllNumbers((const BonValue*)&header[1], header->count)) {
+                return BON_FALSE;
+        }
+        numbers->count  = header->count;
+        numbers->values = (const double*)&header[1];
+        return BON_TRUE;
+}
+
+BonTypedArray
+BonAsTypedArray(const BonValue* bv) {
+        BonTypedArray o;
+        const BonTypedArrayHeader* header = (const BonTypedArrayHeader*)BON_VALUE_PTR(bv);
+        if (BON_VALUE_TYPE(bv) != BON_VT_TYPED_ARRAY) {
+                assert(0 && "Expected BON_VT_TYPED_ARRAY");
+                o.count         = 0;
+                o.elementType   = 0;
+                o.values        = 0;
+                return o;
+        }
+        o.count         = header->count;
+        o.elementType   = header->elementType & ~BON_TYPED_ARRAY_TAG;
+        o.values        = &header[1];
+        return o;
+}
+
+size_t
+BonGetTypedArrayElementSize(int elementType) {
+        switch (elementType) {
+        case BON_ET_FLOAT32:    return 4;
+        case BON_ET_INT32:      return 4;
+        case BON_ET_INT16:      return 2;
+        case BON_ET_UINT8:      return 1;
+        default:                return 0;
+        }
+}
+
 BonName                         
 BonCreateName(const char* nameString, size_t nameStringByteCount) {
         return Hash32(nameString, (uint32_t)nameStringByteCount);
@@ -229,20 +701,21 @@ BonCreateNameCstr(const char* nameString) {
 
 int 
 BonFindIndexOfName(const BonName* names, int nameCount, BonName value) {
-	const int64_t value64 = (int64_t)value;
-	int l = 0;
-	int h = nameCount - 1;
-	while (l <= h) {
-		const int m = (l + h) / 2;
-		int64_t diff = (int64_t)names[m] - value64;
-		if (diff < 0)
-			l = m + 1;
-		else if (diff > 0)
-			h = m - 1;
-		else
-			return m;
-	}
-	return -1;
+        const BonName*  base    = names;
+        int             n       = nameCount;
+        int             i;
+
+        /* Branchless bisection. The lower bound of value is always in base[0..n] (inclusive). */
+        while (n > BON_LINEAR_SEARCH_MAX_COUNT) {
+                const int half = n / 2;
+                base = (base[half] < value) ? base + half : base;
+                n -= half;
+        }
+        if (base + n < names + nameCount) {
+                ++n;
+        }
+        i = LinearSearchName(base, n, value);
+        return i < 0 ? -1 : (int)(base - names) + i;
 }
 
 int                             
@@ -298,6 +771,18 @@ BonMemberAsNumberArray(const BonObject* object, BonName name) {
 }
 
 
+BonTypedArray
+BonMemberAsTypedArray(const BonObject* object, BonName name) {
+	int i = BonFindIndexOfName(object->names, object->count, name);
+	if (i >= 0) {
+		return BonAsTypedArray(&object->values[i]);
+	} else {
+		const BonTypedArray empty = {0};
+		return empty;
+	}
+}
+
+
 double                          
 BonMemberAsNumber(const BonObject* object, BonName name) {
 	int i = BonFindIndexOfName(object->names, object->count, name);
@@ -320,6 +805,19 @@ BonMemberAsString(const BonObject* object, BonName name) {
 }
 
 
+BonStringView
+BonMemberAsStringView(const BonObject* object, BonName name) {
+	BonStringView   view;
+	int             i = BonFindIndexOfName(object->names, object->count, name);
+	if (i >= 0) {
+		view.string = BonAsStringWithLength(&object->values[i], &view.byteCount);
+	} else {
+		view.string     = "";
+		view.byteCount  = 0;
+	}
+	return view;
+}
+
 BonBool                         
 BonMemberAsBool(const BonObject* object, BonName name) {
 	int i = BonFindIndexOfName(object->names, object->count, name);
@@ -330,6 +828,902 @@ BonMemberAsBool(const BonObject* object, BonName name) {
 	}
 }
 
+int
+BonMemberLookupMany(const BonObject* object, const BonName* sortedNames, int nameCount, const BonValue** values) {
+        const BonName*  names           = object->names;
+        const int       count           = object->count;
+        int             j               = 0;
+        int             found           = 0;
+        int             i;
+
+        if (4 * nameCount < count) {
+                /* Few keys in a wide object. Independent searches are faster here than a merge since
+                 * they don't form a dependency chain and don't step through every member. */
+                for (i = 0; i < nameCount; ++i) {
+                        const int k = BonFindIndexOfName(names, count, sortedNames[i]);
+                        values[i] = k >= 0 ? &object->values[k] : 0;
+                        found += k >= 0;
+                }
+                return found;
+        }
+
+        for (i = 0; i < nameCount; ++i) {
+                const BonName name = sortedNames[i];
+                while (j < count && names[j] < name) {
+                        ++j;
+                }
+                if (j < count && names[j] == name) {
+                        values[i] = &object->values[j];
+                        ++found;
+                } else {
+                        values[i] = 0;
+                }
+        }
+        return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Paths */
+
+BonBool
+BonCompilePath(BonPath* path, const char* pathString) {
+        const char* p = pathString;
+
+        path->count = 0;
+        while (*p) {
+                BonPathSegment* segment;
+                if (path->count == BON_PATH_MAX_SEGMENTS) {
+                        return BON_FALSE;
+                }
+                segment = &path->segments[path->count];
+                if (*p == '[') {
+                        int64_t index = 0;
+                        ++p;
+                        if (*p < '0' || *p > '9') {
+                                return BON_FALSE;
+                        }
+                        while (*p >= '0' && *p <= '9') {
+                                index = index * 10 + (*p++ - '0');
+                                if (index > 0x7fffffff) {
+                                        return BON_FALSE;
+                                }
+                        }
+                        if (*p++ != ']') {
+                                return BON_FALSE;
+                        }
+                        segment->name   = 0;
+                        segment->index  = (int32_t)index;
+                } else {
+                        const char* name = p;
+                        if (path->count > 0) {
+                                if (*p++ != '.') {
+                                        return BON_FALSE;
+                                }
+                                name = p;
+                        }
+                        while (*p && *p != '.' && *p != '[') {
+                                ++p;
+                        }
+                        if (p == name) {
+                                return BON_FALSE;
+                        }
+                        segment->name   = BonCreateName(name, (size_t)(p - name));
+                        segment->index  = -1;
+                }
+                ++path->count;
+        }
+        return BON_TRUE;
+}
+
+const BonValue*
+BonEvaluatePath(const BonValue* value, const BonPath* path) {
+        const BonPathSegment*   segment         = path->segments;
+        const BonPathSegment*   segmentEnd      = segment + path->count;
 
+        for (; segment != segmentEnd; ++segment) {
+                const BonContainerHeader*       header;
+                const BonValue*                 values;
+                if (BON_VALUE_TYPE(value) != (segment->index >= 0 ? BON_VT_ARRAY : BON_VT_OBJECT)) {
+                        return 0;                                               /* Only then is the value an offset to a container */
+                }
+                header  = (const BonContainerHeader*)BON_VALUE_PTR(value);
+                values  = (const BonValue*)&header[1];
+                if (segment->index >= 0) {
+                        if (segment->index >= header->count) {
+                                return 0;
+                        }
+                        value = &values[segment->index];
+                } else {
+                        const int i = BonFindIndexOfName((const BonName*)&values[header->count], header->count, segment->name);
+                        if (i < 0) {
+                                return 0;
+                        }
+                        value = &values[i];
+                }
+        }
+        return value;
+}
 
+size_t
+BonEvaluatePathInRecords(const BonPath* path, const void* records, size_t recordsByteCount, const BonValue** results, size_t maxResults) {
+        const uint8_t*  p               = (const uint8_t*)records;
+        const uint8_t*  end             = p + recordsByteCount;
+        size_t          visited         = 0;
 
+        while (visited < maxResults && (size_t)(end - p) >= sizeof(BonRecord)) {
+                const BonRecord*        br      = (const BonRecord*)p;
+                uint64_t                size;
+                if (br->magic == BON_WIDE_RECORD_MAGIC && (size_t)(end - p) < sizeof(BonRecord) + sizeof(BonWideRecordHeader)) {
+                        break;                                                  /* The size is in the wide header, which is cut off */
+                }
+                if (!BonIsAValidRecord(br, 0)) {
+                        break;
+                }
+                size = BonGetRecordSize(br);
+                if (size < sizeof(BonRecord) || size > (uint64_t)(end - p)) {
+                        break;
+                }
+                results[visited++] = BonEvaluatePath(&br->rootValue, path);
+                p += ((size_t)size + 7) & ~(size_t)7;
+        }
+        return visited;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Content hashes
+ *
+ * A 64-bit hash with eight 64-bit lanes, in the style of XXH3. Each 64 byte stripe is mixed into
+ * the lanes with one 32x32->64 bit multiply per lane, which SSE2 and AVX2 do two and four lanes at
+ * a time. The lanes are scrambled every BON_HASH_BLOCK_STRIPES stripes so that bits from early
+ * stripes aren't shifted out. The SIMD and scalar versions give identical hashes.
+ */
+
+#define BON_HASH_STRIPE_SIZE    64
+#define BON_HASH_BLOCK_STRIPES  16
+#define BON_HASH_PRIME32        0x9e3779b1ull
+#define BON_HASH_PRIME64_1      0x9e3779b185ebca87ull
+#define BON_HASH_PRIME64_2      0xc2b2ae3d27d4eb4full
+
+typedef struct BonHashState {
+        uint64_t                lanes[8];
+        uint64_t                byteCount;
+        uint32_t                blockStripes;                                   /* Stripes since the last scramble */
+        uint32_t                bufferSize;
+        uint8_t                 buffer[BON_HASH_STRIPE_SIZE];
+} BonHashState;
+
+static const uint64_t s_hashKeys[8] = {
+        0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+        0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+static const uint64_t s_hashInitialLanes[8] = {
+        0x9e3779b185ebca87ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x85ebca77c2b2ae63ull,
+        0x27d4eb2f165667c5ull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull, 0x510e527fade682d1ull,
+};
+
+static void
+HashInit(BonHashState* state) {
+        memcpy(state->lanes, s_hashInitialLanes, sizeof(state->lanes));
+        state->byteCount        = 0;
+        state->blockStripes     = 0;
+        state->bufferSize       = 0;
+}
+
+/* Mix count stripes into lanes. count must not cross a block. */
+static void
+HashStripes(uint64_t* lanes, const uint8_t* p, size_t count) {
+#if defined(BON_SEARCH_AVX2)
+        const __m256i   key0    = _mm256_loadu_si256((const __m256i*)&s_hashKeys[0]);
+        const __m256i   key1    = _mm256_loadu_si256((const __m256i*)&s_hashKeys[4]);
+        __m256i         acc0    = _mm256_loadu_si256((const __m256i*)&lanes[0]);
+        __m256i         acc1    = _mm256_loadu_si256((const __m256i*)&lanes[4]);
+        for (; count; --count, p += BON_HASH_STRIPE_SIZE) {
+                const __m256i d0        = _mm256_loadu_si256((const __m256i*)p);
+                const __m256i d1        = _mm256_loadu_si256((const __m256i*)(p + 32));
+                const __m256i dk0       = _mm256_xor_si256(d0, key0);
+                const __m256i dk1       = _mm256_xor_si256(d1, key1);
+                acc0 = _mm256_add_epi64(acc0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2)));
+                acc1 = _mm256_add_epi64(acc1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2)));
+                acc0 = _mm256_add_epi64(acc0, _mm256_mul_epu32(dk0, _mm256_shuffle_epi32(dk0, _MM_SHUFFLE(0, 3, 0, 1))));
+                acc1 = _mm256_add_epi64(acc1, _mm256_mul_epu32(dk1, _mm256_shuffle_epi32(dk1, _MM_SHUFFLE(0, 3, 0, 1))));
+        }
+        _mm256_storeu_si256((__m256i*)&lanes[0], acc0);
+        _mm256_storeu_si256((__m256i*)&lanes[4], acc1);
+#elif defined(BON_SEARCH_SSE2)
+        __m128i         acc[4];
+        int             i;
+        for (i = 0; i < 4; ++i) {
+                acc[i] = _mm_loadu_si128((const __m128i*)&lanes[i * 2]);
+        }
+        for (; count; --count, p += BON_HASH_STRIPE_SIZE) {
+                for (i = 0; i < 4; ++i) {
+                        const __m128i d         = _mm_loadu_si128((const __m128i*)(p + i * 16));
+                        const __m128i dk        = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)&s_hashKeys[i * 2]));
+                        acc[i] = _mm_add_epi64(acc[i], _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+                        acc[i] = _mm_add_epi64(acc[i], _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1))));
+                }
+        }
+        for (i = 0; i < 4; ++i) {
+                _mm_storeu_si128((__m128i*)&lanes[i * 2], acc[i]);
+        }
+#else
+        int i;
+        for (; count; --count, p += BON_HASH_STRIPE_SIZE) {
+                for (i = 0; i < 8; ++i) {
+                        uint64_t d;
+                        uint64_t dk;
+                        memcpy(&d, p + i * 8, sizeof(d));
+                        dk = d ^ s_hashKeys[i];
+                        lanes[i ^ 1]    += d;
+                        lanes[i]        += (dk & 0xffffffffu) * (dk >> 32);
+                }
+        }
+#endif
+}
+
+static void
+HashScramble(uint64_t* lanes) {
+        int i;
+        for (i = 0; i < 8; ++i) {
+                lanes[i] ^= lanes[i] >> 47;
+                lanes[i] ^= s_hashKeys[7 - i];
+                lanes[i] *= BON_HASH_PRIME32;
+        }
+}
+
+/* Mix whole stripes, scrambling at block boundaries */
+static void
+HashBlocks(BonHashState* state, const uint8_t* p, size_t stripeCount) {
+        while (stripeCount) {
+                size_t count = BON_HASH_BLOCK_STRIPES - state->blockStripes;
+                if (count > stripeCount)
+                        count = stripeCount;
+                HashStripes(state->lanes, p, count);
+                p                       += count * BON_HASH_STRIPE_SIZE;
+                stripeCount             -= count;
+                state->blockStripes     += (uint32_t)count;
+                if (state->blockStripes == BON_HASH_BLOCK_STRIPES) {
+                        HashScramble(state->lanes);
+                        state->blockStripes = 0;
+                }
+        }
+}
+
+static void
+HashUpdate(BonHashState* state, const void* data, size_t size) {
+        const uint8_t* p = (const uint8_t*)data;
+
+        state->byteCount += size;
+        if (state->bufferSize) {
+                size_t n = BON_HASH_STRIPE_SIZE - state->bufferSize;
+                if (n > size)
+                        n = size;
+                memcpy(state->buffer + state->bufferSize, p, n);
+                state->bufferSize       += (uint32_t)n;
+                p                       += n;
+                size                    -= n;
+                if (state->bufferSize < BON_HASH_STRIPE_SIZE)
+                        return;
+                HashBlocks(state, state->buffer, 1);
+                state->bufferSize = 0;
+        }
+        HashBlocks(state, p, size / BON_HASH_STRIPE_SIZE);
+        p += size & ~(size_t)(BON_HASH_STRIPE_SIZE - 1);
+        size &= BON_HASH_STRIPE_SIZE - 1;
+        memcpy(state->buffer, p, size);
+        state->bufferSize = (uint32_t)size;
+}
+
+/* Same as HashUpdate with a single word, which is what containers mostly add */
+static void
+HashUpdateWord(BonHashState* state, uint64_t word) {
+        if (state->bufferSize > BON_HASH_STRIPE_SIZE - sizeof(word)) {
+                HashUpdate(state, &word, sizeof(word));
+                return;
+        }
+        memcpy(state->buffer + state->bufferSize, &word, sizeof(word));
+        state->bufferSize       += (uint32_t)sizeof(word);
+        state->byteCount        += sizeof(word);
+        if (state->bufferSize == BON_HASH_STRIPE_SIZE) {
+                HashBlocks(state, state->buffer, 1);
+                state->bufferSize = 0;
+        }
+}
+
+/* Mix words into one hash */
+static uint64_t
+HashFold(const uint64_t* words, int wordCount, uint64_t byteCount) {
+        uint64_t        h       = byteCount * BON_HASH_PRIME64_1;
+        int             i;
+
+        for (i = 0; i < wordCount; ++i) {                                       /* The words are mixed independently */
+                uint64_t word = (words[i] ^ s_hashKeys[i]) * BON_HASH_PRIME64_2;
+                word = (word << 31) | (word >> 33);
+                h += word * BON_HASH_PRIME64_1;
+                h = (h << 27) | (h >> 37);
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+}
+
+static uint64_t
+HashFinal(BonHashState* state) {
+        if (state->byteCount <= 32) {
+                /* Short inputs (most strings and small containers) are folded directly */
+                uint64_t words[4] = { 0, 0, 0, 0 };
+                memcpy(words, state->buffer, state->bufferSize);
+                return HashFold(words, 4, state->byteCount);
+        }
+        if (state->bufferSize) {
+                memset(state->buffer + state->bufferSize, 0, BON_HASH_STRIPE_SIZE - state->bufferSize);
+                HashStripes(state->lanes, state->buffer, 1);
+        }
+        return HashFold(state->lanes, 8, state->byteCount);
+}
+
+/* The subtree hash section of a record */
+typedef struct BonSubtreeHashes {
+        const uint8_t*          base;
+        uint64_t*               hashes;
+        const uint32_t*         offsets;
+        int32_t                 count;                                          /* 0 if the record has no hashes */
+        BonBool                 update;                                         /* Compute and store instead of reading hashes */
+} BonSubtreeHashes;
+
+static void
+GetSubtreeHashes(const BonRecord* br, BonSubtreeHashes* sh) {
+        sh->base        = (const uint8_t*)br;
+        sh->count       = 0;
+        sh->update      = BON_FALSE;
+        if (br->flags & BON_RECORD_FLAG_SUBTREE_HASHES) {
+                const BonSubtreeHashFooter* footer = (const BonSubtreeHashFooter*)(sh->base + br->recordSize - sizeof(BonSubtreeHashFooter));
+                sh->hashes      = (uint64_t*)((const uint8_t*)&footer->hashesOffset + footer->hashesOffset);
+                sh->offsets     = (const uint32_t*)&sh->hashes[footer->count];
+                sh->count       = footer->count;
+        }
+}
+
+static BonBool
+IsContainerType(int type) {
+        return type == BON_VT_ARRAY || type == BON_VT_OBJECT || type == BON_VT_TYPED_ARRAY;
+}
+
+/* Return the index of the hash of the container bv points to, or -1 */
+static int32_t
+FindSubtreeHash(const BonSubtreeHashes* sh, const BonValue* bv) {
+        const uint32_t  offset  = (uint32_t)((const uint8_t*)BON_VALUE_PTR(bv) - sh->base);
+        int32_t         first   = 0;
+        int32_t         count   = sh->count;
+
+        while (count > 0) {
+                const int32_t half = count / 2;
+                if (sh->offsets[first + half] < offset) {
+                        first   += half + 1;
+                        count   -= half + 1;
+                } else {
+                        count   = half;
+                }
+        }
+        return first < sh->count && sh->offsets[first] == offset ? first : -1;
+}
+
+static uint64_t HashValue(const BonSubtreeHashes* sh, const BonValue* bv);
+
+/* Add a value to the hash of its container. Scalars are added as is, anything else by its hash. */
+static void
+HashValueWord(const BonSubtreeHashes* sh, BonHashState* state, const BonValue* bv) {
+        uint64_t word = *bv;
+        if (BON_VALUE_TYPE(bv) == BON_VT_STRING || IsContainerType(BON_VALUE_TYPE(bv))) {
+                word = HashValue(sh, bv);
+        }
+        HashUpdateWord(state, word);
+}
+
+/* Hash the elements of a typed array as the number values of an array */
+static void
+HashTypedArrayAsNumbers(BonHashState* state, const BonTypedArray* typedArray) {
+        double  numbers[64];
+        int     i = 0;
+
+        while (i < typedArray->count) {
+                int n = typedArray->count - i < 64 ? typedArray->count - i : 64;
+                int j;
+                for (j = 0; j < n; ++j) {
+                        uint64_t bits;
+                        switch (typedArray->elementType) {
+                        case BON_ET_FLOAT32:    numbers[j] = ((const float*)typedArray->values)[i + j];         break;
+                        case BON_ET_INT32:      numbers[j] = ((const int32_t*)typedArray->values)[i + j];       break;
+                        case BON_ET_INT16:      numbers[j] = ((const int16_t*)typedArray->values)[i + j];       break;
+                        default:                numbers[j] = ((const uint8_t*)typedArray->values)[i + j];       break;
+                        }
+                        memcpy(&bits, &numbers[j], sizeof(bits));
+                        bits &= ~(uint64_t)0x7;                                 /* As the converter stores numbers */
+                        memcpy(&numbers[j], &bits, sizeof(bits));
+                }
+                HashUpdate(state, numbers, (size_t)n * sizeof(double));
+                i += n;
+        }
+}
+
+static uint64_t
+HashValue(const BonSubtreeHashes* sh, const BonValue* bv) {
+        BonHashState    state;
+        uint64_t        header;
+        uint64_t        hash;
+        int32_t         hashIndex       = -1;
+        int             i;
+
+        if (sh->count && IsContainerType(BON_VALUE_TYPE(bv))) {
+                hashIndex = FindSubtreeHash(sh, bv);
+                if (hashIndex >= 0 && !sh->update)
+                        return sh->hashes[hashIndex];
+        }
+        HashInit(&state);
+        switch (BON_VALUE_TYPE(bv)) {
+        case BON_VT_STRING: {
+                size_t          byteCount;
+                const char*     string  = BonAsStringWithLength(bv, &byteCount);
+                header = BON_VT_STRING | ((uint64_t)byteCount << 8);
+                HashUpdateWord(&state, header);
+                HashUpdate(&state, string, byteCount);
+                break;
+        }
+        case BON_VT_ARRAY: {
+                const BonArray array = BonAsArray(bv);
+                header = BON_VT_ARRAY | ((uint64_t)array.count << 8);
+                HashUpdateWord(&state, header);
+                if (*bv & BON_ARRAY_FLAG_NUMBERS) {
+                        HashUpdate(&state, array.values, (size_t)array.count * sizeof(BonValue));
+                } else {
+                        for (i = 0; i < array.count; ++i) {
+                                HashValueWord(sh, &state, &array.values[i]);
+                        }
+                }
+                break;
+        }
+        case BON_VT_TYPED_ARRAY: {
+                const BonTypedArray typedArray = BonAsTypedArray(bv);
+                header = BON_VT_ARRAY | ((uint64_t)typedArray.count << 8);
+                HashUpdateWord(&state, header);
+                HashTypedArrayAsNumbers(&state, &typedArray);
+                break;
+        }
+        case BON_VT_OBJECT: {
+                const BonObject object = BonAsObject(bv);
+                header = BON_VT_OBJECT | ((uint64_t)object.count << 8);
+                HashUpdateWord(&state, header);
+                HashUpdate(&state, object.names, (size_t)object.count * sizeof(BonName));
+                for (i = 0; i < object.count; ++i) {
+                        HashValueWord(sh, &state, &object.values[i]);
+                }
+                break;
+        }
+        default:
+                HashUpdate(&state, bv, sizeof(BonValue));
+                break;
+        }
+        hash = HashFinal(&state);
+        if (hashIndex >= 0) {
+                sh->hashes[hashIndex] = hash;
+        }
+        return hash;
+}
+
+uint64_t
+BonHashRecord(const BonRecord* br) {
+        BonHashState state;
+        HashInit(&state);
+        HashUpdate(&state, br, (size_t)BonGetRecordSize(br));
+        return HashFinal(&state);
+}
+
+uint64_t
+BonHashValue(const BonRecord* br, const BonValue* bv) {
+        BonSubtreeHashes sh;
+        assert((const uint8_t*)bv >= (const uint8_t*)br && (const uint8_t*)bv < (const uint8_t*)br + BonGetRecordSize(br));
+        GetSubtreeHashes(br, &sh);
+        return HashValue(&sh, bv);
+}
+
+BonBool
+BonGetSubtreeHash(const BonRecord* br, const BonValue* bv, uint64_t* hash) {
+        BonSubtreeHashes        sh;
+        int32_t                 i;
+
+        GetSubtreeHashes(br, &sh);
+        if (!sh.count || !IsContainerType(BON_VALUE_TYPE(bv)) || (i = FindSubtreeHash(&sh, bv)) < 0)
+                return BON_FALSE;
+        *hash = sh.hashes[i];
+        return BON_TRUE;
+}
+
+void
+BonUpdateSubtreeHashes(BonRecord* br) {
+        BonSubtreeHashes sh;
+        GetSubtreeHashes(br, &sh);
+        if (sh.count) {
+                sh.update = BON_TRUE;
+                HashValue(&sh, &br->rootValue);                                 /* Children first, so every hash is computed once */
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Changed paths */
+
+typedef struct BonPathComparer {
+        BonSubtreeHashes        oldHashes;
+        BonSubtreeHashes        newHashes;
+        BonChangedPathCallback  callback;
+        void*                   userdata;
+        BonPath                 path;
+        size_t                  changeCount;
+} BonPathComparer;
+
+static void
+ReportChange(BonPathComparer* c, const BonValue* oldValue, const BonValue* newValue) {
+        c->callback(c->userdata, &c->path, oldValue, newValue);
+        ++c->changeCount;
+}
+
+static BonBool
+AreStringsEqual(const BonValue* a, const BonValue* b) {
+        size_t          aByteCount;
+        size_t          bByteCount;
+        const char*     aString         = BonAsStringWithLength(a, &aByteCount);
+        const char*     bString         = BonAsStringWithLength(b, &bByteCount);
+        return aByteCount == bByteCount && 0 == memcmp(aString, bString, aByteCount);
+}
+
+static void     CompareValues(BonPathComparer* c, const BonValue* a, const BonValue* b);
+
+/* Compare a child of the current path */
+static void
+CompareChild(BonPathComparer* c, BonName name, int32_t index, const BonValue* a, const BonValue* b) {
+        BonPathSegment* segment = &c->path.segments[c->path.count++];
+        segment->name   = name;
+        segment->index  = index;
+        if (!a || !b) {
+                ReportChange(c, a, b);
+        } else {
+                CompareValues(c, a, b);
+        }
+        --c->path.count;
+}
+
+static void
+CompareValues(BonPathComparer* c, const BonValue* a, const BonValue* b) {
+        const int       type    = BON_VALUE_TYPE(a);
+        int32_t         i, j;
+
+        if (*a == *b && !IsContainerType(type) && type != BON_VT_STRING)
+                return;
+        if (type != BON_VALUE_TYPE(b) || !IsContainerType(type)) {
+                if (type == BON_VT_STRING && BON_VALUE_TYPE(b) == BON_VT_STRING && AreStringsEqual(a, b))
+                        return;
+                ReportChange(c, a, b);
+                return;
+        }
+        if (c->oldHashes.count && c->newHashes.count) {
+                const int32_t aIndex = FindSubtreeHash(&c->oldHashes, a);
+                const int32_t bIndex = FindSubtreeHash(&c->newHashes, b);
+                if (aIndex >= 0 && bIndex >= 0 && c->oldHashes.hashes[aIndex] == c->newHashes.hashes[bIndex])
+                        return;
+        }
+        if (type == BON_VT_TYPED_ARRAY || c->path.count == BON_PATH_MAX_SEGMENTS) {
+                if (HashValue(&c->oldHashes, a) != HashValue(&c->newHashes, b))
+                        ReportChange(c, a, b);
+        } else if (type == BON_VT_OBJECT) {
+                const BonObject aObject = BonAsObject(a);
+                const BonObject bObject = BonAsObject(b);
+                for (i = 0, j = 0; i < aObject.count || j < bObject.count; ) {
+                        if (j == bObject.count || (i < aObject.count && aObject.names[i] < bObject.names[j])) {
+                                CompareChild(c, aObject.names[i], -1, &aObject.values[i], 0);
+                                ++i;
+                        } else if (i == aObject.count || bObject.names[j] < aObject.names[i]) {
+                                CompareChild(c, bObject.names[j], -1, 0, &bObject.values[j]);
+                                ++j;
+                        } else {
+                                CompareChild(c, aObject.names[i], -1, &aObject.values[i], &bObject.values[j]);
+                                ++i;
+                                ++j;
+                        }
+                }
+        } else {
+                const BonArray aArray = BonAsArray(a);
+                const BonArray bArray = BonAsArray(b);
+                for (i = 0; i < aArray.count || i < bArray.count; ++i) {
+                        CompareChild(c, 0, i, i < aArray.count ? &aArray.values[i] : 0, i < bArray.count ? &bArray.values[i] : 0);
+                }
+        }
+}
+
+size_t
+BonFindChangedPaths(const BonRecord* oldRecord, const BonRecord* newRecord, BonChangedPathCallback callback, void* userdata) {
+        BonPathComparer c;
+        GetSubtreeHashes(oldRecord, &c.oldHashes);
+        GetSubtreeHashes(newRecord, &c.newHashes);
+        c.callback      = callback;
+        c.userdata      = userdata;
+        c.path.count    = 0;
+        c.changeCount   = 0;
+        CompareValues(&c, &oldRecord->rootValue, &newRecord->rootValue);
+        return c.changeCount;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Validation */
+
+/* Two bits per eight byte word of the container section: a container starts here, and it has
+ * already been referenced by a BonValue. */
+#define BON_VALIDATE_STACK_WORDS        (64 * 1024 / 8)
+
+typedef struct BonValidator {
+        const uint8_t*          base;
+        size_t                  containersBegin;                                /* Offsets from base */
+        size_t                  containersEnd;
+        size_t                  valueStringsBegin;
+        size_t                  valueStringsEnd;
+        BonBool                 stringLengths;                                  /* BON_RECORD_FLAG_STRING_LENGTHS */
+        uint32_t                typeMask;                                       /* Wide records have offset bits above the type */
+        uint32_t*               starts;
+        uint32_t*               referenced;
+} BonValidator;
+
+#define BON_BIT_TEST(bits, i)   ((bits)[(i) >> 5] & (1u << ((i) & 31)))
+#define BON_BIT_SET(bits, i)    ((bits)[(i) >> 5] |= (1u << ((i) & 31)))
+
+/* Size of the container at offset or 0 if it doesn't fit in the container section */
+static size_t
+ValidateContainerSize(const BonValidator* v, size_t offset) {
+        const BonContainerHeader*       header  = (const BonContainerHeader*)(v->base + offset);
+        uint64_t                        size;
+
+        if (v->containersEnd - offset < sizeof(BonContainerHeader) || header->count < 0)
+                return 0;
+        if (BON_IS_TYPED_ARRAY_HEADER(header->capacity)) {
+                size = BonGetTypedArrayElementSize(header->capacity & ~BON_TYPED_ARRAY_TAG) * (uint64_t)header->count;
+                size = (size + 7) & ~(uint64_t)7;
+        } else if (header->capacity >= 0) {
+                if (header->count != header->capacity)                         /* Records with spare capacity are not written to disk */
+                        return 0;
+                size = (uint64_t)header->count * sizeof(BonValue);
+        } else {
+                if ((int64_t)header->count != -(int64_t)header->capacity)
+                        return 0;
+                size = (uint64_t)header->count * sizeof(BonValue) + (((uint64_t)header->count * sizeof(BonName) + 7) & ~(uint64_t)7);
+        }
+        size += sizeof(BonContainerHeader);
+        return size <= v->containersEnd - offset ? (size_t)size : 0;
+}
+
+/* Check a string reference to base + target. A string with a byte count must have the count 
+ * right before it and its terminating null within [begin, end). */
+static BonBool
+ValidateStringTarget(const uint8_t* base, int64_t target, size_t begin, size_t end, BonBool stringLengths) {
+        uint32_t byteCount;
+        if (!stringLengths)
+                return (target & 7) == 0 && target >= (int64_t)begin && target < (int64_t)end;
+        if ((target & 7) != 4 || target < (int64_t)begin + 4 || target >= (int64_t)end)
+                return BON_FALSE;
+        byteCount = *(const uint32_t*)(base + target - 4);
+        return (uint64_t)byteCount < (uint64_t)(end - (size_t)target) && base[target + byteCount] == 0;
+}
+
+/* Check a value stored at base + offset */
+static BonBool
+ValidateValue(BonValidator* v, size_t offset) {
+        const BonValue*         value           = (const BonValue*)(v->base + offset);
+        const uint32_t          typeWord        = (uint32_t)*value & v->typeMask;
+        const int64_t           target          = (int64_t)offset + BON_VALUE_OFFSET(value);
+        const BonContainerHeader* header;
+        size_t                  word;
+
+        switch (BON_VALUE_TYPE(value)) {
+        case BON_VT_NUMBER:
+                return BON_TRUE;
+        case BON_VT_NULL:
+                return *value == 0x7ull;
+        case BON_VT_BOOL:
+                return (uint32_t)*value == BON_VT_BOOL && (*value >> 32) <= 1;
+        case BON_VT_STRING:
+                return typeWord == (v->stringLengths ? (BON_VT_STRING | BON_STRING_FLAG_LENGTH) : BON_VT_STRING)
+                        && ValidateStringTarget(v->base, target, v->valueStringsBegin, v->valueStringsEnd, v->stringLengths);
+        case BON_VT_ARRAY:
+                if (typeWord != BON_VT_ARRAY && typeWord != (BON_VT_ARRAY | BON_ARRAY_FLAG_NUMBERS))
+                        return BON_FALSE;
+                break;
+        case BON_VT_OBJECT:
+        case BON_VT_TYPED_ARRAY:
+                if (typeWord != (uint32_t)BON_VALUE_TYPE(value))
+                        return BON_FALSE;
+                break;
+        default:
+                return BON_FALSE;
+        }
+
+        /* A reference to a container */
+        if ((target & 7) != 0 || target < (int64_t)v->containersBegin || target >= (int64_t)v->containersEnd)
+                return BON_FALSE;
+        word = (size_t)target / 8;
+        if (!BON_BIT_TEST(v->starts, word) || BON_BIT_TEST(v->referenced, word))
+                return BON_FALSE;
+        BON_BIT_SET(v->referenced, word);
+        header = (const BonContainerHeader*)(v->base + target);
+        switch (BON_VALUE_TYPE(value)) {
+        case BON_VT_ARRAY:
+                if (header->capacity < 0)
+                        return BON_FALSE;
+                if ((typeWord & BON_ARRAY_FLAG_NUMBERS) && !AreAllNumbers((const BonValue*)&header[1], header->count))
+                        return BON_FALSE;
+                return BON_TRUE;
+        case BON_VT_OBJECT:
+                return header->capacity <= 0 && !BON_IS_TYPED_ARRAY_HEADER(header->capacity);
+        default:
+                return BON_IS_TYPED_ARRAY_HEADER(header->capacity);
+        }
+}
+
+/* Check the footer of the subtree hash section and return where the section begins */
+static BonBool
+GetSubtreeHashSection(const BonRecord* br, size_t size, size_t* begin) {
+        const BonSubtreeHashFooter*     footer;
+        int64_t                         hashesOffset;
+        uint64_t                        sectionSize;
+
+        if (size < sizeof(BonRecord) + sizeof(BonSubtreeHashFooter))
+                return BON_FALSE;
+        footer          = (const BonSubtreeHashFooter*)((const uint8_t*)br + size - sizeof(BonSubtreeHashFooter));
+        hashesOffset    = (int64_t)(size - sizeof(BonSubtreeHashFooter)) + footer->hashesOffset;
+        sectionSize     = (uint64_t)footer->count * sizeof(uint64_t) + (((uint64_t)footer->count * sizeof(uint32_t) + 7) & ~(uint64_t)7);
+        if (footer->count < 0 || (hashesOffset & 7) != 0 || hashesOffset < (int64_t)sizeof(BonRecord)
+                || (uint64_t)hashesOffset + sectionSize != size - sizeof(BonSubtreeHashFooter))
+                return BON_FALSE;
+        *begin = (size_t)hashesOffset;
+        return BON_TRUE;
+}
+
+static BonBool
+ValidateNameLookupTable(const BonRecord* br, size_t nameLookupOffset, size_t size) {
+        const BonBool                   stringLengths   = (br->flags & BON_RECORD_FLAG_STRING_LENGTHS) ? BON_TRUE : BON_FALSE;
+        const uint8_t*                  base            = (const uint8_t*)br;
+        const BonContainerHeader*       header          = (const BonContainerHeader*)(base + nameLookupOffset);
+        const BonNameAndOffset*         items           = (const BonNameAndOffset*)&header[1];
+        size_t                          nameStringsBegin;
+        int32_t                         i;
+
+        if (size - nameLookupOffset < sizeof(BonContainerHeader) || header->count < 0 || header->capacity != header->count)
+                return BON_FALSE;
+        if ((uint64_t)header->count * sizeof(BonNameAndOffset) > size - nameLookupOffset - sizeof(BonContainerHeader))
+                return BON_FALSE;
+        nameStringsBegin = nameLookupOffset + sizeof(BonContainerHeader) + (size_t)header->count * sizeof(BonNameAndOffset);
+        if (nameStringsBegin < size && base[size - 1] != 0)
+                return BON_FALSE;
+        for (i = 0; i < header->count; ++i) {
+                const int64_t target = (int64_t)((const uint8_t*)&items[i].offset - base) + items[i].offset;
+                if (i > 0 && items[i - 1].name >= items[i].name)
+                        return BON_FALSE;
+                if (!ValidateStringTarget(base, target, nameStringsBegin, size, stringLengths))
+                        return BON_FALSE;
+        }
+        return BON_TRUE;
+}
+
+BonBool
+BonValidateRecordDeep(const BonRecord* br, size_t brSizeInBytes) {
+        uint32_t                stackBits[2 * BON_VALIDATE_STACK_WORDS / 32];
+        uint32_t*               bits            = stackBits;
+        BonValidator            v;
+        const BonWideRecordHeader* wide         = GetWideHeader(br);
+        size_t                  nameLookupOffset;
+        size_t                  subtreeHashesBegin      = brSizeInBytes;
+        size_t                  wordCount;
+        size_t                  offset;
+        BonBool                 result          = BON_FALSE;
+
+        if (brSizeInBytes == 0 || !BonIsAValidRecord(br, brSizeInBytes) || (brSizeInBytes & 7) != 0)
+                return BON_FALSE;
+        if ((br->flags & ~(uint32_t)(BON_RECORD_FLAG_STRING_LENGTHS | BON_RECORD_FLAG_SUBTREE_HASHES | BON_RECORD_FLAG_NO_NAMES)) != 0)
+                return BON_FALSE;
+        if (wide) {                                                             /* The narrow fields are unused, and wide records have no subtree hashes */
+                if (br->recordSize != 0 || br->valueStringOffset != 0 || br->nameLookupTableOffset != 0 || (br->flags & BON_RECORD_FLAG_SUBTREE_HASHES)
+                        || wide->valueStringOffset > brSizeInBytes || wide->nameLookupTableOffset > brSizeInBytes)
+                        return BON_FALSE;
+        } else if (brSizeInBytes > 0x7fffffff || br->valueStringOffset < 0 || br->nameLookupTableOffset < 0) {
+                return BON_FALSE;
+        }
+        if (br->flags & BON_RECORD_FLAG_SUBTREE_HASHES) {
+                if (!GetSubtreeHashSection(br, brSizeInBytes, &subtreeHashesBegin))
+                        return BON_FALSE;
+        }
+
+        /* Section boundaries */
+        v.base                  = (const uint8_t*)br;
+        v.containersBegin       = GetContainersBegin(br);
+        v.valueStringsBegin     = GetValueStringsBegin(br);
+        nameLookupOffset        = GetNameLookupOffset(br);
+        if ((v.valueStringsBegin & 7) != 0 || (nameLookupOffset & 7) != 0
+                || v.valueStringsBegin < v.containersBegin || v.valueStringsBegin > nameLookupOffset || nameLookupOffset > subtreeHashesBegin)
+                return BON_FALSE;
+        v.containersEnd         = v.valueStringsBegin;
+        v.valueStringsEnd       = nameLookupOffset;
+        v.stringLengths         = (br->flags & BON_RECORD_FLAG_STRING_LENGTHS) ? BON_TRUE : BON_FALSE;
+        v.typeMask              = wide ? 0xffu : 0xffffffffu;
+        if (v.valueStringsEnd > v.valueStringsBegin && v.base[v.valueStringsEnd - 1] != 0)
+                return BON_FALSE;
+        if (br->flags & BON_RECORD_FLAG_NO_NAMES) {                             /* Stripped names: the value strings end the section */
+                if (nameLookupOffset != subtreeHashesBegin)
+                        return BON_FALSE;
+        } else if (!ValidateNameLookupTable(br, nameLookupOffset, subtreeHashesBegin)) {
+                return BON_FALSE;
+        }
+
+        wordCount = (v.containersEnd / 8 + 31) & ~(size_t)31;
+        if (wordCount > BON_VALIDATE_STACK_WORDS) {
+                bits = (uint32_t*)malloc(2 * wordCount / 8);
+                if (!bits)
+                        return BON_FALSE;
+        }
+        memset(bits, 0, 2 * wordCount / 8);
+        v.starts                = bits;
+        v.referenced            = bits + wordCount / 32;
+
+        /* First pass: container extents and object names */
+        for (offset = v.containersBegin; offset < v.containersEnd; ) {
+                const BonContainerHeader*       header  = (const BonContainerHeader*)(v.base + offset);
+                const size_t                    size    = ValidateContainerSize(&v, offset);
+                if (size == 0)
+                        goto done;
+                if (header->capacity < 0 && !BON_IS_TYPED_ARRAY_HEADER(header->capacity)) {
+                        const BonName*  names   = (const BonName*)((const BonValue*)&header[1] + header->count);
+                        int32_t         i;
+                        for (i = 1; i < header->count; ++i) {
+                                if (names[i - 1] > names[i])
+                                        goto done;
+                        }
+                }
+                BON_BIT_SET(v.starts, offset / 8);
+                offset += size;
+        }
+
+        /* Second pass: every value in every container, and the root */
+        if (BON_VALUE_TYPE(&br->rootValue) != BON_VT_ARRAY && BON_VALUE_TYPE(&br->rootValue) != BON_VT_OBJECT)
+                goto done;
+        if (!ValidateValue(&v, offsetof(BonRecord, rootValue)))
+                goto done;
+        for (offset = v.containersBegin; offset < v.containersEnd; ) {
+                const BonContainerHeader*       header  = (const BonContainerHeader*)(v.base + offset);
+                const size_t                    size    = ValidateContainerSize(&v, offset);
+                if (!BON_IS_TYPED_ARRAY_HEADER(header->capacity)) {
+                        const size_t    valuesEnd       = offset + sizeof(BonContainerHeader) + (size_t)header->count * sizeof(BonValue);
+                        size_t          valueOffset;
+                        for (valueOffset = offset + sizeof(BonContainerHeader); valueOffset < valuesEnd; valueOffset += sizeof(BonValue)) {
+                                if (!ValidateValue(&v, valueOffset))
+                                        goto done;
+                        }
+                }
+                offset += size;
+        }
+
+        /* Subtree hashes: sorted container starts */
+        if (br->flags & BON_RECORD_FLAG_SUBTREE_HASHES) {
+                BonSubtreeHashes        sh;
+                int32_t                 i;
+                GetSubtreeHashes(br, &sh);
+                for (i = 0; i < sh.count; ++i) {
+                        if ((i > 0 && sh.offsets[i - 1] >= sh.offsets[i]) || sh.offsets[i] >= v.containersEnd || (sh.offsets[i] & 7) != 0 
+                                || !BON_BIT_TEST(v.starts, sh.offsets[i] / 8))
+                                goto done;
+                }
+        }
+        result = BON_TRUE;
+
+done:
+        if (bits != stackBits)
+                free(bits);
+        return result;
+}
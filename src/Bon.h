@@ -29,8 +29,45 @@ typedef int32_t                 BonBool;
 #define BON_VT_STRING           2
 #define BON_VT_ARRAY            3
 #define BON_VT_OBJECT           4
+#define BON_VT_TYPED_ARRAY      5
 #define BON_VT_NULL             7
 
+/** 
+ * Set in the type field of a BonArrayValue when every item of the array is a BON_VT_NUMBER. 
+ * The value type is only the three lowest bits, so readers that mask the type don't see it.
+ */
+#define BON_ARRAY_FLAG_NUMBERS  0x8
+
+/**
+ * Set in the type field of a BonStringValue when the string's byte count is stored as a uint32_t
+ * right before the string.
+ */
+#define BON_STRING_FLAG_LENGTH  0x8
+
+/** BonRecord::flags: value and name strings are prefixed with their byte count. */
+#define BON_RECORD_FLAG_STRING_LENGTHS  0x1
+
+/** BonRecord::flags: the record ends with a hash of every container. \sa BonSubtreeHashFooter */
+#define BON_RECORD_FLAG_SUBTREE_HASHES  0x2
+
+/** 
+ * BonRecord::flags: the name lookup table and name strings were removed (see BonStripNames). 
+ * Names only resolve through the record's name dictionary, if any.
+ */
+#define BON_RECORD_FLAG_NO_NAMES        0x4
+
+/** 
+ * BonRecord::magic of a wide record, FourCC('B', 'O', 'N', 'W'). Used for records that don't fit
+ * 32-bit offsets. \sa BonWideRecordHeader 
+ */
+#define BON_WIDE_RECORD_MAGIC   0x574e4f42u
+
+/** Element types of a BON_VT_TYPED_ARRAY */
+#define BON_ET_FLOAT32          1
+#define BON_ET_INT32            2
+#define BON_ET_INT16            3
+#define BON_ET_UINT8            4
+
 #define BON_FALSE               0
 #define BON_TRUE                1
 
@@ -50,14 +87,25 @@ typedef struct BonNumberArray {
         const double*           values;
 } BonNumberArray;
 
+typedef struct BonTypedArray {
+        int                     count;
+        int                     elementType;            /**< One of BON_ET_*, or 0 for an empty BonTypedArray */
+        const void*             values;                 /**< count elements of elementType. Aligned to 8 bytes. */
+} BonTypedArray;
+
+typedef struct BonStringView {
+        const char*             string;                 /**< Null-terminated, but may also contain nulls (JSON \u0000) */
+        size_t                  byteCount;              /**< Number of bytes before the terminating null */
+} BonStringView;
+
 /**
  * \brief A BON record header.
  */
 typedef struct BonRecord {
-        uint32_t                magic;                          /**< FourCC('B', 'O', 'N', ' ') */
-        uint32_t                recordSize;                     /**< Total size of the entire record */
-        uint32_t                reserved;                       /**< Must be 0 */
-        uint32_t                reserved1;                      /**< Must be 0 */
+        uint32_t                magic;                          /**< FourCC('B', 'O', 'N', ' '), or BON_WIDE_RECORD_MAGIC */
+        uint32_t                recordSize;                     /**< Total size of the entire record. 0 in wide records, use BonGetRecordSize */
+        uint32_t                flags;                          /**< 0 or a combination of BON_RECORD_FLAG_* */
+        uint32_t                nameDictionaryId;               /**< 0, or the id of a shared name dictionary (see BonRegisterNameDictionary) */
         int32_t                 valueStringOffset;              /**< Offset to first value string &valueStringOffset */
         int32_t                 nameLookupTableOffset;          /**< Offset to name lookup table relative &nameLookupTableOffset */
         BonValue                rootValue;                      /**< Variant referencing the root value in the record (an array or an object) */
@@ -69,11 +117,127 @@ typedef struct BonRecord {
 BonBool                         BonIsAValidRecord(              const BonRecord* br, 
                                                                 size_t brSizeInBytes);
 
-uint32_t                        BonGetRecordSize(               const BonRecord* br);
+/**
+ * \brief Check that every offset in an untrusted record stays within the record.
+ *
+ * BonIsAValidRecord only checks the header. This function also walks all sections once and checks
+ * that every container fits in its section, that every BonValue is of a known type and points
+ * to the start of a container or string of that type, that no container is referenced twice (so 
+ * there are no cycles), that object names and the name lookup table are sorted and that all 
+ * strings are null-terminated within their section (at their byte count for records with 
+ * BON_RECORD_FLAG_STRING_LENGTHS). The container offsets of the subtree hash section must be
+ * sorted container starts. The hashes themselves aren't checked.
+ *
+ * When it returns BON_TRUE, all functions in this file can be used on the record without reading
+ * outside of it. Records larger than 64KB need a temporary bitmap of brSizeInBytes/32 bytes 
+ * from malloc.
+ *
+ * @param br                    The record. Must be 8 byte aligned.
+ * @param brSizeInBytes         Number of bytes available at br. Must equal BonGetRecordSize.
+ * @return                      BON_TRUE if the record is safe to read.
+ */
+BonBool                         BonValidateRecordDeep(          const BonRecord* br,
+                                                                size_t brSizeInBytes);
+
+/** \brief Return the total size of a record, also of a wide record (see BON_WIDE_RECORD_MAGIC). */
+uint64_t                        BonGetRecordSize(               const BonRecord* br);
 
+/**
+ * \brief Return the string of a name, or null if the record doesn't know the name.
+ *
+ * Names that aren't in the record's own name lookup table are looked up in its shared name
+ * dictionary if it has one and the dictionary is registered.
+ */
 const char*                     BonGetNameString(               const BonRecord* br, 
                                                                 BonName name);
 
+/**
+ * \brief Same as BonGetNameString, but also return the byte count of the string.
+ *
+ * The byte count is read from the record when it has BON_RECORD_FLAG_STRING_LENGTHS. For older 
+ * records it is the strlen of the string. byteCount is set to 0 if the name isn't found.
+ */
+const char*                     BonGetNameStringWithLength(     const BonRecord* br,
+                                                                BonName name,
+                                                                size_t* byteCount);
+
+/** Maximum number of name dictionaries that can be registered at the same time. */
+#define BON_MAX_NAME_DICTIONARIES       16
+
+/**
+ * \brief Return the id of a name dictionary. 
+ *
+ * A name dictionary is a record whose name lookup table holds names shared by many records. 
+ * Records converted with a dictionary leave out those names and store the dictionary's id in
+ * BonRecord::nameDictionaryId instead. The id is a hash of the dictionary's names and is never 0.
+ */
+uint32_t                        BonGetNameDictionaryId(         const BonRecord* dictionary);
+
+/**
+ * \brief Make a name dictionary available to BonGetNameString and friends.
+ *
+ * The dictionary must stay in memory until it is unregistered. Registering is not thread safe,
+ * so register dictionaries before records are read from other threads.
+ *
+ * @return                      BON_FALSE if BON_MAX_NAME_DICTIONARIES are already registered.
+ */
+BonBool                         BonRegisterNameDictionary(      const BonRecord* dictionary);
+
+/** Remove a dictionary registered with BonRegisterNameDictionary. */
+void                            BonUnregisterNameDictionary(    const BonRecord* dictionary);
+
+/** Return the registered name dictionary of a record, or null if it has none or it isn't registered. */
+const BonRecord*                BonGetNameDictionary(           const BonRecord* br);
+
+/**
+ * \brief Resolve the strings of a sorted array of names with one merge pass over the record's name
+ * lookup table.
+ *
+ * This is much faster than calling BonGetNameString for each name, e.g. for all names of an object.
+ *
+ * @param br                    The record that contains the names.
+ * @param sortedNames           Names in ascending order (like BonObject::names).
+ * @param nameCount             Number of names in sortedNames.
+ * @param strings               Receives nameCount strings. Names that aren't found get a null string.
+ * @return                      Number of names that were found.
+ */
+int                             BonGetNameStrings(              const BonRecord* br,
+                                                                const BonName* sortedNames,
+                                                                int nameCount,
+                                                                const char** strings);
+
+struct BonNameIndex;
+
+/** 
+ * \brief Return the number of bytes needed for a name index of a record. 
+ * \sa BonCreateNameIndex
+ */
+size_t                          BonGetNameIndexSize(            const BonRecord* br);
+
+/**
+ * \brief Build a hash index over a record's name lookup table.
+ *
+ * The index resolves a name to its string with a single (expected) probe instead of a binary
+ * search. It is worth building when many names of the same record are resolved, e.g. when
+ * converting a large record to JSON. The index references the record (and its name dictionary)
+ * and is valid for as long as they are.
+ *
+ * @param br                    The record to index.
+ * @param memory                At least BonGetNameIndexSize(br) bytes aligned to an 8 byte boundary.
+ * @return                      The index (same address as memory).
+ */
+struct BonNameIndex*            BonCreateNameIndex(             const BonRecord* br,
+                                                                void* memory);
+
+/** Same as BonGetNameString but resolved through an index created with BonCreateNameIndex. */
+const char*                     BonNameIndexGetString(          const struct BonNameIndex* index,
+                                                                BonName name);
+
+/** Same as BonGetNameStringWithLength but resolved through an index created with BonCreateNameIndex. */
+const char*                     BonNameIndexGetStringWithLength(const struct BonNameIndex* index,
+                                                                BonName name,
+                                                                size_t* byteCount);
+
 /** 
  * \brief Return a BON record's root value.
  * A root value is always an array or an object. It can never be null.
@@ -107,16 +271,57 @@ BonArray                        BonAsArray(                     const BonValue*
  * numbers. So this function also expects that you know what you are doing.
  *
  * If bv isn't a BON_VT_ARRAY then an empty array is returned.
- * \sa BonAsArray
+ * \sa BonAsArray, BonTryAsNumberArray
  */
 BonNumberArray                  BonAsNumberArray(               const BonValue* bv);
 
+/** 
+ * \brief Read a value as an array of numbers if it is an array that only contains numbers.
+ *
+ * Arrays written by the converter are marked with BON_ARRAY_FLAG_NUMBERS, which makes this an O(1)
+ * check. Arrays without the flag (e.g. from older converters) are scanned with SSE2/AVX2 when 
+ * available.
+ *
+ * @param bv                    Value to read.
+ * @param numbers               Receives the numbers on success. Untouched otherwise.
+ * @return                      BON_TRUE if bv is an array of only numbers (or an empty array).
+ */
+BonBool                         BonTryAsNumberArray(            const BonValue* bv,
+                                                                BonNumberArray* numbers);
+
+/** 
+ * \brief Read a value as a BON_VT_TYPED_ARRAY. 
+ *
+ * Typed arrays are packed homogeneous arrays of numbers. The converter only writes them when asked
+ * to (see BonConvertOptions). values points directly into the record and is 8 byte aligned.
+ *
+ * If bv isn't a BON_VT_TYPED_ARRAY then an empty typed array is returned.
+ */
+BonTypedArray                   BonAsTypedArray(                const BonValue* bv);
+
+/** Return the size in bytes of an element of a typed array (BON_ET_*). */
+size_t                          BonGetTypedArrayElementSize(    int elementType);
+
 /** Read a value as a BON_VT_NUMBER. If bv is of another type, then return 0.0 */
 double                          BonAsNumber(                    const BonValue* bv);
 
 /** Read a value as a BON_VT_STRING. If bv is of another type, then return an empty string (non-null)*/
 const char*                     BonAsString(                    const BonValue* bv);
 
+/**
+ * \brief Read a value as a BON_VT_STRING and its length in bytes.
+ *
+ * Strings written with BON_STRING_FLAG_LENGTH have their byte count stored before them, so this
+ * doesn't scan the string, and strings with embedded nulls are returned in full. For older records
+ * the byte count is the strlen of the string.
+ *
+ * @param bv                    The value.
+ * @param byteCount             Receives the number of bytes before the terminating null.
+ * @return                      The string, or an empty string (non-null) if bv is of another type.
+ */
+const char*                     BonAsStringWithLength(          const BonValue* bv,
+                                                                size_t* byteCount);
+
 /** Read a value as a BON_VT_BOOL. If bv is of another type, then return BON_FALSE */
 BonBool                         BonAsBool(                      const BonValue* bv);
 
@@ -127,7 +332,59 @@ BonName                         BonCreateName(                  const char* name
 /** Return the hash of a null-terminated UTF-8 encoded sequence of bytes */
 BonName                         BonCreateNameCstr(              const char* nameString);
 
-/** Return index of value in sorted array names. Return -1 if value is not in the names array. */
+/**
+ * \brief Return a 64-bit hash of the bytes of a record.
+ *
+ * Records are canonical, so two records converted from semantically identical JSON texts (with 
+ * the same options) have the same hash. Runs at memory speed with SSE2/AVX2 when available and
+ * gives the same hash with or without them.
+ */
+uint64_t                        BonHashRecord(                  const BonRecord* br);
+
+/**
+ * \brief Return a 64-bit hash of the content of a value that doesn't depend on where it is stored.
+ *
+ * Equal subtrees of different records have equal hashes, regardless of the offsets, string 
+ * flags, name dictionaries and the record's other content. Object members are hashed by their
+ * BonName. A typed array hashes as the array of numbers it was packed from (if it was packed 
+ * losslessly). 
+ *
+ * @param br                    The record holding bv.
+ * @param bv                    Any value of br.
+ */
+uint64_t                        BonHashValue(                   const BonRecord* br,
+                                                                const BonValue* bv);
+
+/**
+ * \brief Read the stored BonHashValue of a container.
+ *
+ * Records converted with BonConvertOptions::subtreeHashes store the hash of every container, so
+ * this is a binary search instead of a walk over the subtree. BonHashValue uses the stored
+ * hashes, too.
+ *
+ * @param br                    The record holding bv.
+ * @param bv                    Any value of br.
+ * @param hash                  Receives the hash on success.
+ * @return                      BON_FALSE if br has no BON_RECORD_FLAG_SUBTREE_HASHES or bv isn't
+ *                              an object, array or typed array.
+ */
+BonBool                         BonGetSubtreeHash(              const BonRecord* br,
+                                                                const BonValue* bv,
+                                                                uint64_t* hash);
+
+/**
+ * \brief Recompute the stored subtree hashes after values of a record were changed in place.
+ *
+ * Does nothing for records without BON_RECORD_FLAG_SUBTREE_HASHES.
+ */
+void                            BonUpdateSubtreeHashes(         BonRecord* br);
+
+/** 
+ * \brief Return index of value in sorted array names. Return -1 if value is not in the names array.
+ *
+ * Small arrays (typical objects) are scanned linearly with SSE2/AVX2 compares when available, 
+ * larger arrays are bisected down to a small window that is then scanned.
+ */
 int                             BonFindIndexOfName(             const BonName* names,
 	                                                        int nameCount,
 								BonName value);
@@ -149,15 +406,128 @@ BonArray                        BonMemberAsArray(               const BonObject*
 BonNumberArray                  BonMemberAsNumberArray(         const BonObject* object,
                                                                 BonName name);
 
+BonTypedArray                   BonMemberAsTypedArray(          const BonObject* object,
+                                                                BonName name);
+
 double                          BonMemberAsNumber(              const BonObject* object,
                                                                 BonName name);
 
 const char*                     BonMemberAsString(              const BonObject* object,
                                                                 BonName name);
 
+/** Same as BonAsStringWithLength of a member. A missing member is an empty string. */
+BonStringView                   BonMemberAsStringView(          const BonObject* object,
+                                                                BonName name);
+
 BonBool                         BonMemberAsBool(                const BonObject* object,
                                                                 BonName name);
 
+/**
+ * \brief Look up many members of an object at once.
+ *
+ * Both the object's names and sortedNames are in ascending order, so all of them are resolved 
+ * with a single merge pass over the object's names. This is faster than one BonFindIndexOfName per
+ * member when reading more than a few members of the same object.
+ *
+ * @param object                The object to read from.
+ * @param sortedNames           Names to look up in ascending order.
+ * @param nameCount             Number of names in sortedNames.
+ * @param values                Receives nameCount pointers. Members that are missing get null.
+ * @return                      Number of members that were found.
+ */
+int                             BonMemberLookupMany(            const BonObject* object,
+                                                                const BonName* sortedNames,
+                                                                int nameCount,
+                                                                const BonValue** values);
+
+/** Maximum number of segments in a BonPath. */
+#define BON_PATH_MAX_SEGMENTS   32
+
+/** One step in a BonPath. */
+typedef struct BonPathSegment {
+        BonName                 name;                   /**< Member name when index is negative. */
+        int32_t                 index;                  /**< Array index, or -1 for an object member. */
+} BonPathSegment;
+
+/** 
+ * \brief A compiled path query, e.g. "scene.meshes[3].vertices".
+ * \sa BonCompilePath, BonEvaluatePath
+ */
+typedef struct BonPath {
+        int                     count;
+        BonPathSegment          segments[BON_PATH_MAX_SEGMENTS];
+} BonPath;
+
+/**
+ * \brief Compile a path string into a reusable query.
+ *
+ * Member names are separated by '.' and array indices are written as [n], e.g. 
+ * "scene.meshes[3].vertices" or "[0].name". The empty string is the root value. Member names
+ * are hashed once here so evaluating the path does no string work at all.
+ *
+ * @return                      BON_FALSE if the path is malformed or has too many segments.
+ */
+BonBool                         BonCompilePath(                 BonPath* path,
+                                                                const char* pathString);
+
+/** 
+ * \brief Return the value at path relative to value, or null if any step is missing or has the
+ * wrong type.
+ */
+const BonValue*                 BonEvaluatePath(                const BonValue* value,
+                                                                const BonPath* path);
+
+/**
+ * \brief Evaluate a path against every record in a buffer of consecutive records.
+ *
+ * The buffer holds BON records back to back, each starting at an 8 byte boundary (e.g. records
+ * appended to an archive file that has been memory mapped). Evaluation stops at the first invalid
+ * record, at the end of the buffer or when maxResults records have been visited.
+ *
+ * @param path                  A compiled path.
+ * @param records               First record. Must be 8 byte aligned.
+ * @param recordsByteCount      Size of the buffer.
+ * @param results               Receives one value per visited record (null if the path is missing in that record).
+ * @param maxResults            Capacity of results.
+ * @return                      Number of records visited.
+ */
+size_t                          BonEvaluatePathInRecords(       const BonPath* path,
+                                                                const void* records,
+                                                                size_t recordsByteCount,
+                                                                const BonValue** results,
+                                                                size_t maxResults);
+
+/**
+ * \brief Called by BonFindChangedPaths for every changed value.
+ *
+ * @param userdata              As passed to BonFindChangedPaths.
+ * @param path                  Path of the value from the roots. Only valid during the call.
+ * @param oldValue              The value in the old record, or null if it was added.
+ * @param newValue              The value in the new record, or null if it was removed.
+ */
+typedef void                    (*BonChangedPathCallback)(      void* userdata,
+                                                                const BonPath* path,
+                                                                const BonValue* oldValue,
+                                                                const BonValue* newValue);
+
+/**
+ * \brief Report the paths of the values that differ between two records.
+ *
+ * Objects are compared member by member and arrays item by item, where items past the end of
+ * the shorter array are reported as added or removed. A value of another type, or any other 
+ * difference, is reported as a whole. Values nested deeper than BON_PATH_MAX_SEGMENTS are
+ * reported by their ancestor at that depth.
+ *
+ * When both records have BON_RECORD_FLAG_SUBTREE_HASHES, containers with equal hashes are
+ * skipped, so the time depends on what changed rather than on the size of the records.
+ *
+ * @return                      Number of changes reported.
+ */
+size_t                          BonFindChangedPaths(            const BonRecord* oldRecord,
+                                                                const BonRecord* newRecord,
+                                                                BonChangedPathCallback callback,
+                                                                void* userdata);
+
 /** @} */
 
 /**
@@ -171,24 +541,32 @@ BonBool                         BonMemberAsBool(                const BonObject*
  * A BonValue when type is BON_VT_ARRAY
  */
 typedef struct BonArrayValue {
-        int32_t                 type;                   /**< BON_VT_ARRAY **/
-        int32_t                 offset;                 /**< Address of this struct + offset points to the array */
+        int32_t                 type;                   /**< BON_VT_ARRAY, optionally | BON_ARRAY_FLAG_NUMBERS **/
+        int32_t                 offset;                 /**< Address of this struct + offset points to the array (see BonWideRecordHeader) */
 } BonArrayValue;
 
+/**
+ * A BonValue when type is BON_VT_TYPED_ARRAY
+ */
+typedef struct BonTypedArrayValue {
+        int32_t                 type;                   /**< BON_VT_TYPED_ARRAY **/
+        int32_t                 offset;                 /**< Address of this struct + offset points to the typed array (see BonWideRecordHeader) */
+} BonTypedArrayValue;
+
 /**
  * A BonValue when type is BON_VT_OBJECT
  */
 typedef struct BonObjectValue {
         int32_t                 type;                   /**< BON_VT_OBJECT **/
-        int32_t                 offset;                 /**< Address of this struct + offset points to the object */
+        int32_t                 offset;                 /**< Address of this struct + offset points to the object (see BonWideRecordHeader) */
 } BonObjectValue;
 
 /**
  * A BonValue when type is BON_VT_STRING
  */
 typedef struct BonStringValue {
-        int32_t                 type;                   /**< BON_VT_STRING **/
-        int32_t                 offset;                 /**< Address of this struct + offset points to the string */
+        int32_t                 type;                   /**< BON_VT_STRING, optionally | BON_STRING_FLAG_LENGTH **/
+        int32_t                 offset;                 /**< Address of this struct + offset points to the string (see BonWideRecordHeader) */
 } BonStringValue;
 
 /**
@@ -209,6 +587,50 @@ typedef struct BonContainerHeader {
         int32_t                 count;                  /**< Number of items in the container */
 } BonContainerHeader;
 
+/** 
+ * Marks the first field of a BonTypedArrayHeader. No object in a record can have a capacity this
+ * negative, so typed arrays can be stored among the arrays and still be told apart.
+ */
+#define BON_TYPED_ARRAY_TAG     (-0x7fffffff - 1)
+
+/** True if the first int32 of a container header is the elementType of a BonTypedArrayHeader */
+#define BON_IS_TYPED_ARRAY_HEADER(firstField) ((uint32_t)(firstField) - 0x80000001u < (uint32_t)BON_ET_UINT8)
+
+/**
+ * A header for a typed array.
+ * It is followed by count packed elements, padded with zeros to an eight byte boundary.
+ */
+typedef struct BonTypedArrayHeader {
+        int32_t                 elementType;            /**< BON_TYPED_ARRAY_TAG | BON_ET_* */
+        int32_t                 count;                  /**< Number of elements */
+} BonTypedArrayHeader;
+
+/**
+ * The last eight bytes of a record with BON_RECORD_FLAG_SUBTREE_HASHES.
+ *
+ * The subtree hash section follows the name strings. It holds count uint64_t BonHashValue 
+ * hashes followed by count uint32_t container offsets (relative to the record, ascending),
+ * padded with zeros to an eight byte boundary, and ends with this footer.
+ */
+typedef struct BonSubtreeHashFooter {
+        int32_t                 hashesOffset;           /**< Address of hashesOffset + hashesOffset points to the hashes */
+        int32_t                 count;                  /**< Number of hashed containers */
+} BonSubtreeHashFooter;
+
+/**
+ * Follows the BonRecord header of a record with BON_WIDE_RECORD_MAGIC. The header's recordSize,
+ * valueStringOffset and nameLookupTableOffset are 0 and the objects start after this struct.
+ *
+ * The offset of a string, array or object value is 64-bit in a wide record: bits 8-31 of the
+ * value's type field hold bits 32-55 of the offset (sign-extended), which are 0 in other records.
+ * Subtree hashes, patches and name sections larger than 2 GB are not supported in wide records.
+ */
+typedef struct BonWideRecordHeader {
+        uint64_t                recordSize;             /**< Total size of the entire record */
+        uint64_t                valueStringOffset;      /**< Offset to the first value string, relative to the record */
+        uint64_t                nameLookupTableOffset;  /**< Offset to the name lookup table, relative to the record */
+} BonWideRecordHeader;
+
 /**
  * An entry in the name lookup table.
  */
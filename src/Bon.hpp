@@ -0,0 +1,352 @@
+#pragma once
+/* vi: set ts=8 sts=8 sw=8 et: */
+/**
+* @file
+* \addtogroup BonCpp
+* \brief Header-only C++17 helpers for reading BON records.
+* @{
+*/
+
+#include "Bon.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+
+namespace bon {
+
+namespace detail {
+
+constexpr uint32_t
+Rotl32(uint32_t x, int r) {
+        return (x << r) | (x >> (32 - r));
+}
+
+constexpr uint32_t
+LoadLittleEndian32(const char* p) {
+        return (uint32_t)(uint8_t)p[0]
+                | ((uint32_t)(uint8_t)p[1] << 8)
+                | ((uint32_t)(uint8_t)p[2] << 16)
+                | ((uint32_t)(uint8_t)p[3] << 24);
+}
+
+} /* namespace detail */
+
+/**
+ * \brief constexpr version of BonCreateName.
+ *
+ * Must produce exactly the same 32-bit murmur3 as Hash32 in Bon.c (including its tail rotation)
+ * on a little-endian platform.
+ */
+constexpr BonName
+CreateName(const char* nameString, size_t nameStringByteCount) {
+        const uint32_t  c1      = 0xcc9e2d51u;
+        const uint32_t  c2      = 0x1b873593u;
+        const uint32_t  nbytes  = (uint32_t)nameStringByteCount;
+        const uint32_t  nblocks = nbytes / 4;
+        const char*     tail    = nameString + nblocks * 4;
+        uint32_t        h       = 0;
+        uint32_t        k       = 0;
+
+        if (nameString == nullptr || nbytes == 0)
+                return 0;
+
+        for (uint32_t i = 0; i < nblocks; ++i) {
+                k = detail::LoadLittleEndian32(nameString + i * 4);
+                k *= c1;
+                k = detail::Rotl32(k, 15);
+                k *= c2;
+
+                h ^= k;
+                h = detail::Rotl32(h, 13);
+                h = (h * 5) + 0xe6546b64u;
+        }
+
+        k = 0;
+        switch (nbytes & 3) {
+        case 3:
+                k ^= (uint32_t)(uint8_t)tail[2] << 16;
+                [[fallthrough]];
+        case 2:
+                k ^= (uint32_t)(uint8_t)tail[1] << 8;
+                [[fallthrough]];
+        case 1:
+                k ^= (uint32_t)(uint8_t)tail[0];
+                k *= c1;
+                k = (k << 13) | (k >> (32 - 15));                               /* Same as Hash32 in Bon.c */
+                k *= c2;
+                h ^= k;
+        }
+
+        h ^= nbytes;
+
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+
+        return h;
+}
+
+/** constexpr version of BonCreateNameCstr for string literals and char arrays. */
+template <size_t N>
+constexpr BonName
+CreateName(const char (&nameString)[N]) {
+        return CreateName(nameString, N - 1);
+}
+
+} /* namespace bon */
+
+/**
+ * \brief The BonName of a string literal as a compile time constant.
+ *
+ * ~~~
+ * double x = BonMemberAsNumber(&object, BON_NAME("position"));
+ * ~~~
+ */
+#define BON_NAME(nameStringLiteral)     (std::integral_constant<BonName, ::bon::CreateName(nameStringLiteral)>::value)
+
+namespace bon {
+
+/*---------------------------------------------------------------------------*/
+/* Views
+ *
+ * Thin value types over the reader structs in Bon.h. They only hold pointers into the record, 
+ * never allocate and have no virtual functions. All accessors are inline and do the same loads
+ * as the corresponding Bon.c functions, so a loop over a view compiles to a raw pointer walk.
+ */
+
+class value_view;
+class array_view;
+class object_view;
+class number_span;
+
+namespace detail {
+
+inline constexpr BonValue       null_value      = 0x7ull;
+
+inline int
+ValueType(const BonValue* v) {
+        return (int)(*v & 0x7ull);
+}
+
+/** Same as BON_VALUE_PTR in Bon.c: wide records keep offset bits 32-55 above the type. */
+inline const void*
+ValuePtr(const BonValue* v) {
+        int32_t type;
+        int32_t offset;
+        memcpy(&type, v, sizeof(type));
+        memcpy(&offset, (const uint8_t*)v + 4, sizeof(offset));
+        return (const uint8_t*)v + ((int64_t)offset + (int64_t)(type >> 8) * 0x100000000ll);
+}
+
+inline const BonContainerHeader*
+ContainerHeader(const BonValue* v) {
+        return (const BonContainerHeader*)ValuePtr(v);
+}
+
+} /* namespace detail */
+
+/** A contiguous range of doubles, as returned from BonAsNumberArray. */
+class number_span {
+public:
+        using value_type        = double;
+        using iterator          = const double*;
+
+        constexpr number_span() : m_data(nullptr), m_count(0) {}
+        constexpr number_span(const double* data, size_t count) : m_data(data), m_count(count) {}
+        number_span(const BonNumberArray& a) : m_data(a.values), m_count((size_t)a.count) {}
+
+        constexpr const double*         data() const                    { return m_data; }
+        constexpr size_t                size() const                    { return m_count; }
+        constexpr bool                  empty() const                   { return m_count == 0; }
+        constexpr const double&         operator[](size_t i) const      { return m_data[i]; }
+        constexpr iterator              begin() const                   { return m_data; }
+        constexpr iterator              end() const                     { return m_data + m_count; }
+
+private:
+        const double*           m_data;
+        size_t                  m_count;
+};
+
+/** A reference to a BonValue in a record. */
+class value_view {
+public:
+        constexpr value_view() : m_value(&detail::null_value) {}
+        constexpr explicit value_view(const BonValue* value) : m_value(value) {}
+
+        const BonValue*         raw() const                     { return m_value; }
+        int                     type() const                    { return detail::ValueType(m_value); }
+        bool                    is_null() const                 { return *m_value == detail::null_value; }
+
+        /** 
+         * Read the value as T, one of double, bool, const char*, std::string_view, array_view,
+         * object_view or number_span. Like the Bon.c accessors a type mismatch asserts and returns an empty value.
+         */
+        template <typename T> T get() const;
+
+private:
+        const BonValue*         m_value;
+};
+
+/** A BON_VT_ARRAY. Iterating yields value_view. */
+class array_view {
+public:
+        class iterator {
+        public:
+                constexpr explicit iterator(const BonValue* p) : m_p(p) {}
+                value_view      operator*() const                       { return value_view(m_p); }
+                iterator&       operator++()                            { ++m_p; return *this; }
+                bool            operator!=(const iterator& o) const     { return m_p != o.m_p; }
+                bool            operator==(const iterator& o) const     { return m_p == o.m_p; }
+        private:
+                const BonValue* m_p;
+        };
+
+        constexpr array_view() : m_values(nullptr), m_count(0) {}
+        constexpr array_view(const BonValue* values, int count) : m_values(values), m_count(count) {}
+        array_view(const BonArray& a) : m_values(a.values), m_count(a.count) {}
+
+        int                     size() const                    { return m_count; }
+        bool                    empty() const                   { return m_count == 0; }
+        value_view              operator[](int i) const         { return value_view(&m_values[i]); }
+        iterator                begin() const                   { return iterator(m_values); }
+        iterator                end() const                     { return iterator(m_values + m_count); }
+
+        /** Same as BonAsNumberArray: no check that all items are numbers. */
+        number_span             as_numbers() const              { return number_span((const double*)m_values, (size_t)m_count); }
+
+private:
+        const BonValue*         m_values;
+        int                     m_count;
+};
+
+/** A BON_VT_OBJECT. Iterating yields members in name (hash) order. */
+class object_view {
+public:
+        struct member {
+                BonName         name;
+                value_view      value;
+        };
+
+        class iterator {
+        public:
+                constexpr iterator(const BonValue* v, const BonName* n) : m_value(v), m_name(n) {}
+                member          operator*() const                       { return member{ *m_name, value_view(m_value) }; }
+                iterator&       operator++()                            { ++m_value; ++m_name; return *this; }
+                bool            operator!=(const iterator& o) const     { return m_value != o.m_value; }
+                bool            operator==(const iterator& o) const     { return m_value == o.m_value; }
+        private:
+                const BonValue* m_value;
+                const BonName*  m_name;
+        };
+
+        constexpr object_view() : m_values(nullptr), m_names(nullptr), m_count(0) {}
+        object_view(const BonObject& o) : m_values(o.values), m_names(o.names), m_count(o.count) {}
+
+        int                     size() const                    { return m_count; }
+        bool                    empty() const                   { return m_count == 0; }
+        iterator                begin() const                   { return iterator(m_values, m_names); }
+        iterator                end() const                     { return iterator(m_values + m_count, m_names + m_count); }
+
+        /** Return the member's value, or a null value if there is no such member. */
+        value_view              find(BonName name) const {
+                const int i = BonFindIndexOfName(m_names, m_count, name);
+                return i >= 0 ? value_view(&m_values[i]) : value_view();
+        }
+        value_view              operator[](BonName name) const  { return find(name); }
+        bool                    contains(BonName name) const    { return BonFindIndexOfName(m_names, m_count, name) >= 0; }
+
+private:
+        friend class value_view;
+        object_view(const BonValue* values, const BonName* names, int count) : m_values(values), m_names(names), m_count(count) {}
+
+        const BonValue*         m_values;
+        const BonName*          m_names;
+        int                     m_count;
+};
+
+template <> inline double
+value_view::get<double>() const {
+        if (detail::ValueType(m_value) != BON_VT_NUMBER) {
+                assert(0 && "Expected BON_VT_NUMBER");
+                return 0.0;
+        }
+        double d;
+        memcpy(&d, m_value, sizeof(d));
+        return d;
+}
+
+template <> inline bool
+value_view::get<bool>() const {
+        if (detail::ValueType(m_value) != BON_VT_BOOL) {
+                assert(0 && "Expected BON_VT_BOOL");
+                return false;
+        }
+        return ((const BonBoolValue*)m_value)->value != BON_FALSE;
+}
+
+template <> inline const char*
+value_view::get<const char*>() const {
+        if (detail::ValueType(m_value) != BON_VT_STRING) {
+                assert(0 && "Expected BON_VT_STRING");
+                return "";
+        }
+        return (const char*)detail::ValuePtr(m_value);
+}
+
+/** Like BonAsStringWithLength: the length is read from the record instead of scanning the string. */
+template <> inline std::string_view
+value_view::get<std::string_view>() const {
+        if (detail::ValueType(m_value) != BON_VT_STRING) {
+                assert(0 && "Expected BON_VT_STRING");
+                return std::string_view();
+        }
+        const char* string = (const char*)detail::ValuePtr(m_value);
+        if (*m_value & BON_STRING_FLAG_LENGTH) {
+                uint32_t byteCount;
+                memcpy(&byteCount, string - sizeof(byteCount), sizeof(byteCount));
+                return std::string_view(string, byteCount);
+        }
+        return std::string_view(string);
+}
+
+template <> inline array_view
+value_view::get<array_view>() const {
+        if (detail::ValueType(m_value) != BON_VT_ARRAY) {
+                assert(0 && "Expected BON_VT_ARRAY");
+                return array_view();
+        }
+        const BonContainerHeader* header = detail::ContainerHeader(m_value);
+        return array_view((const BonValue*)&header[1], header->count);
+}
+
+template <> inline number_span
+value_view::get<number_span>() const {
+        return get<array_view>().as_numbers();
+}
+
+template <> inline object_view
+value_view::get<object_view>() const {
+        if (detail::ValueType(m_value) != BON_VT_OBJECT) {
+                assert(0 && "Expected BON_VT_OBJECT");
+                return object_view();
+        }
+        const BonContainerHeader* header = detail::ContainerHeader(m_value);
+        const BonValue* values = (const BonValue*)&header[1];
+        return object_view(values, (const BonName*)&values[header->count], header->count);
+}
+
+/** The root value of a record. */
+inline value_view
+root(const BonRecord* record) {
+        return value_view(&record->rootValue);
+}
+
+} /* namespace bon */
+
+/** @} */
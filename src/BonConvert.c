@@ -8,6 +8,33 @@
 #include <setjmp.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <math.h>
+#include <float.h>
+
+/* Stage 1 of the JSON parser classifies 64 bytes at a time. Same guards as the name search in Bon.c. */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BON_JSON_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BON_JSON_SSE2
+#endif
+#if defined(__PCLMUL__) && (defined(BON_JSON_AVX2) || defined(BON_JSON_SSE2))
+#include <wmmintrin.h>
+#define BON_JSON_CLMUL
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Worker threads of the parallel conversion (BonConvertOptions::threadCount) and of BonConvertBatch */
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
 
 /*---------------------------------------------------------------------------*/
 /* List helpers */
@@ -21,84 +48,6 @@
 /* Standard isdigit was too expensive (about 20% of total time when parsing a number-dense file) */
 #define IsDigit(c) (((c) >= (uint8_t)'0') & ((c) <= (uint8_t)'9'))
 
-/* Mergesort adapted from http://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.c
- *
- * This [function] is copyright 2001 Simon Tatham.
- *
- * Permission is hereby granted, free of charge, to any person
- * obtaining a copy of this software and associated documentation
- * files (the "Software"), to deal in the Software without
- * restriction, including without limitation the rights to use,
- * copy, modify, merge, publish, distribute, sublicense, and/or
- * sell copies of the Software, and to permit persons to whom the
- * Software is furnished to do so, subject to the following
- * conditions:
- *
- * The above copyright notice and this permission notice shall be
- * included in all copies or substantial portions of the Software.
- *
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
- * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
- * NONINFRINGEMENT.  IN NO EVENT SHALL SIMON TATHAM BE LIABLE FOR
- * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
- * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
- * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
- * SOFTWARE.
-*/
-#define BonSortList(head, ElementType, CompareFun)                              \
-        do {                                                                    \
-                ElementType *p, *q, *e, *tail, *oldhead, *list;                 \
-                int insize, nmerges, psize, qsize, i;                           \
-                list = *(head);                                                 \
-                if (!list) break;                                               \
-                insize = 1;                                                     \
-                for (;;) {                                                      \
-                        p = oldhead = list;                                     \
-                        list = tail = 0;                                        \
-                        nmerges = 0;                                            \
-                        while (p) {                                             \
-                                nmerges++;                                      \
-                                q = p;                                          \
-                                psize = 0;                                      \
-                                for (i = 0; i < insize; i++) {                  \
-                                        psize++;                                \
-                                        q = q->next;                            \
-                                        if (!q) break;                          \
-                                }                                               \
-                                qsize = insize;                                 \
-                                while (psize > 0 || (qsize > 0 && q)) {         \
-                                        if (psize == 0) {                       \
-                                                e = q; q = q->next; qsize--;    \
-                                        }                                       \
-                                        else if (qsize == 0 || !q) {            \
-                                                e = p; p = p->next; psize--;    \
-                                        }                                       \
-                                        else if (CompareFun(p, q) < 0) {        \
-                                                e = p; p = p->next; psize--;    \
-                                        }                                       \
-                                        else {                                  \
-                                                e = q; q = q->next; qsize--;    \
-                                        }                                       \
-                                        if (tail) {                             \
-                                                tail->next = e;                 \
-                                        }                                       \
-                                        else {                                  \
-                                                list = e;                       \
-                                        }                                       \
-                                        tail = e;                               \
-                                }                                               \
-                                p = q;                                          \
-                        }                                                       \
-                        tail->next = NULL;                                      \
-                        if (nmerges <= 1) {                                     \
-                                *(head) = list;                                 \
-                                break;                                          \
-                        }                                                       \
-                        insize *= 2;                                            \
-                }                                                               \
-        } while(0)
-
 /*---------------------------------------------------------------------------*/
 /* Internal */
 
@@ -125,6 +74,8 @@ typedef struct BonArrayHead {
         size_t                  size;
         struct BonArrayEntry*   valueList;
         struct BonArrayEntry**  lastValue;
+        int                     elementType;                                    /* BON_ET_* when written as a typed array, otherwise 0 */
+        BonBool                 numbersOnly;                                    /* All values are BON_VT_NUMBER */
 } BonArrayHead;
 
 typedef struct BonObjectHead {
@@ -158,6 +109,135 @@ typedef struct BonObjectEntry {
         BonStringEntry*         name;
 } BonObjectEntry;
 
+/* Bytes of input indexed at a time. Positions in a window fit in a uint16_t. */
+#define BON_INDEX_WINDOW_SIZE           16384
+
+/* 
+ * The structural index (stage 1) of the parser. For a window of the input it holds the positions of:
+ * - unescaped quotes
+ * - tokens that follow whitespace outside strings
+ * - escapes and control characters inside strings
+ * Stage 2 (the Parse* functions) reads the bytes at the cursor as before, but jumps over whitespace and
+ * string contents using the index. Structural characters right after a token are not indexed since
+ * stage 2 finds them at the cursor anyway.
+ */
+typedef struct BonJsonIndex {
+        uint16_t*               positions;                                      /* 0 when parsing byte by byte */
+        const uint16_t*         cursor;                                         /* First position not yet passed */
+        const uint16_t*         end;
+        const uint8_t*          base;                                           /* Start of the window */
+        const uint8_t*          indexedEnd;                                     /* End of the input indexed so far */
+        uint64_t                escapedCarry;                                   /* 1 if the first byte of the next block is escaped */
+        uint64_t                inStringCarry;                                  /* All ones if the next block starts inside a string */
+        uint64_t                whitespaceCarry;                                /* 1 if the last byte of the previous block was whitespace */
+} BonJsonIndex;
+
+/*
+ * A value on the tape (BonConvertOptions.tape). Numbers are stored as their double. Everything else is
+ * boxed in the NaN space, which parsed numbers never use: BON_TAPE_BOX, the BON_VT_* type in bits
+ * 48-50 and below that the string or container index, or the bool.
+ */
+typedef uint64_t                BonTapeValue;
+
+#define BON_TAPE_BOX                    0xFFF8000000000000ull
+#define BON_TAPE_INDEX_MASK             0x0000FFFFFFFFFFFFull
+
+/* A closed container in the arena. Its values follow in record order, for objects followed by the names. */
+typedef struct BonTapeContainer {
+        size_t                  offset;                                         /* In the object or array section */
+        int32_t                 count;
+        uint8_t                 type;
+        uint8_t                 elementType;                                    /* BON_ET_* when written as a typed array, otherwise 0 */
+        uint8_t                 numbersOnly;
+} BonTapeContainer;
+
+/* A unique string */
+typedef struct BonTapeString {
+        const uint8_t*          utf8;
+        size_t                  offset;                                         /* In the string section */
+        uint32_t                byteCount;
+        BonName                 hash;
+} BonTapeString;
+
+typedef struct BonTapeStringTable {
+        BonTapeString*          strings;
+        size_t                  count;
+        size_t                  capacity;
+        uint32_t*               slots;                                          /* Open addressing on the hash. String index + 1, 0 when free. */
+        size_t                  slotCount;                                      /* Power of two */
+} BonTapeStringTable;
+
+/* A member of an object that is being sorted */
+typedef struct BonTapeEntry {
+        BonTapeValue            value;
+        BonName                 name;
+        uint32_t                chunk;                                          /* Of a root member in a parallel conversion */
+} BonTapeEntry;
+
+/* Unused memory in the blocks of the tape, kept for reuse */
+typedef struct BonTapeSpare {
+        struct BonTapeSpare*    next;
+        size_t                  byteCount;
+} BonTapeSpare;
+
+/*
+ * Instead of a tree of linked lists the tape engine keeps the values of the open containers on a stack
+ * (a name and a value for each object member). When a container is closed its values are sorted and
+ * moved to the arena as one block, and it becomes a single value of its parent. Strings are interned
+ * as they are parsed. Temp memory is allocated in large blocks, linked through their first word so that
+ * they can be freed, and memory that is no longer needed (grown arrays, the stack once the text is
+ * parsed) is reused from the spares.
+ */
+typedef struct BonTape {
+        void*                   blocks;
+        BonTapeSpare*           spares;
+        uint8_t*                arena;                                          /* Current arena chunk */
+        size_t                  arenaUsed;
+        size_t                  arenaSize;
+
+        BonTapeValue**          stackChunks;
+        size_t                  stackChunkCount;
+        size_t                  stackChunkCapacity;
+        size_t                  stackSize;
+        uint64_t*               sortScratch;                                    /* Keys of SortTapeMembers and their scratch */
+        size_t                  sortScratchCapacity;
+
+        BonTapeContainer**      containers;
+        size_t                  containerCount;
+        size_t                  containerCapacity;
+        size_t*                 breadthFirst;                                   /* Container indices in record order */
+        size_t                  root;
+
+        BonTapeStringTable      names;
+        BonTapeStringTable      values;
+        uint64_t*               nameKeys;                                       /* The names in the record, in order (hash << 32 | string index) */
+        size_t                  nameKeyCount;
+} BonTape;
+
+/* An open container of the push parser */
+typedef struct BonPushFrame {
+        size_t                  first;                                          /* Tape stack index of its first value */
+        int                     type;
+} BonPushFrame;
+
+/*
+ * What BonParserFeed keeps between chunks. There is no recursion: the open containers are frames,
+ * and a string, number or literal that a chunk boundary splits is copied to token until it ends.
+ */
+typedef struct BonPushParser {
+        int                     state;                                          /* BON_PUSH_* */
+        BonPushFrame*           frames;
+        size_t                  frameCount;
+        size_t                  frameCapacity;
+        uint8_t*                token;
+        size_t                  tokenSize;
+        size_t                  tokenCapacity;
+        int                     tokenKind;                                      /* BON_PUSH_TOKEN_*, 0 when there is no split token */
+        BonBool                 tokenEscaped;                                   /* The split string ends with a backslash */
+        uint8_t                 head[3];                                        /* The first bytes, for the encoding checks */
+        size_t                  headSize;
+} BonPushParser;
+
 typedef struct BonParsedJson {
         BonTempMemoryAlloc      alloc;
         void*                   allocUserdata;
@@ -165,27 +245,40 @@ typedef struct BonParsedJson {
         const uint8_t*          jsonString;
         const uint8_t*          jsonStringEnd;
         const uint8_t*          cursor;
+        BonJsonIndex            index;
         
         jmp_buf*                env;
+        BonConvertOptions       options;
+
+        BonTape                 tape;
+        BonPushParser           push;
+        struct BonParallelJson* parallel;                                       /* When converted on worker threads */
 
         BonStringEntry*         valueStringList;
         BonStringEntry*         nameStringList;
         BonContainer*           containerList;
         BonContainer**          lastContainer;
+        uint64_t*               sortKeys;                                       /* Keys, their scratch and their items, sortKeyCapacity of each */
+        size_t                  sortKeyCapacity;
 
         size_t                  totalObjectSize;
         size_t                  totalArraySize;
         size_t                  totalValueStringSize;
         size_t                  totalNameLookupSize;
         size_t                  totalNameStringSize;
+        size_t                  totalSubtreeHashSize;
 
         size_t                  totalNameStringCount;
+        size_t                  containerCount;
+        uint32_t                nameDictionaryId;
 
         size_t                  objectOffset;
         size_t                  arrayOffset;
         size_t                  valueStringOffset;
         size_t                  nameLookupOffset;
         size_t                  nameStringOffset;
+        size_t                  subtreeHashOffset;
+        BonBool                 wide;                                           /* Write a BonWideRecordHeader and 64-bit value offsets */
 
         void*                   recordBaseMemory;
 
@@ -261,8 +354,221 @@ InitArrayVariant(BonParsedJson* pj, BonVariant* v) {
         return head;
 }
 
+/*---------------------------------------------------------------------------*/
+/* Structural index (stage 1) */
+
+typedef struct BonBlockMasks {
+        uint64_t                quote;
+        uint64_t                backslash;
+        uint64_t                whitespace;
+        uint64_t                control;                                        /* Bytes below 0x20. Not allowed unescaped in strings. */
+} BonBlockMasks;
+
+#define IsWhitespace(c) ((c) == 0x20u || (c) == 0x09u || (c) == 0x0Au || (c) == 0x0Du)
+
+#if defined(BON_JSON_AVX2)
+static void
+ClassifyBlock(const uint8_t* block, BonBlockMasks* masks) {
+        const __m256i   quote           = _mm256_set1_epi8('\"');
+        const __m256i   backslash       = _mm256_set1_epi8('\\');
+        const __m256i   control         = _mm256_set1_epi8(0x1F);
+        int             i;
+        memset(masks, 0, sizeof(*masks));
+        for (i = 0; i < 64; i += 32) {
+                const __m256i   x       = _mm256_loadu_si256((const __m256i*)(block + i));
+                const __m256i   ws      = _mm256_or_si256(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x20)), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x09))),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x0A)), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x0D))));
+                masks->quote            |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote)) << i;
+                masks->backslash        |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, backslash)) << i;
+                masks->whitespace       |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << i;
+                masks->control          |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x, control), x)) << i;
+        }
+}
+#elif defined(BON_JSON_SSE2)
+static void
+ClassifyBlock(const uint8_t* block, BonBlockMasks* masks) {
+        const __m128i   quote           = _mm_set1_epi8('\"');
+        const __m128i   backslash       = _mm_set1_epi8('\\');
+        const __m128i   control         = _mm_set1_epi8(0x1F);
+        int             i;
+        memset(masks, 0, sizeof(*masks));
+        for (i = 0; i < 64; i += 16) {
+                const __m128i   x       = _mm_loadu_si128((const __m128i*)(block + i));
+                const __m128i   ws      = _mm_or_si128(
+                        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(0x20)), _mm_cmpeq_epi8(x, _mm_set1_epi8(0x09))),
+                        _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(0x0A)), _mm_cmpeq_epi8(x, _mm_set1_epi8(0x0D))));
+                masks->quote            |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote)) << i;
+                masks->backslash        |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, backslash)) << i;
+                masks->whitespace       |= (uint64_t)(uint32_t)_mm_movemask_epi8(ws) << i;
+                masks->control          |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, control), x)) << i;
+        }
+}
+#else
+static void
+ClassifyBlock(const uint8_t* block, BonBlockMasks* masks) {
+        int i;
+        memset(masks, 0, sizeof(*masks));
+        for (i = 0; i < 64; ++i) {
+                const uint8_t   c       = block[i];
+                const uint64_t  bit     = 1ull << i;
+                if (c == '\"')          masks->quote            |= bit;
+                if (c == '\\')          masks->backslash        |= bit;
+                if (IsWhitespace(c))    masks->whitespace       |= bit;
+                if (c < 0x20u)          masks->control          |= bit;
+        }
+}
+#endif
+
+static int
+CountTrailingZeros64(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return (int)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (unsigned long)mask))
+                return (int)index;
+        _BitScanForward(&index, (unsigned long)(mask >> 32));
+        return (int)index + 32;
+#else
+        return __builtin_ctzll(mask);
+#endif
+}
+
+/* 
+ * Return the bytes escaped by a backslash. The first backslash of a run escapes the second, the
+ * third escapes the fourth and so on. Runs that start on an odd bit are moved to start on an even bit
+ * by adding the run starts (carries ripple through each run). Adapted from simdjson.
+ */
+static uint64_t
+FindEscaped(uint64_t backslash, uint64_t* escapedCarry) {
+        const uint64_t  evenBits        = 0x5555555555555555ull;
+        uint64_t        followsEscape;
+        uint64_t        oddStarts;
+        uint64_t        evenStarts;
+        uint64_t        escaped;
+
+        if (!backslash) {
+                escaped = *escapedCarry;
+                *escapedCarry = 0;
+                return escaped;
+        }
+        backslash       &= ~*escapedCarry;                                      /* An escaped backslash does not escape */
+        followsEscape   = (backslash << 1) | *escapedCarry;
+        oddStarts       = backslash & ~evenBits & ~followsEscape;
+        evenStarts      = oddStarts + backslash;
+        *escapedCarry   = evenStarts < oddStarts ? 1 : 0;                       /* A run reaching bit 63 escapes the next block */
+        escaped         = (evenBits ^ (evenStarts << 1)) & followsEscape;
+        return escaped;
+}
+
+/* Bit i of the result is the xor of bits 0..i, i.e. set from an opening quote up to the closing quote */
+static uint64_t
+PrefixXor(uint64_t bits) {
+#if defined(BON_JSON_CLMUL)
+        return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0, (int64_t)bits), _mm_set1_epi8((char)0xFF), 0));
+#else
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+#endif
+}
+
+/* Index the next window of the input. The state between blocks is carried in the BonJsonIndex. */
+static void
+IndexNextWindow(BonParsedJson* pj) {
+        BonJsonIndex*   index           = &pj->index;
+        const uint8_t*  window          = index->indexedEnd;
+        const size_t    remaining       = (size_t)(pj->jsonStringEnd - window);
+        const size_t    windowSize      = remaining < BON_INDEX_WINDOW_SIZE ? remaining : BON_INDEX_WINDOW_SIZE;
+        uint16_t*       out             = index->positions;
+        size_t          blockOffset;
+
+        for (blockOffset = 0; blockOffset < windowSize; blockOffset += 64) {
+                const uint8_t*  block   = window + blockOffset;
+                uint8_t         padded[64];
+                BonBlockMasks   masks;
+                uint64_t        escaped, quotes, inString, tokens, bits;
+
+                if (windowSize - blockOffset < 64) {                            /* Pad the last block with whitespace */
+                        memset(padded, 0x20, sizeof(padded));
+                        memcpy(padded, block, windowSize - blockOffset);
+                        block = padded;
+                }
+                ClassifyBlock(block, &masks);
+
+                escaped                 = FindEscaped(masks.backslash, &index->escapedCarry);
+                quotes                  = masks.quote & ~escaped;
+                inString                = PrefixXor(quotes) ^ index->inStringCarry;    /* Includes the opening quote but not the closing */
+                index->inStringCarry    = (uint64_t)((int64_t)inString >> 63);
+                tokens                  = ~masks.whitespace & ((masks.whitespace << 1) | index->whitespaceCarry) & ~inString;
+                index->whitespaceCarry  = masks.whitespace >> 63;
+
+                bits = quotes | tokens | (inString & ~quotes & ((masks.backslash & ~escaped) | masks.control));
+                while (bits) {
+                        *out++ = (uint16_t)(blockOffset + (size_t)CountTrailingZeros64(bits));
+                        bits &= bits - 1;
+                }
+        }
+
+        index->base             = window;
+        index->indexedEnd       = window + windowSize;
+        index->cursor           = index->positions;
+        index->end              = out;
+}
+
+/* Return the first indexed position at or after from, or the end of the input */
+static const uint8_t*
+NextIndexed(BonParsedJson* pj, const uint8_t* from) {
+        BonJsonIndex* index = &pj->index;
+        for (;;) {
+                while (index->cursor != index->end) {
+                        const uint8_t* p = index->base + *index->cursor;
+                        if (p >= from)
+                                return p;
+                        ++index->cursor;
+                }
+                if (index->indexedEnd == pj->jsonStringEnd)
+                        return pj->jsonStringEnd;
+                IndexNextWindow(pj);
+        }
+}
+
+/* Index the text from jsonString to jsonStringEnd as it is parsed */
+static void
+InitJsonIndex(BonParsedJson* pj) {
+        const size_t            byteCount       = (size_t)(pj->jsonStringEnd - pj->jsonString);
+        const size_t            windowSize      = byteCount < BON_INDEX_WINDOW_SIZE ? byteCount : BON_INDEX_WINDOW_SIZE;
+
+        pj->index.positions             = (uint16_t*)DoTempCalloc(pj->alloc, pj->allocUserdata, pj->env, windowSize * sizeof(uint16_t));
+        pj->index.cursor                = pj->index.positions;
+        pj->index.end                   = pj->index.positions;
+        pj->index.base                  = pj->jsonString;
+        pj->index.indexedEnd            = pj->jsonString;
+        pj->index.whitespaceCarry       = 1;                                    /* So that the first token is indexed */
+}
+
+/*---------------------------------------------------------------------------*/
+/* Parser (stage 2) */
+
 static void
 SkipWhitespace(BonParsedJson* pj) {
+        if (pj->index.positions) {
+                /* A single space is cheaper to step over than to look up */
+                if (pj->cursor == pj->jsonStringEnd || !IsWhitespace(*pj->cursor))
+                        return;
+                if (++pj->cursor == pj->jsonStringEnd || !IsWhitespace(*pj->cursor))
+                        return;
+                pj->cursor = NextIndexed(pj, pj->cursor);
+                return;
+        }
+
         for (;;) {
                 if (pj->cursor == pj->jsonStringEnd)
                         return;
@@ -290,7 +596,7 @@ FailIfEof(BonParsedJson* pj) {
 
 static void
 FailUnlessCharIs(BonParsedJson* pj, uint8_t c) {
-        assert(pj->cursor != pj->jsonStringEnd);
+        FailIfEof(pj);                                                          /* E.g. a text that ends after a name or a comma */
         if (*pj->cursor++ != c) {
                 GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
         }
@@ -302,6 +608,187 @@ PeekChar(BonParsedJson* pj, uint8_t c) {
         return *pj->cursor == c ? BON_TRUE : BON_FALSE;
 }
 
+/* Parse the four hex digits of a \u escape */
+static uint32_t
+ParseHex4(BonParsedJson* pj, const uint8_t* string, const uint8_t* stringEnd) {
+        uint32_t        value   = 0;
+        int             i;
+        if (stringEnd - string < 4) {
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+        for (i = 0; i < 4; ++i) {
+                const uint8_t c = string[i];
+                value <<= 4;
+                if (c >= '0' && c <= '9')       value |= (uint32_t)(c - '0');
+                else if (c >= 'a' && c <= 'f')  value |= (uint32_t)(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F')  value |= (uint32_t)(c - 'A' + 10);
+                else                            GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+        return value;
+}
+
+/* Parse the code point of a \u escape (after the 'u') and write it as UTF-8. Return the end of the escape. */
+static const uint8_t*
+ParseUnicodeEscape(BonParsedJson* pj, const uint8_t* string, const uint8_t* stringEnd, uint8_t** pdst) {
+        uint32_t        codePoint       = ParseHex4(pj, string, stringEnd);
+        uint8_t*        dst             = *pdst;
+
+        string += 4;
+        if (codePoint >= 0xD800u && codePoint < 0xDC00u) {                     /* High surrogate, must be followed by a low surrogate */
+                uint32_t low;
+                if (stringEnd - string < 2 || string[0] != 0x5Cu || string[1] != 0x75u) {
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                }
+                low = ParseHex4(pj, string + 2, stringEnd);
+                if (low < 0xDC00u || low >= 0xE000u) {
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                }
+                string += 6;
+                codePoint = 0x10000u + ((codePoint - 0xD800u) << 10) + (low - 0xDC00u);
+        } else if (codePoint >= 0xDC00u && codePoint < 0xE000u) {              /* Lone low surrogate */
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+
+        /* An escape is never shorter than its UTF-8 (6 bytes for up to 3, 12 bytes for 4) */
+        if (codePoint < 0x80u) {
+                *dst++ = (uint8_t)codePoint;
+        } else if (codePoint < 0x800u) {
+                *dst++ = (uint8_t)(0xC0u | (codePoint >> 6));
+                *dst++ = (uint8_t)(0x80u | (codePoint & 0x3Fu));
+        } else if (codePoint < 0x10000u) {
+                *dst++ = (uint8_t)(0xE0u | (codePoint >> 12));
+                *dst++ = (uint8_t)(0x80u | ((codePoint >> 6) & 0x3Fu));
+                *dst++ = (uint8_t)(0x80u | (codePoint & 0x3Fu));
+        } else {
+                *dst++ = (uint8_t)(0xF0u | (codePoint >> 18));
+                *dst++ = (uint8_t)(0x80u | ((codePoint >> 12) & 0x3Fu));
+                *dst++ = (uint8_t)(0x80u | ((codePoint >> 6) & 0x3Fu));
+                *dst++ = (uint8_t)(0x80u | (codePoint & 0x3Fu));
+        }
+        *pdst = dst;
+        return string;
+}
+
+/* Decode the escape after a backslash. Return the end of the escape. */
+static const uint8_t*
+ParseEscape(BonParsedJson* pj, const uint8_t* string, const uint8_t* stringEnd, uint8_t** pdst) {
+        uint8_t c;
+        if (string == stringEnd) {
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+
+        c = *string++;
+        switch (c) {
+        case 0x22u:                                                             /* \" */
+        case 0x5Cu:                                                             /* \\ */
+        case 0x2Fu:                                                             /* \/ */
+                *(*pdst)++ = c;
+                break;
+        case 0x62u:                                                             /* \b */
+                *(*pdst)++ = +0x08u;
+                break;
+        case 0x66u:                                                             /* \f */
+                *(*pdst)++ = +0x0Cu;
+                break;
+        case 0x6Eu:                                                             /* \n */
+                *(*pdst)++ = +0x0Au;
+                break;
+        case 0x72u:                                                             /* \r */
+                *(*pdst)++ = +0x0Du;
+                break;
+        case 0x74u:                                                             /* \t */
+                *(*pdst)++ = +0x09u;
+                break;
+        case 0x75u:                                                             /* \u */
+                string = ParseUnicodeEscape(pj, string, stringEnd, pdst);
+                break;
+        default:
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+        return string;
+}
+
+/* Find the end of the string at the cursor and move the cursor past the closing quote. Return the start of the string. */
+static const uint8_t*
+ScanString(BonParsedJson* pj, const uint8_t** pstringEnd, BonBool* phasEscapes) {
+        const uint8_t*          string;
+        BonBool                 hasEscapes      = BON_FALSE;
+
+        FailUnlessCharIs(pj, '\"');
+        string = pj->cursor;
+
+        if (pj->index.positions) {
+                /* The next indexed position is the closing quote, an escape or a control character */
+                const uint8_t* p = string;
+                for (;;) {
+                        p = NextIndexed(pj, p);
+                        if (p == pj->jsonStringEnd || *p < 0x20u) {
+                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                        }
+                        if (*p == '\"')
+                                break;
+                        hasEscapes = BON_TRUE;
+                        ++p;
+                }
+                *pstringEnd = p;
+                pj->cursor = p + 1;
+        }
+        else {
+                /* Scan for the end of the string. The character after a backslash is never the end, so "\\" ends the string. */
+                for (;;) {
+                        FailIfEof(pj);
+                        if (pj->cursor[0] == '\"') {
+                                *pstringEnd = pj->cursor++;
+                                break;
+                        }
+                        if (pj->cursor[0] == '\\') {
+                                ++pj->cursor;
+                                FailIfEof(pj);
+                        }
+                        ++pj->cursor;
+                }
+                hasEscapes = BON_TRUE;                                          /* Not known, check every byte below */
+        }
+        *phasEscapes = hasEscapes;
+        return string;
+}
+
+/* Decode a string found by ScanString to dstString, which must have room for stringEnd - string bytes. Return the end of the decoded string. */
+static uint8_t*
+DecodeString(BonParsedJson* pj, const uint8_t* string, const uint8_t* stringEnd, BonBool hasEscapes, uint8_t* dstString) {
+        if (pj->index.positions) {
+                /* The index has ruled out control characters. Copy the spans between the escapes. */
+                while (string != stringEnd) {
+                        const uint8_t* escape = hasEscapes ? (const uint8_t*)memchr(string, 0x5C, (size_t)(stringEnd - string)) : 0;
+                        if (!escape) {
+                                escape = stringEnd;
+                        }
+                        memcpy(dstString, string, (size_t)(escape - string));
+                        dstString += escape - string;
+                        string = escape;
+                        if (string != stringEnd) {
+                                string = ParseEscape(pj, string + 1, stringEnd, &dstString);
+                        }
+                }
+        }
+
+        /* UTF-8 is copied as is, escapes are decoded. Nulls (\u0000) are kept, the byte count is stored with the string. */
+        while (string != stringEnd) {
+                uint8_t c = *string++;
+
+                if (c == 0x5Cu) {
+                        string = ParseEscape(pj, string, stringEnd, &dstString);
+                }
+                else if (c >= 0x20u) {
+                        *dstString++ = c;
+                }
+                else {
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                }
+        }
+        return dstString;
+}
+
 static void
 ParseString(BonParsedJson* pj, BonStringEntry** pstringEntry) {
         BonStringEntry*         stringEntry     = 0;
@@ -310,19 +797,9 @@ ParseString(BonParsedJson* pj, BonStringEntry** pstringEntry) {
         uint8_t*                dstString;
         size_t                  bufferSize;
         size_t                  stringBufferSize;
+        BonBool                 hasEscapes;
 
-        FailUnlessCharIs(pj, '\"');
-        string = pj->cursor;
-
-        /* Scan for the end of the string */
-        for (;;) {
-                FailIfEof(pj);
-                if (pj->cursor[0] == '\"' && pj->cursor[-1] != '\\') {
-                        stringEnd = pj->cursor++;
-                        break;
-                }
-                ++pj->cursor;
-        }
+        string = ScanString(pj, &stringEnd, &hasEscapes);
 
         stringBufferSize =
                 +(stringEnd - string)                                           /* Min length of string in bytes */
@@ -341,53 +818,7 @@ ParseString(BonParsedJson* pj, BonStringEntry** pstringEntry) {
         /* Immediately link the new string entry to the parent to avoid orphaning if the parsing below fails. */
         *pstringEntry = stringEntry;
 
-        dstString = stringEntry->utf8;
-
-        /* TODO: UTF-8. Just ASCII for now */
-        while (string != stringEnd) {
-                uint8_t c = *string++;
-
-                if (c == 0x5Cu) {
-                        uint8_t c2;
-                        if (string == stringEnd) {
-                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
-                        }
-
-                        c2 = *string++;
-                        switch (c2) {
-                        case 0x22u:                                             /* \" */
-                        case 0x5Cu:                                             /* \\ */
-                        case 0x2Fu:                                             /* \/ */
-                                *dstString++ = c2;
-                                break;
-                        case 0x62u:                                             /* \b */
-                                *dstString++ = +0x08u;
-                                break;
-                        case 0x66u:                                             /* \f */
-                                *dstString++ = +0x0Cu;
-                                break;
-                        case 0x6Eu:                                             /* \n */
-                                *dstString++ = +0x0Au;
-                                break;
-                        case 0x72u:                                             /* \r */
-                                *dstString++ = +0x0Du;
-                                break;
-                        case 0x74u:                                             /* \t */
-                                *dstString++ = +0x09u;
-                                break;
-                        case 0x75u:                                             /* \u */
-                                assert(0);                                      /* TODO: Unicode escape */
-                                break;
-                        }
-                }
-                else if (c >= 0x20u) {
-                        *dstString++ = c;
-                }
-                else {
-                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
-                }
-        }
-
+        dstString = DecodeString(pj, string, stringEnd, hasEscapes, stringEntry->utf8);
         *dstString = 0;
         stringEntry->byteCount  = dstString - stringEntry->utf8;
         stringEntry->hash       = BonCreateName((const char*)stringEntry->utf8, stringEntry->byteCount);
@@ -395,6 +826,8 @@ ParseString(BonParsedJson* pj, BonStringEntry** pstringEntry) {
 }
 
 static void                     ParseValue(BonParsedJson* pj, BonVariant* value);
+static void*                    TapeAlloc(BonParsedJson* pj, size_t byteCount);
+static void                     TapeFree(BonParsedJson* pj, void* memory, size_t byteCount);
 static void                     ParseObject(BonParsedJson* pj, BonObjectHead* objectHead);
 static void                     ParseArray(BonParsedJson* pj, BonArrayHead* arrayHead);
 
@@ -411,12 +844,152 @@ AppendObjectMember(BonParsedJson* pj, BonObjectEntry** objectHead) {
         return member;
 }
 
-static int
-ObjectNameCompare(const BonObjectEntry* a, const BonObjectEntry* b) {
-        int64_t diff = ((int64_t)(uint64_t)(a->name->hash) - (int64_t)(uint64_t)(b->name->hash));
-        if (diff < 0) return -1;
-        if (diff > 0) return 1;
-        return 0;
+/* Fewer keys than this are insertion sorted */
+#define BON_RADIX_SORT_MIN_COUNT        64
+
+/* A key of the list based parser takes a key, a scratch key and an item pointer */
+#define BON_SORT_KEY_BYTES              (2 * sizeof(uint64_t) + sizeof(void*))
+
+/* 
+ * Sort keys (hash << 32 | index) by hash and keep the order of equal hashes: an LSD radix sort on the
+ * four bytes of the hash, without the passes for bytes that all keys share. scratch has room for count
+ * keys. Return keys or scratch, whichever holds the result.
+ */
+static uint64_t*
+RadixSortKeys(uint64_t* keys, uint64_t* scratch, size_t count) {
+        size_t                  buckets[4][256];
+        size_t                  i, k;
+        int                     pass;
+
+        if (count < BON_RADIX_SORT_MIN_COUNT) {
+                for (i = 1; i < count; ++i) {
+                        const uint64_t key = keys[i];
+                        for (k = i; k > 0 && (keys[k - 1] >> 32) > (key >> 32); --k) {
+                                keys[k] = keys[k - 1];
+                        }
+                        keys[k] = key;
+                }
+                return keys;
+        }
+
+        memset(buckets, 0, sizeof(buckets));
+        for (i = 0; i < count; ++i) {
+                const uint32_t hash = (uint32_t)(keys[i] >> 32);
+                ++buckets[0][hash & 0xff];
+                ++buckets[1][(hash >> 8) & 0xff];
+                ++buckets[2][(hash >> 16) & 0xff];
+                ++buckets[3][hash >> 24];
+        }
+        for (pass = 0; pass < 4; ++pass) {
+                const int       shift   = 32 + 8 * pass;
+                size_t*         bucket  = buckets[pass];
+                size_t          offset  = 0;
+                uint64_t*       swap;
+
+                if (bucket[(keys[0] >> shift) & 0xff] == count) {
+                        continue;
+                }
+                for (i = 0; i < 256; ++i) {
+                        const size_t n = bucket[i];
+                        bucket[i] = offset;
+                        offset += n;
+                }
+                for (i = 0; i < count; ++i) {
+                        const uint64_t key = keys[i];
+                        scratch[bucket[(key >> shift) & 0xff]++] = key;
+                }
+                swap    = keys;
+                keys    = scratch;
+                scratch = swap;
+        }
+        return keys;
+}
+
+/* Make room for count keys, with their scratch and items, in the sort scratch of the list based parser */
+static void
+ReserveSortKeys(BonParsedJson* pj, size_t count) {
+        size_t                  capacity        = pj->sortKeyCapacity ? pj->sortKeyCapacity : 256;
+
+        if ((uint64_t)count > 0xffffffffull) {
+                GiveUp(pj->env, BON_STATUS_RECORD_TOO_LARGE);                  /* The index is the low half of a key */
+        }
+        if (count <= pj->sortKeyCapacity) {
+                return;
+        }
+        while (capacity < count) {
+                capacity *= 2;
+        }
+        TapeFree(pj, pj->sortKeys, pj->sortKeyCapacity * BON_SORT_KEY_BYTES);
+        pj->sortKeys            = (uint64_t*)TapeAlloc(pj, capacity * BON_SORT_KEY_BYTES);
+        pj->sortKeyCapacity     = capacity;
+}
+
+static void
+ReleaseSortKeys(BonParsedJson* pj) {
+        TapeFree(pj, pj->sortKeys, pj->sortKeyCapacity * BON_SORT_KEY_BYTES);
+        pj->sortKeys            = 0;
+        pj->sortKeyCapacity     = 0;
+}
+
+static void*
+SortKeyItems(BonParsedJson* pj) {
+        return pj->sortKeys + 2 * pj->sortKeyCapacity;
+}
+
+/* 
+ * Sort the members by name into canonical form. The list has the last member first. Members with the 
+ * same name stay in the order of the text, which is also the order of the tape engine.
+ */
+static void
+SortObjectMembers(BonParsedJson* pj, BonObjectHead* objectHead, size_t memberCount) {
+        BonObjectEntry**        members;
+        BonObjectEntry*         member;
+        const uint64_t*         keys;
+        size_t                  i;
+
+        ReserveSortKeys(pj, memberCount);
+        members = (BonObjectEntry**)SortKeyItems(pj);
+        for (member = objectHead->memberList, i = memberCount; member; member = member->next) {
+                --i;
+                members[i]      = member;
+                pj->sortKeys[i] = ((uint64_t)member->name->hash << 32) | (uint64_t)i;
+        }
+        keys = RadixSortKeys(pj->sortKeys, pj->sortKeys + pj->sortKeyCapacity, memberCount);
+        objectHead->memberList = 0;
+        for (i = memberCount; i > 0; --i) {
+                member = members[(size_t)(keys[i - 1] & 0xffffffffu)];
+                BonPrependToList(&objectHead->memberList, member);
+        }
+}
+
+static size_t
+ObjectSize(size_t memberCount) {
+        size_t size = 8;                                                        /* Size of the object header */
+        size += memberCount * sizeof(BonValue);
+        size += BonRoundUp(memberCount, 2) * sizeof(BonName);                   /* Account for round up when odd number of members */
+        return size;
+}
+
+static size_t
+ArraySize(int elementType, size_t memberCount) {
+        size_t size = 8;                                                        /* Size of the array header */
+        if (elementType) {
+                size += BonRoundUp(memberCount * BonGetTypedArrayElementSize(elementType), 8);
+        } else {
+                size += memberCount * sizeof(BonValue);
+        }
+        return size;
+}
+
+static void
+SetObjectSize(BonObjectHead* objectHead, size_t memberCount) {
+        objectHead->size = ObjectSize(memberCount);
+        objectHead->memberCount = memberCount;
+}
+
+static void
+SetArraySize(BonArrayHead* arrayHead, size_t memberCount) {
+        arrayHead->size = ArraySize(arrayHead->elementType, memberCount);
 }
 
 static void
@@ -445,13 +1018,12 @@ ParseObject(BonParsedJson* pj, BonObjectHead* objectHead) {
         }
 
         /* Canonicalize */
-        BonSortList(&objectHead->memberList, BonObjectEntry, ObjectNameCompare);
+        if (memberCount > 1) {
+                SortObjectMembers(pj, objectHead, (size_t)memberCount);
+        }
 done:
         FailUnlessCharIs(pj, '}');
-        objectHead->size = 8;                                                   /* Size of the object header */
-        objectHead->size += memberCount * sizeof(BonValue);
-        objectHead->size += BonRoundUp(memberCount, 2) * sizeof(BonName);       /* Account for round up when odd number of members */
-        objectHead->memberCount = memberCount;
+        SetObjectSize(objectHead, memberCount);
 }
 
 static BonArrayEntry*
@@ -463,9 +1035,82 @@ AppendArrayMember(BonParsedJson* pj, BonArrayHead* arrayHead) {
         return member;
 }
 
+static BonBool
+IsIntegerInRange(double d, double minValue, double maxValue) {
+        if (d < minValue || d > maxValue || d != (double)(int32_t)d)
+                return BON_FALSE;
+        if (d == 0.0 && signbit(d))                                             /* -0.0 would come back as 0 */
+                return BON_FALSE;
+        return BON_TRUE;
+}
+
+/* Which BON_ET_* types all numbers seen so far fit in */
+typedef struct BonNumberFit {
+        BonBool                 fitsUint8;
+        BonBool                 fitsInt16;
+        BonBool                 fitsInt32;
+        BonBool                 fitsFloat32;
+        BonBool                 inFloat32Range;                                 /* Can be rounded to a float: the cast of a larger value is undefined */
+} BonNumberFit;
+
+static void
+InitNumberFit(BonNumberFit* fit) {
+        fit->fitsUint8          = BON_TRUE;
+        fit->fitsInt16          = BON_TRUE;
+        fit->fitsInt32          = BON_TRUE;
+        fit->fitsFloat32        = BON_TRUE;
+        fit->inFloat32Range     = BON_TRUE;
+}
+
+static void
+FitNumber(BonNumberFit* fit, double d) {
+        fit->fitsUint8          = fit->fitsUint8 && IsIntegerInRange(d, 0.0, 255.0);
+        fit->fitsInt16          = fit->fitsInt16 && IsIntegerInRange(d, -32768.0, 32767.0);
+        fit->fitsInt32          = fit->fitsInt32 && IsIntegerInRange(d, -2147483648.0, 2147483647.0);
+        fit->inFloat32Range     = fit->inFloat32Range && fabs(d) <= FLT_MAX;
+        fit->fitsFloat32        = fit->fitsFloat32 && fit->inFloat32Range && (double)(float)d == d;
+}
+
+/* Return the smallest BON_ET_* of the fit, or 0 if the array should stay an array of BonValues */
+static int
+SelectElementTypeForFit(const BonParsedJson* pj, const BonNumberFit* fit) {
+        if (fit->fitsUint8)     return BON_ET_UINT8;
+        if (fit->fitsInt16)     return BON_ET_INT16;
+        if (fit->fitsInt32)     return BON_ET_INT32;
+        if (fit->fitsFloat32 || (pj->options.typedArrays == BON_TYPED_ARRAYS_FLOAT32 && fit->inFloat32Range))
+                return BON_ET_FLOAT32;
+        return 0;
+}
+
+/* Return whether an array of numbers with memberCount values may be written as a typed array */
+static BonBool
+MayBeTypedArray(const BonParsedJson* pj, BonBool numbersOnly, size_t memberCount) {
+        return pj->options.typedArrays != BON_TYPED_ARRAYS_NEVER && numbersOnly && memberCount > 0
+                && (pj->options.typedArrayMinCount <= 0 || memberCount >= (size_t)pj->options.typedArrayMinCount);
+}
+
+/* Return the smallest BON_ET_* that can hold all values of the array, or 0 if it should stay an array of BonValues */
+static int
+SelectTypedArrayElementType(const BonParsedJson* pj, const BonArrayHead* arrayHead, int memberCount) {
+        const BonArrayEntry*    entry;
+        BonNumberFit            fit;
+
+        if (!MayBeTypedArray(pj, arrayHead->numbersOnly, (size_t)memberCount))
+                return 0;
+        if (pj->rootValue.type == BON_VT_ARRAY && pj->rootValue.value.arrayValue == arrayHead)
+                return 0;                                                       /* A root value is always an array or an object */
+
+        InitNumberFit(&fit);
+        for (entry = arrayHead->valueList; entry; entry = entry->next) {
+                FitNumber(&fit, entry->value.value.numberValue);
+        }
+        return SelectElementTypeForFit(pj, &fit);
+}
+
 static void
 ParseArray(BonParsedJson* pj, BonArrayHead* arrayHead) {
         int memberCount = 0;
+        arrayHead->numbersOnly = BON_TRUE;
         FailIfEof(pj);
         FailUnlessCharIs(pj, '[');
         SkipWhitespace(pj);
@@ -478,6 +1123,9 @@ ParseArray(BonParsedJson* pj, BonArrayHead* arrayHead) {
                 memberCount++;
 
                 ParseValue(pj, &member->value);
+                if (member->value.type != BON_VT_NUMBER) {
+                        arrayHead->numbersOnly = BON_FALSE;
+                }
                 SkipWhitespace(pj);
                 if (!PeekChar(pj, ','))
                         break;
@@ -486,8 +1134,8 @@ ParseArray(BonParsedJson* pj, BonArrayHead* arrayHead) {
         }
 done:
         FailUnlessCharIs(pj, ']');
-        arrayHead->size = 8;                                                    /* Size of the array header */
-        arrayHead->size += memberCount * sizeof(BonValue);
+        arrayHead->elementType = SelectTypedArrayElementType(pj, arrayHead, memberCount);
+        SetArraySize(arrayHead, memberCount);
 }
 
 static void
@@ -539,247 +1187,984 @@ ParseStringValue(BonParsedJson* pj, BonVariant* value) {
         BonPrependToList(&pj->valueStringList, value->value.stringValue);
 }
 
-/* Convert at most n characters starting from string to a double.
- * pend is the position of first non-double character.
- * If the conversion fails, then 0.0 is returned and *endPtr == string
- * This version does not allow initial whitespace.
- * 
- * Adapted from http://svn.ruby-lang.org/repos/ruby/branches/ruby_1_8/missing/strtod.c
- * 
- * Copyright (c) 1988-1993 The Regents of the University of California.
- * Copyright (c) 1994 Sun Microsystems, Inc.
+/*
+ * Numbers
  *
- * Permission to use, copy, modify, and distribute this
- * software and its documentation for any purpose and without
- * fee is hereby granted, provided that the above copyright
- * notice appear in all copies.  The University of California
- * makes no representations about the suitability of this
- * software for any purpose.  It is provided "as is" without
- * express or implied warranty.
+ * A number is scanned into at most 19 significant digits and a decimal exponent. Small exact values
+ * are converted with one floating point multiplication or division (Clinger's fast path), everything
+ * else with the Eisel-Lemire algorithm as in fast_float (https://github.com/fastfloat/fast_float): the
+ * digits are multiplied with a 128-bit truncated power of five, which is always enough to round correctly.
+ * Only numbers with more than 19 significant digits, where the dropped digits decide the rounding, go
+ * through strtod.
  */
-static int maxExponent = 511;                                                   /* Largest possible base 10 exponent.  Any
-                                                                                 * exponent larger than this will already
-                                                                                 * produce underflow or overflow, so there's
-                                                                                 * no need to worry about additional digits.
-                                                                                 */
-
-static double powersOf10[] = {                                                  /* Table giving binary powers of 10.  Entry */
-        10.,                                                                    /* is 10^2^i.  Used to convert decimal */
-        100.,                                                                   /* exponents into floating-point numbers. */
-        1.0e4,
-        1.0e8,
-        1.0e16,
-        1.0e32,
-        1.0e64,
-        1.0e128,
-        1.0e256
+
+typedef struct BonDecimalNumber {
+        uint64_t                mantissa;                                       /* The first 19 significant digits */
+        int64_t                 exponent;                                       /* Value is mantissa * 10^exponent */
+        BonBool                 negative;
+        BonBool                 truncated;                                      /* Nonzero digits were dropped after the first 19 */
+} BonDecimalNumber;
+
+#define BON_MAX_MANTISSA_DIGITS         19
+#define BON_SMALLEST_POWER_OF_TEN       (-342)                                  /* Smaller powers always round to zero */
+#define BON_LARGEST_POWER_OF_TEN        308                                     /* Larger powers always round to infinity */
+
+/* 5^q for q in [-342, 308], normalized to 128 bits: high 64 bits, low 64 bits. Negative powers are rounded up. */
+static const uint64_t s_powersOfFive128[2 * (BON_LARGEST_POWER_OF_TEN - BON_SMALLEST_POWER_OF_TEN + 1)] = {
+        0xeef453d6923bd65aull, 0x113faa2906a13b3full,       /* 5^-342 */
+        0x9558b4661b6565f8ull, 0x4ac7ca59a424c507ull,       /* 5^-341 */
+        0xbaaee17fa23ebf76ull, 0x5d79bcf00d2df649ull,       /* 5^-340 */
+        0xe95a99df8ace6f53ull, 0xf4d82c2c107973dcull,       /* 5^-339 */
+        0x91d8a02bb6c10594ull, 0x79071b9b8a4be869ull,       /* 5^-338 */
+        0xb64ec836a47146f9ull, 0x9748e2826cdee284ull,       /* 5^-337 */
+        0xe3e27a444d8d98b7ull, 0xfd1b1b2308169b25ull,       /* 5^-336 */
+        0x8e6d8c6ab0787f72ull, 0xfe30f0f5e50e20f7ull,       /* 5^-335 */
+        0xb208ef855c969f4full, 0xbdbd2d335e51a935ull,       /* 5^-334 */
+        0xde8b2b66b3bc4723ull, 0xad2c788035e61382ull,       /* 5^-333 */
+        0x8b16fb203055ac76ull, 0x4c3bcb5021afcc31ull,       /* 5^-332 */
+        0xaddcb9e83c6b1793ull, 0xdf4abe242a1bbf3dull,       /* 5^-331 */
+        0xd953e8624b85dd78ull, 0xd71d6dad34a2af0dull,       /* 5^-330 */
+        0x87d4713d6f33aa6bull, 0x8672648c40e5ad68ull,       /* 5^-329 */
+        0xa9c98d8ccb009506ull, 0x680efdaf511f18c2ull,       /* 5^-328 */
+        0xd43bf0effdc0ba48ull, 0x0212bd1b2566def2ull,       /* 5^-327 */
+        0x84a57695fe98746dull, 0x014bb630f7604b57ull,       /* 5^-326 */
+        0xa5ced43b7e3e9188ull, 0x419ea3bd35385e2dull,       /* 5^-325 */
+        0xcf42894a5dce35eaull, 0x52064cac828675b9ull,       /* 5^-324 */
+        0x818995ce7aa0e1b2ull, 0x7343efebd1940993ull,       /* 5^-323 */
+        0xa1ebfb4219491a1full, 0x1014ebe6c5f90bf8ull,       /* 5^-322 */
+        0xca66fa129f9b60a6ull, 0xd41a26e077774ef6ull,       /* 5^-321 */
+        0xfd00b897478238d0ull, 0x8920b098955522b4ull,       /* 5^-320 */
+        0x9e20735e8cb16382ull, 0x55b46e5f5d5535b0ull,       /* 5^-319 */
+        0xc5a890362fddbc62ull, 0xeb2189f734aa831dull,       /* 5^-318 */
+        0xf712b443bbd52b7bull, 0xa5e9ec7501d523e4ull,       /* 5^-317 */
+        0x9a6bb0aa55653b2dull, 0x47b233c92125366eull,       /* 5^-316 */
+        0xc1069cd4eabe89f8ull, 0x999ec0bb696e840aull,       /* 5^-315 */
+        0xf148440a256e2c76ull, 0xc00670ea43ca250dull,       /* 5^-314 */
+        0x96cd2a865764dbcaull, 0x380406926a5e5728ull,       /* 5^-313 */
+        0xbc807527ed3e12bcull, 0xc605083704f5ecf2ull,       /* 5^-312 */
+        0xeba09271e88d976bull, 0xf7864a44c633682eull,       /* 5^-311 */
+        0x93445b8731587ea3ull, 0x7ab3ee6afbe0211dull,       /* 5^-310 */
+        0xb8157268fdae9e4cull, 0x5960ea05bad82964ull,       /* 5^-309 */
+        0xe61acf033d1a45dfull, 0x6fb92487298e33bdull,       /* 5^-308 */
+        0x8fd0c16206306babull, 0xa5d3b6d479f8e056ull,       /* 5^-307 */
+        0xb3c4f1ba87bc8696ull, 0x8f48a4899877186cull,       /* 5^-306 */
+        0xe0b62e2929aba83cull, 0x331acdabfe94de87ull,       /* 5^-305 */
+        0x8c71dcd9ba0b4925ull, 0x9ff0c08b7f1d0b14ull,       /* 5^-304 */
+        0xaf8e5410288e1b6full, 0x07ecf0ae5ee44dd9ull,       /* 5^-303 */
+        0xdb71e91432b1a24aull, 0xc9e82cd9f69d6150ull,       /* 5^-302 */
+        0x892731ac9faf056eull, 0xbe311c083a225cd2ull,       /* 5^-301 */
+        0xab70fe17c79ac6caull, 0x6dbd630a48aaf406ull,       /* 5^-300 */
+        0xd64d3d9db981787dull, 0x092cbbccdad5b108ull,       /* 5^-299 */
+        0x85f0468293f0eb4eull, 0x25bbf56008c58ea5ull,       /* 5^-298 */
+        0xa76c582338ed2621ull, 0xaf2af2b80af6f24eull,       /* 5^-297 */
+        0xd1476e2c07286faaull, 0x1af5af660db4aee1ull,       /* 5^-296 */
+        0x82cca4db847945caull, 0x50d98d9fc890ed4dull,       /* 5^-295 */
+        0xa37fce126597973cull, 0xe50ff107bab528a0ull,       /* 5^-294 */
+        0xcc5fc196fefd7d0cull, 0x1e53ed49a96272c8ull,       /* 5^-293 */
+        0xff77b1fcbebcdc4full, 0x25e8e89c13bb0f7aull,       /* 5^-292 */
+        0x9faacf3df73609b1ull, 0x77b191618c54e9acull,       /* 5^-291 */
+        0xc795830d75038c1dull, 0xd59df5b9ef6a2417ull,       /* 5^-290 */
+        0xf97ae3d0d2446f25ull, 0x4b0573286b44ad1dull,       /* 5^-289 */
+        0x9becce62836ac577ull, 0x4ee367f9430aec32ull,       /* 5^-288 */
+        0xc2e801fb244576d5ull, 0x229c41f793cda73full,       /* 5^-287 */
+        0xf3a20279ed56d48aull, 0x6b43527578c1110full,       /* 5^-286 */
+        0x9845418c345644d6ull, 0x830a13896b78aaa9ull,       /* 5^-285 */
+        0xbe5691ef416bd60cull, 0x23cc986bc656d553ull,       /* 5^-284 */
+        0xedec366b11c6cb8full, 0x2cbfbe86b7ec8aa8ull,       /* 5^-283 */
+        0x94b3a202eb1c3f39ull, 0x7bf7d71432f3d6a9ull,       /* 5^-282 */
+        0xb9e08a83a5e34f07ull, 0xdaf5ccd93fb0cc53ull,       /* 5^-281 */
+        0xe858ad248f5c22c9ull, 0xd1b3400f8f9cff68ull,       /* 5^-280 */
+        0x91376c36d99995beull, 0x23100809b9c21fa1ull,       /* 5^-279 */
+        0xb58547448ffffb2dull, 0xabd40a0c2832a78aull,       /* 5^-278 */
+        0xe2e69915b3fff9f9ull, 0x16c90c8f323f516cull,       /* 5^-277 */
+        0x8dd01fad907ffc3bull, 0xae3da7d97f6792e3ull,       /* 5^-276 */
+        0xb1442798f49ffb4aull, 0x99cd11cfdf41779cull,       /* 5^-275 */
+        0xdd95317f31c7fa1dull, 0x40405643d711d583ull,       /* 5^-274 */
+        0x8a7d3eef7f1cfc52ull, 0x482835ea666b2572ull,       /* 5^-273 */
+        0xad1c8eab5ee43b66ull, 0xda3243650005eecfull,       /* 5^-272 */
+        0xd863b256369d4a40ull, 0x90bed43e40076a82ull,       /* 5^-271 */
+        0x873e4f75e2224e68ull, 0x5a7744a6e804a291ull,       /* 5^-270 */
+        0xa90de3535aaae202ull, 0x711515d0a205cb36ull,       /* 5^-269 */
+        0xd3515c2831559a83ull, 0x0d5a5b44ca873e03ull,       /* 5^-268 */
+        0x8412d9991ed58091ull, 0xe858790afe9486c2ull,       /* 5^-267 */
+        0xa5178fff668ae0b6ull, 0x626e974dbe39a872ull,       /* 5^-266 */
+        0xce5d73ff402d98e3ull, 0xfb0a3d212dc8128full,       /* 5^-265 */
+        0x80fa687f881c7f8eull, 0x7ce66634bc9d0b99ull,       /* 5^-264 */
+        0xa139029f6a239f72ull, 0x1c1fffc1ebc44e80ull,       /* 5^-263 */
+        0xc987434744ac874eull, 0xa327ffb266b56220ull,       /* 5^-262 */
+        0xfbe9141915d7a922ull, 0x4bf1ff9f0062baa8ull,       /* 5^-261 */
+        0x9d71ac8fada6c9b5ull, 0x6f773fc3603db4a9ull,       /* 5^-260 */
+        0xc4ce17b399107c22ull, 0xcb550fb4384d21d3ull,       /* 5^-259 */
+        0xf6019da07f549b2bull, 0x7e2a53a146606a48ull,       /* 5^-258 */
+        0x99c102844f94e0fbull, 0x2eda7444cbfc426dull,       /* 5^-257 */
+        0xc0314325637a1939ull, 0xfa911155fefb5308ull,       /* 5^-256 */
+        0xf03d93eebc589f88ull, 0x793555ab7eba27caull,       /* 5^-255 */
+        0x96267c7535b763b5ull, 0x4bc1558b2f3458deull,       /* 5^-254 */
+        0xbbb01b9283253ca2ull, 0x9eb1aaedfb016f16ull,       /* 5^-253 */
+        0xea9c227723ee8bcbull, 0x465e15a979c1cadcull,       /* 5^-252 */
+        0x92a1958a7675175full, 0x0bfacd89ec191ec9ull,       /* 5^-251 */
+        0xb749faed14125d36ull, 0xcef980ec671f667bull,       /* 5^-250 */
+        0xe51c79a85916f484ull, 0x82b7e12780e7401aull,       /* 5^-249 */
+        0x8f31cc0937ae58d2ull, 0xd1b2ecb8b0908810ull,       /* 5^-248 */
+        0xb2fe3f0b8599ef07ull, 0x861fa7e6dcb4aa15ull,       /* 5^-247 */
+        0xdfbdcece67006ac9ull, 0x67a791e093e1d49aull,       /* 5^-246 */
+        0x8bd6a141006042bdull, 0xe0c8bb2c5c6d24e0ull,       /* 5^-245 */
+        0xaecc49914078536dull, 0x58fae9f773886e18ull,       /* 5^-244 */
+        0xda7f5bf590966848ull, 0xaf39a475506a899eull,       /* 5^-243 */
+        0x888f99797a5e012dull, 0x6d8406c952429603ull,       /* 5^-242 */
+        0xaab37fd7d8f58178ull, 0xc8e5087ba6d33b83ull,       /* 5^-241 */
+        0xd5605fcdcf32e1d6ull, 0xfb1e4a9a90880a64ull,       /* 5^-240 */
+        0x855c3be0a17fcd26ull, 0x5cf2eea09a55067full,       /* 5^-239 */
+        0xa6b34ad8c9dfc06full, 0xf42faa48c0ea481eull,       /* 5^-238 */
+        0xd0601d8efc57b08bull, 0xf13b94daf124da26ull,       /* 5^-237 */
+        0x823c12795db6ce57ull, 0x76c53d08d6b70858ull,       /* 5^-236 */
+        0xa2cb1717b52481edull, 0x54768c4b0c64ca6eull,       /* 5^-235 */
+        0xcb7ddcdda26da268ull, 0xa9942f5dcf7dfd09ull,       /* 5^-234 */
+        0xfe5d54150b090b02ull, 0xd3f93b35435d7c4cull,       /* 5^-233 */
+        0x9efa548d26e5a6e1ull, 0xc47bc5014a1a6dafull,       /* 5^-232 */
+        0xc6b8e9b0709f109aull, 0x359ab6419ca1091bull,       /* 5^-231 */
+        0xf867241c8cc6d4c0ull, 0xc30163d203c94b62ull,       /* 5^-230 */
+        0x9b407691d7fc44f8ull, 0x79e0de63425dcf1dull,       /* 5^-229 */
+        0xc21094364dfb5636ull, 0x985915fc12f542e4ull,       /* 5^-228 */
+        0xf294b943e17a2bc4ull, 0x3e6f5b7b17b2939dull,       /* 5^-227 */
+        0x979cf3ca6cec5b5aull, 0xa705992ceecf9c42ull,       /* 5^-226 */
+        0xbd8430bd08277231ull, 0x50c6ff782a838353ull,       /* 5^-225 */
+        0xece53cec4a314ebdull, 0xa4f8bf5635246428ull,       /* 5^-224 */
+        0x940f4613ae5ed136ull, 0x871b7795e136be99ull,       /* 5^-223 */
+        0xb913179899f68584ull, 0x28e2557b59846e3full,       /* 5^-222 */
+        0xe757dd7ec07426e5ull, 0x331aeada2fe589cfull,       /* 5^-221 */
+        0x9096ea6f3848984full, 0x3ff0d2c85def7621ull,       /* 5^-220 */
+        0xb4bca50b065abe63ull, 0x0fed077a756b53a9ull,       /* 5^-219 */
+        0xe1ebce4dc7f16dfbull, 0xd3e8495912c62894ull,       /* 5^-218 */
+        0x8d3360f09cf6e4bdull, 0x64712dd7abbbd95cull,       /* 5^-217 */
+        0xb080392cc4349decull, 0xbd8d794d96aacfb3ull,       /* 5^-216 */
+        0xdca04777f541c567ull, 0xecf0d7a0fc5583a0ull,       /* 5^-215 */
+        0x89e42caaf9491b60ull, 0xf41686c49db57244ull,       /* 5^-214 */
+        0xac5d37d5b79b6239ull, 0x311c2875c522ced5ull,       /* 5^-213 */
+        0xd77485cb25823ac7ull, 0x7d633293366b828bull,       /* 5^-212 */
+        0x86a8d39ef77164bcull, 0xae5dff9c02033197ull,       /* 5^-211 */
+        0xa8530886b54dbdebull, 0xd9f57f830283fdfcull,       /* 5^-210 */
+        0xd267caa862a12d66ull, 0xd072df63c324fd7bull,       /* 5^-209 */
+        0x8380dea93da4bc60ull, 0x4247cb9e59f71e6dull,       /* 5^-208 */
+        0xa46116538d0deb78ull, 0x52d9be85f074e608ull,       /* 5^-207 */
+        0xcd795be870516656ull, 0x67902e276c921f8bull,       /* 5^-206 */
+        0x806bd9714632dff6ull, 0x00ba1cd8a3db53b6ull,       /* 5^-205 */
+        0xa086cfcd97bf97f3ull, 0x80e8a40eccd228a4ull,       /* 5^-204 */
+        0xc8a883c0fdaf7df0ull, 0x6122cd128006b2cdull,       /* 5^-203 */
+        0xfad2a4b13d1b5d6cull, 0x796b805720085f81ull,       /* 5^-202 */
+        0x9cc3a6eec6311a63ull, 0xcbe3303674053bb0ull,       /* 5^-201 */
+        0xc3f490aa77bd60fcull, 0xbedbfc4411068a9cull,       /* 5^-200 */
+        0xf4f1b4d515acb93bull, 0xee92fb5515482d44ull,       /* 5^-199 */
+        0x991711052d8bf3c5ull, 0x751bdd152d4d1c4aull,       /* 5^-198 */
+        0xbf5cd54678eef0b6ull, 0xd262d45a78a0635dull,       /* 5^-197 */
+        0xef340a98172aace4ull, 0x86fb897116c87c34ull,       /* 5^-196 */
+        0x9580869f0e7aac0eull, 0xd45d35e6ae3d4da0ull,       /* 5^-195 */
+        0xbae0a846d2195712ull, 0x8974836059cca109ull,       /* 5^-194 */
+        0xe998d258869facd7ull, 0x2bd1a438703fc94bull,       /* 5^-193 */
+        0x91ff83775423cc06ull, 0x7b6306a34627ddcfull,       /* 5^-192 */
+        0xb67f6455292cbf08ull, 0x1a3bc84c17b1d542ull,       /* 5^-191 */
+        0xe41f3d6a7377eecaull, 0x20caba5f1d9e4a93ull,       /* 5^-190 */
+        0x8e938662882af53eull, 0x547eb47b7282ee9cull,       /* 5^-189 */
+        0xb23867fb2a35b28dull, 0xe99e619a4f23aa43ull,       /* 5^-188 */
+        0xdec681f9f4c31f31ull, 0x6405fa00e2ec94d4ull,       /* 5^-187 */
+        0x8b3c113c38f9f37eull, 0xde83bc408dd3dd04ull,       /* 5^-186 */
+        0xae0b158b4738705eull, 0x9624ab50b148d445ull,       /* 5^-185 */
+        0xd98ddaee19068c76ull, 0x3badd624dd9b0957ull,       /* 5^-184 */
+        0x87f8a8d4cfa417c9ull, 0xe54ca5d70a80e5d6ull,       /* 5^-183 */
+        0xa9f6d30a038d1dbcull, 0x5e9fcf4ccd211f4cull,       /* 5^-182 */
+        0xd47487cc8470652bull, 0x7647c3200069671full,       /* 5^-181 */
+        0x84c8d4dfd2c63f3bull, 0x29ecd9f40041e073ull,       /* 5^-180 */
+        0xa5fb0a17c777cf09ull, 0xf468107100525890ull,       /* 5^-179 */
+        0xcf79cc9db955c2ccull, 0x7182148d4066eeb4ull,       /* 5^-178 */
+        0x81ac1fe293d599bfull, 0xc6f14cd848405530ull,       /* 5^-177 */
+        0xa21727db38cb002full, 0xb8ada00e5a506a7cull,       /* 5^-176 */
+        0xca9cf1d206fdc03bull, 0xa6d90811f0e4851cull,       /* 5^-175 */
+        0xfd442e4688bd304aull, 0x908f4a166d1da663ull,       /* 5^-174 */
+        0x9e4a9cec15763e2eull, 0x9a598e4e043287feull,       /* 5^-173 */
+        0xc5dd44271ad3cdbaull, 0x40eff1e1853f29fdull,       /* 5^-172 */
+        0xf7549530e188c128ull, 0xd12bee59e68ef47cull,       /* 5^-171 */
+        0x9a94dd3e8cf578b9ull, 0x82bb74f8301958ceull,       /* 5^-170 */
+        0xc13a148e3032d6e7ull, 0xe36a52363c1faf01ull,       /* 5^-169 */
+        0xf18899b1bc3f8ca1ull, 0xdc44e6c3cb279ac1ull,       /* 5^-168 */
+        0x96f5600f15a7b7e5ull, 0x29ab103a5ef8c0b9ull,       /* 5^-167 */
+        0xbcb2b812db11a5deull, 0x7415d448f6b6f0e7ull,       /* 5^-166 */
+        0xebdf661791d60f56ull, 0x111b495b3464ad21ull,       /* 5^-165 */
+        0x936b9fcebb25c995ull, 0xcab10dd900beec34ull,       /* 5^-164 */
+        0xb84687c269ef3bfbull, 0x3d5d514f40eea742ull,       /* 5^-163 */
+        0xe65829b3046b0afaull, 0x0cb4a5a3112a5112ull,       /* 5^-162 */
+        0x8ff71a0fe2c2e6dcull, 0x47f0e785eaba72abull,       /* 5^-161 */
+        0xb3f4e093db73a093ull, 0x59ed216765690f56ull,       /* 5^-160 */
+        0xe0f218b8d25088b8ull, 0x306869c13ec3532cull,       /* 5^-159 */
+        0x8c974f7383725573ull, 0x1e414218c73a13fbull,       /* 5^-158 */
+        0xafbd2350644eeacfull, 0xe5d1929ef90898faull,       /* 5^-157 */
+        0xdbac6c247d62a583ull, 0xdf45f746b74abf39ull,       /* 5^-156 */
+        0x894bc396ce5da772ull, 0x6b8bba8c328eb783ull,       /* 5^-155 */
+        0xab9eb47c81f5114full, 0x066ea92f3f326564ull,       /* 5^-154 */
+        0xd686619ba27255a2ull, 0xc80a537b0efefebdull,       /* 5^-153 */
+        0x8613fd0145877585ull, 0xbd06742ce95f5f36ull,       /* 5^-152 */
+        0xa798fc4196e952e7ull, 0x2c48113823b73704ull,       /* 5^-151 */
+        0xd17f3b51fca3a7a0ull, 0xf75a15862ca504c5ull,       /* 5^-150 */
+        0x82ef85133de648c4ull, 0x9a984d73dbe722fbull,       /* 5^-149 */
+        0xa3ab66580d5fdaf5ull, 0xc13e60d0d2e0ebbaull,       /* 5^-148 */
+        0xcc963fee10b7d1b3ull, 0x318df905079926a8ull,       /* 5^-147 */
+        0xffbbcfe994e5c61full, 0xfdf17746497f7052ull,       /* 5^-146 */
+        0x9fd561f1fd0f9bd3ull, 0xfeb6ea8bedefa633ull,       /* 5^-145 */
+        0xc7caba6e7c5382c8ull, 0xfe64a52ee96b8fc0ull,       /* 5^-144 */
+        0xf9bd690a1b68637bull, 0x3dfdce7aa3c673b0ull,       /* 5^-143 */
+        0x9c1661a651213e2dull, 0x06bea10ca65c084eull,       /* 5^-142 */
+        0xc31bfa0fe5698db8ull, 0x486e494fcff30a62ull,       /* 5^-141 */
+        0xf3e2f893dec3f126ull, 0x5a89dba3c3efccfaull,       /* 5^-140 */
+        0x986ddb5c6b3a76b7ull, 0xf89629465a75e01cull,       /* 5^-139 */
+        0xbe89523386091465ull, 0xf6bbb397f1135823ull,       /* 5^-138 */
+        0xee2ba6c0678b597full, 0x746aa07ded582e2cull,       /* 5^-137 */
+        0x94db483840b717efull, 0xa8c2a44eb4571cdcull,       /* 5^-136 */
+        0xba121a4650e4ddebull, 0x92f34d62616ce413ull,       /* 5^-135 */
+        0xe896a0d7e51e1566ull, 0x77b020baf9c81d17ull,       /* 5^-134 */
+        0x915e2486ef32cd60ull, 0x0ace1474dc1d122eull,       /* 5^-133 */
+        0xb5b5ada8aaff80b8ull, 0x0d819992132456baull,       /* 5^-132 */
+        0xe3231912d5bf60e6ull, 0x10e1fff697ed6c69ull,       /* 5^-131 */
+        0x8df5efabc5979c8full, 0xca8d3ffa1ef463c1ull,       /* 5^-130 */
+        0xb1736b96b6fd83b3ull, 0xbd308ff8a6b17cb2ull,       /* 5^-129 */
+        0xddd0467c64bce4a0ull, 0xac7cb3f6d05ddbdeull,       /* 5^-128 */
+        0x8aa22c0dbef60ee4ull, 0x6bcdf07a423aa96bull,       /* 5^-127 */
+        0xad4ab7112eb3929dull, 0x86c16c98d2c953c6ull,       /* 5^-126 */
+        0xd89d64d57a607744ull, 0xe871c7bf077ba8b7ull,       /* 5^-125 */
+        0x87625f056c7c4a8bull, 0x11471cd764ad4972ull,       /* 5^-124 */
+        0xa93af6c6c79b5d2dull, 0xd598e40d3dd89bcfull,       /* 5^-123 */
+        0xd389b47879823479ull, 0x4aff1d108d4ec2c3ull,       /* 5^-122 */
+        0x843610cb4bf160cbull, 0xcedf722a585139baull,       /* 5^-121 */
+        0xa54394fe1eedb8feull, 0xc2974eb4ee658828ull,       /* 5^-120 */
+        0xce947a3da6a9273eull, 0x733d226229feea32ull,       /* 5^-119 */
+        0x811ccc668829b887ull, 0x0806357d5a3f525full,       /* 5^-118 */
+        0xa163ff802a3426a8ull, 0xca07c2dcb0cf26f7ull,       /* 5^-117 */
+        0xc9bcff6034c13052ull, 0xfc89b393dd02f0b5ull,       /* 5^-116 */
+        0xfc2c3f3841f17c67ull, 0xbbac2078d443ace2ull,       /* 5^-115 */
+        0x9d9ba7832936edc0ull, 0xd54b944b84aa4c0dull,       /* 5^-114 */
+        0xc5029163f384a931ull, 0x0a9e795e65d4df11ull,       /* 5^-113 */
+        0xf64335bcf065d37dull, 0x4d4617b5ff4a16d5ull,       /* 5^-112 */
+        0x99ea0196163fa42eull, 0x504bced1bf8e4e45ull,       /* 5^-111 */
+        0xc06481fb9bcf8d39ull, 0xe45ec2862f71e1d6ull,       /* 5^-110 */
+        0xf07da27a82c37088ull, 0x5d767327bb4e5a4cull,       /* 5^-109 */
+        0x964e858c91ba2655ull, 0x3a6a07f8d510f86full,       /* 5^-108 */
+        0xbbe226efb628afeaull, 0x890489f70a55368bull,       /* 5^-107 */
+        0xeadab0aba3b2dbe5ull, 0x2b45ac74ccea842eull,       /* 5^-106 */
+        0x92c8ae6b464fc96full, 0x3b0b8bc90012929dull,       /* 5^-105 */
+        0xb77ada0617e3bbcbull, 0x09ce6ebb40173744ull,       /* 5^-104 */
+        0xe55990879ddcaabdull, 0xcc420a6a101d0515ull,       /* 5^-103 */
+        0x8f57fa54c2a9eab6ull, 0x9fa946824a12232dull,       /* 5^-102 */
+        0xb32df8e9f3546564ull, 0x47939822dc96abf9ull,       /* 5^-101 */
+        0xdff9772470297ebdull, 0x59787e2b93bc56f7ull,       /* 5^-100 */
+        0x8bfbea76c619ef36ull, 0x57eb4edb3c55b65aull,       /* 5^-99 */
+        0xaefae51477a06b03ull, 0xede622920b6b23f1ull,       /* 5^-98 */
+        0xdab99e59958885c4ull, 0xe95fab368e45ecedull,       /* 5^-97 */
+        0x88b402f7fd75539bull, 0x11dbcb0218ebb414ull,       /* 5^-96 */
+        0xaae103b5fcd2a881ull, 0xd652bdc29f26a119ull,       /* 5^-95 */
+        0xd59944a37c0752a2ull, 0x4be76d3346f0495full,       /* 5^-94 */
+        0x857fcae62d8493a5ull, 0x6f70a4400c562ddbull,       /* 5^-93 */
+        0xa6dfbd9fb8e5b88eull, 0xcb4ccd500f6bb952ull,       /* 5^-92 */
+        0xd097ad07a71f26b2ull, 0x7e2000a41346a7a7ull,       /* 5^-91 */
+        0x825ecc24c873782full, 0x8ed400668c0c28c8ull,       /* 5^-90 */
+        0xa2f67f2dfa90563bull, 0x728900802f0f32faull,       /* 5^-89 */
+        0xcbb41ef979346bcaull, 0x4f2b40a03ad2ffb9ull,       /* 5^-88 */
+        0xfea126b7d78186bcull, 0xe2f610c84987bfa8ull,       /* 5^-87 */
+        0x9f24b832e6b0f436ull, 0x0dd9ca7d2df4d7c9ull,       /* 5^-86 */
+        0xc6ede63fa05d3143ull, 0x91503d1c79720dbbull,       /* 5^-85 */
+        0xf8a95fcf88747d94ull, 0x75a44c6397ce912aull,       /* 5^-84 */
+        0x9b69dbe1b548ce7cull, 0xc986afbe3ee11abaull,       /* 5^-83 */
+        0xc24452da229b021bull, 0xfbe85badce996168ull,       /* 5^-82 */
+        0xf2d56790ab41c2a2ull, 0xfae27299423fb9c3ull,       /* 5^-81 */
+        0x97c560ba6b0919a5ull, 0xdccd879fc967d41aull,       /* 5^-80 */
+        0xbdb6b8e905cb600full, 0x5400e987bbc1c920ull,       /* 5^-79 */
+        0xed246723473e3813ull, 0x290123e9aab23b68ull,       /* 5^-78 */
+        0x9436c0760c86e30bull, 0xf9a0b6720aaf6521ull,       /* 5^-77 */
+        0xb94470938fa89bceull, 0xf808e40e8d5b3e69ull,       /* 5^-76 */
+        0xe7958cb87392c2c2ull, 0xb60b1d1230b20e04ull,       /* 5^-75 */
+        0x90bd77f3483bb9b9ull, 0xb1c6f22b5e6f48c2ull,       /* 5^-74 */
+        0xb4ecd5f01a4aa828ull, 0x1e38aeb6360b1af3ull,       /* 5^-73 */
+        0xe2280b6c20dd5232ull, 0x25c6da63c38de1b0ull,       /* 5^-72 */
+        0x8d590723948a535full, 0x579c487e5a38ad0eull,       /* 5^-71 */
+        0xb0af48ec79ace837ull, 0x2d835a9df0c6d851ull,       /* 5^-70 */
+        0xdcdb1b2798182244ull, 0xf8e431456cf88e65ull,       /* 5^-69 */
+        0x8a08f0f8bf0f156bull, 0x1b8e9ecb641b58ffull,       /* 5^-68 */
+        0xac8b2d36eed2dac5ull, 0xe272467e3d222f3full,       /* 5^-67 */
+        0xd7adf884aa879177ull, 0x5b0ed81dcc6abb0full,       /* 5^-66 */
+        0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull,       /* 5^-65 */
+        0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull,       /* 5^-64 */
+        0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull,       /* 5^-63 */
+        0x83a3eeeef9153e89ull, 0x1953cf68300424acull,       /* 5^-62 */
+        0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull,       /* 5^-61 */
+        0xcdb02555653131b6ull, 0x3792f412cb06794dull,       /* 5^-60 */
+        0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull,       /* 5^-59 */
+        0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull,       /* 5^-58 */
+        0xc8de047564d20a8bull, 0xf245825a5a445275ull,       /* 5^-57 */
+        0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull,       /* 5^-56 */
+        0x9ced737bb6c4183dull, 0x55464dd69685606bull,       /* 5^-55 */
+        0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull,       /* 5^-54 */
+        0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull,       /* 5^-53 */
+        0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull,       /* 5^-52 */
+        0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull,       /* 5^-51 */
+        0xef73d256a5c0f77cull, 0x963e66858f6d4440ull,       /* 5^-50 */
+        0x95a8637627989aadull, 0xdde7001379a44aa8ull,       /* 5^-49 */
+        0xbb127c53b17ec159ull, 0x5560c018580d5d52ull,       /* 5^-48 */
+        0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull,       /* 5^-47 */
+        0x9226712162ab070dull, 0xcab3961304ca70e8ull,       /* 5^-46 */
+        0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull,       /* 5^-45 */
+        0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull,       /* 5^-44 */
+        0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull,       /* 5^-43 */
+        0xb267ed1940f1c61cull, 0x55f038b237591ed3ull,       /* 5^-42 */
+        0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull,       /* 5^-41 */
+        0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull,       /* 5^-40 */
+        0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull,       /* 5^-39 */
+        0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull,       /* 5^-38 */
+        0x881cea14545c7575ull, 0x7e50d64177da2e54ull,       /* 5^-37 */
+        0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull,       /* 5^-36 */
+        0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull,       /* 5^-35 */
+        0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull,       /* 5^-34 */
+        0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull,       /* 5^-33 */
+        0xcfb11ead453994baull, 0x67de18eda5814af2ull,       /* 5^-32 */
+        0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull,       /* 5^-31 */
+        0xa2425ff75e14fc31ull, 0xa1258379a94d028dull,       /* 5^-30 */
+        0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull,       /* 5^-29 */
+        0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull,       /* 5^-28 */
+        0x9e74d1b791e07e48ull, 0x775ea264cf55347eull,       /* 5^-27 */
+        0xc612062576589ddaull, 0x95364afe032a819eull,       /* 5^-26 */
+        0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull,       /* 5^-25 */
+        0x9abe14cd44753b52ull, 0xc4926a9672793543ull,       /* 5^-24 */
+        0xc16d9a0095928a27ull, 0x75b7053c0f178294ull,       /* 5^-23 */
+        0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull,       /* 5^-22 */
+        0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull,       /* 5^-21 */
+        0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull,       /* 5^-20 */
+        0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull,       /* 5^-19 */
+        0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull,       /* 5^-18 */
+        0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull,       /* 5^-17 */
+        0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull,       /* 5^-16 */
+        0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull,       /* 5^-15 */
+        0xb424dc35095cd80full, 0x538484c19ef38c95ull,       /* 5^-14 */
+        0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull,       /* 5^-13 */
+        0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull,       /* 5^-12 */
+        0xafebff0bcb24aafeull, 0xf78f69a51539d749ull,       /* 5^-11 */
+        0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull,       /* 5^-10 */
+        0x89705f4136b4a597ull, 0x31680a88f8953031ull,       /* 5^-9 */
+        0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull,       /* 5^-8 */
+        0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull,       /* 5^-7 */
+        0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull,       /* 5^-6 */
+        0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull,       /* 5^-5 */
+        0xd1b71758e219652bull, 0xd3c36113404ea4a9ull,       /* 5^-4 */
+        0x83126e978d4fdf3bull, 0x645a1cac083126eaull,       /* 5^-3 */
+        0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull,       /* 5^-2 */
+        0xccccccccccccccccull, 0xcccccccccccccccdull,       /* 5^-1 */
+        0x8000000000000000ull, 0x0000000000000000ull,       /* 5^0 */
+        0xa000000000000000ull, 0x0000000000000000ull,       /* 5^1 */
+        0xc800000000000000ull, 0x0000000000000000ull,       /* 5^2 */
+        0xfa00000000000000ull, 0x0000000000000000ull,       /* 5^3 */
+        0x9c40000000000000ull, 0x0000000000000000ull,       /* 5^4 */
+        0xc350000000000000ull, 0x0000000000000000ull,       /* 5^5 */
+        0xf424000000000000ull, 0x0000000000000000ull,       /* 5^6 */
+        0x9896800000000000ull, 0x0000000000000000ull,       /* 5^7 */
+        0xbebc200000000000ull, 0x0000000000000000ull,       /* 5^8 */
+        0xee6b280000000000ull, 0x0000000000000000ull,       /* 5^9 */
+        0x9502f90000000000ull, 0x0000000000000000ull,       /* 5^10 */
+        0xba43b74000000000ull, 0x0000000000000000ull,       /* 5^11 */
+        0xe8d4a51000000000ull, 0x0000000000000000ull,       /* 5^12 */
+        0x9184e72a00000000ull, 0x0000000000000000ull,       /* 5^13 */
+        0xb5e620f480000000ull, 0x0000000000000000ull,       /* 5^14 */
+        0xe35fa931a0000000ull, 0x0000000000000000ull,       /* 5^15 */
+        0x8e1bc9bf04000000ull, 0x0000000000000000ull,       /* 5^16 */
+        0xb1a2bc2ec5000000ull, 0x0000000000000000ull,       /* 5^17 */
+        0xde0b6b3a76400000ull, 0x0000000000000000ull,       /* 5^18 */
+        0x8ac7230489e80000ull, 0x0000000000000000ull,       /* 5^19 */
+        0xad78ebc5ac620000ull, 0x0000000000000000ull,       /* 5^20 */
+        0xd8d726b7177a8000ull, 0x0000000000000000ull,       /* 5^21 */
+        0x878678326eac9000ull, 0x0000000000000000ull,       /* 5^22 */
+        0xa968163f0a57b400ull, 0x0000000000000000ull,       /* 5^23 */
+        0xd3c21bcecceda100ull, 0x0000000000000000ull,       /* 5^24 */
+        0x84595161401484a0ull, 0x0000000000000000ull,       /* 5^25 */
+        0xa56fa5b99019a5c8ull, 0x0000000000000000ull,       /* 5^26 */
+        0xcecb8f27f4200f3aull, 0x0000000000000000ull,       /* 5^27 */
+        0x813f3978f8940984ull, 0x4000000000000000ull,       /* 5^28 */
+        0xa18f07d736b90be5ull, 0x5000000000000000ull,       /* 5^29 */
+        0xc9f2c9cd04674edeull, 0xa400000000000000ull,       /* 5^30 */
+        0xfc6f7c4045812296ull, 0x4d00000000000000ull,       /* 5^31 */
+        0x9dc5ada82b70b59dull, 0xf020000000000000ull,       /* 5^32 */
+        0xc5371912364ce305ull, 0x6c28000000000000ull,       /* 5^33 */
+        0xf684df56c3e01bc6ull, 0xc732000000000000ull,       /* 5^34 */
+        0x9a130b963a6c115cull, 0x3c7f400000000000ull,       /* 5^35 */
+        0xc097ce7bc90715b3ull, 0x4b9f100000000000ull,       /* 5^36 */
+        0xf0bdc21abb48db20ull, 0x1e86d40000000000ull,       /* 5^37 */
+        0x96769950b50d88f4ull, 0x1314448000000000ull,       /* 5^38 */
+        0xbc143fa4e250eb31ull, 0x17d955a000000000ull,       /* 5^39 */
+        0xeb194f8e1ae525fdull, 0x5dcfab0800000000ull,       /* 5^40 */
+        0x92efd1b8d0cf37beull, 0x5aa1cae500000000ull,       /* 5^41 */
+        0xb7abc627050305adull, 0xf14a3d9e40000000ull,       /* 5^42 */
+        0xe596b7b0c643c719ull, 0x6d9ccd05d0000000ull,       /* 5^43 */
+        0x8f7e32ce7bea5c6full, 0xe4820023a2000000ull,       /* 5^44 */
+        0xb35dbf821ae4f38bull, 0xdda2802c8a800000ull,       /* 5^45 */
+        0xe0352f62a19e306eull, 0xd50b2037ad200000ull,       /* 5^46 */
+        0x8c213d9da502de45ull, 0x4526f422cc340000ull,       /* 5^47 */
+        0xaf298d050e4395d6ull, 0x9670b12b7f410000ull,       /* 5^48 */
+        0xdaf3f04651d47b4cull, 0x3c0cdd765f114000ull,       /* 5^49 */
+        0x88d8762bf324cd0full, 0xa5880a69fb6ac800ull,       /* 5^50 */
+        0xab0e93b6efee0053ull, 0x8eea0d047a457a00ull,       /* 5^51 */
+        0xd5d238a4abe98068ull, 0x72a4904598d6d880ull,       /* 5^52 */
+        0x85a36366eb71f041ull, 0x47a6da2b7f864750ull,       /* 5^53 */
+        0xa70c3c40a64e6c51ull, 0x999090b65f67d924ull,       /* 5^54 */
+        0xd0cf4b50cfe20765ull, 0xfff4b4e3f741cf6dull,       /* 5^55 */
+        0x82818f1281ed449full, 0xbff8f10e7a8921a4ull,       /* 5^56 */
+        0xa321f2d7226895c7ull, 0xaff72d52192b6a0dull,       /* 5^57 */
+        0xcbea6f8ceb02bb39ull, 0x9bf4f8a69f764490ull,       /* 5^58 */
+        0xfee50b7025c36a08ull, 0x02f236d04753d5b4ull,       /* 5^59 */
+        0x9f4f2726179a2245ull, 0x01d762422c946590ull,       /* 5^60 */
+        0xc722f0ef9d80aad6ull, 0x424d3ad2b7b97ef5ull,       /* 5^61 */
+        0xf8ebad2b84e0d58bull, 0xd2e0898765a7deb2ull,       /* 5^62 */
+        0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full,       /* 5^63 */
+        0xc2781f49ffcfa6d5ull, 0x3cbf6b71c76b25fbull,       /* 5^64 */
+        0xf316271c7fc3908aull, 0x8bef464e3945ef7aull,       /* 5^65 */
+        0x97edd871cfda3a56ull, 0x97758bf0e3cbb5acull,       /* 5^66 */
+        0xbde94e8e43d0c8ecull, 0x3d52eeed1cbea317ull,       /* 5^67 */
+        0xed63a231d4c4fb27ull, 0x4ca7aaa863ee4bddull,       /* 5^68 */
+        0x945e455f24fb1cf8ull, 0x8fe8caa93e74ef6aull,       /* 5^69 */
+        0xb975d6b6ee39e436ull, 0xb3e2fd538e122b44ull,       /* 5^70 */
+        0xe7d34c64a9c85d44ull, 0x60dbbca87196b616ull,       /* 5^71 */
+        0x90e40fbeea1d3a4aull, 0xbc8955e946fe31cdull,       /* 5^72 */
+        0xb51d13aea4a488ddull, 0x6babab6398bdbe41ull,       /* 5^73 */
+        0xe264589a4dcdab14ull, 0xc696963c7eed2dd1ull,       /* 5^74 */
+        0x8d7eb76070a08aecull, 0xfc1e1de5cf543ca2ull,       /* 5^75 */
+        0xb0de65388cc8ada8ull, 0x3b25a55f43294bcbull,       /* 5^76 */
+        0xdd15fe86affad912ull, 0x49ef0eb713f39ebeull,       /* 5^77 */
+        0x8a2dbf142dfcc7abull, 0x6e3569326c784337ull,       /* 5^78 */
+        0xacb92ed9397bf996ull, 0x49c2c37f07965404ull,       /* 5^79 */
+        0xd7e77a8f87daf7fbull, 0xdc33745ec97be906ull,       /* 5^80 */
+        0x86f0ac99b4e8dafdull, 0x69a028bb3ded71a3ull,       /* 5^81 */
+        0xa8acd7c0222311bcull, 0xc40832ea0d68ce0cull,       /* 5^82 */
+        0xd2d80db02aabd62bull, 0xf50a3fa490c30190ull,       /* 5^83 */
+        0x83c7088e1aab65dbull, 0x792667c6da79e0faull,       /* 5^84 */
+        0xa4b8cab1a1563f52ull, 0x577001b891185938ull,       /* 5^85 */
+        0xcde6fd5e09abcf26ull, 0xed4c0226b55e6f86ull,       /* 5^86 */
+        0x80b05e5ac60b6178ull, 0x544f8158315b05b4ull,       /* 5^87 */
+        0xa0dc75f1778e39d6ull, 0x696361ae3db1c721ull,       /* 5^88 */
+        0xc913936dd571c84cull, 0x03bc3a19cd1e38e9ull,       /* 5^89 */
+        0xfb5878494ace3a5full, 0x04ab48a04065c723ull,       /* 5^90 */
+        0x9d174b2dcec0e47bull, 0x62eb0d64283f9c76ull,       /* 5^91 */
+        0xc45d1df942711d9aull, 0x3ba5d0bd324f8394ull,       /* 5^92 */
+        0xf5746577930d6500ull, 0xca8f44ec7ee36479ull,       /* 5^93 */
+        0x9968bf6abbe85f20ull, 0x7e998b13cf4e1ecbull,       /* 5^94 */
+        0xbfc2ef456ae276e8ull, 0x9e3fedd8c321a67eull,       /* 5^95 */
+        0xefb3ab16c59b14a2ull, 0xc5cfe94ef3ea101eull,       /* 5^96 */
+        0x95d04aee3b80ece5ull, 0xbba1f1d158724a12ull,       /* 5^97 */
+        0xbb445da9ca61281full, 0x2a8a6e45ae8edc97ull,       /* 5^98 */
+        0xea1575143cf97226ull, 0xf52d09d71a3293bdull,       /* 5^99 */
+        0x924d692ca61be758ull, 0x593c2626705f9c56ull,       /* 5^100 */
+        0xb6e0c377cfa2e12eull, 0x6f8b2fb00c77836cull,       /* 5^101 */
+        0xe498f455c38b997aull, 0x0b6dfb9c0f956447ull,       /* 5^102 */
+        0x8edf98b59a373fecull, 0x4724bd4189bd5eacull,       /* 5^103 */
+        0xb2977ee300c50fe7ull, 0x58edec91ec2cb657ull,       /* 5^104 */
+        0xdf3d5e9bc0f653e1ull, 0x2f2967b66737e3edull,       /* 5^105 */
+        0x8b865b215899f46cull, 0xbd79e0d20082ee74ull,       /* 5^106 */
+        0xae67f1e9aec07187ull, 0xecd8590680a3aa11ull,       /* 5^107 */
+        0xda01ee641a708de9ull, 0xe80e6f4820cc9495ull,       /* 5^108 */
+        0x884134fe908658b2ull, 0x3109058d147fdcddull,       /* 5^109 */
+        0xaa51823e34a7eedeull, 0xbd4b46f0599fd415ull,       /* 5^110 */
+        0xd4e5e2cdc1d1ea96ull, 0x6c9e18ac7007c91aull,       /* 5^111 */
+        0x850fadc09923329eull, 0x03e2cf6bc604ddb0ull,       /* 5^112 */
+        0xa6539930bf6bff45ull, 0x84db8346b786151cull,       /* 5^113 */
+        0xcfe87f7cef46ff16ull, 0xe612641865679a63ull,       /* 5^114 */
+        0x81f14fae158c5f6eull, 0x4fcb7e8f3f60c07eull,       /* 5^115 */
+        0xa26da3999aef7749ull, 0xe3be5e330f38f09dull,       /* 5^116 */
+        0xcb090c8001ab551cull, 0x5cadf5bfd3072cc5ull,       /* 5^117 */
+        0xfdcb4fa002162a63ull, 0x73d9732fc7c8f7f6ull,       /* 5^118 */
+        0x9e9f11c4014dda7eull, 0x2867e7fddcdd9afaull,       /* 5^119 */
+        0xc646d63501a1511dull, 0xb281e1fd541501b8ull,       /* 5^120 */
+        0xf7d88bc24209a565ull, 0x1f225a7ca91a4226ull,       /* 5^121 */
+        0x9ae757596946075full, 0x3375788de9b06958ull,       /* 5^122 */
+        0xc1a12d2fc3978937ull, 0x0052d6b1641c83aeull,       /* 5^123 */
+        0xf209787bb47d6b84ull, 0xc0678c5dbd23a49aull,       /* 5^124 */
+        0x9745eb4d50ce6332ull, 0xf840b7ba963646e0ull,       /* 5^125 */
+        0xbd176620a501fbffull, 0xb650e5a93bc3d898ull,       /* 5^126 */
+        0xec5d3fa8ce427affull, 0xa3e51f138ab4cebeull,       /* 5^127 */
+        0x93ba47c980e98cdfull, 0xc66f336c36b10137ull,       /* 5^128 */
+        0xb8a8d9bbe123f017ull, 0xb80b0047445d4184ull,       /* 5^129 */
+        0xe6d3102ad96cec1dull, 0xa60dc059157491e5ull,       /* 5^130 */
+        0x9043ea1ac7e41392ull, 0x87c89837ad68db2full,       /* 5^131 */
+        0xb454e4a179dd1877ull, 0x29babe4598c311fbull,       /* 5^132 */
+        0xe16a1dc9d8545e94ull, 0xf4296dd6fef3d67aull,       /* 5^133 */
+        0x8ce2529e2734bb1dull, 0x1899e4a65f58660cull,       /* 5^134 */
+        0xb01ae745b101e9e4ull, 0x5ec05dcff72e7f8full,       /* 5^135 */
+        0xdc21a1171d42645dull, 0x76707543f4fa1f73ull,       /* 5^136 */
+        0x899504ae72497ebaull, 0x6a06494a791c53a8ull,       /* 5^137 */
+        0xabfa45da0edbde69ull, 0x0487db9d17636892ull,       /* 5^138 */
+        0xd6f8d7509292d603ull, 0x45a9d2845d3c42b6ull,       /* 5^139 */
+        0x865b86925b9bc5c2ull, 0x0b8a2392ba45a9b2ull,       /* 5^140 */
+        0xa7f26836f282b732ull, 0x8e6cac7768d7141eull,       /* 5^141 */
+        0xd1ef0244af2364ffull, 0x3207d795430cd926ull,       /* 5^142 */
+        0x8335616aed761f1full, 0x7f44e6bd49e807b8ull,       /* 5^143 */
+        0xa402b9c5a8d3a6e7ull, 0x5f16206c9c6209a6ull,       /* 5^144 */
+        0xcd036837130890a1ull, 0x36dba887c37a8c0full,       /* 5^145 */
+        0x802221226be55a64ull, 0xc2494954da2c9789ull,       /* 5^146 */
+        0xa02aa96b06deb0fdull, 0xf2db9baa10b7bd6cull,       /* 5^147 */
+        0xc83553c5c8965d3dull, 0x6f92829494e5acc7ull,       /* 5^148 */
+        0xfa42a8b73abbf48cull, 0xcb772339ba1f17f9ull,       /* 5^149 */
+        0x9c69a97284b578d7ull, 0xff2a760414536efbull,       /* 5^150 */
+        0xc38413cf25e2d70dull, 0xfef5138519684abaull,       /* 5^151 */
+        0xf46518c2ef5b8cd1ull, 0x7eb258665fc25d69ull,       /* 5^152 */
+        0x98bf2f79d5993802ull, 0xef2f773ffbd97a61ull,       /* 5^153 */
+        0xbeeefb584aff8603ull, 0xaafb550ffacfd8faull,       /* 5^154 */
+        0xeeaaba2e5dbf6784ull, 0x95ba2a53f983cf38ull,       /* 5^155 */
+        0x952ab45cfa97a0b2ull, 0xdd945a747bf26183ull,       /* 5^156 */
+        0xba756174393d88dfull, 0x94f971119aeef9e4ull,       /* 5^157 */
+        0xe912b9d1478ceb17ull, 0x7a37cd5601aab85dull,       /* 5^158 */
+        0x91abb422ccb812eeull, 0xac62e055c10ab33aull,       /* 5^159 */
+        0xb616a12b7fe617aaull, 0x577b986b314d6009ull,       /* 5^160 */
+        0xe39c49765fdf9d94ull, 0xed5a7e85fda0b80bull,       /* 5^161 */
+        0x8e41ade9fbebc27dull, 0x14588f13be847307ull,       /* 5^162 */
+        0xb1d219647ae6b31cull, 0x596eb2d8ae258fc8ull,       /* 5^163 */
+        0xde469fbd99a05fe3ull, 0x6fca5f8ed9aef3bbull,       /* 5^164 */
+        0x8aec23d680043beeull, 0x25de7bb9480d5854ull,       /* 5^165 */
+        0xada72ccc20054ae9ull, 0xaf561aa79a10ae6aull,       /* 5^166 */
+        0xd910f7ff28069da4ull, 0x1b2ba1518094da04ull,       /* 5^167 */
+        0x87aa9aff79042286ull, 0x90fb44d2f05d0842ull,       /* 5^168 */
+        0xa99541bf57452b28ull, 0x353a1607ac744a53ull,       /* 5^169 */
+        0xd3fa922f2d1675f2ull, 0x42889b8997915ce8ull,       /* 5^170 */
+        0x847c9b5d7c2e09b7ull, 0x69956135febada11ull,       /* 5^171 */
+        0xa59bc234db398c25ull, 0x43fab9837e699095ull,       /* 5^172 */
+        0xcf02b2c21207ef2eull, 0x94f967e45e03f4bbull,       /* 5^173 */
+        0x8161afb94b44f57dull, 0x1d1be0eebac278f5ull,       /* 5^174 */
+        0xa1ba1ba79e1632dcull, 0x6462d92a69731732ull,       /* 5^175 */
+        0xca28a291859bbf93ull, 0x7d7b8f7503cfdcfeull,       /* 5^176 */
+        0xfcb2cb35e702af78ull, 0x5cda735244c3d43eull,       /* 5^177 */
+        0x9defbf01b061adabull, 0x3a0888136afa64a7ull,       /* 5^178 */
+        0xc56baec21c7a1916ull, 0x088aaa1845b8fdd0ull,       /* 5^179 */
+        0xf6c69a72a3989f5bull, 0x8aad549e57273d45ull,       /* 5^180 */
+        0x9a3c2087a63f6399ull, 0x36ac54e2f678864bull,       /* 5^181 */
+        0xc0cb28a98fcf3c7full, 0x84576a1bb416a7ddull,       /* 5^182 */
+        0xf0fdf2d3f3c30b9full, 0x656d44a2a11c51d5ull,       /* 5^183 */
+        0x969eb7c47859e743ull, 0x9f644ae5a4b1b325ull,       /* 5^184 */
+        0xbc4665b596706114ull, 0x873d5d9f0dde1feeull,       /* 5^185 */
+        0xeb57ff22fc0c7959ull, 0xa90cb506d155a7eaull,       /* 5^186 */
+        0x9316ff75dd87cbd8ull, 0x09a7f12442d588f2ull,       /* 5^187 */
+        0xb7dcbf5354e9beceull, 0x0c11ed6d538aeb2full,       /* 5^188 */
+        0xe5d3ef282a242e81ull, 0x8f1668c8a86da5faull,       /* 5^189 */
+        0x8fa475791a569d10ull, 0xf96e017d694487bcull,       /* 5^190 */
+        0xb38d92d760ec4455ull, 0x37c981dcc395a9acull,       /* 5^191 */
+        0xe070f78d3927556aull, 0x85bbe253f47b1417ull,       /* 5^192 */
+        0x8c469ab843b89562ull, 0x93956d7478ccec8eull,       /* 5^193 */
+        0xaf58416654a6babbull, 0x387ac8d1970027b2ull,       /* 5^194 */
+        0xdb2e51bfe9d0696aull, 0x06997b05fcc0319eull,       /* 5^195 */
+        0x88fcf317f22241e2ull, 0x441fece3bdf81f03ull,       /* 5^196 */
+        0xab3c2fddeeaad25aull, 0xd527e81cad7626c3ull,       /* 5^197 */
+        0xd60b3bd56a5586f1ull, 0x8a71e223d8d3b074ull,       /* 5^198 */
+        0x85c7056562757456ull, 0xf6872d5667844e49ull,       /* 5^199 */
+        0xa738c6bebb12d16cull, 0xb428f8ac016561dbull,       /* 5^200 */
+        0xd106f86e69d785c7ull, 0xe13336d701beba52ull,       /* 5^201 */
+        0x82a45b450226b39cull, 0xecc0024661173473ull,       /* 5^202 */
+        0xa34d721642b06084ull, 0x27f002d7f95d0190ull,       /* 5^203 */
+        0xcc20ce9bd35c78a5ull, 0x31ec038df7b441f4ull,       /* 5^204 */
+        0xff290242c83396ceull, 0x7e67047175a15271ull,       /* 5^205 */
+        0x9f79a169bd203e41ull, 0x0f0062c6e984d386ull,       /* 5^206 */
+        0xc75809c42c684dd1ull, 0x52c07b78a3e60868ull,       /* 5^207 */
+        0xf92e0c3537826145ull, 0xa7709a56ccdf8a82ull,       /* 5^208 */
+        0x9bbcc7a142b17ccbull, 0x88a66076400bb691ull,       /* 5^209 */
+        0xc2abf989935ddbfeull, 0x6acff893d00ea435ull,       /* 5^210 */
+        0xf356f7ebf83552feull, 0x0583f6b8c4124d43ull,       /* 5^211 */
+        0x98165af37b2153deull, 0xc3727a337a8b704aull,       /* 5^212 */
+        0xbe1bf1b059e9a8d6ull, 0x744f18c0592e4c5cull,       /* 5^213 */
+        0xeda2ee1c7064130cull, 0x1162def06f79df73ull,       /* 5^214 */
+        0x9485d4d1c63e8be7ull, 0x8addcb5645ac2ba8ull,       /* 5^215 */
+        0xb9a74a0637ce2ee1ull, 0x6d953e2bd7173692ull,       /* 5^216 */
+        0xe8111c87c5c1ba99ull, 0xc8fa8db6ccdd0437ull,       /* 5^217 */
+        0x910ab1d4db9914a0ull, 0x1d9c9892400a22a2ull,       /* 5^218 */
+        0xb54d5e4a127f59c8ull, 0x2503beb6d00cab4bull,       /* 5^219 */
+        0xe2a0b5dc971f303aull, 0x2e44ae64840fd61dull,       /* 5^220 */
+        0x8da471a9de737e24ull, 0x5ceaecfed289e5d2ull,       /* 5^221 */
+        0xb10d8e1456105dadull, 0x7425a83e872c5f47ull,       /* 5^222 */
+        0xdd50f1996b947518ull, 0xd12f124e28f77719ull,       /* 5^223 */
+        0x8a5296ffe33cc92full, 0x82bd6b70d99aaa6full,       /* 5^224 */
+        0xace73cbfdc0bfb7bull, 0x636cc64d1001550bull,       /* 5^225 */
+        0xd8210befd30efa5aull, 0x3c47f7e05401aa4eull,       /* 5^226 */
+        0x8714a775e3e95c78ull, 0x65acfaec34810a71ull,       /* 5^227 */
+        0xa8d9d1535ce3b396ull, 0x7f1839a741a14d0dull,       /* 5^228 */
+        0xd31045a8341ca07cull, 0x1ede48111209a050ull,       /* 5^229 */
+        0x83ea2b892091e44dull, 0x934aed0aab460432ull,       /* 5^230 */
+        0xa4e4b66b68b65d60ull, 0xf81da84d5617853full,       /* 5^231 */
+        0xce1de40642e3f4b9ull, 0x36251260ab9d668eull,       /* 5^232 */
+        0x80d2ae83e9ce78f3ull, 0xc1d72b7c6b426019ull,       /* 5^233 */
+        0xa1075a24e4421730ull, 0xb24cf65b8612f81full,       /* 5^234 */
+        0xc94930ae1d529cfcull, 0xdee033f26797b627ull,       /* 5^235 */
+        0xfb9b7cd9a4a7443cull, 0x169840ef017da3b1ull,       /* 5^236 */
+        0x9d412e0806e88aa5ull, 0x8e1f289560ee864eull,       /* 5^237 */
+        0xc491798a08a2ad4eull, 0xf1a6f2bab92a27e2ull,       /* 5^238 */
+        0xf5b5d7ec8acb58a2ull, 0xae10af696774b1dbull,       /* 5^239 */
+        0x9991a6f3d6bf1765ull, 0xacca6da1e0a8ef29ull,       /* 5^240 */
+        0xbff610b0cc6edd3full, 0x17fd090a58d32af3ull,       /* 5^241 */
+        0xeff394dcff8a948eull, 0xddfc4b4cef07f5b0ull,       /* 5^242 */
+        0x95f83d0a1fb69cd9ull, 0x4abdaf101564f98eull,       /* 5^243 */
+        0xbb764c4ca7a4440full, 0x9d6d1ad41abe37f1ull,       /* 5^244 */
+        0xea53df5fd18d5513ull, 0x84c86189216dc5edull,       /* 5^245 */
+        0x92746b9be2f8552cull, 0x32fd3cf5b4e49bb4ull,       /* 5^246 */
+        0xb7118682dbb66a77ull, 0x3fbc8c33221dc2a1ull,       /* 5^247 */
+        0xe4d5e82392a40515ull, 0x0fabaf3feaa5334aull,       /* 5^248 */
+        0x8f05b1163ba6832dull, 0x29cb4d87f2a7400eull,       /* 5^249 */
+        0xb2c71d5bca9023f8ull, 0x743e20e9ef511012ull,       /* 5^250 */
+        0xdf78e4b2bd342cf6ull, 0x914da9246b255416ull,       /* 5^251 */
+        0x8bab8eefb6409c1aull, 0x1ad089b6c2f7548eull,       /* 5^252 */
+        0xae9672aba3d0c320ull, 0xa184ac2473b529b1ull,       /* 5^253 */
+        0xda3c0f568cc4f3e8ull, 0xc9e5d72d90a2741eull,       /* 5^254 */
+        0x8865899617fb1871ull, 0x7e2fa67c7a658892ull,       /* 5^255 */
+        0xaa7eebfb9df9de8dull, 0xddbb901b98feeab7ull,       /* 5^256 */
+        0xd51ea6fa85785631ull, 0x552a74227f3ea565ull,       /* 5^257 */
+        0x8533285c936b35deull, 0xd53a88958f87275full,       /* 5^258 */
+        0xa67ff273b8460356ull, 0x8a892abaf368f137ull,       /* 5^259 */
+        0xd01fef10a657842cull, 0x2d2b7569b0432d85ull,       /* 5^260 */
+        0x8213f56a67f6b29bull, 0x9c3b29620e29fc73ull,       /* 5^261 */
+        0xa298f2c501f45f42ull, 0x8349f3ba91b47b8full,       /* 5^262 */
+        0xcb3f2f7642717713ull, 0x241c70a936219a73ull,       /* 5^263 */
+        0xfe0efb53d30dd4d7ull, 0xed238cd383aa0110ull,       /* 5^264 */
+        0x9ec95d1463e8a506ull, 0xf4363804324a40aaull,       /* 5^265 */
+        0xc67bb4597ce2ce48ull, 0xb143c6053edcd0d5ull,       /* 5^266 */
+        0xf81aa16fdc1b81daull, 0xdd94b7868e94050aull,       /* 5^267 */
+        0x9b10a4e5e9913128ull, 0xca7cf2b4191c8326ull,       /* 5^268 */
+        0xc1d4ce1f63f57d72ull, 0xfd1c2f611f63a3f0ull,       /* 5^269 */
+        0xf24a01a73cf2dccfull, 0xbc633b39673c8cecull,       /* 5^270 */
+        0x976e41088617ca01ull, 0xd5be0503e085d813ull,       /* 5^271 */
+        0xbd49d14aa79dbc82ull, 0x4b2d8644d8a74e18ull,       /* 5^272 */
+        0xec9c459d51852ba2ull, 0xddf8e7d60ed1219eull,       /* 5^273 */
+        0x93e1ab8252f33b45ull, 0xcabb90e5c942b503ull,       /* 5^274 */
+        0xb8da1662e7b00a17ull, 0x3d6a751f3b936243ull,       /* 5^275 */
+        0xe7109bfba19c0c9dull, 0x0cc512670a783ad4ull,       /* 5^276 */
+        0x906a617d450187e2ull, 0x27fb2b80668b24c5ull,       /* 5^277 */
+        0xb484f9dc9641e9daull, 0xb1f9f660802dedf6ull,       /* 5^278 */
+        0xe1a63853bbd26451ull, 0x5e7873f8a0396973ull,       /* 5^279 */
+        0x8d07e33455637eb2ull, 0xdb0b487b6423e1e8ull,       /* 5^280 */
+        0xb049dc016abc5e5full, 0x91ce1a9a3d2cda62ull,       /* 5^281 */
+        0xdc5c5301c56b75f7ull, 0x7641a140cc7810fbull,       /* 5^282 */
+        0x89b9b3e11b6329baull, 0xa9e904c87fcb0a9dull,       /* 5^283 */
+        0xac2820d9623bf429ull, 0x546345fa9fbdcd44ull,       /* 5^284 */
+        0xd732290fbacaf133ull, 0xa97c177947ad4095ull,       /* 5^285 */
+        0x867f59a9d4bed6c0ull, 0x49ed8eabcccc485dull,       /* 5^286 */
+        0xa81f301449ee8c70ull, 0x5c68f256bfff5a74ull,       /* 5^287 */
+        0xd226fc195c6a2f8cull, 0x73832eec6fff3111ull,       /* 5^288 */
+        0x83585d8fd9c25db7ull, 0xc831fd53c5ff7eabull,       /* 5^289 */
+        0xa42e74f3d032f525ull, 0xba3e7ca8b77f5e55ull,       /* 5^290 */
+        0xcd3a1230c43fb26full, 0x28ce1bd2e55f35ebull,       /* 5^291 */
+        0x80444b5e7aa7cf85ull, 0x7980d163cf5b81b3ull,       /* 5^292 */
+        0xa0555e361951c366ull, 0xd7e105bcc332621full,       /* 5^293 */
+        0xc86ab5c39fa63440ull, 0x8dd9472bf3fefaa7ull,       /* 5^294 */
+        0xfa856334878fc150ull, 0xb14f98f6f0feb951ull,       /* 5^295 */
+        0x9c935e00d4b9d8d2ull, 0x6ed1bf9a569f33d3ull,       /* 5^296 */
+        0xc3b8358109e84f07ull, 0x0a862f80ec4700c8ull,       /* 5^297 */
+        0xf4a642e14c6262c8ull, 0xcd27bb612758c0faull,       /* 5^298 */
+        0x98e7e9cccfbd7dbdull, 0x8038d51cb897789cull,       /* 5^299 */
+        0xbf21e44003acdd2cull, 0xe0470a63e6bd56c3ull,       /* 5^300 */
+        0xeeea5d5004981478ull, 0x1858ccfce06cac74ull,       /* 5^301 */
+        0x95527a5202df0ccbull, 0x0f37801e0c43ebc8ull,       /* 5^302 */
+        0xbaa718e68396cffdull, 0xd30560258f54e6baull,       /* 5^303 */
+        0xe950df20247c83fdull, 0x47c6b82ef32a2069ull,       /* 5^304 */
+        0x91d28b7416cdd27eull, 0x4cdc331d57fa5441ull,       /* 5^305 */
+        0xb6472e511c81471dull, 0xe0133fe4adf8e952ull,       /* 5^306 */
+        0xe3d8f9e563a198e5ull, 0x58180fddd97723a6ull,       /* 5^307 */
+        0x8e679c2f5e44ff8full, 0x570f09eaa7ea7648ull,       /* 5^308 */
 };
-
-static double
-StringToDouble(const char* string, size_t n, const char** endPtr) {
-        int sign = BON_FALSE, expSign = BON_FALSE;
-        double fraction, dblExp, *d;
-        register const char *p;
-        register int c;
-        int exp = 0;                                                            /* Exponent read from "EX" field. */
-        int fracExp = 0;                                                        /* Exponent that derives from the fractional
-                                                                                 * part.  Under normal circumstances, it is
-                                                                                 * the negative of the number of digits in F.
-                                                                                 * However, if I is very long, the last digits
-                                                                                 * of I get dropped (otherwise a long I with a
-                                                                                 * large negative exponent could cause an
-                                                                                 * unnecessary overflow on I alone).  In this
-                                                                                 * case, fracExp is incremented one for each
-                                                                                 * dropped digit. */
-        int mantSize;                                                           /* Number of digits in mantissa. */
-        int decPt;                                                              /* Number of mantissa digits BEFORE decimal
-                                                                                 * point. */
-        const char *pExp;                                                       /* Temporarily holds location of exponent
-                                                                                 * in string. */
-        const char *pEnd;                                                       /* Max position of p */
-
-        p = string;
-        pEnd = string + n;
-
-        if (p != pEnd) {
-                if (*p == '-') {
-                        sign = BON_TRUE;
-                        p += 1;
-                }
-                else {
-                        if (*p == '+') {
-                                p += 1;
-                        }
-                        sign = BON_FALSE;
-                }
-        }
 
-        /*
-         * Count the number of digits in the mantissa (including the decimal
-         * point), and also locate the decimal point.
-         */
+/* Exact powers of ten for Clinger's fast path */
+static const double s_exactPowersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-        decPt = -1;
-        for (mantSize = 0; p != pEnd; mantSize += 1)
-        {
-                c = *p;
-                if (!IsDigit(c)) {
-                        if ((c != '.') || (decPt >= 0)) {
-                                break;
-                        }
-                        decPt = mantSize;
-                }
-                p += 1;
-        }
+/* Eight ASCII digits loaded as a little-endian uint64_t */
+static BonBool
+IsEightDigits(uint64_t v) {
+        return (((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull) ? BON_TRUE : BON_FALSE;
+}
+
+/* SWAR: combine pairs, then pairs of pairs, then the two halves */
+static uint32_t
+ParseEightDigits(uint64_t v) {
+        const uint64_t  mask    = 0x000000FF000000FFull;
+        const uint64_t  mul1    = 0x000F424000000064ull;                        /* 100 + (1000000 << 32) */
+        const uint64_t  mul2    = 0x0000271000000001ull;                        /* 1 + (10000 << 32) */
+        v -= 0x3030303030303030ull;
+        v = (v * 10) + (v >> 8);
+        v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+        return (uint32_t)v;
+}
 
-        /*
-         * Now suck up the digits in the mantissa.  Use two integers to
-         * collect 9 digits each (this is faster than using floating-point).
-         * If the mantissa has more than 18 digits, ignore the extras, since
-         * they can't affect the value anyway.
-         */
+/* Add digits to the mantissa until it holds 19, then count the rest in droppedCount. Return the end of the digits. */
+static const uint8_t*
+AccumulateDigits(const uint8_t* p, const uint8_t* end, BonDecimalNumber* number, int* pdigitCount, int64_t* droppedCount) {
+        uint64_t        mantissa        = number->mantissa;                     /* Locals, the pointers may alias */
+        int             digitCount      = *pdigitCount;
 
-        pExp = p;
-        p -= mantSize;
-        if (decPt < 0) {
-                decPt = mantSize;
+        while (end - p >= 8 && digitCount + 8 <= BON_MAX_MANTISSA_DIGITS) {
+                uint64_t v;
+                memcpy(&v, p, sizeof(v));
+                if (!IsEightDigits(v))
+                        break;
+                mantissa = mantissa * 100000000u + ParseEightDigits(v);
+                digitCount += 8;
+                p += 8;
         }
-        else {
-                mantSize -= 1;                                                  /* One of the digits was the point. */
+        for (; p != end && IsDigit(*p) && digitCount < BON_MAX_MANTISSA_DIGITS; ++p) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                ++digitCount;
         }
-        if (mantSize > 18) {
-                fracExp = decPt - 18;
-                mantSize = 18;
+        for (; p != end && IsDigit(*p); ++p) {
+                ++*droppedCount;
+                if (*p != '0') {
+                        number->truncated = BON_TRUE;
+                }
         }
-        else {
-                fracExp = decPt - mantSize;
+        number->mantissa = mantissa;
+        *pdigitCount = digitCount;
+        return p;
+}
+
+/* Scan a JSON number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? Return the end of the number, or 0 if there is none. */
+static const uint8_t*
+ScanNumber(const uint8_t* p, const uint8_t* end, BonDecimalNumber* number) {
+        int             digitCount      = 0;
+        int64_t         droppedCount    = 0;
+
+        memset(number, 0, sizeof(*number));
+        if (p != end && *p == '-') {
+                number->negative = BON_TRUE;
+                ++p;
         }
-        if (mantSize == 0) {
-                goto fail;
+        if (p == end || !IsDigit(*p))
+                return 0;
+        if (*p == '0') {
+                ++p;                                                            /* No leading zeros, "01" ends after the 0 */
+        } else {
+                p = AccumulateDigits(p, end, number, &digitCount, &droppedCount);
+                number->exponent += droppedCount;
         }
-        else {
-                int frac1, frac2;
-                frac1 = 0;
-                for (; mantSize > 9 && p != pEnd; mantSize -= 1)
-                {
-                        c = *p;
-                        p += 1;
-                        if (c == '.') {
-                                c = *p;
-                                p += 1;
+
+        if (p != end && *p == '.') {
+                const uint8_t* fraction = ++p;
+                if (number->mantissa == 0) {
+                        while (p != end && *p == '0') {                         /* Leading zeros are not significant */
+                                ++p;
                         }
-                        frac1 = 10 * frac1 + (c - '0');
                 }
-                frac2 = 0;
-                for (; mantSize > 0 && p != pEnd; mantSize -= 1)
-                {
-                        c = *p;
-                        p += 1;
-                        if (c == '.') {
-                                c = *p;
-                                p += 1;
+                droppedCount = 0;
+                p = AccumulateDigits(p, end, number, &digitCount, &droppedCount);
+                if (p == fraction)
+                        return 0;
+                number->exponent -= (int64_t)(p - fraction) - droppedCount;
+        }
+
+        if (p != end && (*p == 'e' || *p == 'E')) {
+                BonBool         negativeExponent        = BON_FALSE;
+                int64_t         exponent                = 0;
+                const uint8_t*  digits;
+                ++p;
+                if (p != end && (*p == '+' || *p == '-')) {
+                        negativeExponent = *p++ == '-';
+                }
+                for (digits = p; p != end && IsDigit(*p); ++p) {
+                        if (exponent < 100000) {                                /* Way past zero or infinity */
+                                exponent = exponent * 10 + (*p - '0');
                         }
-                        frac2 = 10 * frac2 + (c - '0');
                 }
-                fraction = (1.0e9 * frac1) + frac2;
+                if (p == digits)
+                        return 0;
+                number->exponent += negativeExponent ? -exponent : exponent;
         }
+        return p;
+}
 
-        /*
-         * Skim off the exponent.
-         */
+static int
+CountLeadingZeros64(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return 63 - (int)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanReverse(&index, (unsigned long)(x >> 32)))
+                return 31 - (int)index;
+        _BitScanReverse(&index, (unsigned long)x);
+        return 63 - (int)index;
+#else
+        return __builtin_clzll(x);
+#endif
+}
 
-        p = pExp;
-        if ((p != pEnd) && ((*p == 'E') || (*p == 'e'))) {
-                p += 1;
+/* Return the low 64 bits of a * b and the high 64 bits in *high */
+static uint64_t
+Multiply128(uint64_t a, uint64_t b, uint64_t* high) {
+#if defined(__SIZEOF_INT128__)
+        const unsigned __int128 product = (unsigned __int128)a * b;
+        *high = (uint64_t)(product >> 64);
+        return (uint64_t)product;
+#elif defined(_MSC_VER) && defined(_M_X64)
+        return _umul128(a, b, high);
+#else
+        const uint64_t  aLow    = (uint32_t)a,          aHigh   = a >> 32;
+        const uint64_t  bLow    = (uint32_t)b,          bHigh   = b >> 32;
+        const uint64_t  ll      = aLow * bLow;
+        const uint64_t  lh      = aLow * bHigh;
+        const uint64_t  hl      = aHigh * bLow;
+        const uint64_t  middle  = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+        *high = aHigh * bHigh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+        return (middle << 32) | (uint32_t)ll;
+#endif
+}
 
-                if (p != pEnd) {
-                        if (*p == '-') {
-                                expSign = BON_TRUE;
-                                p += 1;
-                        }
-                        else {
-                                if (*p == '+') {
-                                        p += 1;
-                                }
-                                expSign = BON_FALSE;
-                        }
-                }
+/* Eisel-Lemire: the bits (without sign) of the double closest to w * 10^q. */
+static uint64_t
+ComputeDoubleBits(uint64_t w, int64_t q) {
+        const int       index           = 2 * (int)(q - BON_SMALLEST_POWER_OF_TEN);
+        uint64_t        high, low, mantissa;
+        int             leadingZeros, upperBit, shift;
+        int64_t         power2;
 
-                while (p != pEnd && IsDigit((unsigned char)*p)) {
-                        exp = exp * 10 + (*p - '0');
-                        p += 1;
+        if (w == 0 || q < BON_SMALLEST_POWER_OF_TEN)
+                return 0;
+        if (q > BON_LARGEST_POWER_OF_TEN)
+                return 0x7FFull << 52;                                          /* Infinity */
+
+        leadingZeros = CountLeadingZeros64(w);
+        w <<= leadingZeros;
+
+        /* 55 bits are needed: 53 for the mantissa, one to round and one for the upper bit. Only when the
+         * bits below those are all ones can the lower half of the power change them. */
+        low = Multiply128(w, s_powersOfFive128[index], &high);
+        if ((high & 0x1FFu) == 0x1FFu) {
+                uint64_t secondHigh;
+                Multiply128(w, s_powersOfFive128[index + 1], &secondHigh);
+                low += secondHigh;
+                if (secondHigh > low) {
+                        ++high;
                 }
         }
 
-        if (expSign) {
-                exp = fracExp - exp;
-        }
-        else {
-                exp = fracExp + exp;
+        upperBit        = (int)(high >> 63);
+        shift           = upperBit + 64 - 52 - 3;
+        mantissa        = high >> shift;
+        power2          = (((152170 + 65536) * q) >> 16) + 63 + upperBit - leadingZeros + 1023;     /* floor(log2(10^q)) + 63 */
+
+        if (power2 <= 0) {                                                      /* Subnormal */
+                if (-power2 + 1 >= 64)
+                        return 0;
+                mantissa >>= -power2 + 1;
+                mantissa += mantissa & 1;
+                mantissa >>= 1;
+                return mantissa < (1ull << 52) ? mantissa : (1ull << 52);      /* May have rounded up to the smallest normal */
         }
 
-        /*
-         * Generate a floating-point number that represents the exponent.
-         * Do this by processing the exponent one bit at a time to combine
-         * many powers of 2 of 10. Then combine the exponent with the
-         * fraction.
-         */
-
-        if (exp < 0) {
-                expSign = BON_TRUE;
-                exp = -exp;
+        /* Exactly halfway between two doubles: round to even instead of up. Only possible for small q. */
+        if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == high) {
+                mantissa &= ~1ull;
         }
-        else {
-                expSign = BON_FALSE;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        if (mantissa >= (2ull << 52)) {
+                mantissa = 1ull << 52;
+                ++power2;
         }
-        if (exp > maxExponent) {
-                exp = maxExponent;
-                goto fail;
+        mantissa &= ~(1ull << 52);
+        if (power2 >= 0x7FF)
+                return 0x7FFull << 52;
+        return mantissa | ((uint64_t)power2 << 52);
+}
+
+/* For numbers with more than 19 significant digits. Rewrites the number as <digits>e<exponent>, which
+ * strtod reads the same in every locale. 800 digits and a sticky digit for the rest are enough to round. */
+static double
+SlowDecimalToDouble(const uint8_t* p, const uint8_t* end) {
+        char            buffer[1 + 800 + 1 + 16];
+        char*           out             = buffer;
+        int64_t         exponent        = 0;
+        int             digitCount      = 0;
+        BonBool         fraction        = BON_FALSE;
+        BonBool         sticky          = BON_FALSE;
+
+        if (*p == '-') {
+                *out++ = (char)*p++;
         }
-        dblExp = 1.0;
-        for (d = powersOf10; exp != 0; exp >>= 1, d += 1) {
-                if (exp & 01) {
-                        dblExp *= *d;
+        for (; p != end && *p != 'e' && *p != 'E'; ++p) {
+                if (*p == '.') {
+                        fraction = BON_TRUE;
+                        continue;
+                }
+                if (fraction) {
+                        --exponent;
+                }
+                if (digitCount == 0 && *p == '0') {
+                        continue;
+                }
+                if (digitCount < 800) {
+                        *out++ = (char)*p;
+                        ++digitCount;
+                } else {
+                        ++exponent;
+                        sticky = sticky || *p != '0';
                 }
         }
-        if (expSign) {
-                fraction /= dblExp;
-        }
-        else {
-                fraction *= dblExp;
-        }
-
-        if (endPtr != NULL) {
-                *endPtr = p;
-        }
-
-        if (sign) {
-                return -fraction;
+        if (sticky) {
+                *out++ = '1';
+                --exponent;
         }
-        return fraction;
-
-fail:
-        if (endPtr != NULL) {
-                *endPtr = string;
+        if (p != end) {                                                         /* The explicit exponent, as in ScanNumber */
+                BonBool         negativeExponent        = BON_FALSE;
+                int64_t         explicitExponent        = 0;
+                ++p;
+                if (*p == '+' || *p == '-') {
+                        negativeExponent = *p++ == '-';
+                }
+                for (; p != end; ++p) {
+                        if (explicitExponent < 100000) {
+                                explicitExponent = explicitExponent * 10 + (*p - '0');
+                        }
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
         }
-
-        return 0.0;
+        if (exponent < -99999)  exponent = -99999;
+        if (exponent > 99999)   exponent = 99999;
+        sprintf(out, "e%d", (int)exponent);
+        return strtod(buffer, 0);
 }
 
 static void
 ParseNumberValue(BonParsedJson* pj, BonVariant* value) {
-        const uint8_t* endptr = 0;
+        BonDecimalNumber        number;
+        const uint8_t*          end             = ScanNumber(pj->cursor, pj->jsonStringEnd, &number);
+        uint64_t                bits;
+        double                  d;
+
+        if (!end) {
+                GiveUp(pj->env, BON_STATUS_INVALID_NUMBER);
+        }
 
-        value->value.numberValue = StringToDouble((const char*)pj->cursor, pj->jsonStringEnd - pj->cursor, (const char**)&endptr);
+#if FLT_EVAL_METHOD == 0
+        if (!number.truncated && number.mantissa <= (1ull << 53) && number.exponent >= -22 && number.exponent <= 22) {
+                d = (double)number.mantissa;                                    /* Exact, and so is an integer */
+                if (number.exponent < 0) {
+                        d /= s_exactPowersOfTen[-number.exponent];
+                } else if (number.exponent > 0) {
+                        d *= s_exactPowersOfTen[number.exponent];
+                }
+                d = number.negative ? -d : d;
+        } else
+#endif
+        {
+                bits = ComputeDoubleBits(number.mantissa, number.exponent);
+                if (number.truncated && bits != ComputeDoubleBits(number.mantissa + 1, number.exponent)) {
+                        d = SlowDecimalToDouble(pj->cursor, end);               /* The dropped digits decide */
+                } else {
+                        bits |= number.negative ? 1ull << 63 : 0;
+                        memcpy(&d, &bits, sizeof(d));
+                }
+        }
 
         /* TODO: Canonicalize. check for denormals, etc */
 
-        if (endptr == pj->cursor) {
+        if (isinf(d)) {                                                         /* Out of range, the record must hold JSON numbers */
                 GiveUp(pj->env, BON_STATUS_INVALID_NUMBER);
         }
 
-        pj->cursor = endptr;
-
+        pj->cursor = end;
+        value->value.numberValue = d;
         value->type = BON_VT_NUMBER;
 }
 
@@ -815,30 +2200,77 @@ ParseObjectOrArray(BonParsedJson* pj) {
 }
 
 static int
-NameCompare(const BonStringEntry* a, const BonStringEntry* b) {
-        int64_t diff = ((int64_t)(uint64_t)(a->hash) - (int64_t)(uint64_t)(b->hash));
-        if (diff < 0) return -1;
-        if (diff > 0) return 1;
-        return 0;
+CompareStringBytes(const uint8_t* a, size_t aByteCount, const uint8_t* b, size_t bByteCount) {
+        const int diff = memcmp(a, b, aByteCount < bByteCount ? aByteCount : bByteCount);
+        if (diff) return diff;
+        return aByteCount < bByteCount ? -1 : aByteCount > bByteCount ? 1 : 0;
+}
+
+/* Order the list by hash, and strings with the same hash by their bytes */
+static void
+SortStringList(BonParsedJson* pj, BonStringEntry** list) {
+        BonStringEntry**        strings;
+        BonStringEntry*         string;
+        uint64_t*               keys;
+        size_t                  count           = 0;
+        size_t                  i, k;
+
+        for (string = *list; string; string = string->next) {
+                ++count;
+        }
+        if (count < 2) {
+                return;
+        }
+        ReserveSortKeys(pj, count);
+        strings = (BonStringEntry**)SortKeyItems(pj);
+        for (string = *list, i = 0; string; string = string->next, ++i) {
+                strings[i]      = string;
+                pj->sortKeys[i] = ((uint64_t)string->hash << 32) | (uint64_t)i;
+        }
+        keys = RadixSortKeys(pj->sortKeys, pj->sortKeys + pj->sortKeyCapacity, count);
+        for (i = 1; i < count; ++i) {
+                const uint64_t          key     = keys[i];
+                string = strings[(size_t)(key & 0xffffffffu)];
+                for (k = i; k > 0 && (keys[k - 1] >> 32) == (key >> 32); --k) {
+                        const BonStringEntry* previous = strings[(size_t)(keys[k - 1] & 0xffffffffu)];
+                        if (CompareStringBytes(previous->utf8, previous->byteCount, string->utf8, string->byteCount) <= 0)
+                                break;
+                        keys[k] = keys[k - 1];
+                }
+                keys[k] = key;
+        }
+        *list = 0;
+        for (i = count; i > 0; --i) {
+                BonPrependToList(list, strings[(size_t)(keys[i - 1] & 0xffffffffu)]);
+        }
+}
+
+/* A string is stored as [uint32_t byteCount][bytes][null][zero padding to 8 bytes] */
+static size_t
+StringSlotSize(size_t byteCount) {
+        return BonRoundUp(sizeof(uint32_t) + byteCount + 1, 8);
 }
 
+/* 
+ * Names are found through their hash, so names with the same hash share the string of the first. 
+ * A value string is only shared by equal strings (sameBytes).
+ */
 static size_t
-ComputeOffsetAndLinkAliasesInSortedList(size_t* stringCount, BonStringEntry* head) {
+ComputeOffsetAndLinkAliasesInSortedList(size_t* stringCount, BonStringEntry* head, BonBool sameBytes) {
         size_t                  totalSize       = 0;
         size_t                  count           = 0;
         BonStringEntry*         p               = head;
         BonStringEntry*         ptop            = p;
 
         while(p) {
-                /* TODO: Should check for conflicts here */
-                if (p->hash == ptop->hash) {
+                if (p->hash == ptop->hash && (!sameBytes || 0 == CompareStringBytes(p->utf8, p->byteCount, ptop->utf8, ptop->byteCount))) {
                         p->alias = ptop;
                 } else {
                         ptop = p;
                 }
                 if (p == p->alias) {
                         p->offset = totalSize;
-                        totalSize += BonRoundUp(p->byteCount + 1, 8);
+                        totalSize += StringSlotSize(p->byteCount);
                         ++count;
                 }
                 p = p->next;
@@ -853,6 +2285,9 @@ static size_t
 ComputeStorageSizeForRecord(BonParsedJson* pj) {
         size_t size = 0;
         size += BonRoundUp(sizeof(BonRecord), 8);
+        if (pj->wide) {
+                size += sizeof(BonWideRecordHeader);
+        }
 
         pj->objectOffset = size;
         size += pj->totalObjectSize;
@@ -869,6 +2304,9 @@ ComputeStorageSizeForRecord(BonParsedJson* pj) {
         pj->nameStringOffset = size;
         size += pj->totalNameStringSize;
 
+        pj->subtreeHashOffset = size;
+        size += pj->totalSubtreeHashSize;
+
         return size;
 }
 
@@ -879,12 +2317,13 @@ ComputeVariantOffsets(BonParsedJson* pj) {
         BonContainer*           p               = rootContainer;
         size_t                  totalObjectSize = 0;
         size_t                  totalArraySize  = 0;
+        size_t                  containerCount  = 0;
 
         *pj->lastContainer = rootContainer;
         assert(rootContainer->next == 0);
         pj->lastContainer = &(rootContainer->next);
 
-        for (; p; p = p->next) {
+        for (; p; p = p->next, ++containerCount) {
                 if (p->type == BON_VT_OBJECT) {
                         BonObjectHead* head = (BonObjectHead*)p;
                         BonObjectEntry* entry;
@@ -915,171 +2354,2190 @@ ComputeVariantOffsets(BonParsedJson* pj) {
 
         pj->totalObjectSize     = totalObjectSize;
         pj->totalArraySize      = totalArraySize;
+        pj->containerCount      = containerCount;
 }
 
-BonParsedJson*
-BonParseJson(BonTempMemoryAlloc tempAlloc, void* tempAllocUserdata, const char* jsonString, size_t jsonStringByteCount) {
-        BonParsedJson*          pj = 0;
-        jmp_buf                 errorJmpBuf;
-        int                     status;
+/* Leave out names that the name dictionary has. The entries are still owned by their object members. */
+static void
+RemoveDictionaryNames(BonParsedJson* pj) {
+        const BonRecord*        dictionary      = pj->options.nameDictionary;
+        BonStringEntry**        link            = &pj->nameStringList;
+        BonBool                 removedAny      = BON_FALSE;
+
+        while (*link) {
+                BonStringEntry*         entry   = *link;
+                size_t                  byteCount;
+                const char*             string  = BonGetNameStringWithLength(dictionary, entry->hash, &byteCount);
+                if (string && byteCount == entry->byteCount && 0 == memcmp(string, entry->utf8, entry->byteCount)) {
+                        *link = entry->next;
+                        removedAny = BON_TRUE;
+                } else {
+                        link = &entry->next;
+                }
+        }
+        pj->nameDictionaryId = removedAny ? BonGetNameDictionaryId(dictionary) : 0;
+}
 
-        if (!tempAlloc)
-                return 0;
+/* Size the optional sections and place everything in the record, once the sizes of the containers
+ * and strings are known */
+static void
+FinishLayout(BonParsedJson* pj) {
+        if (pj->options.subtreeHashes) {
+                pj->totalSubtreeHashSize = pj->containerCount * sizeof(uint64_t) + BonRoundUp(pj->containerCount * sizeof(uint32_t), 8) 
+                        + sizeof(BonSubtreeHashFooter);
+        }
 
-        status = setjmp(errorJmpBuf);
+        pj->bonRecordSize = ComputeStorageSizeForRecord(pj);
+        if (pj->options.wideOffsets || pj->bonRecordSize > 0x7fffffff) {        /* Offsets of narrow records are int32_t */
+                pj->wide                        = BON_TRUE;
+                pj->options.subtreeHashes       = BON_FALSE;                    /* The hash section has 32-bit container offsets */
+                pj->totalSubtreeHashSize        = 0;
+                pj->bonRecordSize               = ComputeStorageSizeForRecord(pj);
+        }
+        if (pj->totalNameLookupSize + pj->totalNameStringSize > 0x7fffffff) {
+                GiveUp(pj->env, BON_STATUS_RECORD_TOO_LARGE);                  /* Name offsets are int32_t also in wide records */
+        }
+}
 
-        if (0 == status) {
-                pj = BonTempCalloc(tempAlloc, tempAllocUserdata, &errorJmpBuf, BonParsedJson);
-                if (!pj) {
-                        GiveUp(&errorJmpBuf, BON_STATUS_OUT_OF_MEMORY);
-                }
-                pj->env                 = &errorJmpBuf;
-                pj->alloc               = tempAlloc;
-                pj->allocUserdata       = tempAllocUserdata;
-                pj->jsonString          = (const uint8_t*)jsonString;
-                pj->jsonStringEnd       = (const uint8_t*)jsonString + jsonStringByteCount;
-                pj->cursor              = (const uint8_t*)jsonString;
-                pj->lastContainer       = &pj->containerList;
+/* Sort strings and containers and compute where everything goes in the record */
+static void
+ComputeLayout(BonParsedJson* pj) {
+        if (pj->options.nameDictionary) {
+                RemoveDictionaryNames(pj);
+        }
 
-                if (!jsonString || jsonStringByteCount < 2) {
-                        GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
-                }
+        /* Sort the strings by hash into a canonical form */
+        SortStringList(pj, &pj->nameStringList);
+        pj->totalNameStringSize = ComputeOffsetAndLinkAliasesInSortedList(&pj->totalNameStringCount, pj->nameStringList, BON_FALSE);
+        pj->totalNameLookupSize = 8;
+        pj->totalNameLookupSize += pj->totalNameStringCount * (sizeof(BonName) + sizeof(uint32_t)); /* Name, offset pair */
 
-                /* http://www.ietf.org/rfc/rfc4627.txt, section 3. Encoding
-                 * http://en.wikipedia.org/wiki/Byte_order_mark, 
-                 * Verify that string is UTF8 by checking for nulls in the first two bytes and also for non UTF8 BOMs*/
-                if (pj->jsonString[0] == 0 || pj->jsonString[1] == 0 || pj->jsonString[0] == 0xFEu || pj->jsonString[0] == 0xFFu) {
-                        GiveUp(pj->env, BON_STATUS_JSON_NOT_UTF8);
-                }
+        SortStringList(pj, &pj->valueStringList);
+        pj->totalValueStringSize = ComputeOffsetAndLinkAliasesInSortedList(0, pj->valueStringList, BON_TRUE);
+        ReleaseSortKeys(pj);
 
-                /* Skip three byte UTF-8 BOM if there is one */
-                if (pj->jsonString[0] == 0xEFu) {
-                        if (jsonStringByteCount < 3 || pj->jsonString[1] != 0xBBu || pj->jsonString[2] != 0xBFu) {
-                                GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
-                        }
+        ComputeVariantOffsets(pj);
+        FinishLayout(pj);
+}
 
-                        pj->cursor += 3;                                        /* Skip parsing BOM */
-                }
+/*---------------------------------------------------------------------------*/
+/* Tape engine */
 
-                SkipWhitespace(pj);
-                ParseObjectOrArray(pj);
-                SkipWhitespace(pj);
+/* Bytes of the arena blocks that hold the strings and the closed containers */
+#define BON_TAPE_CHUNK_SIZE             (64 * 1024)
 
-                if (pj->cursor != pj->jsonStringEnd) {
-                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+/* Smaller pieces of unused memory are not worth keeping */
+#define BON_TAPE_MIN_SPARE_SIZE         (4 * 1024)
+
+/* The stack is kept in chunks of 1 << BON_TAPE_STACK_CHUNK_SHIFT values that are never moved */
+#define BON_TAPE_STACK_CHUNK_SHIFT      13
+#define BON_TAPE_STACK_CHUNK_COUNT      ((size_t)1 << BON_TAPE_STACK_CHUNK_SHIFT)
+
+/* Keep unused memory for a later TapeAlloc. The temp allocator has no free while parsing. */
+static void
+TapeFree(BonParsedJson* pj, void* memory, size_t byteCount) {
+        BonTapeSpare*   spare   = (BonTapeSpare*)memory;
+
+        byteCount &= ~(size_t)0x7u;
+        if (memory && byteCount >= BON_TAPE_MIN_SPARE_SIZE) {
+                spare->next             = pj->tape.spares;
+                spare->byteCount        = byteCount;
+                pj->tape.spares         = spare;
+        }
+}
+
+/* Allocate 8 byte aligned temp memory from the spares, or else a new block that BonFreeParsedJsonMemory frees */
+static void*
+TapeAlloc(BonParsedJson* pj, size_t byteCount) {
+        BonTapeSpare**  link;
+        uint8_t*        block;
+
+        if (byteCount > (size_t)-1 - 16) {
+                GiveUp(pj->env, BON_STATUS_OUT_OF_MEMORY);
+        }
+        byteCount = BonRoundUp(byteCount, 8);
+        for (link = &pj->tape.spares; *link; link = &(*link)->next) {
+                BonTapeSpare* spare = *link;
+                if (spare->byteCount >= byteCount) {
+                        *link = spare->next;
+                        TapeFree(pj, (uint8_t*)spare + byteCount, spare->byteCount - byteCount);
+                        return spare;
                 }
+        }
 
-                /* Sort the strings by hash into a canonical form */
-                BonSortList(&pj->nameStringList, BonStringEntry, NameCompare);
-                pj->totalNameStringSize = ComputeOffsetAndLinkAliasesInSortedList(&pj->totalNameStringCount, pj->nameStringList);
-                pj->totalNameLookupSize = 8;
-                pj->totalNameLookupSize += pj->totalNameStringCount * (sizeof(BonName) + sizeof(uint32_t)); /* Name, offset pair */
+        block = (uint8_t*)pj->alloc(pj->allocUserdata, byteCount + 8);
+        if (!block) {
+                GiveUp(pj->env, BON_STATUS_OUT_OF_MEMORY);
+        } else if ((uintptr_t)block & (uintptr_t)0x7u) {
+                GiveUp(pj->env, BON_STATUS_UNALIGNED_MEMORY);
+        }
+        memcpy(block, &pj->tape.blocks, sizeof(void*));
+        pj->tape.blocks = block;
+        return block + 8;
+}
 
-                BonSortList(&pj->valueStringList, BonStringEntry, NameCompare);
-                pj->totalValueStringSize = ComputeOffsetAndLinkAliasesInSortedList(0, pj->valueStringList);
+/* Return a copy of the array with twice the capacity. The old array becomes a spare. */
+static void*
+TapeGrow(BonParsedJson* pj, void* elements, size_t* capacity, size_t elementSize) {
+        const size_t    newCapacity     = *capacity ? *capacity * 2 : 256;
+        void*           newElements;
 
-                ComputeVariantOffsets(pj);
+        if (newCapacity > (size_t)-1 / 2 / elementSize) {
+                GiveUp(pj->env, BON_STATUS_OUT_OF_MEMORY);
+        }
+        newElements = TapeAlloc(pj, newCapacity * elementSize);
+        if (*capacity) {
+                memcpy(newElements, elements, *capacity * elementSize);
+                TapeFree(pj, elements, *capacity * elementSize);
+        }
+        *capacity = newCapacity;
+        return newElements;
+}
 
-                pj->bonRecordSize = ComputeStorageSizeForRecord(pj);
-        } else {
-                if (pj) {
-                        pj->status = status;
+/* Return room for byteCount bytes at the end of the arena, 8 byte aligned. What is used is kept by
+ * adding it to arenaUsed. */
+static uint8_t*
+TapeReserve(BonParsedJson* pj, size_t byteCount) {
+        BonTape* tape = &pj->tape;
+
+        tape->arenaUsed = BonRoundUp(tape->arenaUsed, 8);
+        if (!tape->arena || tape->arenaSize - tape->arenaUsed < byteCount) {
+                if (tape->arena) {
+                        TapeFree(pj, tape->arena + tape->arenaUsed, tape->arenaSize - tape->arenaUsed);
                 }
+                tape->arenaSize = BonRoundUp(byteCount > BON_TAPE_CHUNK_SIZE ? byteCount : BON_TAPE_CHUNK_SIZE, 8);
+                tape->arena     = (uint8_t*)TapeAlloc(pj, tape->arenaSize);
+                tape->arenaUsed = 0;
         }
-        return pj;
+        return tape->arena + tape->arenaUsed;
 }
 
-int                             
-BonGetParsedJsonStatus(struct BonParsedJson* parsedJson) {
-        if (parsedJson) {
-                return parsedJson->status;
-        } else {
-                return BON_STATUS_OUT_OF_MEMORY;
+/* Return byteCount bytes of the arena. A large block is allocated by itself so that the rest of
+ * the current chunk is still used. */
+static uint8_t*
+TapeArenaAlloc(BonParsedJson* pj, size_t byteCount) {
+        BonTape*        tape    = &pj->tape;
+        uint8_t*        memory;
+
+        if (byteCount > BON_TAPE_CHUNK_SIZE / 4 && (!tape->arena || tape->arenaSize - BonRoundUp(tape->arenaUsed, 8) < byteCount)) {
+                return (uint8_t*)TapeAlloc(pj, byteCount);
         }
+        memory = TapeReserve(pj, byteCount);
+        tape->arenaUsed += byteCount;
+        return memory;
 }
 
-size_t                          
-BonGetBonRecordSize(struct BonParsedJson* parsedJson) {
-        assert(parsedJson->status == BON_STATUS_OK);
-        return parsedJson->bonRecordSize;
+static BonTapeValue
+BoxTapeValue(int type, size_t index) {
+        return BON_TAPE_BOX | ((BonTapeValue)type << 48) | (BonTapeValue)index;
 }
 
-static ptrdiff_t 
-RelativeOffset(void* from, void* basePtr, size_t offsetFromBase) {
-        return ((uint8_t*)basePtr + offsetFromBase) - (uint8_t*)from;
+static int
+TapeValueType(BonTapeValue v) {
+        return (v & BON_TAPE_BOX) == BON_TAPE_BOX ? (int)((v >> 48) & 0x7u) : BON_VT_NUMBER;
 }
 
-static BonValue
-MakeObjectValue(ptrdiff_t relativeOffset) {
-        assert((relativeOffset & 0x7ll) == 0);
-        return ((BonValue)relativeOffset << 32) | (BonValue)BON_VT_OBJECT;
+static BonBool
+IsTapeContainer(BonTapeValue v) {
+        const int type = TapeValueType(v);
+        return type == BON_VT_OBJECT || type == BON_VT_ARRAY;
 }
 
-static BonValue
-MakeArrayValue(ptrdiff_t relativeOffset) {
-        assert((relativeOffset & 0x7ll) == 0);
-        return ((BonValue)relativeOffset << 32) | (BonValue)BON_VT_ARRAY;
+static BonTapeValue*
+TapeContainerValues(const BonTapeContainer* container) {
+        return (BonTapeValue*)((uint8_t*)container + BonRoundUp(sizeof(BonTapeContainer), 8));
 }
 
-static BonValue
-MakeStringValue(ptrdiff_t relativeOffset) {
-        assert((relativeOffset & 0x7ll) == 0);
-        return ((BonValue)relativeOffset << 32) | (BonValue)BON_VT_STRING;
+/* Rehash into twice as many slots */
+static void
+GrowTapeStringSlots(BonParsedJson* pj, BonTapeStringTable* table) {
+        const size_t    slotCount       = table->slotCount ? table->slotCount * 2 : 1024;
+        uint32_t*       slots           = (uint32_t*)TapeAlloc(pj, slotCount * sizeof(uint32_t));
+        size_t          i;
+
+        memset(slots, 0, slotCount * sizeof(uint32_t));
+        for (i = 0; i < table->count; ++i) {
+                size_t slot = table->strings[i].hash & (slotCount - 1);
+                while (slots[slot]) {
+                        slot = (slot + 1) & (slotCount - 1);
+                }
+                slots[slot] = (uint32_t)(i + 1);
+        }
+        TapeFree(pj, table->slots, table->slotCount * sizeof(uint32_t));
+        table->slots            = slots;
+        table->slotCount        = slotCount;
 }
 
-static BonValue
-MakeBoolValue(int v) {
-        return ((BonValue)v << 32) | (BonValue)BON_VT_BOOL;
+/* Return the index of a string just decoded to the end of the arena. A new string is kept in the arena. */
+static size_t
+InternTapeString(BonParsedJson* pj, BonTapeStringTable* table, const uint8_t* utf8, size_t byteCount) {
+        const BonName   hash    = BonCreateName((const char*)utf8, byteCount);
+        BonTapeString*  string;
+        size_t          slot;
+
+        if (2 * (table->count + 1) > table->slotCount) {
+                GrowTapeStringSlots(pj, table);
+        }
+        for (slot = hash & (table->slotCount - 1); table->slots[slot]; slot = (slot + 1) & (table->slotCount - 1)) {
+                string = &table->strings[table->slots[slot] - 1];
+                if (string->hash == hash && string->byteCount == byteCount && 0 == memcmp(string->utf8, utf8, byteCount)) {
+                        return table->slots[slot] - 1;
+                }
+        }
+
+        if ((uint64_t)table->count >= 0xffffffffull || (uint64_t)byteCount > 0xffffffffull) {
+                GiveUp(pj->env, BON_STATUS_RECORD_TOO_LARGE);                  /* 32-bit indices and byte counts */
+        }
+        if (table->count == table->capacity) {
+                table->strings = (BonTapeString*)TapeGrow(pj, table->strings, &table->capacity, sizeof(BonTapeString));
+        }
+        string                  = &table->strings[table->count];
+        string->utf8            = utf8;
+        string->offset          = 0;
+        string->byteCount       = (uint32_t)byteCount;
+        string->hash            = hash;
+        table->slots[slot]      = (uint32_t)++table->count;
+        pj->tape.arenaUsed      += byteCount;
+        return table->count - 1;
 }
 
-static BonValue
-MakeNullValue(void) {
-        return (BonValue)0x7ull;
+static size_t
+TapeParseString(BonParsedJson* pj, BonTapeStringTable* table) {
+        const uint8_t*          stringEnd;
+        BonBool                 hasEscapes;
+        const uint8_t*          string          = ScanString(pj, &stringEnd, &hasEscapes);
+        uint8_t*                utf8            = TapeReserve(pj, (size_t)(stringEnd - string));
+        const uint8_t*          utf8End         = DecodeString(pj, string, stringEnd, hasEscapes, utf8);
+
+        return InternTapeString(pj, table, utf8, (size_t)(utf8End - utf8));
 }
 
-static BonValue
-MakeNumberValue(const BonVariant* v) {
-        return (v->value.value & ~0x7ull);
+static void
+PushTapeValue(BonParsedJson* pj, BonTapeValue value) {
+        BonTape*                tape            = &pj->tape;
+        const size_t            chunk           = tape->stackSize >> BON_TAPE_STACK_CHUNK_SHIFT;
+
+        if (chunk == tape->stackChunkCount) {
+                if (tape->stackChunkCount == tape->stackChunkCapacity) {
+                        tape->stackChunks = (BonTapeValue**)TapeGrow(pj, tape->stackChunks, &tape->stackChunkCapacity, sizeof(BonTapeValue*));
+                }
+                tape->stackChunks[tape->stackChunkCount++] = (BonTapeValue*)TapeAlloc(pj, BON_TAPE_STACK_CHUNK_COUNT * sizeof(BonTapeValue));
+        }
+        tape->stackChunks[chunk][tape->stackSize & (BON_TAPE_STACK_CHUNK_COUNT - 1)] = value;
+        ++tape->stackSize;
 }
 
-static BonValue
-MakeValueFromVariant(BonParsedJson* pj, BonValue* value, BonVariant* v) {
-        switch (v->type) {
-        case BON_VT_NUMBER:     return MakeNumberValue(v);
-        case BON_VT_BOOL:       return MakeBoolValue(v->value.boolValue);
-        case BON_VT_STRING:     return MakeStringValue(RelativeOffset(value, pj->recordBaseMemory, pj->valueStringOffset + v->value.stringValue->alias->offset));
-        case BON_VT_ARRAY:      return MakeArrayValue(RelativeOffset(value, pj->recordBaseMemory, pj->arrayOffset + v->value.arrayValue->offset));
-        case BON_VT_OBJECT:     return MakeObjectValue(RelativeOffset(value, pj->recordBaseMemory, pj->objectOffset + v->value.objectValue->offset));
-        case BON_VT_NULL:       return MakeNullValue();
-        default: assert(0);     return 0;
+static BonTapeValue
+TapeStackValue(const BonTape* tape, size_t i) {
+        return tape->stackChunks[i >> BON_TAPE_STACK_CHUNK_SHIFT][i & (BON_TAPE_STACK_CHUNK_COUNT - 1)];
+}
+
+/* Return the members on top of the stack as keys (name << 32 | member index), sorted as SortObjectMembers sorts */
+static const uint64_t*
+SortTapeMembers(BonParsedJson* pj, size_t first, size_t count) {
+        BonTape*                tape            = &pj->tape;
+        size_t                  i;
+
+        if (tape->sortScratchCapacity < 2 * count) {
+                size_t capacity = tape->sortScratchCapacity ? tape->sortScratchCapacity : 256;
+                while (capacity < 2 * count) {
+                        capacity *= 2;
+                }
+                TapeFree(pj, tape->sortScratch, tape->sortScratchCapacity * sizeof(uint64_t));
+                tape->sortScratch               = (uint64_t*)TapeAlloc(pj, capacity * sizeof(uint64_t));
+                tape->sortScratchCapacity       = capacity;
         }
+        for (i = 0; i < count; ++i) {
+                tape->sortScratch[i] = ((uint64_t)(BonName)TapeStackValue(tape, first + 2 * i) << 32) | (uint64_t)i;
+        }
+        return RadixSortKeys(tape->sortScratch, tape->sortScratch + count, count);
 }
 
+/* Move the values of a container from the stack to the arena and return the container as a value of its parent */
+static BonTapeValue
+CloseTapeContainer(BonParsedJson* pj, int type, size_t first) {
+        BonTape*                tape            = &pj->tape;
+        const size_t            count           = type == BON_VT_OBJECT ? (tape->stackSize - first) / 2 : tape->stackSize - first;
+        const size_t            headerSize      = BonRoundUp(sizeof(BonTapeContainer), 8);
+        BonTapeContainer*       container;
+        BonTapeValue*           values;
+        size_t                  i;
+
+        if ((uint64_t)count > 0x7fffffffull) {
+                GiveUp(pj->env, BON_STATUS_RECORD_TOO_LARGE);                  /* Counts are int32_t */
+        }
+        if (tape->containerCount == tape->containerCapacity) {
+                tape->containers = (BonTapeContainer**)TapeGrow(pj, tape->containers, &tape->containerCapacity, sizeof(BonTapeContainer*));
+        }
 
-BonRecord*              
-BonCreateRecordFromParsedJson(BonParsedJson* pj, void* recordMemory) {
-        /* Exploit fact that both arrayValue and objectValue has a BonContainer as the first member */
-        BonContainer*           p               = pj->containerList;
-        BonRecord*              header          = (BonRecord*)recordMemory;
-        uint8_t*                baseMemory      = (uint8_t*)recordMemory;
-        BonStringEntry*         stringEntry     = 0;
-        uint32_t*               nameLookupCursor= (uint32_t*)(baseMemory + pj->nameLookupOffset);
+        if (type == BON_VT_OBJECT) {
+                const uint64_t*         keys    = SortTapeMembers(pj, first, count);
+                BonName*                names;
+                container       = (BonTapeContainer*)TapeArenaAlloc(pj, headerSize + count * (sizeof(BonTapeValue) + sizeof(BonName)));
+                values          = TapeContainerValues(container);
+                names           = (BonName*)(values + count);
+                for (i = 0; i < count; ++i) {
+                        values[i]       = TapeStackValue(tape, first + 2 * (size_t)(keys[i] & 0xffffffffu) + 1);
+                        names[i]        = (BonName)(keys[i] >> 32);
+                }
+                container->numbersOnly  = BON_FALSE;
+                container->elementType  = 0;
+        } else {
+                container       = (BonTapeContainer*)TapeArenaAlloc(pj, headerSize + count * sizeof(BonTapeValue));
+                values          = TapeContainerValues(container);
+                for (i = 0; i < count; ) {
+                        const size_t    offset  = (first + i) & (BON_TAPE_STACK_CHUNK_COUNT - 1);
+                        size_t          span    = BON_TAPE_STACK_CHUNK_COUNT - offset;
+                        if (span > count - i) {
+                                span = count - i;
+                        }
+                        memcpy(values + i, tape->stackChunks[(first + i) >> BON_TAPE_STACK_CHUNK_SHIFT] + offset, span * sizeof(BonTapeValue));
+                        i += span;
+                }
 
-        assert(pj->status == BON_STATUS_OK);
+                container->numbersOnly = BON_TRUE;
+                for (i = 0; i < count; ++i) {
+                        if (TapeValueType(values[i]) != BON_VT_NUMBER) {
+                                container->numbersOnly = BON_FALSE;
+                                break;
+                        }
+                }
+                container->elementType = 0;
+                if (MayBeTypedArray(pj, container->numbersOnly, count)) {
+                        BonNumberFit fit;
+                        InitNumberFit(&fit);
+                        for (i = 0; i < count; ++i) {
+                                double d;
+                                memcpy(&d, &values[i], sizeof(d));
+                                FitNumber(&fit, d);
+                        }
+                        container->elementType = (uint8_t)SelectElementTypeForFit(pj, &fit);
+                }
+        }
+        container->offset       = 0;
+        container->count        = (int32_t)count;
+        container->type         = (uint8_t)type;
+        tape->containers[tape->containerCount] = container;
+        tape->stackSize         = first;
+        return BoxTapeValue(type, tape->containerCount++);
+}
 
-        pj->recordBaseMemory = recordMemory;
+static BonTapeValue             TapeParseValue(BonParsedJson* pj);
 
-        /* Header */
-        header->magic                   = BonFourCC('B', 'O', 'N', ' ');
-        header->recordSize              = (uint32_t)pj->bonRecordSize;
-        header->reserved                = 0;
-        header->reserved1               = 0;
-        header->valueStringOffset       = (int32_t)RelativeOffset(&header->valueStringOffset, baseMemory, pj->valueStringOffset);
-        header->nameLookupTableOffset   = (int32_t)RelativeOffset(&header->nameLookupTableOffset, baseMemory, pj->nameLookupOffset);
-        header->rootValue               = MakeValueFromVariant(pj, &header->rootValue, &pj->rootValue);
+static BonTapeValue
+TapeParseObject(BonParsedJson* pj) {
+        const size_t            first           = pj->tape.stackSize;
 
-        /* Containers and arrays */
-        for (; p; p = p->next) {
+        FailUnlessCharIs(pj, '{');
+        SkipWhitespace(pj);
+        if (!PeekChar(pj, '}')) {
+                for (;;) {
+                        const size_t    nameIndex       = TapeParseString(pj, &pj->tape.names);
+                        SkipWhitespace(pj);
+                        FailUnlessCharIs(pj, ':');
+                        SkipWhitespace(pj);
+                        PushTapeValue(pj, (BonTapeValue)pj->tape.names.strings[nameIndex].hash);
+                        PushTapeValue(pj, TapeParseValue(pj));
+                        SkipWhitespace(pj);
+                        if (!PeekChar(pj, ','))
+                                break;
+                        FailUnlessCharIs(pj, ',');
+                        SkipWhitespace(pj);
+                }
+        }
+        FailUnlessCharIs(pj, '}');
+        return CloseTapeContainer(pj, BON_VT_OBJECT, first);
+}
+
+static BonTapeValue
+TapeParseArray(BonParsedJson* pj) {
+        const size_t            first           = pj->tape.stackSize;
+
+        FailUnlessCharIs(pj, '[');
+        SkipWhitespace(pj);
+        if (!PeekChar(pj, ']')) {
+                for (;;) {
+                        PushTapeValue(pj, TapeParseValue(pj));
+                        SkipWhitespace(pj);
+                        if (!PeekChar(pj, ','))
+                                break;
+                        FailUnlessCharIs(pj, ',');
+                        SkipWhitespace(pj);
+                }
+        }
+        FailUnlessCharIs(pj, ']');
+        return CloseTapeContainer(pj, BON_VT_ARRAY, first);
+}
+
+static BonTapeValue
+TapeParseValue(BonParsedJson* pj) {
+        BonVariant value;
+        FailIfEof(pj);
+        switch (*pj->cursor) {
+        case 'f':       ParseFalseValue(pj, &value);    return BoxTapeValue(BON_VT_BOOL, BON_FALSE);
+        case 't':       ParseTrueValue(pj, &value);     return BoxTapeValue(BON_VT_BOOL, BON_TRUE);
+        case 'n':       ParseNullValue(pj, &value);     return BoxTapeValue(BON_VT_NULL, 0);
+        case '{':       return TapeParseObject(pj);
+        case '[':       return TapeParseArray(pj);
+        case '\"':      return BoxTapeValue(BON_VT_STRING, TapeParseString(pj, &pj->tape.values));
+        default:        ParseNumberValue(pj, &value);   return value.value.value;
+        }
+}
+
+/* The stack, the sort scratch and the string slots are not needed once the text is parsed. They become spares. */
+static void
+ReleaseTapeParseState(BonParsedJson* pj) {
+        BonTape*                tape            = &pj->tape;
+        size_t                  i;
+
+        for (i = 0; i < tape->stackChunkCount; ++i) {
+                TapeFree(pj, tape->stackChunks[i], BON_TAPE_STACK_CHUNK_COUNT * sizeof(BonTapeValue));
+        }
+        TapeFree(pj, tape->stackChunks, tape->stackChunkCapacity * sizeof(BonTapeValue*));
+        TapeFree(pj, tape->sortScratch, tape->sortScratchCapacity * sizeof(uint64_t));
+        TapeFree(pj, tape->names.slots, tape->names.slotCount * sizeof(uint32_t));
+        TapeFree(pj, tape->values.slots, tape->values.slotCount * sizeof(uint32_t));
+        tape->stackChunks               = 0;
+        tape->stackChunkCount           = 0;
+        tape->stackChunkCapacity        = 0;
+        tape->sortScratch               = 0;
+        tape->sortScratchCapacity       = 0;
+        tape->names.slots               = 0;
+        tape->names.slotCount           = 0;
+        tape->values.slots              = 0;
+        tape->values.slotCount          = 0;
+}
+
+static void
+TapeParseObjectOrArray(BonParsedJson* pj) {
+        BonTape*                tape            = &pj->tape;
+        BonTapeValue            root            = 0;
+
+        FailIfEof(pj);
+        switch(*pj->cursor) {
+        case '{':
+                root = TapeParseObject(pj);
+                break;
+        case '[':
+                root = TapeParseArray(pj);
+                break;
+        default:
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                break;
+        }
+        tape->root = (size_t)(root & BON_TAPE_INDEX_MASK);
+        ReleaseTapeParseState(pj);
+}
+
+static const BonTapeString*
+TapeSortKeyString(const BonTapeStringTable* table, uint64_t key) {
+        return &table->strings[(size_t)(key & 0xffffffffu)];
+}
+
+/* Sort the keys (hash << 32 | string index) as SortStringList orders the strings of the list based parser */
+static void
+SortTapeStringKeys(BonParsedJson* pj, const BonTapeStringTable* table, uint64_t* keys, size_t keyCount) {
+        uint64_t*               scratch         = (uint64_t*)TapeAlloc(pj, keyCount * sizeof(uint64_t));
+        const uint64_t*         sorted          = RadixSortKeys(keys, scratch, keyCount);
+        size_t                  i, k;
+
+        if (sorted != keys) {
+                memcpy(keys, sorted, keyCount * sizeof(uint64_t));
+        }
+        TapeFree(pj, scratch, keyCount * sizeof(uint64_t));
+        for (i = 1; i < keyCount; ++i) {
+                const uint64_t          key     = keys[i];
+                const BonTapeString*    string  = TapeSortKeyString(table, key);
+                for (k = i; k > 0 && (keys[k - 1] >> 32) == (key >> 32); --k) {
+                        const BonTapeString* previous = TapeSortKeyString(table, keys[k - 1]);
+                        if (CompareStringBytes(previous->utf8, previous->byteCount, string->utf8, string->byteCount) <= 0)
+                                break;
+                        keys[k] = keys[k - 1];
+                }
+                keys[k] = key;
+        }
+}
+
+/* Return whether the name dictionary has the name, so that the record leaves it out */
+static BonBool
+IsTapeNameInDictionary(const BonParsedJson* pj, const BonTapeString* name) {
+        size_t                  byteCount;
+        const char*             string;
+
+        if (!pj->options.nameDictionary)
+                return BON_FALSE;
+        string = BonGetNameStringWithLength(pj->options.nameDictionary, name->hash, &byteCount);
+        return string && byteCount == name->byteCount && 0 == memcmp(string, name->utf8, byteCount);
+}
+
+/* Same layout as ComputeLayout. The containers are laid out breadth first from the root. */
+static void
+ComputeTapeLayout(BonParsedJson* pj) {
+        BonTape*                tape            = &pj->tape;
+        const BonRecord*        dictionary      = pj->options.nameDictionary;
+        uint64_t*               valueKeys;
+        size_t                  nameCount       = 0;
+        size_t                  containerCount  = 1;
+        BonBool                 removedAny      = BON_FALSE;
+        size_t                  i, k;
+
+        tape->containers[tape->root]->elementType = 0;                          /* A root value is always an array or an object */
+
+        /* Names, without those in the name dictionary. Names with the same hash share the string of the first. */
+        tape->nameKeys = (uint64_t*)TapeAlloc(pj, tape->names.count * sizeof(uint64_t));
+        for (i = 0; i < tape->names.count; ++i) {
+                const BonTapeString* name = &tape->names.strings[i];
+                if (IsTapeNameInDictionary(pj, name)) {
+                        removedAny = BON_TRUE;
+                        continue;
+                }
+                tape->nameKeys[nameCount++] = ((uint64_t)name->hash << 32) | (uint64_t)i;
+        }
+        SortTapeStringKeys(pj, &tape->names, tape->nameKeys, nameCount);
+        pj->totalNameStringSize = 0;
+        for (i = 0, k = 0; i < nameCount; ++i) {
+                if (k == 0 || (tape->nameKeys[k - 1] >> 32) != (tape->nameKeys[i] >> 32)) {
+                        BonTapeString* name = &tape->names.strings[(size_t)(tape->nameKeys[i] & 0xffffffffu)];
+                        name->offset = pj->totalNameStringSize;
+                        pj->totalNameStringSize += StringSlotSize(name->byteCount);
+                        tape->nameKeys[k++] = tape->nameKeys[i];
+                }
+        }
+        tape->nameKeyCount              = k;
+        pj->nameDictionaryId            = removedAny ? BonGetNameDictionaryId(dictionary) : 0;
+        pj->totalNameStringCount        = k;
+        pj->totalNameLookupSize         = 8;
+        pj->totalNameLookupSize         += k * (sizeof(BonName) + sizeof(uint32_t)); /* Name, offset pair */
+
+        /* Value strings, each in its own slot */
+        valueKeys = (uint64_t*)TapeAlloc(pj, tape->values.count * sizeof(uint64_t));
+        for (i = 0; i < tape->values.count; ++i) {
+                valueKeys[i] = ((uint64_t)tape->values.strings[i].hash << 32) | (uint64_t)i;
+        }
+        SortTapeStringKeys(pj, &tape->values, valueKeys, tape->values.count);
+        pj->totalValueStringSize = 0;
+        for (i = 0; i < tape->values.count; ++i) {
+                BonTapeString* string = &tape->values.strings[(size_t)(valueKeys[i] & 0xffffffffu)];
+                string->offset = pj->totalValueStringSize;
+                pj->totalValueStringSize += StringSlotSize(string->byteCount);
+        }
+        TapeFree(pj, valueKeys, tape->values.count * sizeof(uint64_t));
+
+        /* The queue of the breadth first walk is the record order */
+        tape->breadthFirst      = (size_t*)TapeAlloc(pj, tape->containerCount * sizeof(size_t));
+        tape->breadthFirst[0]   = tape->root;
+        for (i = 0; i < containerCount; ++i) {
+                BonTapeContainer*       container       = tape->containers[tape->breadthFirst[i]];
+                const BonTapeValue*     values          = TapeContainerValues(container);
+                if (container->type == BON_VT_OBJECT) {
+                        container->offset = pj->totalObjectSize;
+                        pj->totalObjectSize += ObjectSize((size_t)container->count);
+                } else {
+                        container->offset = pj->totalArraySize;
+                        pj->totalArraySize += ArraySize(container->elementType, (size_t)container->count);
+                }
+                if (container->numbersOnly)
+                        continue;
+                for (k = 0; k < (size_t)container->count; ++k) {
+                        if (IsTapeContainer(values[k])) {
+                                tape->breadthFirst[containerCount++] = (size_t)(values[k] & BON_TAPE_INDEX_MASK);
+                        }
+                }
+        }
+        assert(containerCount == tape->containerCount);
+        pj->containerCount = containerCount;
+
+        FinishLayout(pj);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Worker threads */
+
+#define BON_MAX_THREADS                 64
+
+typedef void                    (*BonJobFunction)(void* userdata, size_t jobIndex);
+
+/* Jobs 0 to jobCount - 1, taken by the threads in order */
+typedef struct BonJobs {
+        BonJobFunction          function;
+        void*                   userdata;
+        size_t                  jobCount;
+        volatile long           nextJob;
+} BonJobs;
+
+static size_t
+TakeJob(BonJobs* jobs) {
+#if defined(_WIN32)
+        return (size_t)(InterlockedIncrement(&jobs->nextJob) - 1);
+#else
+        return (size_t)__sync_fetch_and_add(&jobs->nextJob, 1);
+#endif
+}
+
+static void
+RunJobs(BonJobs* jobs) {
+        size_t job;
+        while ((job = TakeJob(jobs)) < jobs->jobCount) {
+                jobs->function(jobs->userdata, job);
+        }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI
+JobThread(LPVOID jobs) {
+        RunJobs((BonJobs*)jobs);
+        return 0;
+}
+#else
+static void*
+JobThread(void* jobs) {
+        RunJobs((BonJobs*)jobs);
+        return 0;
+}
+#endif
+
+/* 
+ * Run the jobs on up to threadCount threads, the calling thread being one of them, and return when 
+ * all are done. If a thread cannot be started the others take its jobs.
+ */
+static void
+RunInParallel(int threadCount, size_t jobCount, BonJobFunction function, void* userdata) {
+        BonJobs                 jobs;
+#if defined(_WIN32)
+        HANDLE                  threads[BON_MAX_THREADS];
+#else
+        pthread_t               threads[BON_MAX_THREADS];
+        BonBool                 started[BON_MAX_THREADS];
+#endif
+        int                     i;
+
+        jobs.function   = function;
+        jobs.userdata   = userdata;
+        jobs.jobCount   = jobCount;
+        jobs.nextJob    = 0;
+        if (threadCount > BON_MAX_THREADS) {
+                threadCount = BON_MAX_THREADS;
+        }
+        if ((size_t)threadCount > jobCount) {
+                threadCount = (int)jobCount;
+        }
+        for (i = 1; i < threadCount; ++i) {
+#if defined(_WIN32)
+                threads[i] = CreateThread(0, 0, JobThread, &jobs, 0, 0);
+#else
+                started[i] = 0 == pthread_create(&threads[i], 0, JobThread, &jobs);
+#endif
+        }
+        RunJobs(&jobs);
+        for (i = 1; i < threadCount; ++i) {
+#if defined(_WIN32)
+                if (threads[i]) {
+                        WaitForSingleObject(threads[i], INFINITE);
+                        CloseHandle(threads[i]);
+                }
+#else
+                if (started[i]) {
+                        pthread_join(threads[i], 0);
+                }
+#endif
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Parallel conversion
+ *
+ * With BonConvertOptions::threadCount the text between the brackets of the root is split at commas into 
+ * chunks, and each chunk is parsed by the tape engine into a BonParsedJson of its own. Then the chunks are
+ * merged into the layout that ComputeTapeLayout would compute for the whole text:
+ *
+ * - Strings are distributed to buckets on the top bits of their hash. Each bucket is sorted by itself, and
+ *   since a bucket holds all strings of its hashes, the buckets in order are the sorted strings.
+ * - The containers of a root array are laid out breadth first in each chunk, level by level. Level n of the
+ *   whole text is level n of the first chunk, then of the second and so on, so a chunk only needs to know
+ *   where each of its levels starts. The members of a root object are sorted, so the walk is sequential.
+ *
+ * The chunks then write their containers and the buckets their strings, all to the same record. If
+ * anything fails the text is parsed again on the calling thread, which returns the status that it would
+ * have returned anyway.
+ */
+
+/* Chunks are at least this large, to keep the cost per chunk low */
+#define BON_PARALLEL_MIN_CHUNK_SIZE     (64 * 1024)
+
+/* Strings are sorted in buckets on the top bits of their hash */
+#define BON_STRING_BUCKET_SHIFT         24
+#define BON_STRING_BUCKET_COUNT         ((size_t)1 << (32 - BON_STRING_BUCKET_SHIFT))
+
+/* BonTapeString::offset of a name that the name dictionary has */
+#define BON_TAPE_NAME_IN_DICTIONARY     ((size_t)-1)
+
+/* A level of the breadth first walk of a chunk */
+typedef struct BonTapeLevel {
+        size_t                  end;                                            /* Index in BonTapeChunk::order after its last container */
+        size_t                  objectSize;
+        size_t                  arraySize;
+        size_t                  objectBase;                                     /* Where the level of the chunk starts in the object section */
+        size_t                  arrayBase;
+} BonTapeLevel;
+
+typedef struct BonTapeChunk {
+        struct BonParsedJson*   pj;
+        const uint8_t*          text;                                           /* Elements of the root, without the commas around them */
+        const uint8_t*          textEnd;
+        BonTapeValue*           values;                                         /* The elements in order */
+        BonName*                names;                                          /* Their names, when the root is an object */
+        size_t                  count;
+        size_t                  first;                                          /* Index of the first element in a root array */
+        BonBool                 numbersOnly;
+        size_t*                 order;                                          /* Containers breadth first (root arrays) */
+        BonTapeLevel*           levels;
+        size_t                  levelCount;
+        size_t                  levelCapacity;
+        size_t                  nameBuckets[BON_STRING_BUCKET_COUNT];           /* String counts, then where they go in the sorted arrays */
+        size_t                  valueBuckets[BON_STRING_BUCKET_COUNT];
+        BonBool                 removedAny;                                     /* Names were left out for the name dictionary */
+} BonTapeChunk;
+
+/* A container in the breadth first walk of a root object */
+typedef struct BonTapeContainerRef {
+        size_t                  chunk;
+        size_t                  index;
+} BonTapeContainerRef;
+
+typedef struct BonParallelJson {
+        BonTapeChunk*           chunks;
+        size_t                  chunkCount;
+        int                     threadCount;
+        void                    (*phase)(struct BonParsedJson* pj, BonTapeChunk* chunk);
+
+        int                     rootType;
+        size_t                  rootCount;
+        BonBool                 rootNumbersOnly;
+        const BonTapeEntry*     rootMembers;                                    /* Sorted, when the root is an object */
+        BonTapeContainerRef*    breadthFirst;                                   /* When the root is an object */
+        size_t                  levelCount;                                     /* Most levels of a chunk, when the root is an array */
+
+        BonTapeString**         names;                                          /* All strings by hash and bytes, bucket after bucket */
+        BonTapeString**         values;
+        size_t                  nameBuckets[BON_STRING_BUCKET_COUNT + 1];       /* Where each bucket starts */
+        size_t                  valueBuckets[BON_STRING_BUCKET_COUNT + 1];
+        size_t                  nameSizes[BON_STRING_BUCKET_COUNT];             /* Bytes of each bucket, then where it starts in its section */
+        size_t                  valueSizes[BON_STRING_BUCKET_COUNT];
+        size_t                  nameCounts[BON_STRING_BUCKET_COUNT];            /* Names in the record, then the index of the first */
+        BonBool                 merged;                                         /* The chunks make up the record */
+} BonParallelJson;
+
+/* Run the phase of the parallel conversion on a chunk. An error is kept in its status. */
+static void
+RunChunkPhase(void* userdata, size_t jobIndex) {
+        BonParsedJson*          pj              = (BonParsedJson*)userdata;
+        BonTapeChunk*           chunk           = &pj->parallel->chunks[jobIndex];
+        jmp_buf                 errorJmpBuf;
+        int                     status;
+
+        status = setjmp(errorJmpBuf);
+        if (0 == status) {
+                chunk->pj->env = &errorJmpBuf;
+                pj->parallel->phase(pj, chunk);
+        } else {
+                chunk->pj->status = status;
+        }
+        chunk->pj->env = 0;
+}
+
+/* Run the phase on all chunks. Return whether all succeeded. */
+static BonBool
+RunChunkPhaseInParallel(BonParsedJson* pj, void (*phase)(BonParsedJson* pj, BonTapeChunk* chunk)) {
+        BonParallelJson*        par             = pj->parallel;
+        size_t                  i;
+
+        par->phase = phase;
+        RunInParallel(par->threadCount, par->chunkCount, RunChunkPhase, pj);
+        for (i = 0; i < par->chunkCount; ++i) {
+                if (par->chunks[i].pj->status != BON_STATUS_OK)
+                        return BON_FALSE;
+        }
+        return BON_TRUE;
+}
+
+/* 
+ * Split the elements of the root at the cursor into chunks of at least chunkSize bytes at the commas 
+ * between them. The text is classified 64 bytes at a time as by the structural index, and only the 
+ * bytes outside strings that are not whitespace are looked at. The chunks are checked when they are 
+ * parsed, so a text that is not JSON only needs to end up in some chunks. Return the end of the root,
+ * or 0 if it does not end.
+ */
+static const uint8_t*
+SplitRootElements(BonParsedJson* pj, size_t chunkSize) {
+        BonParallelJson*        par             = pj->parallel;
+        const uint8_t*          end             = pj->jsonStringEnd;
+        const uint8_t*          start           = pj->cursor + 1;
+        const uint8_t*          block;
+        uint64_t                escapedCarry    = 0;
+        uint64_t                inStringCarry   = 0;
+        size_t                  depth           = 0;
+
+        for (block = start; block < end; block += 64) {
+                uint8_t                 padded[64];
+                BonBlockMasks           masks;
+                uint64_t                escaped, quotes, inString, bits;
+
+                if (end - block < 64) {                                         /* Pad the last block with whitespace */
+                        memset(padded, 0x20, sizeof(padded));
+                        memcpy(padded, block, (size_t)(end - block));
+                        ClassifyBlock(padded, &masks);
+                } else {
+                        ClassifyBlock(block, &masks);
+                }
+                escaped         = FindEscaped(masks.backslash, &escapedCarry);
+                quotes          = masks.quote & ~escaped;
+                inString        = PrefixXor(quotes) ^ inStringCarry;
+                inStringCarry   = (uint64_t)((int64_t)inString >> 63);
+
+                for (bits = ~inString & ~quotes & ~masks.whitespace; bits; bits &= bits - 1) {
+                        const uint8_t* p = block + CountTrailingZeros64(bits);
+                        switch (*p) {
+                        case '[':
+                        case '{':
+                                ++depth;
+                                break;
+                        case ']':
+                        case '}':
+                                if (depth == 0) {
+                                        par->chunks[par->chunkCount].text       = start;
+                                        par->chunks[par->chunkCount].textEnd    = p;
+                                        ++par->chunkCount;
+                                        return p + 1;
+                                }
+                                --depth;
+                                break;
+                        case ',':
+                                if (depth == 0 && (size_t)(p - start) >= chunkSize) {
+                                        par->chunks[par->chunkCount].text       = start;
+                                        par->chunks[par->chunkCount].textEnd    = p;
+                                        ++par->chunkCount;
+                                        start = p + 1;
+                                }
+                                break;
+                        default:
+                                break;
+                        }
+                }
+        }
+        return 0;
+}
+
+/* Lay out the containers of a chunk breadth first, each level on its own from offset 0 */
+static void
+LayOutChunk(BonParsedJson* cj, BonTapeChunk* chunk) {
+        BonTape*                tape            = &cj->tape;
+        size_t                  queued          = 0;
+        size_t                  i               = 0;
+        size_t                  k;
+
+        chunk->order = (size_t*)TapeAlloc(cj, tape->containerCount * sizeof(size_t));
+        for (k = 0; k < chunk->count; ++k) {
+                if (IsTapeContainer(chunk->values[k])) {
+                        chunk->order[queued++] = (size_t)(chunk->values[k] & BON_TAPE_INDEX_MASK);
+                }
+        }
+        while (i < queued) {
+                BonTapeLevel*   level;
+                if (chunk->levelCount == chunk->levelCapacity) {
+                        chunk->levels = (BonTapeLevel*)TapeGrow(cj, chunk->levels, &chunk->levelCapacity, sizeof(BonTapeLevel));
+                }
+                level                   = &chunk->levels[chunk->levelCount++];
+                level->end              = queued;
+                level->objectSize       = 0;
+                level->arraySize        = 0;
+                for (; i < level->end; ++i) {
+                        BonTapeContainer*       container       = tape->containers[chunk->order[i]];
+                        const BonTapeValue*     values          = TapeContainerValues(container);
+                        if (container->type == BON_VT_OBJECT) {
+                                container->offset = level->objectSize;
+                                level->objectSize += ObjectSize((size_t)container->count);
+                        } else {
+                                container->offset = level->arraySize;
+                                level->arraySize += ArraySize(container->elementType, (size_t)container->count);
+                        }
+                        if (container->numbersOnly)
+                                continue;
+                        for (k = 0; k < (size_t)container->count; ++k) {
+                                if (IsTapeContainer(values[k])) {
+                                        chunk->order[queued++] = (size_t)(values[k] & BON_TAPE_INDEX_MASK);
+                                }
+                        }
+                }
+        }
+        assert(queued == tape->containerCount);
+}
+
+/* Parse the elements of a chunk, count its strings per bucket and lay out its containers */
+static void
+ParseChunk(BonParsedJson* pj, BonTapeChunk* chunk) {
+        BonParsedJson*          cj              = chunk->pj;
+        BonTape*                tape            = &cj->tape;
+        const BonBool           object          = pj->parallel->rootType == BON_VT_OBJECT;
+        size_t                  i;
+
+        if (!cj->options.scalarParse) {
+                InitJsonIndex(cj);
+        }
+        SkipWhitespace(cj);
+        for (;;) {
+                if (object) {
+                        const size_t    nameIndex       = TapeParseString(cj, &tape->names);
+                        SkipWhitespace(cj);
+                        FailUnlessCharIs(cj, ':');
+                        SkipWhitespace(cj);
+                        PushTapeValue(cj, (BonTapeValue)tape->names.strings[nameIndex].hash);
+                }
+                PushTapeValue(cj, TapeParseValue(cj));
+                SkipWhitespace(cj);
+                if (cj->cursor == cj->jsonStringEnd)
+                        break;
+                FailUnlessCharIs(cj, ',');
+                SkipWhitespace(cj);
+        }
+
+        /* The elements leave the stack for arrays of their own */
+        chunk->count    = object ? tape->stackSize / 2 : tape->stackSize;
+        chunk->values   = (BonTapeValue*)TapeAlloc(cj, chunk->count * sizeof(BonTapeValue));
+        if (object) {
+                chunk->names = (BonName*)TapeAlloc(cj, chunk->count * sizeof(BonName));
+                for (i = 0; i < chunk->count; ++i) {
+                        chunk->names[i]         = (BonName)TapeStackValue(tape, 2 * i);
+                        chunk->values[i]        = TapeStackValue(tape, 2 * i + 1);
+                }
+        } else {
+                for (i = 0; i < chunk->count; ++i) {
+                        chunk->values[i]        = TapeStackValue(tape, i);
+                }
+        }
+        ReleaseTapeParseState(cj);
+
+        chunk->numbersOnly = BON_TRUE;
+        for (i = 0; i < chunk->count && chunk->numbersOnly; ++i) {
+                chunk->numbersOnly = TapeValueType(chunk->values[i]) == BON_VT_NUMBER;
+        }
+
+        for (i = 0; i < tape->names.count; ++i) {
+                BonTapeString* name = &tape->names.strings[i];
+                if (IsTapeNameInDictionary(cj, name)) {
+                        name->offset            = BON_TAPE_NAME_IN_DICTIONARY;
+                        chunk->removedAny       = BON_TRUE;
+                } else {
+                        ++chunk->nameBuckets[name->hash >> BON_STRING_BUCKET_SHIFT];
+                }
+        }
+        for (i = 0; i < tape->values.count; ++i) {
+                ++chunk->valueBuckets[tape->values.strings[i].hash >> BON_STRING_BUCKET_SHIFT];
+        }
+
+        if (!object) {
+                LayOutChunk(cj, chunk);
+        }
+}
+
+/* Put the strings of a chunk in their buckets */
+static void
+ScatterChunkStrings(BonParsedJson* pj, BonTapeChunk* chunk) {
+        BonParallelJson*        par             = pj->parallel;
+        BonTape*                tape            = &chunk->pj->tape;
+        size_t                  i;
+
+        for (i = 0; i < tape->names.count; ++i) {
+                BonTapeString* name = &tape->names.strings[i];
+                if (name->offset != BON_TAPE_NAME_IN_DICTIONARY) {
+                        par->names[chunk->nameBuckets[name->hash >> BON_STRING_BUCKET_SHIFT]++] = name;
+                }
+        }
+        for (i = 0; i < tape->values.count; ++i) {
+                BonTapeString* string = &tape->values.strings[i];
+                par->values[chunk->valueBuckets[string->hash >> BON_STRING_BUCKET_SHIFT]++] = string;
+        }
+}
+
+/* Order as SortStringList */
+static int
+CompareTapeStrings(const void* a, const void* b) {
+        const BonTapeString*    x       = *(const BonTapeString* const*)a;
+        const BonTapeString*    y       = *(const BonTapeString* const*)b;
+        if (x->hash != y->hash)
+                return x->hash < y->hash ? -1 : 1;
+        return CompareStringBytes(x->utf8, x->byteCount, y->utf8, y->byteCount);
+}
+
+/* 
+ * Sort a bucket of names (the first BON_STRING_BUCKET_COUNT jobs) or value strings and give each string its
+ * offset in the bucket. Equal value strings of different chunks share a slot, and names the slot of the
+ * first with the same hash, as in ComputeTapeLayout.
+ */
+static void
+SortStringBucket(void* userdata, size_t jobIndex) {
+        BonParallelJson*        par             = ((BonParsedJson*)userdata)->parallel;
+        const BonBool           names           = jobIndex < BON_STRING_BUCKET_COUNT;
+        const size_t            bucket          = jobIndex % BON_STRING_BUCKET_COUNT;
+        BonTapeString**         strings         = names ? par->names : par->values;
+        const size_t*           buckets         = names ? par->nameBuckets : par->valueBuckets;
+        size_t                  size            = 0;
+        size_t                  count           = 0;
+        size_t                  i;
+
+        qsort(strings + buckets[bucket], buckets[bucket + 1] - buckets[bucket], sizeof(BonTapeString*), CompareTapeStrings);
+        for (i = buckets[bucket]; i < buckets[bucket + 1]; ++i) {
+                BonTapeString*          string          = strings[i];
+                const BonTapeString*    previous        = i > buckets[bucket] ? strings[i - 1] : 0;
+                if (previous && previous->hash == string->hash 
+                        && (names || 0 == CompareStringBytes(previous->utf8, previous->byteCount, string->utf8, string->byteCount))) {
+                        string->offset = previous->offset;
+                } else {
+                        string->offset = size;
+                        size += StringSlotSize(string->byteCount);
+                        ++count;
+                }
+        }
+        if (names) {
+                par->nameSizes[bucket]  = size;
+                par->nameCounts[bucket] = count;
+        } else {
+                par->valueSizes[bucket] = size;
+        }
+}
+
+/* Move the strings and containers of a chunk from the offsets in their bucket or level to those in the record */
+static void
+AddChunkOffsets(BonParsedJson* pj, BonTapeChunk* chunk) {
+        BonParallelJson*        par             = pj->parallel;
+        BonTape*                tape            = &chunk->pj->tape;
+        size_t                  i, k;
+
+        for (i = 0; i < tape->names.count; ++i) {
+                BonTapeString* name = &tape->names.strings[i];
+                if (name->offset != BON_TAPE_NAME_IN_DICTIONARY) {
+                        name->offset += par->nameSizes[name->hash >> BON_STRING_BUCKET_SHIFT];
+                }
+        }
+        for (i = 0; i < tape->values.count; ++i) {
+                BonTapeString* string = &tape->values.strings[i];
+                string->offset += par->valueSizes[string->hash >> BON_STRING_BUCKET_SHIFT];
+        }
+        for (i = 0, k = 0; k < chunk->levelCount; ++k) {
+                for (; i < chunk->levels[k].end; ++i) {
+                        BonTapeContainer* container = tape->containers[chunk->order[i]];
+                        container->offset += container->type == BON_VT_OBJECT ? chunk->levels[k].objectBase : chunk->levels[k].arrayBase;
+                }
+        }
+}
+
+/* Sort the strings of all chunks and compute the sizes of the string sections */
+static void
+MergeChunkStrings(BonParsedJson* pj) {
+        BonParallelJson*        par             = pj->parallel;
+        size_t                  nameCount       = 0;
+        size_t                  valueCount      = 0;
+        size_t                  b, c;
+
+        for (b = 0; b < BON_STRING_BUCKET_COUNT; ++b) {
+                par->nameBuckets[b]     = nameCount;
+                par->valueBuckets[b]    = valueCount;
+                for (c = 0; c < par->chunkCount; ++c) {
+                        BonTapeChunk*   chunk   = &par->chunks[c];
+                        const size_t    names   = chunk->nameBuckets[b];
+                        const size_t    values  = chunk->valueBuckets[b];
+                        chunk->nameBuckets[b]   = nameCount;
+                        chunk->valueBuckets[b]  = valueCount;
+                        nameCount               += names;
+                        valueCount              += values;
+                }
+        }
+        par->nameBuckets[BON_STRING_BUCKET_COUNT]       = nameCount;
+        par->valueBuckets[BON_STRING_BUCKET_COUNT]      = valueCount;
+        if (nameCount > (size_t)-1 / sizeof(BonTapeString*) || valueCount > (size_t)-1 / sizeof(BonTapeString*)) {
+                GiveUp(pj->env, BON_STATUS_OUT_OF_MEMORY);
+        }
+        par->names      = (BonTapeString**)TapeAlloc(pj, nameCount * sizeof(BonTapeString*));
+        par->values     = (BonTapeString**)TapeAlloc(pj, valueCount * sizeof(BonTapeString*));
+        RunChunkPhaseInParallel(pj, ScatterChunkStrings);
+        RunInParallel(par->threadCount, 2 * BON_STRING_BUCKET_COUNT, SortStringBucket, pj);
+
+        pj->totalNameStringSize         = 0;
+        pj->totalNameStringCount        = 0;
+        pj->totalValueStringSize        = 0;
+        for (b = 0; b < BON_STRING_BUCKET_COUNT; ++b) {
+                const size_t    nameSize        = par->nameSizes[b];
+                const size_t    bucketNames     = par->nameCounts[b];
+                const size_t    valueSize       = par->valueSizes[b];
+                par->nameSizes[b]               = pj->totalNameStringSize;
+                par->nameCounts[b]              = pj->totalNameStringCount;
+                par->valueSizes[b]              = pj->totalValueStringSize;
+                pj->totalNameStringSize         += nameSize;
+                pj->totalNameStringCount        += bucketNames;
+                pj->totalValueStringSize        += valueSize;
+        }
+        pj->totalNameLookupSize         = 8;
+        pj->totalNameLookupSize         += pj->totalNameStringCount * (sizeof(BonName) + sizeof(uint32_t)); /* Name, offset pair */
+        pj->nameDictionaryId            = 0;
+        for (c = 0; c < par->chunkCount; ++c) {
+                if (par->chunks[c].removedAny) {
+                        pj->nameDictionaryId = BonGetNameDictionaryId(pj->options.nameDictionary);
+                }
+        }
+}
+
+/* Lay out a root array and its containers: level by level, and in a level chunk by chunk. The root
+ * itself is never a typed array. */
+static void
+MergeRootArray(BonParsedJson* pj) {
+        BonParallelJson*        par             = pj->parallel;
+        size_t                  c, k;
+
+        par->rootNumbersOnly = BON_TRUE;
+        for (c = 0; c < par->chunkCount; ++c) {
+                const BonTapeChunk* chunk = &par->chunks[c];
+                par->rootNumbersOnly    = par->rootNumbersOnly && chunk->numbersOnly;
+                if (chunk->levelCount > par->levelCount) {
+                        par->levelCount = chunk->levelCount;
+                }
+        }
+        pj->totalObjectSize     = 0;
+        pj->totalArraySize      = ArraySize(0, par->rootCount);
+        pj->containerCount      = 1;
+        for (k = 0; k < par->levelCount; ++k) {
+                for (c = 0; c < par->chunkCount; ++c) {
+                        BonTapeChunk* chunk = &par->chunks[c];
+                        if (k < chunk->levelCount) {
+                                chunk->levels[k].objectBase     = pj->totalObjectSize;
+                                chunk->levels[k].arrayBase      = pj->totalArraySize;
+                                pj->totalObjectSize             += chunk->levels[k].objectSize;
+                                pj->totalArraySize              += chunk->levels[k].arraySize;
+                        }
+                }
+        }
+        for (c = 0; c < par->chunkCount; ++c) {
+                pj->containerCount += par->chunks[c].pj->tape.containerCount;
+        }
+}
+
+/* Sort the members of a root object and lay out the containers breadth first from it */
+static void
+MergeRootObject(BonParsedJson* pj) {
+        BonParallelJson*        par             = pj->parallel;
+        BonTapeEntry*           src             = (BonTapeEntry*)TapeAlloc(pj, par->rootCount * sizeof(BonTapeEntry));
+        BonTapeEntry*           members         = (BonTapeEntry*)TapeAlloc(pj, par->rootCount * sizeof(BonTapeEntry));
+        uint64_t*               keys            = (uint64_t*)TapeAlloc(pj, 2 * par->rootCount * sizeof(uint64_t));
+        const uint64_t*         sorted;
+        size_t                  containerCount  = 1;
+        size_t                  queued          = 0;
+        size_t                  c, i, k;
+
+        /* In the order of the text, as SortTapeMembers */
+        for (c = 0, k = 0; c < par->chunkCount; ++c) {
+                const BonTapeChunk* chunk = &par->chunks[c];
+                for (i = 0; i < chunk->count; ++i, ++k) {
+                        src[k].value    = chunk->values[i];
+                        src[k].name     = chunk->names[i];
+                        src[k].chunk    = (uint32_t)c;
+                        keys[k]         = ((uint64_t)chunk->names[i] << 32) | (uint64_t)k;
+                }
+                containerCount += chunk->pj->tape.containerCount;
+        }
+        sorted = RadixSortKeys(keys, keys + par->rootCount, par->rootCount);
+        for (i = 0; i < par->rootCount; ++i) {
+                members[i] = src[(size_t)(sorted[i] & 0xffffffffu)];
+        }
+        TapeFree(pj, keys, 2 * par->rootCount * sizeof(uint64_t));
+        TapeFree(pj, src, par->rootCount * sizeof(BonTapeEntry));
+        par->rootMembers        = members;
+        par->breadthFirst       = (BonTapeContainerRef*)TapeAlloc(pj, containerCount * sizeof(BonTapeContainerRef));
+        for (i = 0; i < par->rootCount; ++i) {
+                if (IsTapeContainer(par->rootMembers[i].value)) {
+                        par->breadthFirst[queued].chunk = par->rootMembers[i].chunk;
+                        par->breadthFirst[queued].index = (size_t)(par->rootMembers[i].value & BON_TAPE_INDEX_MASK);
+                        ++queued;
+                }
+        }
+        pj->totalObjectSize     = ObjectSize(par->rootCount);
+        pj->totalArraySize      = 0;
+        for (i = 0; i < queued; ++i) {
+                const BonTapeContainerRef       ref             = par->breadthFirst[i];
+                BonTapeContainer*               container       = par->chunks[ref.chunk].pj->tape.containers[ref.index];
+                const BonTapeValue*             values          = TapeContainerValues(container);
+                if (container->type == BON_VT_OBJECT) {
+                        container->offset = pj->totalObjectSize;
+                        pj->totalObjectSize += ObjectSize((size_t)container->count);
+                } else {
+                        container->offset = pj->totalArraySize;
+                        pj->totalArraySize += ArraySize(container->elementType, (size_t)container->count);
+                }
+                if (container->numbersOnly)
+                        continue;
+                for (k = 0; k < (size_t)container->count; ++k) {
+                        if (IsTapeContainer(values[k])) {
+                                par->breadthFirst[queued].chunk = ref.chunk;
+                                par->breadthFirst[queued].index = (size_t)(values[k] & BON_TAPE_INDEX_MASK);
+                                ++queued;
+                        }
+                }
+        }
+        assert(queued + 1 == containerCount);
+        pj->containerCount = containerCount;
+}
+
+/* 
+ * Parse the text from the root at the cursor on worker threads. Return BON_FALSE, with the cursor
+ * where it was, if the text is too small to split or anything fails, so that it is parsed as usual.
+ */
+static BonBool
+ParseInParallel(BonParsedJson* pj) {
+        const uint8_t*          root            = pj->cursor;
+        const size_t            byteCount       = (size_t)(pj->jsonStringEnd - root);
+        const int               threadCount     = pj->options.threadCount < BON_MAX_THREADS ? pj->options.threadCount : BON_MAX_THREADS;
+        size_t                  chunkSize       = byteCount / ((size_t)threadCount * 4);
+        const uint8_t*          rootEnd;
+        BonParallelJson*        par;
+        size_t                  c;
+
+        if (chunkSize < BON_PARALLEL_MIN_CHUNK_SIZE) {
+                chunkSize = BON_PARALLEL_MIN_CHUNK_SIZE;
+        }
+        if (byteCount < 2 * chunkSize || (*root != '[' && *root != '{'))
+                return BON_FALSE;
+
+        par                     = (BonParallelJson*)TapeAlloc(pj, sizeof(BonParallelJson));
+        memset(par, 0, sizeof(BonParallelJson));
+        pj->parallel            = par;
+        par->threadCount        = threadCount;
+        par->rootType           = *root == '{' ? BON_VT_OBJECT : BON_VT_ARRAY;
+        par->chunks             = (BonTapeChunk*)TapeAlloc(pj, (byteCount / chunkSize + 2) * sizeof(BonTapeChunk));
+        memset(par->chunks, 0, (byteCount / chunkSize + 2) * sizeof(BonTapeChunk));
+
+        /* The root must close with its own bracket and only whitespace may follow */
+        rootEnd = SplitRootElements(pj, chunkSize);
+        if (!rootEnd || par->chunkCount < 2 || rootEnd[-1] != (par->rootType == BON_VT_OBJECT ? '}' : ']'))
+                return BON_FALSE;
+        for (; rootEnd != pj->jsonStringEnd; ++rootEnd) {
+                if (!IsWhitespace(*rootEnd))
+                        return BON_FALSE;
+        }
+
+        for (c = 0; c < par->chunkCount; ++c) {
+                BonTapeChunk*   chunk   = &par->chunks[c];
+                BonParsedJson*  cj      = BonTempCalloc(pj->alloc, pj->allocUserdata, pj->env, BonParsedJson);
+                chunk->pj               = cj;
+                cj->alloc               = pj->alloc;
+                cj->allocUserdata       = pj->allocUserdata;
+                cj->jsonString          = chunk->text;
+                cj->jsonStringEnd       = chunk->textEnd;
+                cj->cursor              = chunk->text;
+                cj->lastContainer       = &cj->containerList;
+                cj->options             = pj->options;
+                cj->options.tape        = BON_TRUE;
+                cj->options.threadCount = 0;
+        }
+        if (!RunChunkPhaseInParallel(pj, ParseChunk)) {
+                pj->cursor = root;
+                return BON_FALSE;
+        }
+
+        for (c = 0; c < par->chunkCount; ++c) {
+                par->chunks[c].first    = par->rootCount;
+                par->rootCount          += par->chunks[c].count;
+        }
+        if ((uint64_t)par->rootCount > 0x7fffffffull) {
+                GiveUp(pj->env, BON_STATUS_RECORD_TOO_LARGE);                  /* Counts are int32_t */
+        }
+        if (par->rootType == BON_VT_OBJECT) {
+                MergeRootObject(pj);
+        } else {
+                MergeRootArray(pj);
+        }
+        MergeChunkStrings(pj);
+        RunChunkPhaseInParallel(pj, AddChunkOffsets);
+        FinishLayout(pj);
+        par->merged = BON_TRUE;
+        return BON_TRUE;
+}
+
+BonParsedJson*
+BonParseJson(BonTempMemoryAlloc tempAlloc, void* tempAllocUserdata, const char* jsonString, size_t jsonStringByteCount) {
+        return BonParseJsonWithOptions(tempAlloc, tempAllocUserdata, jsonString, jsonStringByteCount, 0);
+}
+
+BonParsedJson*
+BonParseJsonWithOptions(BonTempMemoryAlloc tempAlloc, void* tempAllocUserdata, const char* jsonString, size_t jsonStringByteCount, const BonConvertOptions* options) {
+        BonParsedJson* volatile pj = 0;                                         /* volatile: must survive longjmp */
+        jmp_buf                 errorJmpBuf;
+        int                     status;
+
+        if (!tempAlloc)
+                return 0;
+
+        status = setjmp(errorJmpBuf);
+
+        if (0 == status) {
+                pj = BonTempCalloc(tempAlloc, tempAllocUserdata, &errorJmpBuf, BonParsedJson);
+                if (!pj) {
+                        GiveUp(&errorJmpBuf, BON_STATUS_OUT_OF_MEMORY);
+                }
+                pj->env                 = &errorJmpBuf;
+                pj->alloc               = tempAlloc;
+                pj->allocUserdata       = tempAllocUserdata;
+                pj->jsonString          = (const uint8_t*)jsonString;
+                pj->jsonStringEnd       = (const uint8_t*)jsonString + jsonStringByteCount;
+                pj->cursor              = (const uint8_t*)jsonString;
+                pj->lastContainer       = &pj->containerList;
+                if (options) {
+                        pj->options     = *options;
+                }
+
+                if (!jsonString || jsonStringByteCount < 2) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
+                }
+
+                if (!pj->options.scalarParse) {
+                        InitJsonIndex(pj);
+                }
+
+                /* http://www.ietf.org/rfc/rfc4627.txt, section 3. Encoding
+                 * http://en.wikipedia.org/wiki/Byte_order_mark, 
+                 * Verify that string is UTF8 by checking for nulls in the first two bytes and also for non UTF8 BOMs*/
+                if (pj->jsonString[0] == 0 || pj->jsonString[1] == 0 || pj->jsonString[0] == 0xFEu || pj->jsonString[0] == 0xFFu) {
+                        GiveUp(pj->env, BON_STATUS_JSON_NOT_UTF8);
+                }
+
+                /* Skip three byte UTF-8 BOM if there is one */
+                if (pj->jsonString[0] == 0xEFu) {
+                        if (jsonStringByteCount < 3 || pj->jsonString[1] != 0xBBu || pj->jsonString[2] != 0xBFu) {
+                                GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
+                        }
+
+                        pj->cursor += 3;                                        /* Skip parsing BOM */
+                }
+
+                SkipWhitespace(pj);
+                if (pj->options.threadCount > 1 && ParseInParallel(pj)) {
+                        return pj;
+                }
+                if (pj->options.tape) {
+                        TapeParseObjectOrArray(pj);
+                } else {
+                        ParseObjectOrArray(pj);
+                }
+                SkipWhitespace(pj);
+
+                if (pj->cursor != pj->jsonStringEnd) {
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                }
+
+                if (pj->options.tape) {
+                        ComputeTapeLayout(pj);
+                } else {
+                        ComputeLayout(pj);
+                }
+        } else {
+                if (pj) {
+                        pj->status = status;
+                }
+        }
+        return pj;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Push parser */
+
+#define BON_PUSH_HEAD                   0                                       /* Waiting for the first three bytes */
+#define BON_PUSH_ROOT                   1
+#define BON_PUSH_VALUE_OR_CLOSE         2                                       /* After [ */
+#define BON_PUSH_VALUE                  3
+#define BON_PUSH_NAME_OR_CLOSE          4                                       /* After { */
+#define BON_PUSH_NAME                   5
+#define BON_PUSH_COLON                  6
+#define BON_PUSH_COMMA_OR_CLOSE         7
+#define BON_PUSH_END                    8
+
+#define BON_PUSH_TOKEN_STRING           1
+#define BON_PUSH_TOKEN_BARE             2                                       /* A number or a literal */
+
+#define IsBareTokenChar(c) (((c) >= '0' && (c) <= '9') || ((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || (c) == '-' || (c) == '+' || (c) == '.')
+
+/* Return the end of a token that goes on at p, or 0 if it may go on after end. A string token
+ * starts after its opening quote. */
+static const uint8_t*
+FindPushTokenEnd(int kind, const uint8_t* p, const uint8_t* end, BonBool* escaped) {
+        if (kind == BON_PUSH_TOKEN_BARE) {
+                while (p != end && IsBareTokenChar(*p)) {
+                        ++p;
+                }
+                return p != end ? p : 0;
+        }
+        for (; p != end; ++p) {
+                if (*escaped) {
+                        *escaped = BON_FALSE;
+                } else if (*p == '\\') {
+                        *escaped = BON_TRUE;
+                } else if (*p == '\"') {
+                        return p + 1;
+                }
+        }
+        return 0;
+}
+
+static void
+AppendPushToken(BonParsedJson* pj, const uint8_t* p, const uint8_t* end) {
+        BonPushParser*          push            = &pj->push;
+        const size_t            byteCount       = (size_t)(end - p);
+
+        while (push->tokenCapacity - push->tokenSize < byteCount) {
+                push->token = (uint8_t*)TapeGrow(pj, push->token, &push->tokenCapacity, 1);
+        }
+        memcpy(push->token + push->tokenSize, p, byteCount);
+        push->tokenSize += byteCount;
+}
+
+static void
+OpenPushContainer(BonParsedJson* pj, int type) {
+        BonPushParser*          push            = &pj->push;
+
+        if (push->frameCount == push->frameCapacity) {
+                push->frames = (BonPushFrame*)TapeGrow(pj, push->frames, &push->frameCapacity, sizeof(BonPushFrame));
+        }
+        push->frames[push->frameCount].first    = pj->tape.stackSize;
+        push->frames[push->frameCount].type     = type;
+        ++push->frameCount;
+        push->state = type == BON_VT_OBJECT ? BON_PUSH_NAME_OR_CLOSE : BON_PUSH_VALUE_OR_CLOSE;
+}
+
+static void
+ClosePushContainer(BonParsedJson* pj, int type) {
+        BonPushParser*          push            = &pj->push;
+        const BonPushFrame*     frame           = &push->frames[push->frameCount - 1];
+        BonTapeValue            value;
+
+        if (frame->type != type) {
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+        }
+        value = CloseTapeContainer(pj, type, frame->first);
+        if (--push->frameCount == 0) {
+                pj->tape.root   = (size_t)(value & BON_TAPE_INDEX_MASK);
+                push->state     = BON_PUSH_END;
+        } else {
+                PushTapeValue(pj, value);
+                push->state     = BON_PUSH_COMMA_OR_CLOSE;
+        }
+}
+
+/* Parse a whole string, number or literal as a name or a value. The same functions as for a
+ * contiguous text do the work, with the token as the text. */
+static void
+ParsePushToken(BonParsedJson* pj, const uint8_t* token, const uint8_t* tokenEnd) {
+        BonPushParser*          push            = &pj->push;
+
+        pj->cursor              = token;
+        pj->jsonStringEnd       = tokenEnd;
+        if (push->state == BON_PUSH_NAME || push->state == BON_PUSH_NAME_OR_CLOSE) {
+                const size_t nameIndex = TapeParseString(pj, &pj->tape.names);
+                PushTapeValue(pj, (BonTapeValue)pj->tape.names.strings[nameIndex].hash);
+                push->state = BON_PUSH_COLON;
+        } else {
+                PushTapeValue(pj, TapeParseValue(pj));
+                push->state = BON_PUSH_COMMA_OR_CLOSE;
+        }
+        if (pj->cursor != tokenEnd) {
+                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);                  /* E.g. 1x or truex */
+        }
+}
+
+static void
+PushParseBytes(BonParsedJson* pj, const uint8_t* p, const uint8_t* end) {
+        BonPushParser*          push            = &pj->push;
+
+        if (push->tokenKind) {
+                const uint8_t* tokenEnd = FindPushTokenEnd(push->tokenKind, p, end, &push->tokenEscaped);
+                AppendPushToken(pj, p, tokenEnd ? tokenEnd : end);
+                if (!tokenEnd)
+                        return;
+                ParsePushToken(pj, push->token, push->token + push->tokenSize);
+                push->tokenKind = 0;
+                push->tokenSize = 0;
+                p = tokenEnd;
+        }
+
+        while (p != end) {
+                const uint8_t c = *p;
+                if (IsWhitespace(c)) {
+                        ++p;
+                        continue;
+                }
+                switch (push->state) {
+                case BON_PUSH_ROOT:
+                        if (c != '{' && c != '[') {
+                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                        }
+                        OpenPushContainer(pj, c == '{' ? BON_VT_OBJECT : BON_VT_ARRAY);
+                        ++p;
+                        continue;
+                case BON_PUSH_VALUE_OR_CLOSE:
+                        if (c == ']') {
+                                ClosePushContainer(pj, BON_VT_ARRAY);
+                                ++p;
+                                continue;
+                        }
+                        /* Fall through */
+                case BON_PUSH_VALUE:
+                        if (c == '{' || c == '[') {
+                                OpenPushContainer(pj, c == '{' ? BON_VT_OBJECT : BON_VT_ARRAY);
+                                ++p;
+                                continue;
+                        }
+                        if (c != '\"' && !IsBareTokenChar(c)) {
+                                GiveUp(pj->env, BON_STATUS_INVALID_NUMBER);    /* As ParseNumberValue, which a contiguous text falls back to */
+                        }
+                        break;
+                case BON_PUSH_NAME_OR_CLOSE:
+                        if (c == '}') {
+                                ClosePushContainer(pj, BON_VT_OBJECT);
+                                ++p;
+                                continue;
+                        }
+                        /* Fall through */
+                case BON_PUSH_NAME:
+                        if (c != '\"') {
+                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                        }
+                        break;
+                case BON_PUSH_COLON:
+                        if (c != ':') {
+                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                        }
+                        push->state = BON_PUSH_VALUE;
+                        ++p;
+                        continue;
+                case BON_PUSH_COMMA_OR_CLOSE:
+                        if (c == ',') {
+                                push->state = push->frames[push->frameCount - 1].type == BON_VT_OBJECT ? BON_PUSH_NAME : BON_PUSH_VALUE;
+                        } else if (c == '}' || c == ']') {
+                                ClosePushContainer(pj, c == '}' ? BON_VT_OBJECT : BON_VT_ARRAY);
+                        } else {
+                                GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);
+                        }
+                        ++p;
+                        continue;
+                default:
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);          /* After the root container */
+                        break;
+                }
+
+                /* A string, number or literal. Parse it in place unless the chunk ends first. */
+                {
+                        const int       kind            = c == '\"' ? BON_PUSH_TOKEN_STRING : BON_PUSH_TOKEN_BARE;
+                        BonBool         escaped         = BON_FALSE;
+                        const uint8_t*  tokenEnd        = FindPushTokenEnd(kind, kind == BON_PUSH_TOKEN_STRING ? p + 1 : p, end, &escaped);
+                        if (!tokenEnd) {
+                                push->tokenKind         = kind;
+                                push->tokenEscaped      = escaped;
+                                AppendPushToken(pj, p, end);
+                                return;
+                        }
+                        ParsePushToken(pj, p, tokenEnd);
+                        p = tokenEnd;
+                }
+        }
+}
+
+/* Check the encoding as BonParseJsonWithOptions does, skip a BOM and parse the first bytes */
+static void
+PushParseHead(BonParsedJson* pj) {
+        BonPushParser*          push            = &pj->push;
+        const uint8_t*          head            = push->head;
+        size_t                  skip            = 0;
+
+        if (push->headSize < 2) {
+                GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
+        }
+        if (head[0] == 0 || head[1] == 0 || head[0] == 0xFEu || head[0] == 0xFFu) {
+                GiveUp(pj->env, BON_STATUS_JSON_NOT_UTF8);
+        }
+        if (head[0] == 0xEFu) {
+                if (push->headSize < 3 || head[1] != 0xBBu || head[2] != 0xBFu) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_JSON_TEXT);
+                }
+                skip = 3;
+        }
+        push->state = BON_PUSH_ROOT;
+        PushParseBytes(pj, head + skip, head + push->headSize);
+}
+
+BonParsedJson*
+BonParserBegin(BonTempMemoryAlloc tempAlloc, void* tempAllocUserdata, const BonConvertOptions* options) {
+        BonParsedJson* volatile pj = 0;                                         /* volatile: must survive longjmp */
+        jmp_buf                 errorJmpBuf;
+
+        if (!tempAlloc)
+                return 0;
+
+        if (0 == setjmp(errorJmpBuf)) {
+                pj = BonTempCalloc(tempAlloc, tempAllocUserdata, &errorJmpBuf, BonParsedJson);
+        }
+        if (pj) {
+                pj->alloc               = tempAlloc;
+                pj->allocUserdata       = tempAllocUserdata;
+                pj->lastContainer       = &pj->containerList;
+                if (options) {
+                        pj->options     = *options;
+                }
+                pj->options.tape        = BON_TRUE;                             /* The tape keeps no pointers into the text */
+                pj->options.scalarParse = BON_TRUE;                             /* Tokens are found while feeding */
+                pj->push.state          = BON_PUSH_HEAD;
+        }
+        return pj;
+}
+
+int
+BonParserFeed(BonParsedJson* pj, const char* chunk, size_t chunkByteCount) {
+        const uint8_t*          p               = (const uint8_t*)chunk;
+        const uint8_t*          end             = p + chunkByteCount;
+        jmp_buf                 errorJmpBuf;
+        int                     status;
+
+        if (!pj)
+                return BON_STATUS_OUT_OF_MEMORY;
+        if (pj->status != BON_STATUS_OK || chunkByteCount == 0)
+                return pj->status;
+
+        status = setjmp(errorJmpBuf);
+        if (0 == status) {
+                pj->env = &errorJmpBuf;
+                if (pj->push.state == BON_PUSH_HEAD) {
+                        while (pj->push.headSize < 3 && p != end) {
+                                pj->push.head[pj->push.headSize++] = *p++;
+                        }
+                        if (pj->push.headSize == 3) {
+                                PushParseHead(pj);
+                        }
+                }
+                if (pj->push.state != BON_PUSH_HEAD) {
+                        PushParseBytes(pj, p, end);
+                }
+        } else {
+                pj->status = status;
+        }
+        pj->env = 0;
+        return pj->status;
+}
+
+int
+BonParserFinish(BonParsedJson* pj) {
+        BonPushParser*          push;
+        jmp_buf                 errorJmpBuf;
+        int                     status;
+
+        if (!pj)
+                return BON_STATUS_OUT_OF_MEMORY;
+        if (pj->status != BON_STATUS_OK)
+                return pj->status;
+
+        push = &pj->push;
+        status = setjmp(errorJmpBuf);
+        if (0 == status) {
+                pj->env = &errorJmpBuf;
+                if (push->state == BON_PUSH_HEAD) {
+                        PushParseHead(pj);
+                }
+                if (push->tokenKind == BON_PUSH_TOKEN_BARE) {
+                        ParsePushToken(pj, push->token, push->token + push->tokenSize);         /* A number ends with the text */
+                        push->tokenKind = 0;
+                }
+                if (push->state != BON_PUSH_END) {
+                        GiveUp(pj->env, BON_STATUS_JSON_PARSE_ERROR);          /* The text ends in a container or a string */
+                }
+
+                TapeFree(pj, push->frames, push->frameCapacity * sizeof(BonPushFrame));
+                TapeFree(pj, push->token, push->tokenCapacity);
+                push->frames            = 0;
+                push->frameCapacity     = 0;
+                push->token             = 0;
+                push->tokenCapacity     = 0;
+                push->tokenSize         = 0;
+                ReleaseTapeParseState(pj);
+                ComputeTapeLayout(pj);
+        } else {
+                pj->status = status;
+        }
+        pj->env = 0;
+        return pj->status;
+}
+
+int                             
+BonGetParsedJsonStatus(struct BonParsedJson* parsedJson) {
+        if (parsedJson) {
+                return parsedJson->status;
+        } else {
+                return BON_STATUS_OUT_OF_MEMORY;
+        }
+}
+
+size_t                          
+BonGetBonRecordSize(struct BonParsedJson* parsedJson) {
+        assert(parsedJson->status == BON_STATUS_OK);
+        return parsedJson->bonRecordSize;
+}
+
+static ptrdiff_t 
+RelativeOffset(void* from, void* basePtr, size_t offsetFromBase) {
+        return ((uint8_t*)basePtr + offsetFromBase) - (uint8_t*)from;
+}
+
+/* The low 32 bits of the offset go in the upper half of the value and bits 32-55 above the type.
+ * The latter are only non-zero in wide records. */
+static BonValue
+MakeOffsetBits(ptrdiff_t relativeOffset) {
+        const int64_t   low     = (int32_t)(uint32_t)relativeOffset;
+        const int64_t   high    = ((int64_t)relativeOffset - low) / 0x100000000ll;
+        assert(high >= -0x800000 && high < 0x800000);
+        return ((BonValue)(uint32_t)relativeOffset << 32) | ((BonValue)((uint32_t)high & 0xffffffu) << 8);
+}
+
+static BonValue
+MakeObjectValue(ptrdiff_t relativeOffset) {
+        assert((relativeOffset & 0x7ll) == 0);
+        return MakeOffsetBits(relativeOffset) | (BonValue)BON_VT_OBJECT;
+}
+
+static BonValue
+MakeArrayValue(ptrdiff_t relativeOffset, BonBool numbersOnly) {
+        assert((relativeOffset & 0x7ll) == 0);
+        return MakeOffsetBits(relativeOffset) | (BonValue)BON_VT_ARRAY | (numbersOnly ? (BonValue)BON_ARRAY_FLAG_NUMBERS : 0);
+}
+
+static BonValue
+MakeTypedArrayValue(ptrdiff_t relativeOffset) {
+        assert((relativeOffset & 0x7ll) == 0);
+        return MakeOffsetBits(relativeOffset) | (BonValue)BON_VT_TYPED_ARRAY;
+}
+
+static BonValue
+MakeStringValue(ptrdiff_t relativeOffset) {
+        assert((relativeOffset & 0x7ll) == 4);                                 /* After the byte count */
+        return MakeOffsetBits(relativeOffset) | (BonValue)BON_VT_STRING | (BonValue)BON_STRING_FLAG_LENGTH;
+}
+
+static BonValue
+MakeBoolValue(int v) {
+        return ((BonValue)v << 32) | (BonValue)BON_VT_BOOL;
+}
+
+static BonValue
+MakeNullValue(void) {
+        return (BonValue)0x7ull;
+}
+
+static BonValue
+MakeNumberValue(const BonVariant* v) {
+        return (v->value.value & ~0x7ull);
+}
+
+static BonValue
+MakeValueFromVariant(BonParsedJson* pj, BonValue* value, BonVariant* v) {
+        switch (v->type) {
+        case BON_VT_NUMBER:     return MakeNumberValue(v);
+        case BON_VT_BOOL:       return MakeBoolValue(v->value.boolValue);
+        case BON_VT_STRING:     return MakeStringValue(RelativeOffset(value, pj->recordBaseMemory, pj->valueStringOffset + v->value.stringValue->alias->offset + sizeof(uint32_t)));
+        case BON_VT_ARRAY:
+                if (v->value.arrayValue->elementType) {
+                        return MakeTypedArrayValue(RelativeOffset(value, pj->recordBaseMemory, pj->arrayOffset + v->value.arrayValue->offset));
+                }
+                return MakeArrayValue(RelativeOffset(value, pj->recordBaseMemory, pj->arrayOffset + v->value.arrayValue->offset), v->value.arrayValue->numbersOnly);
+        case BON_VT_OBJECT:     return MakeObjectValue(RelativeOffset(value, pj->recordBaseMemory, pj->objectOffset + v->value.objectValue->offset));
+        case BON_VT_NULL:       return MakeNullValue();
+        default: assert(0);     return 0;
+        }
+}
+
+
+static void
+StoreTypedArrayElement(uint8_t* values, int elementType, int32_t i, double d) {
+        switch (elementType) {
+        case BON_ET_FLOAT32:    ((float*)values)[i]             = (float)d;     break;
+        case BON_ET_INT32:      ((int32_t*)values)[i]           = (int32_t)d;   break;
+        case BON_ET_INT16:      ((int16_t*)values)[i]           = (int16_t)d;   break;
+        case BON_ET_UINT8:      ((uint8_t*)values)[i]           = (uint8_t)d;   break;
+        default:                assert(0);                                      break;
+        }
+}
+
+static void
+WriteTypedArray(const BonArrayHead* head, BonTypedArrayHeader* dst) {
+        const BonArrayEntry*    entry;
+        uint8_t*                values          = (uint8_t*)&dst[1];
+        size_t                  byteCount       = head->size - sizeof(BonTypedArrayHeader);
+        int32_t                 count           = 0;
+
+        memset(values, 0, byteCount);                                           /* Zero the padding */
+        for (entry = head->valueList; entry; entry = entry->next, ++count) {
+                StoreTypedArrayElement(values, head->elementType, count, entry->value.value.numberValue);
+        }
+        dst->elementType        = BON_TYPED_ARRAY_TAG | head->elementType;
+        dst->count              = count;
+}
+
+static void
+WriteStringSlot(uint8_t* dst, const uint8_t* utf8, size_t byteCount) {
+        const uint32_t  storedByteCount = (uint32_t)byteCount;
+        const size_t    slotSize        = StringSlotSize(byteCount);
+        memcpy(dst, &storedByteCount, sizeof(storedByteCount));
+        dst += sizeof(storedByteCount);
+        memcpy(dst, utf8, byteCount);
+        memset(dst + byteCount, 0, slotSize - sizeof(storedByteCount) - byteCount);   /* Always at least one terminating null */
+}
+
+/* Write the footer of the subtree hash section and compute the hashes. The container offsets
+ * (objects first, as in the record) must already be written. */
+static void
+FinishSubtreeHashSection(BonParsedJson* pj, BonRecord* header, uint32_t* offsetEnd) {
+        BonSubtreeHashFooter*   footer  = (BonSubtreeHashFooter*)((uint8_t*)header + pj->bonRecordSize - sizeof(BonSubtreeHashFooter));
+
+        if (pj->containerCount % 2) {
+                *offsetEnd = 0;
+        }
+        footer->hashesOffset    = (int32_t)RelativeOffset(&footer->hashesOffset, header, pj->subtreeHashOffset);
+        footer->count           = (int32_t)pj->containerCount;
+        header->flags           |= BON_RECORD_FLAG_SUBTREE_HASHES;
+        BonUpdateSubtreeHashes(header);
+}
+
+/* Return where the container offsets of the subtree hash section go */
+static uint32_t*
+SubtreeHashOffsets(BonParsedJson* pj, BonRecord* header) {
+        return (uint32_t*)((uint8_t*)header + pj->subtreeHashOffset + pj->containerCount * sizeof(uint64_t));
+}
+
+static void
+WriteSubtreeHashSection(BonParsedJson* pj, BonRecord* header) {
+        uint32_t*               offset  = SubtreeHashOffsets(pj, header);
+        BonContainer*           p;
+
+        for (p = pj->containerList; p; p = p->next) {
+                if (p->type == BON_VT_OBJECT) {
+                        *offset++ = (uint32_t)(pj->objectOffset + ((BonObjectHead*)p)->offset);
+                }
+        }
+        for (p = pj->containerList; p; p = p->next) {
+                if (p->type == BON_VT_ARRAY) {
+                        *offset++ = (uint32_t)(pj->arrayOffset + ((BonArrayHead*)p)->offset);
+                }
+        }
+        FinishSubtreeHashSection(pj, header, offset);
+}
+
+/* Write everything of the header but the root value */
+static void
+WriteRecordHeader(BonParsedJson* pj, BonRecord* header) {
+        uint8_t*                baseMemory      = (uint8_t*)header;
+
+        header->magic                   = BonFourCC('B', 'O', 'N', ' ');
+        header->recordSize              = (uint32_t)pj->bonRecordSize;
+        header->flags                   = BON_RECORD_FLAG_STRING_LENGTHS;
+        header->nameDictionaryId        = pj->nameDictionaryId;
+        header->valueStringOffset       = (int32_t)RelativeOffset(&header->valueStringOffset, baseMemory, pj->valueStringOffset);
+        header->nameLookupTableOffset   = (int32_t)RelativeOffset(&header->nameLookupTableOffset, baseMemory, pj->nameLookupOffset);
+        if (pj->wide) {
+                BonWideRecordHeader* wide = (BonWideRecordHeader*)&header[1];
+                header->magic                   = BON_WIDE_RECORD_MAGIC;
+                header->recordSize              = 0;
+                header->valueStringOffset       = 0;
+                header->nameLookupTableOffset   = 0;
+                wide->recordSize                = pj->bonRecordSize;
+                wide->valueStringOffset         = pj->valueStringOffset;
+                wide->nameLookupTableOffset     = pj->nameLookupOffset;
+        }
+}
+
+static BonValue
+MakeValueFromTape(BonParsedJson* pj, BonValue* value, BonTapeValue v) {
+        const BonTape*          tape            = &pj->tape;
+        const size_t            index           = (size_t)(v & BON_TAPE_INDEX_MASK);
+
+        switch (TapeValueType(v)) {
+        case BON_VT_NUMBER:     return v & ~0x7ull;
+        case BON_VT_BOOL:       return MakeBoolValue((int)index);
+        case BON_VT_STRING:     return MakeStringValue(RelativeOffset(value, pj->recordBaseMemory, pj->valueStringOffset + tape->values.strings[index].offset + sizeof(uint32_t)));
+        case BON_VT_ARRAY:
+                if (tape->containers[index]->elementType) {
+                        return MakeTypedArrayValue(RelativeOffset(value, pj->recordBaseMemory, pj->arrayOffset + tape->containers[index]->offset));
+                }
+                return MakeArrayValue(RelativeOffset(value, pj->recordBaseMemory, pj->arrayOffset + tape->containers[index]->offset), tape->containers[index]->numbersOnly);
+        case BON_VT_OBJECT:     return MakeObjectValue(RelativeOffset(value, pj->recordBaseMemory, pj->objectOffset + tape->containers[index]->offset));
+        case BON_VT_NULL:       return MakeNullValue();
+        default: assert(0);     return 0;
+        }
+}
+
+/* Write a container of the tape to its place in the record */
+static void
+WriteTapeContainer(BonParsedJson* pj, const BonTapeContainer* container) {
+        uint8_t*                baseMemory      = (uint8_t*)pj->recordBaseMemory;
+        const BonTapeValue*     tapeValues      = TapeContainerValues(container);
+        const int32_t           count           = container->count;
+        int32_t                 k;
+
+        if (container->type == BON_VT_OBJECT) {
+                BonContainerInternal*   dst     = (BonContainerInternal*)(baseMemory + container->offset + pj->objectOffset);
+                BonName*                name    = (BonName*)(&(dst->items[count]));
+
+                dst->count      = count;
+                dst->capacity   = -count;
+                for (k = 0; k < count; ++k) {
+                        dst->items[k] = MakeValueFromTape(pj, &dst->items[k], tapeValues[k]);
+                }
+                memcpy(name, tapeValues + count, (size_t)count * sizeof(BonName));
+                if (count % 2) {
+                        name[count] = 0;                                        /* Clear the odd name slot (everything is 8 byte aligned) */
+                }
+        } else if (container->elementType) {
+                BonTypedArrayHeader*    dst     = (BonTypedArrayHeader*)(baseMemory + container->offset + pj->arrayOffset);
+                uint8_t*                values  = (uint8_t*)&dst[1];
+
+                memset(values, 0, ArraySize(container->elementType, (size_t)count) - sizeof(BonTypedArrayHeader));   /* Zero the padding */
+                for (k = 0; k < count; ++k) {
+                        double d;
+                        memcpy(&d, &tapeValues[k], sizeof(d));
+                        StoreTypedArrayElement(values, container->elementType, k, d);
+                }
+                dst->elementType        = BON_TYPED_ARRAY_TAG | container->elementType;
+                dst->count              = count;
+        } else {
+                BonContainerInternal*   dst     = (BonContainerInternal*)(baseMemory + container->offset + pj->arrayOffset);
+
+                dst->count      = count;
+                dst->capacity   = count;
+                for (k = 0; k < count; ++k) {
+                        dst->items[k] = MakeValueFromTape(pj, &dst->items[k], tapeValues[k]);
+                }
+        }
+}
+
+/* Same as BonCreateRecordFromParsedJson, from the tape */
+static BonRecord*
+CreateRecordFromTape(BonParsedJson* pj, void* recordMemory) {
+        const BonTape*          tape            = &pj->tape;
+        BonRecord*              header          = (BonRecord*)recordMemory;
+        uint8_t*                baseMemory      = (uint8_t*)recordMemory;
+        uint32_t*               nameLookupCursor= (uint32_t*)(baseMemory + pj->nameLookupOffset);
+        size_t                  i;
+
+        pj->recordBaseMemory = recordMemory;
+
+        /* Header */
+        WriteRecordHeader(pj, header);
+        header->rootValue = MakeValueFromTape(pj, &header->rootValue, BoxTapeValue(tape->containers[tape->root]->type, tape->root));
+
+        /* Containers and arrays, in record order */
+        for (i = 0; i < tape->containerCount; ++i) {
+                WriteTapeContainer(pj, tape->containers[tape->breadthFirst[i]]);
+        }
+
+        /* Value strings */
+        for (i = 0; i < tape->values.count; ++i) {
+                const BonTapeString* string = &tape->values.strings[i];
+                WriteStringSlot(baseMemory + pj->valueStringOffset + string->offset, string->utf8, string->byteCount);
+        }
+
+        /* Name lookup and name strings */
+        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* capacity */
+        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* count: Same as capacity */
+        for (i = 0; i < pj->totalNameStringCount; ++i) {
+                const BonTapeString* string = &tape->names.strings[(size_t)(tape->nameKeys[i] & 0xffffffffu)];
+
+                *nameLookupCursor++ = string->hash;
+                *nameLookupCursor = (uint32_t)RelativeOffset(nameLookupCursor, baseMemory, pj->nameStringOffset + string->offset + sizeof(uint32_t));
+                ++nameLookupCursor;
+
+                WriteStringSlot(baseMemory + pj->nameStringOffset + string->offset, string->utf8, string->byteCount);
+        }
+
+        if (pj->options.subtreeHashes) {
+                uint32_t* offset = SubtreeHashOffsets(pj, header);
+                for (i = 0; i < tape->containerCount; ++i) {
+                        const BonTapeContainer* container = tape->containers[tape->breadthFirst[i]];
+                        if (container->type == BON_VT_OBJECT) {
+                                *offset++ = (uint32_t)(pj->objectOffset + container->offset);
+                        }
+                }
+                for (i = 0; i < tape->containerCount; ++i) {
+                        const BonTapeContainer* container = tape->containers[tape->breadthFirst[i]];
+                        if (container->type == BON_VT_ARRAY) {
+                                *offset++ = (uint32_t)(pj->arrayOffset + container->offset);
+                        }
+                }
+                FinishSubtreeHashSection(pj, header, offset);
+        }
+        return header;
+}
+
+/* Write the containers of a chunk and its elements of a root array */
+static void
+WriteChunk(BonParsedJson* pj, BonTapeChunk* chunk) {
+        BonParallelJson*        par             = pj->parallel;
+        BonParsedJson*          cj              = chunk->pj;
+        BonContainerInternal*   root            = (BonContainerInternal*)((uint8_t*)pj->recordBaseMemory + pj->arrayOffset);
+        size_t                  i;
+
+        for (i = 0; i < cj->tape.containerCount; ++i) {
+                WriteTapeContainer(cj, cj->tape.containers[i]);
+        }
+
+        if (par->rootType != BON_VT_ARRAY)
+                return;
+        for (i = 0; i < chunk->count; ++i) {
+                root->items[chunk->first + i] = MakeValueFromTape(cj, &root->items[chunk->first + i], chunk->values[i]);
+        }
+}
+
+/* Write the strings of a bucket, and for names their entries of the name lookup */
+static void
+WriteStringBucket(void* userdata, size_t jobIndex) {
+        BonParsedJson*          pj              = (BonParsedJson*)userdata;
+        BonParallelJson*        par             = pj->parallel;
+        uint8_t*                baseMemory      = (uint8_t*)pj->recordBaseMemory;
+        const size_t            bucket          = jobIndex % BON_STRING_BUCKET_COUNT;
+        size_t                  i;
+
+        if (jobIndex < BON_STRING_BUCKET_COUNT) {
+                uint32_t* nameLookupCursor = (uint32_t*)(baseMemory + pj->nameLookupOffset) + 2 + 2 * par->nameCounts[bucket];
+                for (i = par->nameBuckets[bucket]; i < par->nameBuckets[bucket + 1]; ++i) {
+                        const BonTapeString* string = par->names[i];
+                        if (i > par->nameBuckets[bucket] && par->names[i - 1]->hash == string->hash)
+                                continue;
+                        *nameLookupCursor++ = string->hash;
+                        *nameLookupCursor = (uint32_t)RelativeOffset(nameLookupCursor, baseMemory, pj->nameStringOffset + string->offset + sizeof(uint32_t));
+                        ++nameLookupCursor;
+                        WriteStringSlot(baseMemory + pj->nameStringOffset + string->offset, string->utf8, string->byteCount);
+                }
+        } else {
+                for (i = par->valueBuckets[bucket]; i < par->valueBuckets[bucket + 1]; ++i) {
+                        const BonTapeString* string = par->values[i];
+                        if (i > par->valueBuckets[bucket] && par->values[i - 1]->offset == string->offset)
+                                continue;
+                        WriteStringSlot(baseMemory + pj->valueStringOffset + string->offset, string->utf8, string->byteCount);
+                }
+        }
+}
+
+/* Same as CreateRecordFromTape, from the chunks of a parallel conversion */
+static BonRecord*
+CreateRecordFromChunks(BonParsedJson* pj, void* recordMemory) {
+        BonParallelJson*        par             = pj->parallel;
+        BonRecord*              header          = (BonRecord*)recordMemory;
+        uint8_t*                baseMemory      = (uint8_t*)recordMemory;
+        uint32_t*               nameLookup      = (uint32_t*)(baseMemory + pj->nameLookupOffset);
+        const int32_t           count           = (int32_t)par->rootCount;
+        size_t                  i;
+        int                     type;
+
+        pj->recordBaseMemory = recordMemory;
+        for (i = 0; i < par->chunkCount; ++i) {
+                BonParsedJson* cj = par->chunks[i].pj;
+                cj->recordBaseMemory    = recordMemory;
+                cj->objectOffset        = pj->objectOffset;
+                cj->arrayOffset         = pj->arrayOffset;
+                cj->valueStringOffset   = pj->valueStringOffset;
+        }
+
+        /* Header and the root, but for the elements of a root array that the chunks write */
+        WriteRecordHeader(pj, header);
+        if (par->rootType == BON_VT_OBJECT) {
+                BonContainerInternal*   dst     = (BonContainerInternal*)(baseMemory + pj->objectOffset);
+                BonName*                name    = (BonName*)(&(dst->items[count]));
+
+                header->rootValue = MakeObjectValue(RelativeOffset(&header->rootValue, baseMemory, pj->objectOffset));
+                dst->count      = count;
+                dst->capacity   = -count;
+                for (i = 0; i < par->rootCount; ++i) {
+                        const BonTapeEntry* member = &par->rootMembers[i];
+                        dst->items[i]   = MakeValueFromTape(par->chunks[member->chunk].pj, &dst->items[i], member->value);
+                        name[i]         = member->name;
+                }
+                if (count % 2) {
+                        name[count] = 0;                                        /* Clear the odd name slot (everything is 8 byte aligned) */
+                }
+        } else {
+                BonContainerInternal*   dst     = (BonContainerInternal*)(baseMemory + pj->arrayOffset);
+
+                header->rootValue = MakeArrayValue(RelativeOffset(&header->rootValue, baseMemory, pj->arrayOffset), par->rootNumbersOnly);
+                dst->count      = count;
+                dst->capacity   = count;
+        }
+
+        /* Containers chunk by chunk, strings bucket by bucket */
+        RunChunkPhaseInParallel(pj, WriteChunk);
+        nameLookup[0] = (uint32_t)pj->totalNameStringCount;                    /* capacity */
+        nameLookup[1] = (uint32_t)pj->totalNameStringCount;                    /* count: Same as capacity */
+        RunInParallel(par->threadCount, 2 * BON_STRING_BUCKET_COUNT, WriteStringBucket, pj);
+
+        if (pj->options.subtreeHashes) {
+                uint32_t* offset = SubtreeHashOffsets(pj, header);
+                for (type = BON_VT_OBJECT; ; type = BON_VT_ARRAY) {
+                        const size_t sectionOffset = type == BON_VT_OBJECT ? pj->objectOffset : pj->arrayOffset;
+                        if (par->rootType == type) {
+                                *offset++ = (uint32_t)sectionOffset;
+                        }
+                        if (par->rootType == BON_VT_OBJECT) {
+                                for (i = 0; i + 1 < pj->containerCount; ++i) {
+                                        const BonTapeContainer* container = par->chunks[par->breadthFirst[i].chunk].pj->tape.containers[par->breadthFirst[i].index];
+                                        if (container->type == type) {
+                                                *offset++ = (uint32_t)(sectionOffset + container->offset);
+                                        }
+                                }
+                        } else {
+                                size_t level, c;
+                                for (level = 0; level < par->levelCount; ++level) {
+                                        for (c = 0; c < par->chunkCount; ++c) {
+                                                const BonTapeChunk* chunk = &par->chunks[c];
+                                                if (level >= chunk->levelCount)
+                                                        continue;
+                                                for (i = level ? chunk->levels[level - 1].end : 0; i < chunk->levels[level].end; ++i) {
+                                                        const BonTapeContainer* container = chunk->pj->tape.containers[chunk->order[i]];
+                                                        if (container->type == type) {
+                                                                *offset++ = (uint32_t)(sectionOffset + container->offset);
+                                                        }
+                                                }
+                                        }
+                                }
+                        }
+                        if (type == BON_VT_ARRAY)
+                                break;
+                }
+                FinishSubtreeHashSection(pj, header, offset);
+        }
+        return header;
+}
+
+BonRecord*              
+BonCreateRecordFromParsedJson(BonParsedJson* pj, void* recordMemory) {
+        /* Exploit fact that both arrayValue and objectValue has a BonContainer as the first member */
+        BonContainer*           p               = pj->containerList;
+        BonRecord*              header          = (BonRecord*)recordMemory;
+        uint8_t*                baseMemory      = (uint8_t*)recordMemory;
+        BonStringEntry*         stringEntry     = 0;
+        uint32_t*               nameLookupCursor= (uint32_t*)(baseMemory + pj->nameLookupOffset);
+
+        assert(pj->status == BON_STATUS_OK);
+
+        if (pj->parallel && pj->parallel->merged) {
+                return CreateRecordFromChunks(pj, recordMemory);
+        }
+        if (pj->options.tape) {
+                return CreateRecordFromTape(pj, recordMemory);
+        }
+        pj->recordBaseMemory = recordMemory;
+
+        /* Header */
+        WriteRecordHeader(pj, header);
+        header->rootValue               = MakeValueFromVariant(pj, &header->rootValue, &pj->rootValue);
+
+        /* Containers and arrays */
+        for (; p; p = p->next) {
                 if (p->type == BON_VT_OBJECT) {
                         BonObjectHead*          head    = (BonObjectHead*)p;
                         BonContainerInternal*   dst     = (BonContainerInternal*)(baseMemory + head->offset + pj->objectOffset);
@@ -1104,6 +4562,10 @@ BonCreateRecordFromParsedJson(BonParsedJson* pj, void* recordMemory) {
                         BonValue*               item = &(dst->items[0]);
                         BonArrayEntry*          entry;
                         assert(p->type == BON_VT_ARRAY);
+                        if (head->elementType) {
+                                WriteTypedArray(head, (BonTypedArrayHeader*)dst);
+                                continue;
+                        }
                         dst->count      = (int32_t)((head->size - 8) / sizeof(BonValue));
                         dst->capacity   = dst->count;
                         for (entry = head->valueList; entry; entry = entry->next) {
@@ -1113,130 +4575,1139 @@ BonCreateRecordFromParsedJson(BonParsedJson* pj, void* recordMemory) {
                 }
         }
 
-        /* Value strings */
-        for (stringEntry = pj->valueStringList; stringEntry; stringEntry = stringEntry->next) {
-                uint8_t*        dst;
-                size_t          zeroCount;
-                /* Ignore all with an alias */
-                if (stringEntry->alias != stringEntry) {
-                        continue;
-                }
-                dst = baseMemory + pj->valueStringOffset + stringEntry->offset;
-                memcpy(dst, stringEntry->utf8, stringEntry->byteCount);
-                dst += stringEntry->byteCount;
-                zeroCount = BonRoundUp(stringEntry->byteCount, 8) - stringEntry->byteCount;
-                memset(dst, 0, zeroCount);
+        /* Value strings */
+        for (stringEntry = pj->valueStringList; stringEntry; stringEntry = stringEntry->next) {
+                /* Ignore all with an alias */
+                if (stringEntry->alias != stringEntry) {
+                        continue;
+                }
+                WriteStringSlot(baseMemory + pj->valueStringOffset + stringEntry->offset, stringEntry->utf8, stringEntry->byteCount);
+        }
+
+        /* Name lookup and name strings*/
+        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* capacity */
+        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* count: Same as capacity */
+        for (stringEntry = pj->nameStringList; stringEntry; stringEntry = stringEntry->next) {
+                /* Ignore all with an alias */
+                if (stringEntry->alias != stringEntry) {
+                        continue;
+                }
+                
+                /* Write a (name hash, offset) pair for each name */
+                *nameLookupCursor++ = stringEntry->hash;
+                *nameLookupCursor = (uint32_t)RelativeOffset(nameLookupCursor, baseMemory, pj->nameStringOffset + stringEntry->offset + sizeof(uint32_t));
+                ++nameLookupCursor;
+
+                WriteStringSlot(baseMemory + pj->nameStringOffset + stringEntry->offset, stringEntry->utf8, stringEntry->byteCount);
+        }
+
+        if (pj->options.subtreeHashes) {
+                WriteSubtreeHashSection(pj, header);
+        }
+        return header;
+}
+
+static void
+FreeString(BonStringEntry* v, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
+        if (!v)
+                return;
+        tempFree(tempFreeUserdata, v);
+}
+
+static void 
+FreeVariant(BonVariant* v, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
+        switch (v->type) {
+        case BON_VT_OBJECT: {
+                BonObjectHead* head = v->value.objectValue;
+                BonObjectEntry* p;
+                if (!head)
+                        break;
+                p = head->memberList;
+                tempFree(tempFreeUserdata, head);
+                while (p) {
+                        BonObjectEntry* next = p->next;
+                        FreeString(p->name, tempFree, tempFreeUserdata);
+                        FreeVariant(&p->value, tempFree, tempFreeUserdata);
+                        tempFree(tempFreeUserdata, p);
+                        p = next;
+                }
+                break;
+        }
+        case BON_VT_ARRAY: {
+                BonArrayHead* head = v->value.arrayValue;
+                BonArrayEntry* p;
+                if (!head)
+                        break;
+                p = head->valueList;
+                tempFree(tempFreeUserdata, head);
+                while (p) {
+                        BonArrayEntry* next = p->next;
+                        FreeVariant(&p->value, tempFree, tempFreeUserdata);
+                        tempFree(tempFreeUserdata, p);
+                        p = next;
+                }
+                break;
+        }
+        case BON_VT_STRING: {
+                FreeString(v->value.stringValue, tempFree, tempFreeUserdata);
+                break;
+        }
+
+        }
+}
+
+void 
+BonFreeParsedJsonMemory(BonParsedJson* parsedJson, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
+        if (parsedJson) {
+                void* block = parsedJson->tape.blocks;
+                if (parsedJson->parallel) {
+                        size_t i;
+                        for (i = 0; i < parsedJson->parallel->chunkCount; ++i) {
+                                BonFreeParsedJsonMemory(parsedJson->parallel->chunks[i].pj, tempFree, tempFreeUserdata);
+                        }
+                }
+                while (block) {
+                        void* previous;
+                        memcpy(&previous, block, sizeof(previous));
+                        tempFree(tempFreeUserdata, block);
+                        block = previous;
+                }
+                FreeVariant(&parsedJson->rootValue, tempFree, tempFreeUserdata);
+                if (parsedJson->index.positions) {
+                        tempFree(tempFreeUserdata, parsedJson->index.positions);
+                }
+                tempFree(tempFreeUserdata, parsedJson);
+        }
+}
+
+static void*
+MallocWrap(void* userdata, size_t size) {
+        (void)userdata;
+        return malloc(size);
+}
+
+static void
+FreeWrap(void* userdata, void* p) {
+        (void)userdata;
+        free(p);
+}
+
+BonRecord*              
+BonCreateRecordFromJson(const char* jsonString, size_t jsonStringByteCount) {
+        return BonCreateRecordFromJsonWithOptions(jsonString, jsonStringByteCount, 0);
+}
+
+BonRecord*              
+BonCreateRecordFromJsonWithOptions(const char* jsonString, size_t jsonStringByteCount, const BonConvertOptions* options) {
+        BonParsedJson*          parsedJson      = BonParseJsonWithOptions(MallocWrap, 0, jsonString, jsonStringByteCount, options);
+        BonRecord*              bonRecord;
+
+        if (!parsedJson) {
+                return 0;
+        }
+        if (parsedJson->status != BON_STATUS_OK) {
+                BonFreeParsedJsonMemory(parsedJson, FreeWrap, 0);
+                return 0;
+        }
+
+        bonRecord = BonCreateRecordFromParsedJson(parsedJson, MallocWrap(0, BonGetBonRecordSize(parsedJson)));
+        BonFreeParsedJsonMemory(parsedJson, FreeWrap, 0);
+
+        return bonRecord;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Batch conversion */
+
+/* The temp memory of a batch worker grows in blocks of at least this many bytes */
+#define BON_BATCH_BLOCK_SIZE            (1024 * 1024)
+
+typedef struct BonBatchBlock {
+        struct BonBatchBlock*   next;
+        size_t                  byteCount;
+} BonBatchBlock;
+
+/* A worker of BonConvertBatch. The temp memory is a linear allocator that is reset for each text. */
+typedef struct BonBatchWorker {
+        BonBatchBlock*          blocks;                                         /* The one in use first */
+        uint8_t*                cursor;
+        uint8_t*                end;
+        size_t                  failureCount;
+} BonBatchWorker;
+
+typedef struct BonBatch {
+        BonJobs                 items;                                          /* Only the counter is used: the workers take the texts in order */
+        BonBatchLoad            load;
+        BonBatchStore           store;
+        void*                   userdata;
+        BonConvertOptions       options;
+        BonBatchWorker          workers[BON_MAX_THREADS];
+} BonBatch;
+
+/* Wall clock seconds, also when other threads run */
+static double
+BatchSeconds(void) {
+#if defined(_WIN32)
+        LARGE_INTEGER           counter;
+        LARGE_INTEGER           frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+        struct timespec         ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void*
+BatchAlloc(void* userdata, size_t size) {
+        BonBatchWorker*         worker          = (BonBatchWorker*)userdata;
+        const size_t            headerSize      = BonRoundUp(sizeof(BonBatchBlock), 8);
+        uint8_t*                memory;
+
+        if (size > (size_t)-1 - headerSize - 8) {
+                return 0;
+        }
+        size = BonRoundUp(size, 8);
+        if (size > (size_t)(worker->end - worker->cursor)) {
+                const size_t    byteCount       = size + headerSize > BON_BATCH_BLOCK_SIZE ? size + headerSize : BON_BATCH_BLOCK_SIZE;
+                BonBatchBlock*  block           = (BonBatchBlock*)malloc(byteCount);
+                if (!block) {
+                        return 0;
+                }
+                block->next             = worker->blocks;
+                block->byteCount        = byteCount;
+                worker->blocks          = block;
+                worker->cursor          = (uint8_t*)block + headerSize;
+                worker->end             = (uint8_t*)block + byteCount;
+        }
+        memory = worker->cursor;
+        worker->cursor += size;
+        return memory;
+}
+
+static void
+FreeBatchBlocks(BonBatchWorker* worker) {
+        while (worker->blocks) {
+                BonBatchBlock* next = worker->blocks->next;
+                free(worker->blocks);
+                worker->blocks = next;
+        }
+        worker->cursor  = 0;
+        worker->end     = 0;
+}
+
+/* Make all temp memory of the worker free. Its blocks are merged into one so that the next text as 
+ * large as the largest so far needs no allocation. */
+static void
+ResetBatchWorker(BonBatchWorker* worker) {
+        const size_t            headerSize      = BonRoundUp(sizeof(BonBatchBlock), 8);
+
+        if (worker->blocks && worker->blocks->next) {
+                size_t          byteCount       = 0;
+                BonBatchBlock*  block;
+                for (block = worker->blocks; block; block = block->next) {
+                        byteCount += block->byteCount;
+                }
+                FreeBatchBlocks(worker);
+                worker->blocks = (BonBatchBlock*)malloc(byteCount);
+                if (worker->blocks) {
+                        worker->blocks->next            = 0;
+                        worker->blocks->byteCount       = byteCount;
+                }
+        }
+        if (worker->blocks) {
+                worker->cursor  = (uint8_t*)worker->blocks + headerSize;
+                worker->end     = (uint8_t*)worker->blocks + worker->blocks->byteCount;
+        }
+}
+
+static void
+RunBatchWorker(void* userdata, size_t workerIndex) {
+        BonBatch*               batch           = (BonBatch*)userdata;
+        BonBatchWorker*         worker          = &batch->workers[workerIndex];
+        size_t                  index;
+
+        while ((index = TakeJob(&batch->items)) < batch->items.jobCount) {
+                BonBatchItem    item;
+
+                memset(&item, 0, sizeof(item));
+                item.index = index;
+                if (!batch->load(batch->userdata, &item)) {
+                        item.status = BON_STATUS_LOAD_FAILED;
+                } else {
+                        const double    start   = BatchSeconds();
+                        BonParsedJson*  pj;
+
+                        ResetBatchWorker(worker);
+                        pj              = BonParseJsonWithOptions(BatchAlloc, worker, item.jsonData, item.jsonDataSize, &batch->options);
+                        item.status     = pj ? pj->status : BON_STATUS_OUT_OF_MEMORY;
+                        if (item.status == BON_STATUS_OK) {
+                                void* recordMemory = malloc(BonGetBonRecordSize(pj));
+                                if (recordMemory) {
+                                        item.record = BonCreateRecordFromParsedJson(pj, recordMemory);
+                                } else {
+                                        item.status = BON_STATUS_OUT_OF_MEMORY;
+                                }
+                        }
+                        item.seconds = BatchSeconds() - start;
+                }
+                if (item.status != BON_STATUS_OK) {
+                        ++worker->failureCount;
+                }
+                batch->store(batch->userdata, &item);
+        }
+}
+
+size_t
+BonConvertBatch(size_t itemCount, BonBatchLoad load, BonBatchStore store, void* userdata, const BonConvertOptions* options, int threadCount) {
+        BonBatch*               batch           = (BonBatch*)malloc(sizeof(BonBatch));
+        size_t                  failureCount    = 0;
+        int                     i;
+
+        if (!batch || !load || !store) {
+                free(batch);
+                return itemCount;
+        }
+        memset(batch, 0, sizeof(BonBatch));
+        batch->items.jobCount   = itemCount;
+        batch->load             = load;
+        batch->store            = store;
+        batch->userdata         = userdata;
+        if (options) {
+                batch->options  = *options;
+        }
+        batch->options.threadCount = 0;                                         /* The temp memory of a worker is not thread safe */
+        if (threadCount < 1) {
+                threadCount = 1;
+        } else if (threadCount > BON_MAX_THREADS) {
+                threadCount = BON_MAX_THREADS;
+        }
+
+        RunInParallel(threadCount, (size_t)threadCount, RunBatchWorker, batch);
+        for (i = 0; i < threadCount; ++i) {
+                failureCount += batch->workers[i].failureCount;
+                FreeBatchBlocks(&batch->workers[i]);
+        }
+        free(batch);
+        return failureCount;
+}
+
+/* A BonParsedJson that is filled in from records instead of a JSON text. Uses malloc. */
+static BonParsedJson*
+CreateEmptyParsedJson(jmp_buf* env) {
+        BonParsedJson* pj       = BonTempCalloc(MallocWrap, 0, env, BonParsedJson);
+        pj->env                 = env;
+        pj->alloc               = MallocWrap;
+        pj->lastContainer       = &pj->containerList;
+        return pj;
+}
+
+static BonStringEntry*
+CreateStringEntry(BonParsedJson* pj, const char* utf8, size_t byteCount) {
+        BonStringEntry* entry   = (BonStringEntry*)DoTempCalloc(pj->alloc, pj->allocUserdata, pj->env, offsetof(BonStringEntry, utf8) + byteCount + 1);
+        memcpy(entry->utf8, utf8, byteCount);
+        entry->alias            = entry;
+        entry->byteCount        = byteCount;
+        entry->hash             = BonCreateName(utf8, byteCount);
+        return entry;
+}
+
+BonRecord*
+BonCreateNameDictionary(const char* const* nameStrings, int nameCount) {
+        BonParsedJson* volatile pj              = 0;                            /* volatile: must survive longjmp */
+        BonRecord* volatile     record          = 0;                            /* volatile: must survive longjmp */
+        BonArrayHead*           root;
+        jmp_buf                 errorJmpBuf;
+        int                     i;
+
+        if (setjmp(errorJmpBuf) == 0) {
+                pj                      = CreateEmptyParsedJson(&errorJmpBuf);
+                root                    = InitArrayVariant(pj, &pj->rootValue);
+                root->size              = 8;                                    /* An empty root array */
+                root->numbersOnly       = BON_TRUE;
+                for (i = 0; i < nameCount; ++i) {
+                        BonStringEntry* entry = CreateStringEntry(pj, nameStrings[i], strlen(nameStrings[i]));
+                        BonPrependToList(&pj->nameStringList, entry);
+                }
+                ComputeLayout(pj);
+                record = (BonRecord*)MallocWrap(0, pj->bonRecordSize);
+                if (record) {
+                        BonCreateRecordFromParsedJson(pj, record);
+                }
+        }
+
+        if (pj) {
+                /* The names aren't owned by any object member, so free them here */
+                while (pj->nameStringList) {
+                        BonStringEntry* next = pj->nameStringList->next;
+                        free(pj->nameStringList);
+                        pj->nameStringList = next;
+                }
+                BonFreeParsedJsonMemory(pj, FreeWrap, 0);
+        }
+        return record;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Diff and patch
+ *
+ * A patch is a BonPatchHeader followed by opCount operations. Each operation starts at an eight
+ * byte boundary:
+ *
+ *      uint32_t        op                      BON_PATCH_OP_*, optionally | BON_PATCH_OP_FLAG_NAME
+ *      uint32_t        pathLength
+ *      uint32_t        path[pathLength]        A BonName in objects, an index in arrays
+ *                      zero padding to eight bytes
+ *      string          The name of a new member, if BON_PATCH_OP_FLAG_NAME
+ *      payload         Depends on op
+ *
+ * Strings are a uint32_t byte count followed by the bytes, zero padded to eight bytes.
+ *
+ * A patch is applied by building the intermediate tree of the old record, editing the tree and
+ * writing it like a parsed JSON text. Since records are canonical, the result is byte for byte
+ * the new record, which is checked against its hash. Patches that only give numbers and bools new values
+ * are written over a copy of the old record instead. An object with duplicate names is replaced as a
+ * whole, since a path can't tell its members apart.
+ */
+
+#define BON_PATCH_OP_SET_VALUE          1                                       /* Payload: a number, bool or null BonValue */
+#define BON_PATCH_OP_SET_STRING         2                                       /* Payload: a string */
+#define BON_PATCH_OP_SET_RECORD         3                                       /* Payload: a record with a root array holding the value */
+#define BON_PATCH_OP_REMOVE             4                                       /* No payload. Removes an object member. */
+#define BON_PATCH_OP_FLAG_NAME          0x100u
+
+#define BON_PATCH_MAX_DEPTH             64                                      /* Deeper changes replace the subtree at this depth */
+
+typedef struct BonPatchHeader {
+        uint32_t                magic;                                          /* FourCC('B', 'O', 'N', 'D') */
+        uint32_t                patchSize;
+        uint32_t                oldRecordSize;
+        uint32_t                oldRecordHash;                                  /* BonCreateName of the bytes of the record */
+        uint32_t                newRecordSize;
+        uint32_t                newRecordHash;
+        uint32_t                newNameDictionaryId;
+        uint32_t                newRecordFlags;                                 /* The options the new record was converted with */
+        uint32_t                reserved;
+        uint32_t                opCount;
+} BonPatchHeader;
+
+static uint32_t
+HashRecordBytes(const BonRecord* br) {
+        return BonCreateName((const char*)br, br->recordSize);
+}
+
+static double
+GetTypedArrayElement(const BonTypedArray* array, int i) {
+        switch (array->elementType) {
+        case BON_ET_FLOAT32:    return ((const float*)array->values)[i];
+        case BON_ET_INT32:      return ((const int32_t*)array->values)[i];
+        case BON_ET_INT16:      return ((const int16_t*)array->values)[i];
+        case BON_ET_UINT8:      return ((const uint8_t*)array->values)[i];
+        default:                assert(0);      return 0.0;
+        }
+}
+
+/* Build the intermediate tree of a value of a record, as if it had been parsed from JSON. Sizes 
+ * and string lists are left to FinishVariant. */
+static void
+BuildVariantFromValue(BonParsedJson* pj, const BonRecord* br, const BonValue* value, BonVariant* v) {
+        int i;
+        switch (BonGetValueType(value)) {
+        case BON_VT_NUMBER:
+                v->type                 = BON_VT_NUMBER;
+                v->value.numberValue    = BonAsNumber(value);
+                break;
+        case BON_VT_BOOL:
+                *v = BonAsBool(value) ? s_boolTrueVariant : s_boolFalseVariant;
+                break;
+        case BON_VT_STRING: {
+                size_t          byteCount;
+                const char*     string  = BonAsStringWithLength(value, &byteCount);
+                v->type                 = BON_VT_STRING;
+                v->value.stringValue    = CreateStringEntry(pj, string, byteCount);
+                break;
+        }
+        case BON_VT_OBJECT: {
+                BonObject               object  = BonAsObject(value);
+                BonObjectHead*          head    = InitObjectVariant(pj, v);
+                BonObjectEntry**        last    = &head->memberList;
+                for (i = 0; i < object.count; ++i) {
+                        size_t          byteCount;
+                        const char*     name    = BonGetNameStringWithLength(br, object.names[i], &byteCount);
+                        BonObjectEntry* member  = CreateObjectEntry(pj);
+                        *last = member;                                         /* Link first so that the tree owns it if we give up */
+                        last = &member->next;
+                        if (!name) {
+                                GiveUp(pj->env, BON_STATUS_MISSING_NAME);
+                        }
+                        member->name = CreateStringEntry(pj, name, byteCount);
+                        BuildVariantFromValue(pj, br, &object.values[i], &member->value);
+                }
+                break;
+        }
+        case BON_VT_ARRAY: {
+                BonArray                array   = BonAsArray(value);
+                BonArrayHead*           head    = InitArrayVariant(pj, v);
+                for (i = 0; i < array.count; ++i) {
+                        BuildVariantFromValue(pj, br, &array.values[i], &AppendArrayMember(pj, head)->value);
+                }
+                break;
+        }
+        case BON_VT_TYPED_ARRAY: {
+                BonTypedArray           array   = BonAsTypedArray(value);
+                BonArrayHead*           head    = InitArrayVariant(pj, v);
+                head->elementType = array.elementType;
+                for (i = 0; i < array.count; ++i) {
+                        BonArrayEntry* member = AppendArrayMember(pj, head);
+                        member->value.type              = BON_VT_NUMBER;
+                        member->value.value.numberValue = GetTypedArrayElement(&array, i);
+                }
+                break;
+        }
+        default:
+                *v = s_nullVariant;
+                break;
+        }
+}
+
+/* Compute what parsing computes (sizes, member counts, number-only arrays) and collect the strings
+ * of a tree that was built from records or edited. */
+static void
+FinishVariant(BonParsedJson* pj, BonVariant* v) {
+        size_t count = 0;
+        switch (v->type) {
+        case BON_VT_STRING:
+                BonPrependToList(&pj->valueStringList, v->value.stringValue);
+                break;
+        case BON_VT_OBJECT: {
+                BonObjectHead*  head    = v->value.objectValue;
+                BonObjectEntry* member;
+                head->container.next = 0;
+                for (member = head->memberList; member; member = member->next, ++count) {
+                        BonPrependToList(&pj->nameStringList, member->name);
+                        FinishVariant(pj, &member->value);
+                }
+                SetObjectSize(head, count);
+                break;
+        }
+        case BON_VT_ARRAY: {
+                BonArrayHead*   head    = v->value.arrayValue;
+                BonArrayEntry*  entry;
+                head->container.next    = 0;
+                head->numbersOnly       = BON_TRUE;
+                for (entry = head->valueList; entry; entry = entry->next, ++count) {
+                        FinishVariant(pj, &entry->value);
+                        if (entry->value.type != BON_VT_NUMBER) {
+                                head->numbersOnly = BON_FALSE;
+                        }
+                }
+                SetArraySize(head, count);
+                break;
+        }
+        }
+}
+
+/* Finish the tree of pj and write it to a new record (malloc) */
+static BonRecord*
+CreateRecordFromTree(BonParsedJson* pj) {
+        BonRecord* record;
+        pj->valueStringList     = 0;
+        pj->nameStringList      = 0;
+        pj->containerList       = 0;
+        pj->lastContainer       = &pj->containerList;
+        FinishVariant(pj, &pj->rootValue);
+        ComputeLayout(pj);
+        record = (BonRecord*)MallocWrap(0, pj->bonRecordSize);
+        if (!record) {
+                GiveUp(pj->env, BON_STATUS_OUT_OF_MEMORY);
         }
+        return BonCreateRecordFromParsedJson(pj, record);
+}
 
-        /* Name lookup and name strings*/
-        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* capacity */
-        *nameLookupCursor++ = (uint32_t)pj->totalNameStringCount; /* count: Same as capacity */
-        for (stringEntry = pj->nameStringList; stringEntry; stringEntry = stringEntry->next) {
-                uint8_t*        dst;
-                size_t          zeroCount;
-                /* Ignore all with an alias */
-                if (stringEntry->alias != stringEntry) {
-                        continue;
+/* Copy a value of br to a new record (malloc) whose root array holds only the value */
+static BonRecord*
+CreateRecordFromValue(const BonRecord* br, const BonValue* value, int* status) {
+        BonParsedJson* volatile pj              = 0;                            /* volatile: must survive longjmp */
+        BonRecord* volatile     record          = 0;
+        jmp_buf                 errorJmpBuf;
+
+        *status = setjmp(errorJmpBuf);
+        if (*status == 0) {
+                pj = CreateEmptyParsedJson(&errorJmpBuf);
+                BuildVariantFromValue(pj, br, value, &AppendArrayMember(pj, InitArrayVariant(pj, &pj->rootValue))->value);
+                record = CreateRecordFromTree(pj);
+        }
+        if (pj) {
+                BonFreeParsedJsonMemory(pj, FreeWrap, 0);
+        }
+        return record;
+}
+
+/* Deep equality of two values that may be in different records */
+static BonBool
+AreValuesEqual(const BonValue* a, const BonValue* b) {
+        int i;
+        if (BonGetValueType(a) != BonGetValueType(b))
+                return BON_FALSE;
+        switch (BonGetValueType(a)) {
+        case BON_VT_STRING: {
+                size_t          aCount;
+                size_t          bCount;
+                const char*     aString = BonAsStringWithLength(a, &aCount);
+                const char*     bString = BonAsStringWithLength(b, &bCount);
+                return aCount == bCount && 0 == memcmp(aString, bString, aCount);
+        }
+        case BON_VT_TYPED_ARRAY: {
+                BonTypedArray   aArray  = BonAsTypedArray(a);
+                BonTypedArray   bArray  = BonAsTypedArray(b);
+                return aArray.elementType == bArray.elementType && aArray.count == bArray.count
+                        && 0 == memcmp(aArray.values, bArray.values, aArray.count * BonGetTypedArrayElementSize(aArray.elementType));
+        }
+        case BON_VT_ARRAY: {
+                BonArray        aArray  = BonAsArray(a);
+                BonArray        bArray  = BonAsArray(b);
+                if (aArray.count != bArray.count)
+                        return BON_FALSE;
+                for (i = 0; i < aArray.count; ++i) {
+                        if (!AreValuesEqual(&aArray.values[i], &bArray.values[i]))
+                                return BON_FALSE;
                 }
-                
-                /* Write a (name hash, offset) pair for each name */
-                *nameLookupCursor++ = stringEntry->hash;
-                *nameLookupCursor = (uint32_t)RelativeOffset(nameLookupCursor, baseMemory, pj->nameStringOffset + stringEntry->offset);
-                ++nameLookupCursor;
+                return BON_TRUE;
+        }
+        case BON_VT_OBJECT: {
+                BonObject       aObject = BonAsObject(a);
+                BonObject       bObject = BonAsObject(b);
+                if (aObject.count != bObject.count || 0 != memcmp(aObject.names, bObject.names, aObject.count * sizeof(BonName)))
+                        return BON_FALSE;
+                for (i = 0; i < aObject.count; ++i) {
+                        if (!AreValuesEqual(&aObject.values[i], &bObject.values[i]))
+                                return BON_FALSE;
+                }
+                return BON_TRUE;
+        }
+        default:
+                return *a == *b;                                                /* Numbers, bools and null */
+        }
+}
 
-                dst = baseMemory + pj->nameStringOffset + stringEntry->offset;
-                memcpy(dst, stringEntry->utf8, stringEntry->byteCount);
-                dst += stringEntry->byteCount;
-                zeroCount = BonRoundUp(stringEntry->byteCount, 8) - stringEntry->byteCount;
-                memset(dst, 0, zeroCount);
+typedef struct BonPatchWriter {
+        jmp_buf*                env;
+        const BonRecord*        oldRecord;
+        const BonRecord*        newRecord;
+        uint8_t*                data;
+        size_t                  size;
+        size_t                  capacity;
+        uint32_t                opCount;
+        BonRecord*              valueRecord;                                    /* Freed if we give up while it is copied */
+        int                     depth;
+        uint32_t                path[BON_PATCH_MAX_DEPTH];
+} BonPatchWriter;
+
+/* Append byteCount zeroed bytes to the patch and return them */
+static uint8_t*
+PatchAppend(BonPatchWriter* w, size_t byteCount) {
+        uint8_t* p;
+        if (w->size + byteCount > w->capacity) {
+                size_t          capacity        = w->capacity ? w->capacity * 2 : 256;
+                uint8_t*        data;
+                while (capacity < w->size + byteCount) {
+                        capacity *= 2;
+                }
+                data = (uint8_t*)realloc(w->data, capacity);
+                if (!data) {
+                        GiveUp(w->env, BON_STATUS_OUT_OF_MEMORY);
+                }
+                w->data         = data;
+                w->capacity     = capacity;
         }
+        p = w->data + w->size;
+        w->size += byteCount;
+        return (uint8_t*)memset(p, 0, byteCount);
+}
 
-        return header;
+static void
+PatchAppendString(BonPatchWriter* w, const char* string, size_t byteCount) {
+        const uint32_t  count   = (uint32_t)byteCount;
+        uint8_t*        p       = PatchAppend(w, BonRoundUp(sizeof(uint32_t) + byteCount, 8));
+        memcpy(p, &count, sizeof(count));
+        memcpy(p + sizeof(count), string, byteCount);
 }
 
+/* Append an operation on the current path */
 static void
-FreeString(BonStringEntry* v, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
-        if (!v)
-                return;
-        tempFree(tempFreeUserdata, v);
+PatchAppendOp(BonPatchWriter* w, uint32_t op) {
+        uint32_t* p = (uint32_t*)PatchAppend(w, BonRoundUp((2 + (size_t)w->depth) * sizeof(uint32_t), 8));
+        p[0] = op;
+        p[1] = (uint32_t)w->depth;
+        memcpy(&p[2], w->path, w->depth * sizeof(uint32_t));
+        ++w->opCount;
 }
 
-static void 
-FreeVariant(BonVariant* v, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
-        switch (v->type) {
-        case BON_VT_OBJECT: {
-                BonObjectHead* head = v->value.objectValue;
-                BonObjectEntry* p;
-                if (!head)
-                        break;
-                p = head->memberList;
-                tempFree(tempFreeUserdata, head);
-                while (p) {
-                        BonObjectEntry* next = p->next;
-                        FreeString(p->name, tempFree, tempFreeUserdata);
-                        FreeVariant(&p->value, tempFree, tempFreeUserdata);
-                        tempFree(tempFreeUserdata, p);
-                        p = next;
+/* Set the current path to value (of the new record). A new member also gets its name string. */
+static void
+PatchAppendSet(BonPatchWriter* w, const BonValue* value, BonBool newMember) {
+        const uint32_t  nameFlag        = newMember ? BON_PATCH_OP_FLAG_NAME : 0;
+        const int       type            = BonGetValueType(value);
+        size_t          byteCount;
+        const char*     string;
+        int             status;
+
+        PatchAppendOp(w, (type == BON_VT_STRING ? BON_PATCH_OP_SET_STRING : 
+                type == BON_VT_NUMBER || type == BON_VT_BOOL || type == BON_VT_NULL ? BON_PATCH_OP_SET_VALUE : BON_PATCH_OP_SET_RECORD) | nameFlag);
+        if (newMember) {
+                string = BonGetNameStringWithLength(w->newRecord, w->path[w->depth - 1], &byteCount);
+                if (!string) {
+                        GiveUp(w->env, BON_STATUS_MISSING_NAME);
                 }
-                break;
+                PatchAppendString(w, string, byteCount);
         }
-        case BON_VT_ARRAY: {
-                BonArrayHead* head = v->value.arrayValue;
-                BonArrayEntry* p;
-                if (!head)
-                        break;
-                p = head->valueList;
-                tempFree(tempFreeUserdata, head);
-                while (p) {
-                        BonArrayEntry* next = p->next;
-                        FreeVariant(&p->value, tempFree, tempFreeUserdata);
-                        tempFree(tempFreeUserdata, p);
-                        p = next;
+        switch (type) {
+        case BON_VT_NUMBER:
+        case BON_VT_BOOL:
+        case BON_VT_NULL:
+                memcpy(PatchAppend(w, sizeof(BonValue)), value, sizeof(BonValue));
+                break;
+        case BON_VT_STRING:
+                string = BonAsStringWithLength(value, &byteCount);
+                PatchAppendString(w, string, byteCount);
+                break;
+        default:
+                w->valueRecord = CreateRecordFromValue(w->newRecord, value, &status);
+                if (!w->valueRecord) {
+                        GiveUp(w->env, status);
                 }
+                memcpy(PatchAppend(w, w->valueRecord->recordSize), w->valueRecord, w->valueRecord->recordSize);
+                free(w->valueRecord);
+                w->valueRecord = 0;
                 break;
         }
-        case BON_VT_STRING: {
-                FreeString(v->value.stringValue, tempFree, tempFreeUserdata);
+}
+
+static void                     DiffValues(BonPatchWriter* w, const BonValue* a, const BonValue* b);
+
+/* Duplicate names, or names with the same hash, can't be told apart by a path */
+static BonBool
+HasAdjacentEqualNames(const BonObject* object) {
+        int i;
+        for (i = 1; i < object->count; ++i) {
+                if (object->names[i - 1] == object->names[i])
+                        return BON_TRUE;
+        }
+        return BON_FALSE;
+}
+
+/* Merge the sorted names of two objects */
+static void
+DiffObjects(BonPatchWriter* w, const BonObject* a, const BonObject* b) {
+        int i = 0;
+        int j = 0;
+        while (i < a->count || j < b->count) {
+                if (j == b->count || (i < a->count && a->names[i] < b->names[j])) {
+                        w->path[w->depth++] = a->names[i++];
+                        PatchAppendOp(w, BON_PATCH_OP_REMOVE);
+                } else if (i == a->count || b->names[j] < a->names[i]) {
+                        w->path[w->depth++] = b->names[j];
+                        PatchAppendSet(w, &b->values[j++], BON_TRUE);
+                } else {
+                        w->path[w->depth++] = b->names[j];
+                        DiffValues(w, &a->values[i++], &b->values[j++]);
+                }
+                --w->depth;
+        }
+}
+
+static void
+DiffValues(BonPatchWriter* w, const BonValue* a, const BonValue* b) {
+        const int       type    = BonGetValueType(b);
+        uint64_t        aHash;
+        uint64_t        bHash;
+        if (BonGetSubtreeHash(w->oldRecord, a, &aHash) && BonGetSubtreeHash(w->newRecord, b, &bHash) && aHash == bHash && type == BonGetValueType(a)) {
+                return;                                                         /* Skip unchanged subtrees of records with subtree hashes */
+        }
+        if (type == BonGetValueType(a) && w->depth < BON_PATCH_MAX_DEPTH) {
+                if (type == BON_VT_OBJECT) {
+                        BonObject       aObject = BonAsObject(a);
+                        BonObject       bObject = BonAsObject(b);
+                        if (!HasAdjacentEqualNames(&aObject) && !HasAdjacentEqualNames(&bObject)) {
+                                DiffObjects(w, &aObject, &bObject);     /* Otherwise the whole object is replaced */
+                                return;
+                        }
+                }
+                if (type == BON_VT_ARRAY) {
+                        BonArray        aArray  = BonAsArray(a);
+                        BonArray        bArray  = BonAsArray(b);
+                        int             i;
+                        if (aArray.count == bArray.count) {                     /* Otherwise the whole array is replaced */
+                                for (i = 0; i < aArray.count; ++i) {
+                                        w->path[w->depth++] = (uint32_t)i;
+                                        DiffValues(w, &aArray.values[i], &bArray.values[i]);
+                                        --w->depth;
+                                }
+                                return;
+                        }
+                }
+        }
+        if (!AreValuesEqual(a, b)) {
+                PatchAppendSet(w, b, BON_FALSE);
+        }
+}
+
+void*
+BonDiffRecords(const BonRecord* oldRecord, const BonRecord* newRecord, size_t* patchSize) {
+        BonPatchWriter* volatile w              = 0;                            /* volatile: must survive longjmp */
+        void* volatile          patch           = 0;
+        BonPatchHeader*         header;
+        jmp_buf                 errorJmpBuf;
+
+        *patchSize = 0;
+        if (oldRecord->magic == BON_WIDE_RECORD_MAGIC || newRecord->magic == BON_WIDE_RECORD_MAGIC) {
+                return 0;                                                       /* Patch headers have 32-bit record sizes */
+        }
+        if (setjmp(errorJmpBuf) == 0) {
+                w = (BonPatchWriter*)DoTempCalloc(MallocWrap, 0, &errorJmpBuf, sizeof(BonPatchWriter));
+                w->env          = &errorJmpBuf;
+                w->oldRecord    = oldRecord;
+                w->newRecord    = newRecord;
+                PatchAppend(w, sizeof(BonPatchHeader));
+                DiffValues(w, &oldRecord->rootValue, &newRecord->rootValue);
+
+                header                          = (BonPatchHeader*)w->data;
+                header->magic                   = BonFourCC('B', 'O', 'N', 'D');
+                header->patchSize               = (uint32_t)w->size;
+                header->oldRecordSize           = oldRecord->recordSize;
+                header->oldRecordHash           = HashRecordBytes(oldRecord);
+                header->newRecordSize           = newRecord->recordSize;
+                header->newRecordHash           = HashRecordBytes(newRecord);
+                header->newNameDictionaryId     = newRecord->nameDictionaryId;
+                header->newRecordFlags          = newRecord->flags;
+                header->opCount                 = w->opCount;
+                patch           = w->data;
+                *patchSize      = w->size;
+                w->data         = 0;
+        }
+        if (w) {
+                free(w->valueRecord);
+                free(w->data);
+                free(w);
+        }
+        return patch;
+}
+
+typedef struct BonPatchReader {
+        const uint8_t*          cursor;
+        const uint8_t*          end;
+} BonPatchReader;
+
+static const uint8_t*
+PatchRead(BonParsedJson* pj, BonPatchReader* r, size_t byteCount) {
+        const uint8_t* p = r->cursor;
+        if ((size_t)(r->end - r->cursor) < byteCount) {
+                GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+        }
+        r->cursor += byteCount;
+        return p;
+}
+
+static BonStringEntry*
+PatchReadString(BonParsedJson* pj, BonPatchReader* r) {
+        uint32_t byteCount;
+        memcpy(&byteCount, PatchRead(pj, r, sizeof(uint32_t)), sizeof(uint32_t));
+        return CreateStringEntry(pj, (const char*)PatchRead(pj, r, BonRoundUp(sizeof(uint32_t) + (size_t)byteCount, 8) - sizeof(uint32_t)), byteCount);
+}
+
+static void
+PatchReadValue(BonParsedJson* pj, BonPatchReader* r, uint32_t op, BonVariant* v) {
+        BonValue                value;
+        const BonRecord*        record;
+        BonArray                root;
+
+        switch (op) {
+        case BON_PATCH_OP_SET_VALUE:
+                memcpy(&value, PatchRead(pj, r, sizeof(BonValue)), sizeof(BonValue));
+                if (BonGetValueType(&value) != BON_VT_NUMBER && BonGetValueType(&value) != BON_VT_BOOL && BonGetValueType(&value) != BON_VT_NULL) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                BuildVariantFromValue(pj, 0, &value, v);
+                break;
+        case BON_PATCH_OP_SET_STRING:
+                v->type                 = BON_VT_STRING;
+                v->value.stringValue    = PatchReadString(pj, r);
                 break;
+        case BON_PATCH_OP_SET_RECORD:
+                record = (const BonRecord*)r->cursor;
+                if ((size_t)(r->end - r->cursor) < sizeof(BonRecord) || ((uintptr_t)record & 7) != 0) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                PatchRead(pj, r, record->recordSize);
+                if (!BonValidateRecordDeep(record, record->recordSize) || BonGetValueType(&record->rootValue) != BON_VT_ARRAY) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                root = BonAsArray(&record->rootValue);
+                if (root.count != 1) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                BuildVariantFromValue(pj, record, &root.values[0], v);
+                break;
+        default:
+                GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
         }
+}
 
+/* Return the member or item key of a container, or null if there is none */
+static BonVariant*
+FindChildVariant(BonVariant* parent, uint32_t key) {
+        if (parent->type == BON_VT_OBJECT) {
+                BonObjectEntry* member;
+                for (member = parent->value.objectValue->memberList; member; member = member->next) {
+                        if (member->name && member->name->hash == key)
+                                return &member->value;
+                }
+        } else if (parent->type == BON_VT_ARRAY && !parent->value.arrayValue->elementType) {
+                BonArrayEntry* entry;
+                for (entry = parent->value.arrayValue->valueList; entry; entry = entry->next, --key) {
+                        if (key == 0)
+                                return &entry->value;
+                }
         }
+        return 0;
 }
 
-void 
-BonFreeParsedJsonMemory(BonParsedJson* parsedJson, BonTempMemoryFree tempFree, void* tempFreeUserdata) {
-        if (parsedJson) {
-                FreeVariant(&parsedJson->rootValue, tempFree, tempFreeUserdata);
-                tempFree(parsedJson, tempFreeUserdata);
+/* Add a member in name order and return it */
+static BonObjectEntry*
+InsertObjectMember(BonParsedJson* pj, BonObjectHead* head, BonName name) {
+        BonObjectEntry**        link    = &head->memberList;
+        BonObjectEntry*         member  = CreateObjectEntry(pj);
+        while (*link && (*link)->name->hash < name) {
+                link = &(*link)->next;
         }
+        member->value   = s_nullVariant;
+        member->next    = *link;
+        *link           = member;
+        return member;
 }
 
-static void*
-MallocWrap(void* userdata, size_t size) {
-        (void)userdata;
-        return malloc(size);
+static void
+RemoveObjectMember(BonParsedJson* pj, BonObjectHead* head, BonName name) {
+        BonObjectEntry** link;
+        for (link = &head->memberList; *link; link = &(*link)->next) {
+                BonObjectEntry* member = *link;
+                if (member->name->hash == name) {
+                        *link = member->next;
+                        FreeString(member->name, FreeWrap, 0);
+                        FreeVariant(&member->value, FreeWrap, 0);
+                        FreeWrap(0, member);
+                        return;
+                }
+        }
+        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
 }
 
 static void
-FreeWrap(void* userdata, void* p) {
-        (void)userdata;
-        free(p);
+ApplyPatchOp(BonParsedJson* pj, BonPatchReader* r) {
+        const uint32_t*         words           = (const uint32_t*)PatchRead(pj, r, 2 * sizeof(uint32_t));
+        const uint32_t          op              = words[0] & ~BON_PATCH_OP_FLAG_NAME;
+        const uint32_t          pathLength      = words[1];
+        const uint32_t*         path;
+        BonVariant*             parent          = 0;
+        BonVariant*             target          = &pj->rootValue;
+        uint32_t                i;
+
+        if (pathLength > BON_PATCH_MAX_DEPTH) {
+                GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+        }
+        path = (const uint32_t*)PatchRead(pj, r, BonRoundUp((2 + (size_t)pathLength) * sizeof(uint32_t), 8) - 2 * sizeof(uint32_t));
+        for (i = 0; i < pathLength; ++i) {
+                if (!target) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                parent = target;
+                target = FindChildVariant(parent, path[i]);
+        }
+
+        if (words[0] & BON_PATCH_OP_FLAG_NAME) {                                /* A new member */
+                BonObjectEntry* member;
+                if (target || !parent || parent->type != BON_VT_OBJECT || op == BON_PATCH_OP_REMOVE) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                member          = InsertObjectMember(pj, parent->value.objectValue, path[pathLength - 1]);
+                member->name    = PatchReadString(pj, r);
+                if (member->name->hash != path[pathLength - 1]) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                target = &member->value;
+        } else if (!target) {
+                GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+        }
+
+        if (op == BON_PATCH_OP_REMOVE) {
+                if (!parent || parent->type != BON_VT_OBJECT) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+                RemoveObjectMember(pj, parent->value.objectValue, path[pathLength - 1]);
+        } else {
+                FreeVariant(target, FreeWrap, 0);
+                *target = s_nullVariant;
+                PatchReadValue(pj, r, op, target);
+        }
 }
 
-BonRecord*              
-BonCreateRecordFromJson(const char* jsonString, size_t jsonStringByteCount) {
-        BonParsedJson*          parsedJson      = BonParseJson(MallocWrap, 0, jsonString, jsonStringByteCount);
-        BonRecord*              bonRecord;
+/* Return the member or item key of a container value, or null if there is none */
+static BonValue*
+FindChildValue(BonValue* value, uint32_t key) {
+        if (BonGetValueType(value) == BON_VT_OBJECT) {
+                BonObject       object  = BonAsObject(value);
+                const int       i       = BonFindIndexOfName(object.names, object.count, key);
+                return i >= 0 ? (BonValue*)&object.values[i] : 0;
+        } else if (BonGetValueType(value) == BON_VT_ARRAY) {
+                BonArray        array   = BonAsArray(value);
+                return key < (uint32_t)array.count ? (BonValue*)&array.values[key] : 0;
+        }
+        return 0;
+}
 
-        if (parsedJson->status != BON_STATUS_OK) {
-                BonFreeParsedJsonMemory(parsedJson, FreeWrap, 0);
+/* Most patches only give numbers and bools new values of the same type. That doesn't change the
+ * layout, so the new values are written over a copy of the old record instead of building a tree.
+ * Return null if the patch has any other kind of operation. */
+static BonRecord*
+ApplyPatchInPlace(const BonRecord* oldRecord, const BonPatchHeader* header) {
+        const uint8_t*          cursor          = (const uint8_t*)&header[1];
+        const uint8_t*          end             = (const uint8_t*)header + header->patchSize;
+        BonRecord*              record;
+        uint32_t                i;
+        uint32_t                j;
+
+        if (header->newRecordSize != oldRecord->recordSize || header->newRecordFlags != oldRecord->flags 
+                || (record = (BonRecord*)malloc(oldRecord->recordSize)) == 0)
+                return 0;
+        memcpy(record, oldRecord, oldRecord->recordSize);
+        for (i = 0; i < header->opCount; ++i) {
+                const uint32_t* words   = (const uint32_t*)cursor;
+                BonValue*       target  = &record->rootValue;
+                BonValue        value;
+                size_t          opSize;
+
+                if (end - cursor < 8 || words[0] != BON_PATCH_OP_SET_VALUE || words[1] > BON_PATCH_MAX_DEPTH)
+                        goto fail;
+                opSize = BonRoundUp((2 + (size_t)words[1]) * sizeof(uint32_t), 8) + sizeof(BonValue);
+                if ((size_t)(end - cursor) < opSize)
+                        goto fail;
+                for (j = 0; j < words[1] && target; ++j) {
+                        target = FindChildValue(target, words[2 + j]);
+                }
+                memcpy(&value, cursor + opSize - sizeof(BonValue), sizeof(BonValue));
+                if (!target || BonGetValueType(target) != BonGetValueType(&value) 
+                        || (BonGetValueType(target) != BON_VT_NUMBER && BonGetValueType(target) != BON_VT_BOOL))
+                        goto fail;
+                *target = value;
+                cursor += opSize;
+        }
+        return record;
+fail:
+        free(record);
+        return 0;
+}
+
+BonRecord*
+BonApplyPatch(const BonRecord* oldRecord, const void* patch, size_t patchSize) {
+        BonParsedJson* volatile pj              = 0;                            /* volatile: must survive longjmp */
+        BonRecord* volatile     record          = 0;
+        const BonPatchHeader*   header          = (const BonPatchHeader*)patch;
+        const BonRecord* volatile dictionary     = 0;                           /* volatile: must survive longjmp */
+        BonRecord               dictionaryKey;
+        BonPatchReader          reader;
+        jmp_buf                 errorJmpBuf;
+        uint32_t                i;
+
+        if (patchSize < sizeof(BonPatchHeader) || ((uintptr_t)patch & 7) != 0 || header->magic != BonFourCC('B', 'O', 'N', 'D') || oldRecord->magic == BON_WIDE_RECORD_MAGIC
+                || header->patchSize > patchSize || header->patchSize < sizeof(BonPatchHeader)
+                || header->oldRecordSize != oldRecord->recordSize || header->oldRecordHash != HashRecordBytes(oldRecord)) {
+                return 0;
+        }
+        if (header->opCount == 0) {                                             /* Nothing changed */
+                if (header->newRecordHash != header->oldRecordHash || header->newRecordSize != oldRecord->recordSize)
+                        return 0;
+                record = (BonRecord*)malloc(oldRecord->recordSize);
+                return record ? (BonRecord*)memcpy(record, oldRecord, oldRecord->recordSize) : 0;
+        }
+        if ((record = ApplyPatchInPlace(oldRecord, header)) != 0) {
+                BonUpdateSubtreeHashes(record);
+                if (HashRecordBytes(record) == header->newRecordHash)
+                        return record;
+                free(record);
                 return 0;
         }
+        if (header->newNameDictionaryId) {
+                memset(&dictionaryKey, 0, sizeof(dictionaryKey));               /* Only the id is used to find the registered dictionary */
+                dictionaryKey.nameDictionaryId = header->newNameDictionaryId;
+                if ((dictionary = BonGetNameDictionary(&dictionaryKey)) == 0)
+                        return 0;
+        }
 
-        bonRecord = BonCreateRecordFromParsedJson(parsedJson, MallocWrap(0, BonGetBonRecordSize(parsedJson)));
-        BonFreeParsedJsonMemory(parsedJson, FreeWrap, 0);
+        if (setjmp(errorJmpBuf) == 0) {
+                pj                      = CreateEmptyParsedJson(&errorJmpBuf);
+                pj->options.nameDictionary = dictionary;
+                pj->options.subtreeHashes = (header->newRecordFlags & BON_RECORD_FLAG_SUBTREE_HASHES) ? BON_TRUE : BON_FALSE;
+                BuildVariantFromValue(pj, oldRecord, &oldRecord->rootValue, &pj->rootValue);
 
-        return bonRecord;
+                reader.cursor   = (const uint8_t*)&header[1];
+                reader.end      = (const uint8_t*)patch + header->patchSize;
+                for (i = 0; i < header->opCount; ++i) {
+                        ApplyPatchOp(pj, &reader);
+                }
+                if (pj->rootValue.type != BON_VT_OBJECT && (pj->rootValue.type != BON_VT_ARRAY || pj->rootValue.value.arrayValue->elementType)) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+
+                record = CreateRecordFromTree(pj);
+                if (record->recordSize != header->newRecordSize || HashRecordBytes(record) != header->newRecordHash) {
+                        GiveUp(pj->env, BON_STATUS_INVALID_PATCH);
+                }
+        } else {
+                free(record);
+                record = 0;
+        }
+        if (pj) {
+                BonFreeParsedJsonMemory(pj, FreeWrap, 0);
+        }
+        return record;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Stripping names */
+
+BonRecord*
+BonStripNames(const BonRecord* br) {
+        const BonWideRecordHeader*      wide                    = br->magic == BON_WIDE_RECORD_MAGIC ? (const BonWideRecordHeader*)&br[1] : 0;
+        const size_t                    brSize                  = (size_t)BonGetRecordSize(br);
+        const size_t                    nameLookupOffset        = wide ? (size_t)wide->nameLookupTableOffset
+                                                                       : (size_t)((const uint8_t*)&br->nameLookupTableOffset + br->nameLookupTableOffset - (const uint8_t*)br);
+        size_t                          hashesBegin             = brSize;
+        size_t                          recordSize;
+        BonRecord*                      record;
+
+        if (br->flags & BON_RECORD_FLAG_SUBTREE_HASHES) {                       /* The footer's offset is relative, so the section moves as is */
+                const BonSubtreeHashFooter* footer = (const BonSubtreeHashFooter*)((const uint8_t*)br + brSize - sizeof(BonSubtreeHashFooter));
+                hashesBegin = (size_t)((const uint8_t*)&footer->hashesOffset + footer->hashesOffset - (const uint8_t*)br);
+        }
+        if (br->flags & BON_RECORD_FLAG_NO_NAMES) {
+                hashesBegin = nameLookupOffset;
+        }
+        recordSize = nameLookupOffset + (brSize - hashesBegin);
+        record = (BonRecord*)malloc(recordSize);
+        if (!record) {
+                return 0;
+        }
+        memcpy(record, br, nameLookupOffset);
+        memcpy((uint8_t*)record + nameLookupOffset, (const uint8_t*)br + hashesBegin, brSize - hashesBegin);
+        record->flags          |= BON_RECORD_FLAG_NO_NAMES;                     /* The name lookup offset now points at the end of the value strings */
+        if (wide) {
+                ((BonWideRecordHeader*)&record[1])->recordSize = recordSize;
+        } else {
+                record->recordSize = (uint32_t)recordSize;
+        }
+        return record;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -1244,6 +5715,9 @@ BonCreateRecordFromJson(const char* jsonString, size_t jsonStringByteCount) {
 
 typedef struct JSONPrinter {
         const BonRecord*        doc;
+        const struct BonNameIndex* names;                                       /* Optional. Null if it couldn't be allocated */
+        BonNameProvider         nameProvider;                                   /* Optional. Asked for names that the record doesn't have */
+        void*                   nameProviderUserdata;
         int                     indent;
         FILE*                   stream;
 } JSONPrinter;
@@ -1260,6 +5734,51 @@ IndentStr(int indent) {
         return indentStr;
 }
 
+/* Print a string in quotes with the characters that JSON doesn't allow in a string escaped */
+static void
+printJSONString(FILE* stream, const char* string, size_t byteCount) {
+        const char*     end     = string + byteCount;
+        const char*     run     = string;                                       /* Start of characters that don't need escaping */
+
+        fputc('\"', stream);
+        for (; string != end; ++string) {
+                const uint8_t c = (uint8_t)*string;
+                if (c >= 0x20u && c != '\"' && c != '\\') {
+                        continue;
+                }
+                fwrite(run, 1, (size_t)(string - run), stream);
+                run = string + 1;
+                switch (c) {
+                case '\"':      fputs("\\\"", stream);          break;
+                case '\\':      fputs("\\\\", stream);          break;
+                case '\b':      fputs("\\b", stream);           break;
+                case '\f':      fputs("\\f", stream);           break;
+                case '\n':      fputs("\\n", stream);           break;
+                case '\r':      fputs("\\r", stream);           break;
+                case '\t':      fputs("\\t", stream);           break;
+                default:        fprintf(stream, "\\u%04x", c);  break;
+                }
+        }
+        fwrite(run, 1, (size_t)(string - run), stream);
+        fputc('\"', stream);
+}
+
+/* The shortest of 15, 16 or 17 significant digits that reads back as the same double */
+static void
+printJSONNumber(FILE* stream, double d) {
+        char    buffer[32];
+        int     precision;
+        for (precision = 15; precision < 17; ++precision) {
+                sprintf(buffer, "%.*g", precision, d);
+                if (strtod(buffer, 0) == d)
+                        break;
+        }
+        if (precision == 17) {
+                sprintf(buffer, "%.17g", d);
+        }
+        fputs(buffer, stream);
+}
+
 static void 
 printAsJSON(JSONPrinter* p, const BonValue* v, BonBool lastInList, const char* IndentString)
 {
@@ -1271,11 +5790,16 @@ printAsJSON(JSONPrinter* p, const BonValue* v, BonBool lastInList, const char* I
                         fprintf(p->stream, "%s%s", IndentString, (BonAsBool(v) ? "true" : "false"));
                         break;
                 case BON_VT_NUMBER:
-                        fprintf(p->stream, "%s%f", IndentString, BonAsNumber(v));
+                        fputs(IndentString, p->stream);
+                        printJSONNumber(p->stream, BonAsNumber(v));
                         break;
-                case BON_VT_STRING:
-                        fprintf(p->stream, "%s\"%s\"", IndentString, BonAsString(v));
+                case BON_VT_STRING: {
+                        size_t byteCount;
+                        const char* string = BonAsStringWithLength(v, &byteCount);
+                        fputs(IndentString, p->stream);
+                        printJSONString(p->stream, string, byteCount);
                         break;
+                }
                 case BON_VT_ARRAY: {
                         BonArray array = BonAsArray(v);
                         int i;
@@ -1288,14 +5812,46 @@ printAsJSON(JSONPrinter* p, const BonValue* v, BonBool lastInList, const char* I
                         fprintf(p->stream, "%s]", IndentStr(p->indent));
                         break;
                 }
+                case BON_VT_TYPED_ARRAY: {
+                        BonTypedArray array = BonAsTypedArray(v);
+                        int i;
+                        fprintf(p->stream, "%s[\n", IndentString);
+                        p->indent++;
+                        for (i = 0; i < array.count; ++i) {
+                                const char* separator = i == array.count - 1 ? "\n" : ",\n";
+                                switch (array.elementType) {
+                                case BON_ET_FLOAT32:
+                                        fputs(IndentStr(p->indent), p->stream);
+                                        printJSONNumber(p->stream, ((const float*)array.values)[i]);
+                                        fputs(separator, p->stream);
+                                        break;
+                                case BON_ET_INT32:      fprintf(p->stream, "%s%d%s", IndentStr(p->indent), ((const int32_t*)array.values)[i], separator);  break;
+                                case BON_ET_INT16:      fprintf(p->stream, "%s%d%s", IndentStr(p->indent), ((const int16_t*)array.values)[i], separator);  break;
+                                case BON_ET_UINT8:      fprintf(p->stream, "%s%d%s", IndentStr(p->indent), ((const uint8_t*)array.values)[i], separator);  break;
+                                }
+                        }
+                        p->indent--;
+                        fprintf(p->stream, "%s]", IndentStr(p->indent));
+                        break;
+                }
                 case BON_VT_OBJECT: {
                         BonObject object = BonAsObject(v);
                         int i;
                         fprintf(p->stream, "%s{\n", IndentString);
                         p->indent++;
                         for (i = 0; i < object.count; ++i) {
-                                const char* nameString = BonGetNameString(p->doc, object.names[i]);
-                                fprintf(p->stream, "%s\"%s\" : ", IndentStr(p->indent), nameString);
+                                size_t byteCount;
+                                const char* nameString = p->names ? BonNameIndexGetStringWithLength(p->names, object.names[i], &byteCount) : BonGetNameStringWithLength(p->doc, object.names[i], &byteCount);
+                                if (!nameString && p->nameProvider) {
+                                        nameString = p->nameProvider(p->nameProviderUserdata, object.names[i], &byteCount);
+                                }
+                                if (nameString) {
+                                        fputs(IndentStr(p->indent), p->stream);
+                                        printJSONString(p->stream, nameString, byteCount);
+                                        fputs(" : ", p->stream);
+                                } else {
+                                        fprintf(p->stream, "%s\"0x%08x\" : ", IndentStr(p->indent), object.names[i]);  /* E.g. a missing name dictionary or stripped names */
+                                }
                                 printAsJSON(p, &object.values[i], i == object.count - 1, "");
                         }
                         p->indent--;
@@ -1316,21 +5872,38 @@ printAsJSON(JSONPrinter* p, const BonValue* v, BonBool lastInList, const char* I
 
 void                            
 BonWriteAsJsonToStream(const BonRecord* record, FILE* stream) {
+        BonWriteAsJsonToStreamWithNames(record, stream, 0, 0);
+}
+
+void
+BonWriteAsJsonToStreamWithNames(const BonRecord* record, FILE* stream, BonNameProvider provider, void* userdata) {
         JSONPrinter printer;
+        void*       nameIndexMemory = malloc(BonGetNameIndexSize(record));
         printer.doc             = record;
+        printer.names           = nameIndexMemory ? BonCreateNameIndex(record, nameIndexMemory) : 0;
+        printer.nameProvider    = provider;
+        printer.nameProviderUserdata = userdata;
         printer.indent          = 0;
         printer.stream          = stream;
         printAsJSON(&printer, BonGetRootValue(record), BON_TRUE, "");
+        free(nameIndexMemory);
 }
 
-static uint32_t
-DebugAbsoluteOffset(const void* from, const void* to, int32_t offset) {
-        return (uint32_t)((uint8_t*)to - (uint8_t*)from) + offset;
+static unsigned long long
+DebugAbsoluteOffset(const void* from, const void* to, int64_t offset) {
+        return (unsigned long long)(((uint8_t*)to - (uint8_t*)from) + offset);
+}
+
+/* The offset of a string or container value, including the high bits of wide records */
+static int64_t
+DebugValueOffset(const BonValue* v) {
+        const BonStringValue* sv = (const BonStringValue*)v;
+        return (int64_t)sv->offset + (int64_t)(sv->type >> 8) * 0x100000000ll;
 }
 
 static void
 DebugWriteBonValue(const BonRecord* r, const BonValue* v, FILE* f) {
-        int32_t offset;
+        const int64_t offset = DebugValueOffset(v);
         if (BonIsNullValue(v)) {
                 fprintf(f, "NULL\n");
                 return;
@@ -1343,37 +5916,62 @@ DebugWriteBonValue(const BonRecord* r, const BonValue* v, FILE* f) {
                 fprintf(f, "NUMBER %f\n", BonAsNumber(v));
                 return;
         case BON_VT_STRING:
-                offset = ((const BonStringValue*)v)->offset;
-                fprintf(f, "STRING %5d (%08x)\n", offset, DebugAbsoluteOffset(r, v, offset));
+                fprintf(f, "STRING %5lld (%08llx)%s\n", (long long)offset, DebugAbsoluteOffset(r, v, offset), (*v & BON_STRING_FLAG_LENGTH) ? " length" : "");
                 return;
         case BON_VT_ARRAY:
-                offset = ((const BonArrayValue*)v)->offset;
-                fprintf(f, "ARRAY  %5d (%08x)\n", offset, DebugAbsoluteOffset(r, v, offset));
+                fprintf(f, "ARRAY  %5lld (%08llx)%s\n", (long long)offset, DebugAbsoluteOffset(r, v, offset), (*v & BON_ARRAY_FLAG_NUMBERS) ? " numbers" : "");
+                return;
+        case BON_VT_TYPED_ARRAY:
+                fprintf(f, "TYPED  %5lld (%08llx)\n", (long long)offset, DebugAbsoluteOffset(r, v, offset));
                 return;
         case BON_VT_OBJECT:
-                offset = ((const BonObjectValue*)v)->offset;
-                fprintf(f, "OBJECT %5d (%08x)\n", offset, DebugAbsoluteOffset(r, v, offset));
+                fprintf(f, "OBJECT %5lld (%08llx)\n", (long long)offset, DebugAbsoluteOffset(r, v, offset));
                 return;
         default:
                 assert(0);
         }
 }
 
+/* Print the strings from pchar to end, one per line. Return end. */
+static const char*
+DebugWriteStrings(const BonRecord* r, const char* pchar, const char* end, FILE* stream) {
+        while (pchar < end) {
+                if (r->flags & BON_RECORD_FLAG_STRING_LENGTHS) {
+                        const uint32_t len = *(const uint32_t*)pchar;
+                        fprintf(stream, "%08llx: [%u] ", DebugAbsoluteOffset(r, pchar + sizeof(uint32_t), 0), len);
+                        fwrite(pchar + sizeof(uint32_t), 1, len, stream);
+                        fputc('\n', stream);
+                        pchar += BonRoundUp(sizeof(uint32_t) + len + 1, 8);
+                } else {
+                        const size_t len = strlen(pchar);
+                        fprintf(stream, "%08llx: %s\n", DebugAbsoluteOffset(r, pchar, 0), pchar);
+                        pchar += BonRoundUp(len + 1, 8);
+                }
+        }
+        return pchar;
+}
+
 void
 BonDebugWrite(const BonRecord* r, FILE* stream) {
         const uint64_t*                 p;
         const char*                     pchar;
-        const uint64_t*                 pvalueStrings           = (uint64_t*)((uint8_t*)&(r->valueStringOffset) + r->valueStringOffset);
-        const char*                     pnameLookupTable        = ((char*)(&r->nameLookupTableOffset) + r->nameLookupTableOffset);
+        const BonWideRecordHeader*      wide                    = r->magic == BON_WIDE_RECORD_MAGIC ? (const BonWideRecordHeader*)&r[1] : 0;
+        const uint64_t                  recordSize              = BonGetRecordSize(r);
+        const uint64_t*                 pvalueStrings           = wide ? (const uint64_t*)((const uint8_t*)r + wide->valueStringOffset)
+                                                                       : (uint64_t*)((uint8_t*)&(r->valueStringOffset) + r->valueStringOffset);
+        const char*                     pnameLookupTable        = wide ? (const char*)r + wide->nameLookupTableOffset
+                                                                       : ((char*)(&r->nameLookupTableOffset) + r->nameLookupTableOffset);
         const BonContainerHeader*       container;
+        const BonSubtreeHashFooter*     footer                  = 0;
+        const uint64_t*                 hashes                  = (const uint64_t*)((const uint8_t*)r + recordSize);
         int32_t                         i;
 
         fprintf(stream,
                 "HEADER\n"
                 "00000000: magic                     : '%c%c%c%c'\n"
                 "00000004: recordSize                : %u\n"
-                "00000008: reserved                  : %d\n"
-                "0000000c: reserved1                 : %d\n"
+                "00000008: flags                     : 0x%08x\n"
+                "0000000c: nameDictionaryId          : 0x%08x\n"
                 "00000010: valueStringOffset         : %d (%08x)\n"
                 "00000014: nameLookupTableOffset     : %d (%08x)\n"
                 "00000018: rootValue                 : ",
@@ -1382,69 +5980,95 @@ BonDebugWrite(const BonRecord* r, FILE* stream) {
                 ((const char*)&r->magic)[2], 
                 ((const char*)&r->magic)[3], 
                 r->recordSize, 
-                r->reserved, 
-                r->reserved1, 
+                r->flags, 
+                r->nameDictionaryId, 
                 r->valueStringOffset, 
                 r->valueStringOffset + 0x10,
                 r->nameLookupTableOffset, 
                 r->nameLookupTableOffset + 0x14);
         DebugWriteBonValue(r, &r->rootValue, stream);
+        if (wide) {
+                fprintf(stream,
+                        "WIDE HEADER\n"
+                        "00000020: recordSize                : %llu\n"
+                        "00000028: valueStringOffset         : %08llx\n"
+                        "00000030: nameLookupTableOffset     : %08llx\n",
+                        (unsigned long long)wide->recordSize,
+                        (unsigned long long)wide->valueStringOffset,
+                        (unsigned long long)wide->nameLookupTableOffset);
+        }
 
         /* Objects and arrays */
         fprintf(stream, "OBJECTS AND ARRAYS\n");
-        for (p = (const uint64_t*)&r[1]; p < pvalueStrings; ) {
+        for (p = wide ? (const uint64_t*)&wide[1] : (const uint64_t*)&r[1]; p < pvalueStrings; ) {
                 container = (const BonContainerHeader*)p;
-                if (container->capacity > 0) {
-                        fprintf(stream, "%08x: ARRAY  count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
+                if (BON_IS_TYPED_ARRAY_HEADER(container->capacity)) {
+                        const int       elementType     = container->capacity & ~BON_TYPED_ARRAY_TAG;
+                        const size_t    byteCount       = BonGetTypedArrayElementSize(elementType) * (size_t)container->count;
+                        fprintf(stream, "%08llx: TYPED  count %4d, element type %d\n", DebugAbsoluteOffset(r, p, 0), container->count, elementType);
+                        p += 1 + (byteCount + 7) / 8;
+                } else if (container->capacity > 0) {
+                        fprintf(stream, "%08llx: ARRAY  count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
                         ++p;
                         for (i = 0; i < container->count; ++i) {
-                                fprintf(stream, "%08x: %5d: ", DebugAbsoluteOffset(r, p, 0), i);
+                                fprintf(stream, "%08llx: %5d: ", DebugAbsoluteOffset(r, p, 0), i);
                                 DebugWriteBonValue(r, (const BonValue*)p, stream);
                                 ++p;
                         }
                 } else {
-                        fprintf(stream, "%08x: OBJECT count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
+                        fprintf(stream, "%08llx: OBJECT count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
                         ++p;
                         for (i = 0; i < container->count; ++i) {
-                                fprintf(stream, "%08x: %5d: ", DebugAbsoluteOffset(r, p, 0), i);
+                                fprintf(stream, "%08llx: %5d: ", DebugAbsoluteOffset(r, p, 0), i);
                                 DebugWriteBonValue(r, (const BonValue*)p, stream);
                                 ++p;
                         }
                         for (i = 0; i < container->count; i = i + 2) {
                                 const BonName* names = (const BonName*)p;
-                                fprintf(stream, "%08x: %5d: 0x%08x 0x%08x\n", DebugAbsoluteOffset(r, p, 0), i, names[0], names[1]);
+                                fprintf(stream, "%08llx: %5d: 0x%08x 0x%08x\n", DebugAbsoluteOffset(r, p, 0), i, names[0], names[1]);
                                 ++p;
                         }
                 }
         }
 
         /* Value strings */
-        /* TODO: unicode */
         fprintf(stream, "VALUE STRINGS\n");
-        for (pchar = (const char*)p; pchar < pnameLookupTable; pchar = (const char*)(((size_t)pchar & ~0x7ull) + 8)) {
-                size_t len = strlen(pchar);
-                fprintf(stream, "%08x: %s\n", DebugAbsoluteOffset(r, pchar, 0), pchar);
-                pchar += len;
-        }
+        pchar = DebugWriteStrings(r, (const char*)p, pnameLookupTable, stream);
         p = (const uint64_t*)pchar;
 
+        if (r->flags & BON_RECORD_FLAG_SUBTREE_HASHES) {
+                footer  = (const BonSubtreeHashFooter*)((const uint8_t*)r + recordSize - sizeof(BonSubtreeHashFooter));
+                hashes  = (const uint64_t*)((const uint8_t*)&footer->hashesOffset + footer->hashesOffset);
+        }
+
         /* Name lookup table */
-        container = (const BonContainerHeader*)p;
-        fprintf(stream, "NAME LOOKUP TABLE\n%08x:  count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
-        ++p;
-        for (i = 0; i < container->count; ++i) {
-                const BonNameAndOffset* nameAndOffset = (const BonNameAndOffset*)p;
-                fprintf(stream, "%08x: 0x%08x %5d (%08x)\n", DebugAbsoluteOffset(r, p, 0), nameAndOffset->name, nameAndOffset->offset, DebugAbsoluteOffset(r, &nameAndOffset->offset, nameAndOffset->offset));
+        if (r->flags & BON_RECORD_FLAG_NO_NAMES) {
+                fprintf(stream, "NAME LOOKUP TABLE\n%08llx: stripped\n", DebugAbsoluteOffset(r, p, 0));
+        } else {
+                container = (const BonContainerHeader*)p;
+                fprintf(stream, "NAME LOOKUP TABLE\n%08llx:  count %4d, capacity %5d\n", DebugAbsoluteOffset(r, p, 0), container->count, container->capacity);
                 ++p;
+                for (i = 0; i < container->count; ++i) {
+                        const BonNameAndOffset* nameAndOffset = (const BonNameAndOffset*)p;
+                        fprintf(stream, "%08llx: 0x%08x %5d (%08llx)\n", DebugAbsoluteOffset(r, p, 0), nameAndOffset->name, nameAndOffset->offset, DebugAbsoluteOffset(r, &nameAndOffset->offset, nameAndOffset->offset));
+                        ++p;
+                }
+
+                /* Name strings */
+                fprintf(stream, "NAME STRINGS\n");
+                DebugWriteStrings(r, (const char*)p, (const char*)hashes, stream);
         }
-        
-        /* Name strings */
-        /* TODO: unicode */
-        fprintf(stream, "NAME STRINGS\n");
-        for (pchar = (const char*)p; pchar < (char*)r + r->recordSize; pchar = (const char*)(((size_t)pchar & ~0x7ull) + 8)) {
-                size_t len = strlen(pchar);
-                fprintf(stream, "%08x: %s\n", DebugAbsoluteOffset(r, pchar, 0), pchar);
-                pchar += len;
+        if (!footer) {
+                return;
+        }
+
+        /* Subtree hashes */
+        fprintf(stream, "SUBTREE HASHES\n");
+        for (i = 0; i < footer->count; ++i) {
+                fprintf(stream, "%08llx: %08x 0x%016llx\n", DebugAbsoluteOffset(r, &hashes[i], 0), ((const uint32_t*)&hashes[footer->count])[i], 
+                        (unsigned long long)hashes[i]);
         }
+        fprintf(stream, "%08llx: count %4d, hashes %d (%08llx)\n", DebugAbsoluteOffset(r, footer, 0), footer->count, footer->hashesOffset, 
+                DebugAbsoluteOffset(r, &footer->hashesOffset, footer->hashesOffset));
 }
 
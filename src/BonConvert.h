@@ -24,6 +24,10 @@ extern "C" {
 #define                         BON_STATUS_OUT_OF_MEMORY        4               /**< Memory allocator returned null. */
 #define                         BON_STATUS_UNALIGNED_MEMORY     5               /**< Memory allocator returned memory that wasn't 8-byte aligned */
 #define                         BON_STATUS_INVALID_NUMBER       6               /**< The JSON text contained a number that could not be converted to a double. */
+#define                         BON_STATUS_INVALID_PATCH        7               /**< A patch was malformed or made for another record. */
+#define                         BON_STATUS_MISSING_NAME         8               /**< A record's name string was not found (e.g. its name dictionary isn't registered). */
+#define                         BON_STATUS_RECORD_TOO_LARGE     9               /**< The names of the record need more than 2 GB. */
+#define                         BON_STATUS_LOAD_FAILED          10              /**< A BonBatchLoad callback could not load the text. */
 /** @} */
 
 /**
@@ -58,6 +62,26 @@ typedef void                    (*BonTempMemoryFree)(           void*
 
 struct BonParsedJson;
 
+#define                         BON_TYPED_ARRAYS_NEVER          0               /**< Always write arrays of BonValues (the default). */
+#define                         BON_TYPED_ARRAYS_LOSSLESS       1               /**< Write a typed array when every number fits exactly in one of the BON_ET_* types. */
+#define                         BON_TYPED_ARRAYS_FLOAT32        2               /**< As BON_TYPED_ARRAYS_LOSSLESS, but round non-integer arrays to float32 when all values are within float range. */
+
+/**
+ * \brief Options for the JSON to BON conversion. 
+ *
+ * Zero initialize to get the same record as from BonParseJson.
+ */
+typedef struct BonConvertOptions {
+        int                     typedArrays;                                    /**< One of BON_TYPED_ARRAYS_* */
+        int                     typedArrayMinCount;                             /**< Arrays with fewer numbers than this are never typed. */
+        const BonRecord*        nameDictionary;                                 /**< Optional. Names found here are left out of the record. \sa BonCreateNameDictionary */
+        BonBool                 subtreeHashes;                                  /**< Store the hash of every container (not in wide records). \sa BonGetSubtreeHash, BonFindChangedPaths */
+        BonBool                 wideOffsets;                                    /**< Always write a wide record. Records larger than 2 GB are always wide. \sa BON_WIDE_RECORD_MAGIC */
+        BonBool                 scalarParse;                                    /**< Parse byte by byte instead of through the SIMD structural index. Same result, for testing and comparison. */
+        BonBool                 tape;                                           /**< Parse onto a flat tape instead of a tree of linked lists. Same record with less temp memory. */
+        int                     threadCount;                                    /**< Convert a large text on up to this many threads, split between the elements of the root. The same record. tempAlloc must then be thread safe. 0 or 1 for the calling thread only. */
+} BonConvertOptions;
+
 /**
  * \brief Parse a sequence of JSON UTF-8 data into an intermediate format.
  *
@@ -105,6 +129,61 @@ struct BonParsedJson*           BonParseJson(                   BonTempMemoryAll
                                                                 const char*                     jsonData, 
                                                                 size_t                          jsonDataByteCount);
 
+/**
+ * \brief Same as BonParseJson, but with conversion options.
+ *
+ * @param options               Conversion options. NULL is the same as zero initialized options.
+ */
+struct BonParsedJson*           BonParseJsonWithOptions(        BonTempMemoryAlloc              tempAlloc, 
+                                                                void*                           tempAllocUserdata, 
+                                                                const char*                     jsonData, 
+                                                                size_t                          jsonDataByteCount,
+                                                                const BonConvertOptions*        options);
+
+/**
+ * \brief Start parsing a JSON text that arrives in chunks, e.g. from a pipe or a socket.
+ *
+ * Feed the text with BonParserFeed and end it with BonParserFinish. The chunks can be split
+ * anywhere, also inside strings and numbers, and are not referenced after each call. After
+ * BonParserFinish the result is used as one from BonParseJsonWithOptions: the same record,
+ * BonGetBonRecordSize, BonCreateRecordFromParsedJson and BonFreeParsedJsonMemory. The text is
+ * converted through the tape (BonConvertOptions::tape).
+ *
+ * ~~~
+ * struct BonParsedJson* pj = BonParserBegin(MyAllocator, &myAllocatorInstance, 0);
+ * while ((n = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+ *      BonParserFeed(pj, buffer, n);
+ * }
+ * if (BonParserFinish(pj) != BON_STATUS_OK) {
+ *      fail();
+ * }
+ * ~~~
+ *
+ * @param tempAlloc             A function used to allocate temporary working memory.
+ * @param tempAllocUserdata     A user provided pointer always passed to tempAlloc.
+ * @param options               Conversion options. NULL is the same as zero initialized options.
+ * @return                      NULL if tempAlloc is NULL or the first allocation fails.
+ */
+struct BonParsedJson*           BonParserBegin(                 BonTempMemoryAlloc              tempAlloc,
+                                                                void*                           tempAllocUserdata,
+                                                                const BonConvertOptions*        options);
+
+/**
+ * \brief Parse the next chunk of a text started with BonParserBegin.
+ *
+ * @return                      The status so far. After a failure the rest of the text is ignored.
+ */
+int                             BonParserFeed(                  struct BonParsedJson*           parsedJson,
+                                                                const char*                     chunk,
+                                                                size_t                          chunkByteCount);
+
+/**
+ * \brief End the text and compute the layout of the record. Call once, after the last BonParserFeed.
+ *
+ * @return                      Same as BonGetParsedJsonStatus.
+ */
+int                             BonParserFinish(                struct BonParsedJson*           parsedJson);
+
 /**
  * \brief Free all memory allocated for parsedJson including parsedJson itself.
  *
@@ -173,6 +252,142 @@ BonRecord*                      BonCreateRecordFromParsedJson(  struct BonParsed
 BonRecord*                      BonCreateRecordFromJson(        const char*                     jsonData, 
                                                                 size_t                          jsonDataSize);
 
+/** 
+ * \brief Same as BonCreateRecordFromJson, but with conversion options.
+ *
+ * @param options               Conversion options. NULL is the same as zero initialized options.
+ */
+BonRecord*                      BonCreateRecordFromJsonWithOptions(const char*                  jsonData, 
+                                                                size_t                          jsonDataSize,
+                                                                const BonConvertOptions*        options);
+
+/** 
+ * \brief A text of BonConvertBatch.
+ */
+typedef struct BonBatchItem {
+        size_t                  index;                                          /**< Of the text in the batch, 0 to itemCount - 1. */
+        const char*             jsonData;                                       /**< Set by BonBatchLoad. Does not need to be null terminated. */
+        size_t                  jsonDataSize;                                   /**< Set by BonBatchLoad. */
+        void*                   loadUserdata;                                   /**< For BonBatchLoad, e.g. the buffer that BonBatchStore should free. */
+        BonRecord*              record;                                         /**< The record, allocated with malloc, or null if the conversion failed. Owned by BonBatchStore. */
+        int                     status;                                         /**< BON_STATUS_* of the conversion. */
+        double                  seconds;                                        /**< Wall clock time of the conversion, without BonBatchLoad and BonBatchStore. */
+} BonBatchItem;
+
+/** 
+ * \brief Set jsonData and jsonDataSize of the item from its index. Return BON_FALSE if the text could not be loaded.
+ */
+typedef BonBool                 (*BonBatchLoad)(                void*                           userdata,
+                                                                BonBatchItem*                   item);
+
+/** 
+ * \brief Take the record of the item (or its status) and release the text.
+ */
+typedef void                    (*BonBatchStore)(               void*                           userdata,
+                                                                BonBatchItem*                   item);
+
+/**
+ * \brief Convert many texts on a pool of worker threads.
+ *
+ * Each worker takes the next text, loads it with load, converts it and hands the record to store.
+ * A worker keeps its temp memory from text to text, so that after the first texts a conversion
+ * allocates nothing but its record. load and store are called on the worker threads, for several
+ * texts at once, but only once for each index. The records are the same as from 
+ * BonCreateRecordFromJsonWithOptions.
+ *
+ * ~~~
+ * BonBool Load(void* files, BonBatchItem* item) { 
+ *      item->jsonData = ReadFile(((MyFiles*)files)->inputs[item->index], &item->jsonDataSize);
+ *      return item->jsonData != 0;
+ * }
+ * void Store(void* files, BonBatchItem* item) { 
+ *      if (item->record) {
+ *              WriteFile(((MyFiles*)files)->outputs[item->index], item->record, (size_t)BonGetRecordSize(item->record));
+ *      }
+ *      free(item->record);
+ *      free((void*)item->jsonData);
+ * }
+ *
+ * failed = BonConvertBatch(fileCount, Load, Store, &myFiles, 0, 8);
+ * ~~~
+ *
+ * @param itemCount             Number of texts.
+ * @param load                  Called on a worker thread before each conversion.
+ * @param store                 Called on a worker thread after each conversion, also the failed ones.
+ * @param userdata              Passed to load and store.
+ * @param options               Conversion options. NULL is the same as zero initialized options.
+ *                              Each text is converted on a single thread, so threadCount is ignored.
+ * @param threadCount           Number of workers, the calling thread being one of them.
+ * @return                      Number of texts that were not converted.
+ */
+size_t                          BonConvertBatch(                size_t                          itemCount,
+                                                                BonBatchLoad                    load,
+                                                                BonBatchStore                   store,
+                                                                void*                           userdata,
+                                                                const BonConvertOptions*        options,
+                                                                int                             threadCount);
+
+/**
+ * \brief Create a name dictionary holding the given names.
+ *
+ * The dictionary is a BON record with an empty root array. Pass it in BonConvertOptions to leave
+ * its names out of converted records, and register it with BonRegisterNameDictionary before 
+ * reading the names of those records.
+ *
+ * @param nameStrings           Null-terminated UTF-8 names. Duplicates are allowed.
+ * @param nameCount             Number of names.
+ * @return                      A BON record allocated with malloc, or null if anything failed.
+ */
+BonRecord*                      BonCreateNameDictionary(        const char* const*              nameStrings,
+                                                                int                             nameCount);
+
+/**
+ * \brief Copy a record without its name lookup table and name strings.
+ *
+ * The copy is marked with BON_RECORD_FLAG_NO_NAMES. Values, subtree hashes and the name 
+ * dictionary id are kept, so readers that look members up by BonName work as before, while name
+ * strings only resolve through the record's name dictionary or a BonNameProvider. Patches can't
+ * be created for new members of a stripped record.
+ *
+ * @param br                    A valid record.
+ * @return                      A BON record allocated with malloc, or null if anything failed.
+ */
+BonRecord*                      BonStripNames(                  const BonRecord*                br);
+
+/**
+ * \brief Create a patch that turns one record into another.
+ *
+ * The patch lists the values that differ between the records by their path (member names and
+ * array indices), so its size depends on what changed rather than on the size of the records.
+ * An array whose length changed is replaced as a whole. The name strings of both records must be
+ * available, i.e. their name dictionaries (if any) must be registered. Wide records (see 
+ * BON_WIDE_RECORD_MAGIC) are not supported.
+ *
+ * @param oldRecord             The record the patch is applied to.
+ * @param newRecord             The record the patch produces.
+ * @param patchSize             Receives the size of the patch in bytes.
+ * @return                      The patch allocated with malloc, or null if anything failed.
+ */
+void*                           BonDiffRecords(                 const BonRecord*                oldRecord,
+                                                                const BonRecord*                newRecord,
+                                                                size_t*                         patchSize);
+
+/**
+ * \brief Create a new record from a record and a patch created with BonDiffRecords.
+ *
+ * The result is identical to the newRecord that the patch was created from. The patch stores
+ * hashes of both records, so a patch made for another record, or one that was damaged, fails
+ * instead of producing a wrong record.
+ *
+ * @param oldRecord             The record the patch was created from.
+ * @param patch                 The patch. Must be 8 byte aligned.
+ * @param patchSize             Size of the patch in bytes.
+ * @return                      A BON record allocated with malloc, or null if anything failed.
+ */
+BonRecord*                      BonApplyPatch(                  const BonRecord*                oldRecord,
+                                                                const void*                     patch,
+                                                                size_t                          patchSize);
+
 /** 
  * \brief Write a BON record as JSON to a stream.
  *
@@ -182,6 +397,28 @@ BonRecord*                      BonCreateRecordFromJson(        const char*
 void                            BonWriteAsJsonToStream(         const BonRecord*                record, 
                                                                 FILE*                           stream);
 
+/**
+ * \brief Return the string of a name that a record doesn't have, or null if it is unknown.
+ *
+ * @param userdata              The userdata passed with the provider.
+ * @param name                  The name to look up.
+ * @param byteCount             Receives the byte count of the string.
+ */
+typedef const char*             (*BonNameProvider)(             void*                           userdata,
+                                                                BonName                         name,
+                                                                size_t*                         byteCount);
+
+/** 
+ * \brief Same as BonWriteAsJsonToStream, but names that the record and its name dictionary don't 
+ * have (e.g. after BonStripNames) are looked up with provider. 
+ *
+ * Names that the provider doesn't know either are written as hex keys, e.g. "0x1b873593".
+ */
+void                            BonWriteAsJsonToStreamWithNames(const BonRecord*                record, 
+                                                                FILE*                           stream,
+                                                                BonNameProvider                 provider,
+                                                                void*                           userdata);
+
 /** @} */
 
 /**
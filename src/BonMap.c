@@ -0,0 +1,207 @@
+/* vi: set ts=8 sts=8 sw=8 et: */
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                                                             /* MAP_POPULATE, MADV_HUGEPAGE */
+#endif
+
+#include "BonMap.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define BON_MAP_WIN32
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define BON_MAP_POSIX
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Platform */
+
+#if defined(BON_MAP_POSIX)
+
+static BonBool
+MapFile(BonMappedFile* file, const char* fileName, int flags) {
+        struct stat     st;
+        int             mapFlags        = MAP_PRIVATE;
+        void*           data;
+        int             fd              = open(fileName, O_RDONLY);
+
+        if (fd < 0)
+                return BON_FALSE;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)(size_t)-1) {
+                close(fd);
+                return BON_FALSE;
+        }
+#ifdef MAP_POPULATE
+        if (flags & BON_MAP_POPULATE) {
+                mapFlags |= MAP_POPULATE;
+        }
+#endif
+        data = mmap(0, (size_t)st.st_size, PROT_READ, mapFlags, fd, 0);
+        close(fd);                                                              /* The mapping keeps the file open */
+        if (data == MAP_FAILED)
+                return BON_FALSE;
+
+#ifdef MADV_SEQUENTIAL
+        if (flags & BON_MAP_SEQUENTIAL) {
+                madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+        }
+#endif
+#ifdef MADV_RANDOM
+        if (flags & BON_MAP_RANDOM) {
+                madvise(data, (size_t)st.st_size, MADV_RANDOM);
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        if (flags & BON_MAP_HUGE_PAGES) {
+                madvise(data, (size_t)st.st_size, MADV_HUGEPAGE);
+        }
+#endif
+#ifdef MADV_WILLNEED
+        if (flags & BON_MAP_WILLNEED) {
+                madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+        }
+#endif
+        file->data      = data;
+        file->size      = (size_t)st.st_size;
+        file->handle    = 0;
+        return BON_TRUE;
+}
+
+static void
+UnmapFile(BonMappedFile* file) {
+        munmap((void*)file->data, file->size);
+}
+
+#elif defined(BON_MAP_WIN32)
+
+static BonBool
+MapFile(BonMappedFile* file, const char* fileName, int flags) {
+        LARGE_INTEGER   size;
+        HANDLE          mapping;
+        const void*     data;
+        HANDLE          f               = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                                                        (flags & BON_MAP_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : 
+                                                        (flags & BON_MAP_RANDOM) ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL, 0);
+        if (f == INVALID_HANDLE_VALUE)
+                return BON_FALSE;
+        if (!GetFileSizeEx(f, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > (uint64_t)(size_t)-1) {
+                CloseHandle(f);
+                return BON_FALSE;
+        }
+        mapping = CreateFileMappingA(f, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(f);                                                         /* The mapping keeps the file open */
+        if (!mapping)
+                return BON_FALSE;
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data) {
+                CloseHandle(mapping);
+                return BON_FALSE;
+        }
+        if (flags & BON_MAP_POPULATE) {
+                /* No MAP_POPULATE on Windows. Touch one byte per page instead. */
+                volatile const uint8_t* p = (const uint8_t*)data;
+                size_t i;
+                for (i = 0; i < (size_t)size.QuadPart; i += 4096) {
+                        (void)p[i];
+                }
+        }
+        file->data      = data;
+        file->size      = (size_t)size.QuadPart;
+        file->handle    = mapping;
+        return BON_TRUE;
+}
+
+static void
+UnmapFile(BonMappedFile* file) {
+        UnmapViewOfFile(file->data);
+        CloseHandle((HANDLE)file->handle);
+}
+
+#else
+
+/* No memory mapping. Read the file into memory instead. */
+static BonBool
+MapFile(BonMappedFile* file, const char* fileName, int flags) {
+        FILE*   f               = fopen(fileName, "rb");
+        long    size;
+        void*   data;
+
+        (void)flags;
+        if (!f)
+                return BON_FALSE;
+        if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0) {
+                fclose(f);
+                return BON_FALSE;
+        }
+        data = malloc((size_t)size);
+        if (!data || fread(data, (size_t)size, 1, f) != 1) {
+                free(data);
+                fclose(f);
+                return BON_FALSE;
+        }
+        fclose(f);
+        file->data      = data;
+        file->size      = (size_t)size;
+        file->handle    = data;
+        return BON_TRUE;
+}
+
+static void
+UnmapFile(BonMappedFile* file) {
+        free(file->handle);
+}
+
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+BonBool
+BonMapFile(BonMappedFile* file, const char* fileName, int flags) {
+        file->data      = 0;
+        file->size      = 0;
+        file->handle    = 0;
+        if (!fileName)
+                return BON_FALSE;
+        return MapFile(file, fileName, flags);
+}
+
+void
+BonUnmapFile(BonMappedFile* file) {
+        if (!file->data)
+                return;
+        UnmapFile(file);
+        file->data      = 0;
+        file->size      = 0;
+        file->handle    = 0;
+}
+
+const BonRecord*
+BonMapRecordFile(BonMappedFile* file, const char* fileName, int flags) {
+        const BonRecord*        record;
+        BonBool                 valid;
+
+        if (!BonMapFile(file, fileName, flags))
+                return 0;
+        record  = (const BonRecord*)file->data;
+        valid   = (flags & BON_MAP_VALIDATE_DEEP) ? BonValidateRecordDeep(record, file->size) : BonIsAValidRecord(record, file->size);
+        if (!valid) {
+                BonUnmapFile(file);
+                return 0;
+        }
+        return record;
+}
+
+void
+BonUnmapRecord(BonMappedFile* file) {
+        BonUnmapFile(file);
+}
@@ -0,0 +1,86 @@
+#pragma once
+/* vi: set ts=8 sts=8 sw=8 et: */
+/**
+* @file
+* \addtogroup BonMap
+* \brief Memory mapping BON records from files.
+*
+* A BON record needs no parsing, so the cheapest way to read one from disk is to map the file 
+* and use it where it lies. The pages are only read when they are touched and are shared with
+* the page cache instead of being copied into a malloc:ed buffer.
+* @{
+*/
+
+#include "Bon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BON_MAP_POPULATE        0x01    /**< Read the whole file up front (MAP_POPULATE). Good when all of it will be used. */
+#define BON_MAP_SEQUENTIAL      0x02    /**< Hint that the file will be read front to back (MADV_SEQUENTIAL). */
+#define BON_MAP_RANDOM          0x04    /**< Hint that the file will be read at random (MADV_RANDOM). Disables read-ahead. */
+#define BON_MAP_WILLNEED        0x08    /**< Start reading the file in the background (MADV_WILLNEED). */
+#define BON_MAP_HUGE_PAGES      0x10    /**< Ask for transparent huge pages (MADV_HUGEPAGE) where the file system supports it. */
+#define BON_MAP_VALIDATE_DEEP   0x20    /**< BonMapRecordFile: validate with BonValidateRecordDeep instead of BonIsAValidRecord. */
+
+/**
+ * A read-only file mapped into memory.
+ */
+typedef struct BonMappedFile {
+        const void*             data;                   /**< The file contents. Aligned to a page boundary. */
+        size_t                  size;                   /**< Size of the file in bytes. */
+        void*                   handle;                 /**< Platform specific. */
+} BonMappedFile;
+
+/**
+ * \brief Map a whole file read-only into memory.
+ *
+ * On platforms without memory mapping the file is read into memory from malloc instead, so the
+ * caller doesn't need a fallback path. Hints in flags that the platform doesn't support are ignored.
+ *
+ * @param file                  Receives the mapping. Release it with BonUnmapFile.
+ * @param fileName              Name of the file to map.
+ * @param flags                 A combination of BON_MAP_* flags.
+ * @return                      BON_FALSE if the file couldn't be opened or mapped, or is empty.
+ */
+BonBool                         BonMapFile(                     BonMappedFile* file,
+                                                                const char* fileName,
+                                                                int flags);
+
+/** Release a mapping created by BonMapFile. Does nothing if file has already been unmapped. */
+void                            BonUnmapFile(                   BonMappedFile* file);
+
+/**
+ * \brief Map a file holding a single BON record.
+ *
+ * The record is checked in place with BonIsAValidRecord, or BonValidateRecordDeep when 
+ * BON_MAP_VALIDATE_DEEP is set. Use the deep validation for files that aren't trusted.
+ *
+ * ~~~
+ * BonMappedFile file;
+ * const BonRecord* record = BonMapRecordFile(&file, "scene.bon", BON_MAP_SEQUENTIAL);
+ * if (record) {
+ *      ...
+ *      BonUnmapRecord(&file);
+ * }
+ * ~~~
+ *
+ * @param file                  Receives the mapping. Release it with BonUnmapRecord.
+ * @param fileName              Name of the file to map.
+ * @param flags                 A combination of BON_MAP_* flags.
+ * @return                      The record, or null if the file couldn't be mapped or the record
+ *                              isn't valid. Nothing needs to be released on failure.
+ */
+const BonRecord*                BonMapRecordFile(               BonMappedFile* file,
+                                                                const char* fileName,
+                                                                int flags);
+
+/** Release a record mapped by BonMapRecordFile. */
+void                            BonUnmapRecord(                 BonMappedFile* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
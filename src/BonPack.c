@@ -0,0 +1,161 @@
+/* vi: set ts=8 sts=8 sw=8 et: */
+#include "BonPack.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define BON_PACK_MAGIC          ((uint32_t)('B' | ('O' << 8) | ('N' << 16) | ('P' << 24)))
+
+static uint64_t
+RoundUp8(uint64_t value) {
+        return (value + 7) & ~(uint64_t)7;
+}
+
+static size_t
+KeysSize(uint32_t recordCount) {
+        return (size_t)RoundUp8((uint64_t)recordCount * sizeof(BonName));
+}
+
+static const BonPackEntry*
+GetEntries(const BonPackHeader* pack) {
+        return (const BonPackEntry*)((const uint8_t*)&pack[1] + KeysSize(pack->recordCount));
+}
+
+BonBool
+BonIsAValidPack(const void* pack, size_t packSizeInBytes) {
+        const BonPackHeader*    header  = (const BonPackHeader*)pack;
+        const BonName*          keys;
+        const BonPackEntry*     entries;
+        uint64_t                indexEnd;
+        uint32_t                i;
+
+        if (!pack || ((uintptr_t)pack & 7) != 0 || packSizeInBytes < sizeof(BonPackHeader))
+                return BON_FALSE;
+        if (header->magic != BON_PACK_MAGIC || header->packSize != packSizeInBytes)
+                return BON_FALSE;
+        indexEnd = sizeof(BonPackHeader) + KeysSize(header->recordCount) + (uint64_t)header->recordCount * sizeof(BonPackEntry);
+        if (header->recordCount > 0x7fffffff || indexEnd > packSizeInBytes)
+                return BON_FALSE;
+
+        keys    = (const BonName*)&header[1];
+        entries = GetEntries(header);
+        for (i = 0; i < header->recordCount; ++i) {
+                if (i > 0 && keys[i - 1] >= keys[i])
+                        return BON_FALSE;
+                if ((entries[i].offset & 7) != 0 || entries[i].offset < indexEnd || entries[i].size < sizeof(BonRecord)
+                        || entries[i].offset > packSizeInBytes || entries[i].size > packSizeInBytes - entries[i].offset)
+                        return BON_FALSE;
+        }
+        return BON_TRUE;
+}
+
+int
+BonGetPackRecordCount(const BonPackHeader* pack) {
+        return (int)pack->recordCount;
+}
+
+const BonName*
+BonGetPackKeys(const BonPackHeader* pack) {
+        return (const BonName*)&pack[1];
+}
+
+const BonRecord*
+BonGetPackRecordAt(const BonPackHeader* pack, int index) {
+        const BonPackEntry*     entry;
+        const BonRecord*        record;
+        if (index < 0 || index >= (int)pack->recordCount)
+                return 0;
+        entry   = &GetEntries(pack)[index];
+        record  = (const BonRecord*)((const uint8_t*)pack + entry->offset);
+        return BonIsAValidRecord(record, (size_t)entry->size) ? record : 0;
+}
+
+const BonRecord*
+BonFindPackRecord(const BonPackHeader* pack, BonName key) {
+        const int index = BonFindIndexOfName(BonGetPackKeys(pack), (int)pack->recordCount, key);
+        return index >= 0 ? BonGetPackRecordAt(pack, index) : 0;
+}
+
+const BonPackHeader*
+BonMapPackFile(BonMappedFile* file, const char* fileName, int flags) {
+        if (!BonMapFile(file, fileName, flags))
+                return 0;
+        if (!BonIsAValidPack(file->data, file->size)) {
+                BonUnmapFile(file);
+                return 0;
+        }
+        return (const BonPackHeader*)file->data;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Writing */
+
+static int
+ItemCompare(const void* a, const void* b) {
+        const BonName x = ((const BonPackItem*)a)->key;
+        const BonName y = ((const BonPackItem*)b)->key;
+        return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static BonBool
+WriteZeros(FILE* stream, size_t count) {
+        static const uint8_t zeros[8] = { 0 };
+        assert(count <= sizeof(zeros));
+        return count == 0 || fwrite(zeros, count, 1, stream) == 1;
+}
+
+BonBool
+BonWritePack(BonPackItem* items, int itemCount, FILE* stream) {
+        BonPackHeader           header;
+        BonPackEntry            entry;
+        uint64_t                offset;
+        int                     i;
+
+        if (itemCount < 0 || (itemCount > 0 && !items) || !stream)
+                return BON_FALSE;
+
+        qsort(items, (size_t)itemCount, sizeof(BonPackItem), ItemCompare);
+        for (i = 0; i < itemCount; ++i) {
+                if (!BonIsAValidRecord(items[i].record, 0) || BonGetRecordSize(items[i].record) < sizeof(BonRecord))
+                        return BON_FALSE;
+                if (i > 0 && items[i - 1].key == items[i].key)
+                        return BON_FALSE;
+        }
+
+        /* Header and keys */
+        offset = sizeof(BonPackHeader) + KeysSize((uint32_t)itemCount) + (uint64_t)itemCount * sizeof(BonPackEntry);
+        header.magic            = BON_PACK_MAGIC;
+        header.recordCount      = (uint32_t)itemCount;
+        header.packSize         = offset;
+        for (i = 0; i < itemCount; ++i) {
+                header.packSize += RoundUp8(BonGetRecordSize(items[i].record));
+        }
+        if (fwrite(&header, sizeof(header), 1, stream) != 1)
+                return BON_FALSE;
+        for (i = 0; i < itemCount; ++i) {
+                if (fwrite(&items[i].key, sizeof(BonName), 1, stream) != 1)
+                        return BON_FALSE;
+        }
+        if (!WriteZeros(stream, KeysSize((uint32_t)itemCount) - (size_t)itemCount * sizeof(BonName)))
+                return BON_FALSE;
+
+        /* Entries */
+        for (i = 0; i < itemCount; ++i) {
+                entry.offset    = offset;
+                entry.size      = BonGetRecordSize(items[i].record);
+                if (fwrite(&entry, sizeof(entry), 1, stream) != 1)
+                        return BON_FALSE;
+                offset += RoundUp8(entry.size);
+        }
+
+        /* Records */
+        for (i = 0; i < itemCount; ++i) {
+                const uint64_t size = BonGetRecordSize(items[i].record);
+                if (fwrite(items[i].record, (size_t)size, 1, stream) != 1 || !WriteZeros(stream, (size_t)(RoundUp8(size) - size)))
+                        return BON_FALSE;
+        }
+        return BON_TRUE;
+}
@@ -0,0 +1,112 @@
+#pragma once
+/* vi: set ts=8 sts=8 sw=8 et: */
+/**
+* @file
+* \addtogroup BonPack
+* \brief Pack files: many BON records in one file, found by key.
+*
+* Opening, reading and closing thousands of small record files is much slower than mapping one
+* file. A pack holds an index of sorted BonName keys followed by the records, each aligned to
+* eight bytes, so a mapped pack can hand out records without copying them.
+*
+* Layout:
+*
+* ~~~
+* BonPackHeader
+* BonName              keys[recordCount]               (ascending, padded with zeros to 8 bytes)
+* BonPackEntry         entries[recordCount]            (same order as keys)
+* records                                              (each starting at an 8 byte boundary)
+* ~~~
+* @{
+*/
+
+#include "Bon.h"
+#include "BonMap.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The header of a pack file. */
+typedef struct BonPackHeader {
+        uint32_t                magic;                          /**< FourCC('B', 'O', 'N', 'P') */
+        uint32_t                recordCount;                    /**< Number of records in the pack */
+        uint64_t                packSize;                       /**< Total size of the pack in bytes */
+} BonPackHeader;
+
+/** Where a record is in a pack. */
+typedef struct BonPackEntry {
+        uint64_t                offset;                         /**< Offset of the record from the start of the pack */
+        uint64_t                size;                           /**< Size of the record (same as its recordSize) */
+} BonPackEntry;
+
+/** A record to write to a pack with BonWritePack. */
+typedef struct BonPackItem {
+        BonName                 key;                            /**< E.g. BonCreateNameCstr of the file name */
+        const BonRecord*        record;
+} BonPackItem;
+
+/**
+ * \brief Check the header and index of a pack.
+ *
+ * Records are only checked when they are fetched, so this doesn't touch the pages of every record.
+ *
+ * @param pack                  The pack. Must be 8 byte aligned.
+ * @param packSizeInBytes       Number of bytes available at pack.
+ */
+BonBool                         BonIsAValidPack(                const void* pack,
+                                                                size_t packSizeInBytes);
+
+/** Return the number of records in a valid pack. */
+int                             BonGetPackRecordCount(          const BonPackHeader* pack);
+
+/** Return the sorted array of keys in a valid pack. */
+const BonName*                  BonGetPackKeys(                 const BonPackHeader* pack);
+
+/** 
+ * \brief Return the record at index in the sorted keys, or null if it isn't a valid record.
+ *
+ * The record is checked with BonIsAValidRecord.
+ */
+const BonRecord*                BonGetPackRecordAt(             const BonPackHeader* pack,
+                                                                int index);
+
+/** Return the record with key, or null if there is no such (valid) record in the pack. */
+const BonRecord*                BonFindPackRecord(              const BonPackHeader* pack,
+                                                                BonName key);
+
+/**
+ * \brief Map a pack file.
+ *
+ * @param file                  Receives the mapping. Release it with BonUnmapFile.
+ * @param fileName              Name of the pack file.
+ * @param flags                 A combination of BON_MAP_* flags. BON_MAP_RANDOM is a good choice
+ *                              when only some of the records are used.
+ * @return                      The pack, or null if the file couldn't be mapped or isn't a valid pack.
+ */
+const BonPackHeader*            BonMapPackFile(                 BonMappedFile* file,
+                                                                const char* fileName,
+                                                                int flags);
+
+/**
+ * \brief Write a pack to a stream.
+ *
+ * The items are sorted by key in place. Keys must be unique, so two file names whose hashes 
+ * collide can't be in the same pack.
+ *
+ * @param items                 The records and their keys.
+ * @param itemCount             Number of items.
+ * @param stream                A binary stream to write to.
+ * @return                      BON_FALSE if two keys are equal, a record is invalid or writing failed.
+ */
+BonBool                         BonWritePack(                   BonPackItem* items,
+                                                                int itemCount,
+                                                                FILE* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
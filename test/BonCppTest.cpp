@@ -0,0 +1,246 @@
+/* vi: set ts=8 sts=8 sw=8 et: */
+#include "Bon.hpp"
+#include "BonConvert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+/*---------------------------------------------------------------------------*/
+/* :Names */
+
+struct NameAndHash {
+        const char*             name;
+        BonName                 hash;                                           /* Produced by the runtime Hash32 (BonCreateNameCstr) */
+};
+
+static constexpr NameAndHash s_names[] = {
+        { "", 0x00000000u },
+        { "a", 0xf4046f30u },
+        { "ab", 0x1998834cu },
+        { "abc", 0x8168fbb8u },
+        { "abcd", 0x43ed676au },
+        { "abcde", 0x505a1904u },
+        { "position", 0xcfb9154au },
+        { "rotation", 0x41e1307du },
+        { "scale", 0x33fed1c8u },
+        { "vertices", 0x29a68ab4u },
+        { "meshes", 0x2ac579f1u },
+        { "name", 0xdbaf43f0u },
+        { "id", 0x04d501c4u },
+        { "children", 0x865116ddu },
+        { "Skill", 0x41ab54a2u },
+        { "apa", 0x351bdc01u },
+        { "foo", 0x518dee13u },
+        { "child", 0xf67bf9feu },
+        { "\xc3\xa5\xc3\xa4\xc3\xb6", 0x2186afe2u },
+        { "a somewhat longer key with spaces", 0xe141c453u },
+};
+
+constexpr size_t
+ConstexprStrlen(const char* s) {
+        size_t n = 0;
+        while (s[n])
+                ++n;
+        return n;
+}
+
+constexpr bool
+AllNamesMatch() {
+        for (const NameAndHash& n : s_names) {
+                if (bon::CreateName(n.name, ConstexprStrlen(n.name)) != n.hash)
+                        return false;
+        }
+        return true;
+}
+
+static_assert(AllNamesMatch(), "bon::CreateName differs from Hash32");
+static_assert(BON_NAME("position") == 0xcfb9154au, "BON_NAME differs from Hash32");
+static_assert(BON_NAME("abcde") == 0x505a1904u, "BON_NAME differs from Hash32 for a 1 byte tail");
+static_assert(BON_NAME("") == 0u, "BON_NAME of an empty string must be 0");
+
+static void
+NameTest() {
+        char    key[64];
+        size_t  length;
+
+        for (const NameAndHash& n : s_names) {
+                if (BonCreateNameCstr(n.name) != n.hash) {
+                        printf("FAIL (NAME): runtime hash of '%s'\n", n.name);
+                }
+        }
+
+        /* All tail lengths and bytes with the high bit set */
+        for (length = 0; length < sizeof(key); ++length) {
+                key[length] = (char)(0x41 + length * 37);
+                if (BonCreateName(key, length) != bon::CreateName(key, length)) {
+                        printf("FAIL (NAME): length %u\n", (unsigned)length);
+                }
+        }
+}
+
+/*---------------------------------------------------------------------------*/
+/* :Views */
+
+static BonRecord*
+RecordFromJson(const char* json) {
+        return BonCreateRecordFromJson(json, strlen(json));
+}
+
+static void
+ViewTest() {
+        const char*             json    = "{\"position\":[1,2,3],\"name\":\"box\",\"visible\":true,\"child\":{\"id\":7},\"none\":null,\"nul\":\"a\\u0000b\"}";
+        BonRecord*              br      = RecordFromJson(json);
+        bon::object_view        root    = bon::root(br).get<bon::object_view>();
+        BonObject               raw     = BonAsObject(BonGetRootValue(br));
+        double                  sum     = 0.0;
+        int                     count   = 0;
+
+        for (double d : root[BON_NAME("position")].get<bon::number_span>()) {
+                sum += d;
+        }
+        for (bon::value_view v : root[BON_NAME("position")].get<bon::array_view>()) {
+                sum += v.get<double>();
+        }
+        if (sum != 12.0) {
+                printf("FAIL (VIEW): number iteration\n");
+        }
+        if (0 != strcmp(root[BON_NAME("name")].get<const char*>(), "box") || !root[BON_NAME("visible")].get<bool>()) {
+                printf("FAIL (VIEW): string/bool\n");
+        }
+        if (root[BON_NAME("name")].get<std::string_view>() != "box" || root[BON_NAME("nul")].get<std::string_view>() != std::string_view("a\0b", 3)) {
+                printf("FAIL (VIEW): string_view\n");
+        }
+        if (root[BON_NAME("child")].get<bon::object_view>()[BON_NAME("id")].get<double>() != 7.0) {
+                printf("FAIL (VIEW): child object\n");
+        }
+        if (!root[BON_NAME("none")].is_null() || !root[BON_NAME("missing")].is_null() || root.contains(BON_NAME("missing"))) {
+                printf("FAIL (VIEW): null/missing\n");
+        }
+        for (bon::object_view::member m : root) {
+                if (m.name != raw.names[count] || m.value.raw() != &raw.values[count]) {
+                        printf("FAIL (VIEW): member order\n");
+                }
+                ++count;
+        }
+        if (count != root.size() || count != 6) {
+                printf("FAIL (VIEW): member count\n");
+        }
+        free(br);
+
+        BonConvertOptions       options = {};
+        options.wideOffsets = BON_TRUE;
+        BonRecord*              wide    = BonCreateRecordFromJsonWithOptions(json, strlen(json), &options);
+        bon::object_view        wideRoot = bon::root(wide).get<bon::object_view>();
+        if (wideRoot[BON_NAME("name")].get<std::string_view>() != "box" || wideRoot[BON_NAME("child")].get<bon::object_view>()[BON_NAME("id")].get<double>() != 7.0) {
+                printf("FAIL (VIEW): wide record\n");
+        }
+        free(wide);
+}
+
+/*---------------------------------------------------------------------------*/
+/* :Benchmarks */
+
+/* These compare a loop over the views with the same loop over raw pointers. With optimizations
+ * enabled the pairs should compile to the same instructions and run at the same speed. */
+
+#ifdef _MSC_VER
+#define BON_NOINLINE __declspec(noinline)
+#else
+#define BON_NOINLINE __attribute__((noinline))
+#endif
+
+BON_NOINLINE static double
+SumRawPointers(const BonValue* values, int count) {
+        const double* p = (const double*)values;
+        const double* end = p + count;
+        double sum = 0.0;
+        for (; p != end; ++p) {
+                sum += *p;
+        }
+        return sum;
+}
+
+BON_NOINLINE static double
+SumNumberSpan(bon::number_span numbers) {
+        double sum = 0.0;
+        for (double d : numbers) {
+                sum += d;
+        }
+        return sum;
+}
+
+BON_NOINLINE static double
+SumRawValues(const BonValue* values, int count) {
+        double sum = 0.0;
+        for (int i = 0; i < count; ++i) {
+                if ((values[i] & 0x7ull) == BON_VT_NUMBER) {
+                        double d;
+                        memcpy(&d, &values[i], sizeof(d));
+                        sum += d;
+                }
+        }
+        return sum;
+}
+
+BON_NOINLINE static double
+SumArrayView(bon::array_view array) {
+        double sum = 0.0;
+        for (bon::value_view v : array) {
+                if (v.type() == BON_VT_NUMBER) {
+                        sum += v.get<double>();
+                }
+        }
+        return sum;
+}
+
+static void
+ViewBenchmark() {
+        const int       count   = 1000000;
+        const int       rounds  = 100;
+        std::string     json    = "[";
+        for (int i = 0; i < count; ++i) {
+                json += (i ? ",": "");
+                json += std::to_string(i % 1000);
+        }
+        json += "]";
+
+        BonRecord*      br      = RecordFromJson(json.c_str());
+        BonArray        raw     = BonAsArray(BonGetRootValue(br));
+        bon::array_view view    = bon::root(br).get<bon::array_view>();
+        const BonValue* volatile values = raw.values;                           /* Keep the calls from being hoisted out of the loops */
+        double          sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+        clock_t         t[5];
+
+        t[0] = clock();
+        for (int r = 0; r < rounds; ++r) sums[0] += SumRawPointers(values, raw.count);
+        t[1] = clock();
+        for (int r = 0; r < rounds; ++r) sums[1] += SumNumberSpan(bon::array_view(values, view.size()).as_numbers());
+        t[2] = clock();
+        for (int r = 0; r < rounds; ++r) sums[2] += SumRawValues(values, raw.count);
+        t[3] = clock();
+        for (int r = 0; r < rounds; ++r) sums[3] += SumArrayView(bon::array_view(values, view.size()));
+        t[4] = clock();
+
+        const double n = (double)count * rounds;
+        printf("Views: ns per element (raw / view)\n");
+        printf("  number array:      %.3f / %.3f%s\n",
+                (double)(t[1] - t[0]) / CLOCKS_PER_SEC * 1e9 / n, (double)(t[2] - t[1]) / CLOCKS_PER_SEC * 1e9 / n,
+                sums[0] != sums[1] ? "  (MISMATCH)" : "");
+        printf("  checked values:    %.3f / %.3f%s\n",
+                (double)(t[3] - t[2]) / CLOCKS_PER_SEC * 1e9 / n, (double)(t[4] - t[3]) / CLOCKS_PER_SEC * 1e9 / n,
+                sums[2] != sums[3] ? "  (MISMATCH)" : "");
+        free(br);
+}
+
+int
+main(int argc, char** argv) {
+        NameTest();
+        ViewTest();
+        if (argc > 1 && 0 == strcmp(argv[1], "-bench")) {
+                ViewBenchmark();
+        }
+        return 0;
+}
@@ -1,6 +1,8 @@
 /* vi: set ts=8 sts=8 sw=8 et: */
 #include "Bon.h"
 #include "BonConvert.h"
+#include "BonMap.h"
+#include "BonPack.h"
 
 #include <stdlib.h>
 #ifdef _WIN32
@@ -11,6 +13,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <time.h>
+#include <math.h>
         
 /*---------------------------------------------------------------------------*/
 /* :Testing */
@@ -23,11 +26,23 @@ static const char s_tests[] =
         "+[1, 2.3, -1, 2.0e-1, 0.333e+23, 0.44E8, 123123123.4E-3]\0"
         "+[]\0"
         "+[false,true,null,false,\"apa\",{\"foo\":false},[\"a\",false,null]]\0"
+        "+[\"tab\\t quote\\\" slash\\/ backslash\\\\\", \"\\u00e9\\ud83d\\ude00\", \"a\\u0000b\", {\"k\\u0000\\u001f\":\"\\\\\"}]\0"
         "-[\0"
         "-\0"
         "-25\0"
         "-[ \"abc ]\0"
         "-[false,true,null,false,\"apa\",{\"foo\":false},[\"a\",false,nul]]\0"
+        "-[\"\\ud800\"]\0"
+        "-[\"\\udc00x\"]\0"
+        "-[\"\\u12G4\"]\0"
+        "-[\"\\q\"]\0"
+        "-[01]\0"
+        "-[1.]\0"
+        "-[.5]\0"
+        "-[+1]\0"
+        "-[1e]\0"
+        "-[-]\0"
+        "-[1e400]\0"
         "\0";                                                                   /* Terminate tests */
 
 static uint8_t* 
@@ -276,11 +291,2999 @@ SearchTest(void) {
 	}
 }
 
+static uint32_t
+NextRandom(uint32_t* state) {
+        *state = *state * 1664525u + 1013904223u;
+        return *state;
+}
+
+/* Fill names with count unique sorted hashes. Gaps of at least 2 between the hashes leave room for 
+ * names that aren't in the array. */
+static void
+MakeSortedNames(BonName* names, int count, uint32_t* state) {
+        int i;
+        BonName name = 1u;
+        for (i = 0; i < count; ++i) {
+                name += 2u + (NextRandom(state) >> 8) % (0xffffffffu / 2u / (uint32_t)(count + 1));
+                names[i] = name;
+        }
+}
+
+static void
+WideSearchTest(void) {
+        BonName         names[300];
+        uint32_t        state = 12345u;
+        int             count;
+        int             i;
+
+        for (count = 0; count <= 300; count += (count < 40 ? 1 : 13)) {
+                MakeSortedNames(names, count, &state);
+                for (i = 0; i < count; ++i) {
+                        if (BonFindIndexOfName(names, count, names[i]) != i) {
+                                printf("FAIL (WIDESEARCH): count %d, index %d\n", count, i);
+                        }
+                        if (BonFindIndexOfName(names, count, names[i] + 1u) != -1) {
+                                printf("FAIL (WIDESEARCH): count %d, missing %d\n", count, i);
+                        }
+                }
+                if (BonFindIndexOfName(names, count, 0u) != -1 || BonFindIndexOfName(names, count, 0xffffffffu) != -1) {
+                        printf("FAIL (WIDESEARCH): count %d, out of range\n", count);
+                }
+        }
+}
+
+/* Return a malloc:ed JSON object with memberCount members named "member<i>" */
+static char*
+MakeWideObjectJson(int memberCount) {
+        char*   json    = (char*)malloc((size_t)memberCount * 32 + 16);
+        char*   p       = json;
+        int     i;
+        *p++ = '{';
+        for (i = 0; i < memberCount; ++i) {
+                p += sprintf(p, "%s\"member%d\":%d", i ? "," : "", i, i);
+        }
+        *p++ = '}';
+        *p = 0;
+        return json;
+}
+
+static void
+NameStringTest(void) {
+        char*                   json            = MakeWideObjectJson(200);
+        BonRecord*              br              = BonCreateRecordFromJson(json, strlen(json));
+        BonObject               object          = BonAsObject(BonGetRootValue(br));
+        void*                   indexMemory     = malloc(BonGetNameIndexSize(br));
+        struct BonNameIndex*    index           = BonCreateNameIndex(br, indexMemory);
+        const char*             strings[200];
+        BonName                 unknown[2];
+        char                    expected[32];
+        int                     i;
+
+        if (BonGetNameStrings(br, object.names, object.count, strings) != 200) {
+                printf("FAIL (NAMES): batch count\n");
+        }
+        for (i = 0; i < object.count; ++i) {
+                const char* s = BonGetNameString(br, object.names[i]);
+                sprintf(expected, "member%d", (int)BonAsNumber(&object.values[i]));
+                if (!s || 0 != strcmp(s, expected)) {
+                        printf("FAIL (NAMES): BonGetNameString %s\n", expected);
+                }
+                if (s != BonNameIndexGetString(index, object.names[i]) || s != strings[i]) {
+                        printf("FAIL (NAMES): index/batch %s\n", expected);
+                }
+        }
+        unknown[0] = BonCreateNameCstr("nope");
+        unknown[1] = BonCreateNameCstr("member0");
+        if (unknown[0] > unknown[1]) {
+                BonName t = unknown[0]; unknown[0] = unknown[1]; unknown[1] = t;
+        }
+        if (BonNameIndexGetString(index, BonCreateNameCstr("nope")) != 0 || BonGetNameStrings(br, unknown, 2, strings) != 1) {
+                printf("FAIL (NAMES): unknown name\n");
+        }
+        free(indexMemory);
+        free(br);
+        free(json);
+}
+
+static int
+CompareNames(const void* a, const void* b) {
+        const BonName an = *(const BonName*)a;
+        const BonName bn = *(const BonName*)b;
+        return an < bn ? -1 : (an > bn ? 1 : 0);
+}
+
+static void
+LookupManyTest(void) {
+        char*                   json            = MakeWideObjectJson(40);
+        BonRecord*              br              = BonCreateRecordFromJson(json, strlen(json));
+        BonObject               object          = BonAsObject(BonGetRootValue(br));
+        BonName                 keys[12];
+        const BonValue*         values[12];
+        char                    name[32];
+        int                     i;
+
+        for (i = 0; i < 12; ++i) {
+                sprintf(name, "member%d", i * 4);                               /* member40 and member44 are missing */
+                keys[i] = BonCreateNameCstr(name);
+        }
+        qsort(keys, 12, sizeof(BonName), CompareNames);
+        if (BonMemberLookupMany(&object, keys, 12, values) != 10) {
+                printf("FAIL (MANY): found count\n");
+        }
+        for (i = 0; i < 12; ++i) {
+                const int index = BonFindIndexOfName(object.names, object.count, keys[i]);
+                if ((index < 0 && values[i]) || (index >= 0 && values[i] != &object.values[index])) {
+                        printf("FAIL (MANY): key %d\n", i);
+                }
+        }
+        if (BonMemberLookupMany(&object, keys, 0, values) != 0) {
+                printf("FAIL (MANY): no keys\n");
+        }
+        for (i = 0; i < 2; ++i) {
+                /* Two keys in a 40 member object takes the independent search path */
+                const int index = BonFindIndexOfName(object.names, object.count, keys[i]);
+                if (BonMemberLookupMany(&object, keys + i, 1, values) != (index >= 0) || (index >= 0 && values[0] != &object.values[index])) {
+                        printf("FAIL (MANY): few keys %d\n", i);
+                }
+        }
+        free(br);
+        free(json);
+}
+
+static void
+PathTest(void) {
+        const char*             json    = "{\"scene\":{\"meshes\":[{},{},{},{\"vertices\":[1,2,3]}],\"name\":\"s\"}}";
+        BonRecord*              br      = BonCreateRecordFromJson(json, strlen(json));
+        BonPath                 path;
+        const BonValue*         v;
+        static const char*      invalid[] = { "a..b", ".a", "a.", "a[", "a[]", "a[x]", "a[1", "a[99999999999]", "[0]x" };
+        int                     i;
+
+        if (!BonCompilePath(&path, "scene.meshes[3].vertices") || path.count != 4) {
+                printf("FAIL (PATH): compile\n");
+        }
+        v = BonEvaluatePath(BonGetRootValue(br), &path);
+        if (!v || BonAsNumberArray(v).count != 3 || BonAsNumberArray(v).values[2] != 3.0) {
+                printf("FAIL (PATH): evaluate\n");
+        }
+        if (!BonCompilePath(&path, "") || BonEvaluatePath(BonGetRootValue(br), &path) != BonGetRootValue(br)) {
+                printf("FAIL (PATH): empty path\n");
+        }
+        BonCompilePath(&path, "scene.meshes[4]");
+        if (BonEvaluatePath(BonGetRootValue(br), &path)) {
+                printf("FAIL (PATH): index out of range\n");
+        }
+        BonCompilePath(&path, "scene.name.x");
+        if (BonEvaluatePath(BonGetRootValue(br), &path)) {
+                printf("FAIL (PATH): member of string\n");
+        }
+        BonCompilePath(&path, "scene[0]");
+        if (BonEvaluatePath(BonGetRootValue(br), &path)) {
+                printf("FAIL (PATH): index of object\n");
+        }
+        for (i = 0; i < (int)(sizeof(invalid) / sizeof(invalid[0])); ++i) {
+                if (BonCompilePath(&path, invalid[i])) {
+                        printf("FAIL (PATH): accepted '%s'\n", invalid[i]);
+                }
+        }
+
+        /* Three records back to back followed by garbage */
+        {
+                uint64_t*               buffer  = (uint64_t*)calloc(br->recordSize * 3 + 64, 1);
+                const BonValue*         results[8];
+                for (i = 0; i < 3; ++i) {
+                        memcpy((uint8_t*)buffer + br->recordSize * i, br, br->recordSize);
+                }
+                BonCompilePath(&path, "scene.name");
+                if (BonEvaluatePathInRecords(&path, buffer, br->recordSize * 3 + 64, results, 8) != 3 
+                        || 0 != strcmp(BonAsString(results[2]), "s")) {
+                        printf("FAIL (PATH): batch\n");
+                }
+                if (BonEvaluatePathInRecords(&path, buffer, br->recordSize * 3, results, 2) != 2) {
+                        printf("FAIL (PATH): batch max results\n");
+                }
+                free(buffer);
+        }
+
+        /* A wide record cut off inside its wide header */
+        {
+                BonConvertOptions       options;
+                BonRecord*              wide;
+                uint64_t*               buffer  = (uint64_t*)malloc(sizeof(BonRecord));
+                const BonValue*         results[1];
+                memset(&options, 0, sizeof(options));
+                options.wideOffsets     = BON_TRUE;
+                wide    = BonCreateRecordFromJsonWithOptions("{\"a\":1}", 7, &options);
+                memcpy(buffer, wide, sizeof(BonRecord));
+                if (BonEvaluatePathInRecords(&path, buffer, sizeof(BonRecord), results, 1) != 0) {
+                        printf("FAIL (PATH): batch truncated wide record\n");
+                }
+                free(buffer);
+                free(wide);
+        }
+        free(br);
+}
+
+static BonRecord*
+CreateRecordWithTypedArrays(const char* json, size_t jsonSize, int policy, int minCount) {
+        BonConvertOptions       options;
+        memset(&options, 0, sizeof(options));
+        options.typedArrays             = policy;
+        options.typedArrayMinCount      = minCount;
+        return BonCreateRecordFromJsonWithOptions(json, jsonSize, &options);
+}
+
+static BonBool
+ReadBackCompareTypedTest(const BonRecord* br, int policy, int minCount) {
+        BonBool                 result          = BON_TRUE;
+        uint8_t*                jsonData;
+        size_t                  size;
+        BonRecord*              br2;
+        WriteRecordToDisk(br, "temp.json");
+        jsonData = LoadAll(&size, "temp.json");
+        assert(jsonData);
+        br2 = CreateRecordWithTypedArrays((const char*)jsonData, size, policy, minCount);
+        if (!br2 || br->recordSize != br2->recordSize || 0 != memcmp(br, br2, br->recordSize)) {
+                result = BON_FALSE;
+        }
+        free(br2);
+        free(jsonData);
+        return result;
+}
+
+static void
+TypedArrayTest(void) {
+        const char*             json    = "{\"a\":[1,2,255],\"b\":[-1,300],\"c\":[1.5,2.25],\"d\":[0.1,1],"
+                                          "\"e\":[1,\"x\"],\"f\":[70000,-5],\"g\":[-0.0,1],\"h\":[7],\"i\":[1e300,1.5,-1e300],\"j\":[3.5e38,1]}";
+        static const struct {
+                const char*     name;
+                int             lossless;                                       /* Expected element type per policy */
+                int             float32;
+        } expected[] = {
+                { "a", BON_ET_UINT8,    BON_ET_UINT8 },
+                { "b", BON_ET_INT16,    BON_ET_INT16 },
+                { "c", BON_ET_FLOAT32,  BON_ET_FLOAT32 },
+                { "d", 0,               BON_ET_FLOAT32 },
+                { "e", 0,               0 },
+                { "f", BON_ET_INT32,    BON_ET_INT32 },
+                { "g", BON_ET_FLOAT32,  BON_ET_FLOAT32 },
+                { "h", 0,               0 },                                    /* Shorter than typedArrayMinCount */
+                { "i", 0,               0 },                                    /* Out of float range */
+                { "j", 0,               0 },
+        };
+        BonRecord*              plain   = BonCreateRecordFromJson(json, strlen(json));
+        BonRecord*              lossless= CreateRecordWithTypedArrays(json, strlen(json), BON_TYPED_ARRAYS_LOSSLESS, 2);
+        BonRecord*              float32 = CreateRecordWithTypedArrays(json, strlen(json), BON_TYPED_ARRAYS_FLOAT32, 2);
+        BonObject               object;
+        BonTypedArray           ta;
+        int                     i;
+
+        if (!plain || !lossless || !float32) {
+                printf("FAIL (TA): conversion\n");
+                free(plain); free(lossless); free(float32);
+                return;
+        }
+        for (i = 0; i < (int)(sizeof(expected) / sizeof(expected[0])); ++i) {
+                const BonName   name            = BonCreateNameCstr(expected[i].name);
+                BonObject       losslessObject  = BonAsObject(BonGetRootValue(lossless));
+                BonObject       float32Object   = BonAsObject(BonGetRootValue(float32));
+
+                if (expected[i].lossless ? BonGetMemberValueType(&losslessObject, name) != BON_VT_TYPED_ARRAY 
+                                                || BonMemberAsTypedArray(&losslessObject, name).elementType != expected[i].lossless
+                                         : BonGetMemberValueType(&losslessObject, name) != BON_VT_ARRAY) {
+                        printf("FAIL (TA): lossless type of %s\n", expected[i].name);
+                }
+                if (expected[i].float32 ? BonGetMemberValueType(&float32Object, name) != BON_VT_TYPED_ARRAY 
+                                                || BonMemberAsTypedArray(&float32Object, name).elementType != expected[i].float32
+                                        : BonGetMemberValueType(&float32Object, name) != BON_VT_ARRAY) {
+                        printf("FAIL (TA): float32 type of %s\n", expected[i].name);
+                }
+                if (expected[i].float32 && ((uintptr_t)BonMemberAsTypedArray(&float32Object, name).values & 7u)) {
+                        printf("FAIL (TA): unaligned values in %s\n", expected[i].name);
+                }
+        }
+
+        object  = BonAsObject(BonGetRootValue(lossless));
+        ta      = BonMemberAsTypedArray(&object, BonCreateNameCstr("a"));
+        if (ta.count != 3 || ((const uint8_t*)ta.values)[2] != 255) {
+                printf("FAIL (TA): uint8 values\n");
+        }
+        ta      = BonMemberAsTypedArray(&object, BonCreateNameCstr("f"));
+        if (ta.count != 2 || ((const int32_t*)ta.values)[0] != 70000 || ((const int32_t*)ta.values)[1] != -5) {
+                printf("FAIL (TA): int32 values\n");
+        }
+        object  = BonAsObject(BonGetRootValue(float32));
+        ta      = BonMemberAsTypedArray(&object, BonCreateNameCstr("d"));
+        if (ta.count != 2 || ((const float*)ta.values)[0] != 0.1f) {
+                printf("FAIL (TA): float32 values\n");
+        }
+        {
+                const BonObject plainObject     = BonAsObject(BonGetRootValue(plain));
+                const BonArray  rounded         = BonMemberAsArray(&object, BonCreateNameCstr("i"));
+                const BonArray  original        = BonMemberAsArray(&plainObject, BonCreateNameCstr("i"));
+
+                if (rounded.count != 3 || BonAsNumber(&rounded.values[0]) != BonAsNumber(&original.values[0])
+                                       || BonAsNumber(&rounded.values[2]) != BonAsNumber(&original.values[2])) {
+                        printf("FAIL (TA): float32 rounded a number out of float range\n");
+                }
+        }
+
+        if (lossless->recordSize >= plain->recordSize || float32->recordSize >= lossless->recordSize) {
+                printf("FAIL (TA): typed arrays didn't make the record smaller\n");
+        }
+        if (!BonIsAValidRecord(lossless, lossless->recordSize) || !BonIsAValidRecord(float32, float32->recordSize)) {
+                printf("FAIL (TA): invalid record\n");
+        }
+        if (!ReadBackCompareTypedTest(lossless, BON_TYPED_ARRAYS_LOSSLESS, 2) || !ReadBackCompareTypedTest(float32, BON_TYPED_ARRAYS_FLOAT32, 2)) {
+                printf("FAIL (TA): read back\n");
+        }
+
+        free(plain);
+        free(lossless);
+        free(float32);
+}
+
+/* Return "[0,1,...,count-1]" with the item at nonNumberIndex replaced by null (if in range) */
+static char*
+MakeNumberArrayJson(int count, int nonNumberIndex) {
+        char*   json    = (char*)malloc((size_t)count * 12 + 3);
+        char*   p       = json;
+        int     i;
+        *p++ = '[';
+        for (i = 0; i < count; ++i) {
+                p += i == nonNumberIndex ? sprintf(p, "%snull", i ? "," : "") : sprintf(p, "%s%d", i ? "," : "", i);
+        }
+        *p++ = ']';
+        *p = 0;
+        return json;
+}
+
+static void
+NumberArrayTest(void) {
+        static const struct {
+                int             count;
+                int             nonNumberIndex;
+        } cases[] = {
+                { 0, -1 }, { 3, -1 }, { 3, 2 }, { 40, -1 }, { 40, 0 }, { 40, 17 }, { 40, 39 }, { 1000, -1 }, { 1000, 999 },
+        };
+        int                     i;
+
+        for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); ++i) {
+                char*           json            = MakeNumberArrayJson(cases[i].count, cases[i].nonNumberIndex);
+                BonRecord*      br              = BonCreateRecordFromJson(json, strlen(json));
+                BonValue*       root            = (BonValue*)BonGetRootValue(br);
+                const BonBool   expected        = cases[i].nonNumberIndex < 0 ? BON_TRUE : BON_FALSE;
+                BonNumberArray  numbers         = { -1, 0 };
+
+                if (((*root & BON_ARRAY_FLAG_NUMBERS) != 0) != expected) {
+                        printf("FAIL (NA): flag for %d items, non-number at %d\n", cases[i].count, cases[i].nonNumberIndex);
+                }
+                if (BonTryAsNumberArray(root, &numbers) != expected || (expected && numbers.count != cases[i].count)) {
+                        printf("FAIL (NA): flagged %d items, non-number at %d\n", cases[i].count, cases[i].nonNumberIndex);
+                }
+                *root &= ~(BonValue)BON_ARRAY_FLAG_NUMBERS;                     /* As written by an older converter */
+                if (BonTryAsNumberArray(root, &numbers) != expected || BonGetValueType(root) != BON_VT_ARRAY) {
+                        printf("FAIL (NA): scanned %d items, non-number at %d\n", cases[i].count, cases[i].nonNumberIndex);
+                }
+                if (BonTryAsNumberArray(&((const BonValue*)&br[1])[1], &numbers)) {
+                        printf("FAIL (NA): accepted a non-array\n");
+                }
+                free(br);
+                free(json);
+        }
+}
+
+/* Read every value reachable from v. Used to check that a validated record can be read. */
+static double
+TouchAllValues(const BonValue* v) {
+        double sum = 0.0;
+        int i;
+        switch (BonGetValueType(v)) {
+        case BON_VT_NUMBER:
+                return BonAsNumber(v);
+        case BON_VT_STRING:
+                return (double)strlen(BonAsString(v));
+        case BON_VT_TYPED_ARRAY: {
+                BonTypedArray a = BonAsTypedArray(v);
+                const uint8_t* bytes = (const uint8_t*)a.values;
+                for (i = 0; i < a.count * (int)BonGetTypedArrayElementSize(a.elementType); ++i) {
+                        sum += bytes[i];
+                }
+                return sum;
+        }
+        case BON_VT_ARRAY: {
+                BonArray a = BonAsArray(v);
+                for (i = 0; i < a.count; ++i) {
+                        sum += TouchAllValues(&a.values[i]);
+                }
+                return sum;
+        }
+        case BON_VT_OBJECT: {
+                BonObject o = BonAsObject(v);
+                for (i = 0; i < o.count; ++i) {
+                        sum += TouchAllValues(&o.values[i]) + o.names[i];
+                }
+                return sum;
+        }
+        default:
+                return 0.0;
+        }
+}
+
+static void
+ValidationTest(void) {
+        const char*             json    = "{\"a\":[1,2,{\"b\":\"hello\",\"c\":[true,null]}],\"d\":\"world!!!\",\"e\":[4,5,6,7],\"f\":{}}";
+        BonConvertOptions       options;
+        BonRecord*              plain   = BonCreateRecordFromJson(json, strlen(json));
+        BonRecord*              typed;
+        BonRecord*              copy    = (BonRecord*)malloc(plain->recordSize);
+        const char*             test    = s_tests;
+        uint32_t                state   = 12345;
+        size_t                  i;
+        int                     bit, accepted = 0;
+
+        memset(&options, 0, sizeof(options));
+        options.typedArrays             = BON_TYPED_ARRAYS_LOSSLESS;
+        options.typedArrayMinCount      = 2;
+        typed   = BonCreateRecordFromJsonWithOptions(json, strlen(json), &options);
+
+        while (*test) {
+                const size_t    len     = strlen(test + 1);
+                BonRecord*      br      = *test == '+' ? BonCreateRecordFromJson(test + 1, len) : 0;
+                if (br && !BonValidateRecordDeep(br, br->recordSize)) {
+                        printf("FAIL (VAL): rejected %s\n", test + 1);
+                }
+                free(br);
+                test += len + 2;
+        }
+        if (!BonValidateRecordDeep(plain, plain->recordSize) || !BonValidateRecordDeep(typed, typed->recordSize)) {
+                printf("FAIL (VAL): rejected valid record\n");
+        }
+        if (BonValidateRecordDeep(plain, plain->recordSize - 8) || BonValidateRecordDeep(plain, 0)) {
+                printf("FAIL (VAL): accepted wrong size\n");
+        }
+
+        /* A cycle: the root array's first item references the root array */
+        {
+                const char*     cycleJson       = "[[1],2]";
+                BonRecord*      br              = BonCreateRecordFromJson(cycleJson, strlen(cycleJson));
+                BonArray        root            = BonAsArray(BonGetRootValue(br));
+                BonValue*       item            = (BonValue*)&root.values[0];
+                const int32_t   toRoot          = (int32_t)((const uint8_t*)&root.values[-1] - (const uint8_t*)item);
+                memcpy((int32_t*)item + 1, &toRoot, sizeof(toRoot));
+                if (BonValidateRecordDeep(br, br->recordSize)) {
+                        printf("FAIL (VAL): accepted a cycle\n");
+                }
+                free(br);
+        }
+
+        /* Flip every bit of the record one at a time. Whatever is accepted must be readable. */
+        for (i = 0; i < plain->recordSize; ++i) {
+                for (bit = 0; bit < 8; ++bit) {
+                        memcpy(copy, plain, plain->recordSize);
+                        ((uint8_t*)copy)[i] ^= (uint8_t)(1u << bit);
+                        if (BonValidateRecordDeep(copy, plain->recordSize)) {
+                                TouchAllValues(BonGetRootValue(copy));
+                                BonGetNameString(copy, NextRandom(&state));
+                                ++accepted;
+                        }
+                }
+        }
+        /* Flipping bits in numbers, names and string contents is harmless, but most offsets must be caught */
+        if (accepted == 0 || accepted > (int)plain->recordSize * 4) {
+                printf("FAIL (VAL): accepted %d of %d bit flips\n", accepted, (int)plain->recordSize * 8);
+        }
+
+        free(copy);
+        free(plain);
+        free(typed);
+}
+
+static void
+WriteBinaryFile(const void* data, size_t size, const char* fn) {
+        FILE* f = fopen(fn, "wb");
+        assert(f);
+        if (!f)
+                return;
+        fwrite(data, size, 1, f);
+        fclose(f);
+}
+
+static void
+MapTest(void) {
+        static const int        flags[] = { 0, BON_MAP_POPULATE, BON_MAP_SEQUENTIAL | BON_MAP_WILLNEED, BON_MAP_RANDOM | BON_MAP_HUGE_PAGES, BON_MAP_VALIDATE_DEEP };
+        const char*             json    = "{\"a\":[1,2,3],\"b\":\"text\"}";
+        BonRecord*              br      = BonCreateRecordFromJson(json, strlen(json));
+        BonMappedFile           file;
+        const BonRecord*        mapped;
+        int                     i;
+
+        WriteBinaryFile(br, br->recordSize, "temp.bon");
+        for (i = 0; i < (int)(sizeof(flags) / sizeof(flags[0])); ++i) {
+                mapped = BonMapRecordFile(&file, "temp.bon", flags[i]);
+                if (!mapped || file.size != br->recordSize || 0 != memcmp(mapped, br, br->recordSize)) {
+                        printf("FAIL (MAP): flags 0x%x\n", flags[i]);
+                }
+                BonUnmapRecord(&file);
+                BonUnmapRecord(&file);                                          /* Unmapping twice is harmless */
+        }
+
+        /* A bad string offset passes the header check but not the deep validation */
+        ((BonStringValue*)&BonAsObject(BonGetRootValue(br)).values[1])->offset += 4096;
+        WriteBinaryFile(br, br->recordSize, "temp.bon");
+        mapped = BonMapRecordFile(&file, "temp.bon", 0);
+        if (!mapped) {
+                printf("FAIL (MAP): header check\n");
+        }
+        BonUnmapRecord(&file);
+        if (BonMapRecordFile(&file, "temp.bon", BON_MAP_VALIDATE_DEEP) || file.data) {
+                printf("FAIL (MAP): accepted invalid record\n");
+        }
+        if (BonMapRecordFile(&file, "does-not-exist.bon", 0)) {
+                printf("FAIL (MAP): missing file\n");
+        }
+        WriteBinaryFile(br, 0, "temp.bon");
+        if (BonMapRecordFile(&file, "temp.bon", 0)) {
+                printf("FAIL (MAP): empty file\n");
+        }
+        free(br);
+}
+
+static void
+PackTest(void) {
+        static const char*      jsons[] = { "[1]", "{\"a\":\"b\"}", "[true,false,null,\"abcdefghijk\"]" };
+        static const char*      keys[]  = { "one", "two", "three" };
+        BonRecord*              records[3];
+        BonPackItem             items[3];
+        BonMappedFile           file;
+        const BonPackHeader*    pack;
+        FILE*                   f;
+        int                     i;
+
+        for (i = 0; i < 3; ++i) {
+                records[i]      = BonCreateRecordFromJson(jsons[i], strlen(jsons[i]));
+                items[i].key    = BonCreateNameCstr(keys[i]);
+                items[i].record = records[i];
+        }
+        f = fopen("temp.pack", "wb");
+        if (!f || !BonWritePack(items, 3, f)) {
+                printf("FAIL (PACK): write\n");
+        }
+        if (f)
+                fclose(f);
+
+        pack = BonMapPackFile(&file, "temp.pack", BON_MAP_RANDOM);
+        if (!pack || BonGetPackRecordCount(pack) != 3) {
+                printf("FAIL (PACK): map\n");
+                return;
+        }
+        for (i = 0; i < 3; ++i) {
+                const BonRecord* record = BonFindPackRecord(pack, BonCreateNameCstr(keys[i]));
+                if (!record || record->recordSize != records[i]->recordSize || 0 != memcmp(record, records[i], record->recordSize)) {
+                        printf("FAIL (PACK): find %s\n", keys[i]);
+                }
+                if (record && ((uintptr_t)record & 7)) {
+                        printf("FAIL (PACK): unaligned %s\n", keys[i]);
+                }
+        }
+        if (BonFindPackRecord(pack, BonCreateNameCstr("four"))) {
+                printf("FAIL (PACK): found missing key\n");
+        }
+        if (BonIsAValidPack(pack, file.size - 8)) {
+                printf("FAIL (PACK): accepted wrong size\n");
+        }
+        BonUnmapFile(&file);
+
+        items[1].key = items[0].key;
+        f = fopen("temp.pack", "wb");
+        if (BonWritePack(items, 3, f)) {
+                printf("FAIL (PACK): accepted duplicate keys\n");
+        }
+        fclose(f);
+        if (BonMapPackFile(&file, "temp.pack", 0)) {
+                printf("FAIL (PACK): mapped a partial pack\n");
+        }
+
+        for (i = 0; i < 3; ++i) {
+                free(records[i]);
+        }
+}
+
+static void
+NameDictionaryTest(void) {
+        static const char*      names[] = { "position", "angle", "unused", "angle" };
+        const char*             json    = "{\"position\":[1,2],\"rotation\":{\"angle\":3}}";
+        BonRecord*              dictionary      = BonCreateNameDictionary(names, 4);
+        BonRecord*              plain           = BonCreateRecordFromJson(json, strlen(json));
+        BonConvertOptions       options;
+        BonRecord*              br;
+        BonName                 sortedNames[3];
+        const char*             strings[3];
+
+        memset(&options, 0, sizeof(options));
+        options.nameDictionary  = dictionary;
+        br                      = BonCreateRecordFromJsonWithOptions(json, strlen(json), &options);
+
+        if (!dictionary || !BonValidateRecordDeep(dictionary, dictionary->recordSize) || BonGetNameDictionaryId(dictionary) == 0) {
+                printf("FAIL (DICT): create dictionary\n");
+        }
+        if (!br || br->nameDictionaryId != BonGetNameDictionaryId(dictionary) || br->recordSize >= plain->recordSize 
+                || !BonValidateRecordDeep(br, br->recordSize)) {
+                printf("FAIL (DICT): convert\n");
+        }
+        if (BonGetNameString(br, BonCreateNameCstr("angle")) || !BonGetNameString(br, BonCreateNameCstr("rotation"))) {
+                printf("FAIL (DICT): names before register\n");
+        }
+        BonRegisterNameDictionary(dictionary);
+        if (BonGetNameDictionary(br) != dictionary || BonGetNameDictionary(plain) != 0
+                || 0 != strcmp(BonGetNameString(br, BonCreateNameCstr("angle")), "angle")
+                || 0 != strcmp(BonGetNameString(br, BonCreateNameCstr("rotation")), "rotation")) {
+                printf("FAIL (DICT): names after register\n");
+        }
+        sortedNames[0] = BonCreateNameCstr("position");
+        sortedNames[1] = BonCreateNameCstr("rotation");
+        sortedNames[2] = BonCreateNameCstr("angle");
+        qsort(sortedNames, 3, sizeof(BonName), CompareNames);
+        if (BonGetNameStrings(br, sortedNames, 3, strings) != 3) {
+                printf("FAIL (DICT): BonGetNameStrings\n");
+        }
+        {
+                /* The name index (used when writing JSON) covers the dictionary too */
+                uint8_t*        jsonData;
+                size_t          size;
+                BonRecord*      br2;
+                WriteRecordToDisk(br, "temp.json");
+                jsonData = LoadAll(&size, "temp.json");
+                br2 = BonCreateRecordFromJsonWithOptions((const char*)jsonData, size, &options);
+                if (!br2 || br2->recordSize != br->recordSize || 0 != memcmp(br, br2, br->recordSize)) {
+                        printf("FAIL (DICT): read back\n");
+                }
+                free(br2);
+                free(jsonData);
+        }
+        BonUnregisterNameDictionary(dictionary);
+        if (BonGetNameDictionary(br)) {
+                printf("FAIL (DICT): unregister\n");
+        }
+
+        free(br);
+        free(plain);
+        free(dictionary);
+}
+
+static void
+StringLengthTest(void) {
+        const char*             json    = "{\"a\\u0000b\":\"x\\u0000y\",\"smile\":\"\\ud83d\\ude00\",\"plain\":\"purposes\"}";
+        BonRecord*              br      = BonCreateRecordFromJson(json, strlen(json));
+        BonObject               object;
+        BonStringView           view;
+        const char*             string;
+        size_t                  byteCount;
+        uint64_t                oldFormat[2];
+
+        if (!br || !(br->flags & BON_RECORD_FLAG_STRING_LENGTHS) || !BonValidateRecordDeep(br, br->recordSize)) {
+                printf("FAIL (STRLEN): convert\n");
+                free(br);
+                return;
+        }
+        object = BonAsObject(BonGetRootValue(br));
+        view = BonMemberAsStringView(&object, BonCreateName("a\0b", 3));
+        if (view.byteCount != 3 || 0 != memcmp(view.string, "x\0y", 4)) {
+                printf("FAIL (STRLEN): embedded null\n");
+        }
+        view = BonMemberAsStringView(&object, BonCreateNameCstr("smile"));
+        if (view.byteCount != 4 || 0 != memcmp(view.string, "\xf0\x9f\x98\x80", 5)) {
+                printf("FAIL (STRLEN): surrogate pair\n");
+        }
+        view = BonMemberAsStringView(&object, BonCreateNameCstr("plain"));
+        if (view.byteCount != 8 || 0 != strcmp(view.string, "purposes") || (((size_t)view.string - (size_t)br) & 7) != 4) {
+                printf("FAIL (STRLEN): plain\n");
+        }
+        view = BonMemberAsStringView(&object, BonCreateNameCstr("missing"));
+        if (view.byteCount != 0 || !view.string) {
+                printf("FAIL (STRLEN): missing member\n");
+        }
+        string = BonGetNameStringWithLength(br, BonCreateName("a\0b", 3), &byteCount);
+        if (!string || byteCount != 3 || 0 != memcmp(string, "a\0b", 4)) {
+                printf("FAIL (STRLEN): name\n");
+        }
+        if (BonGetNameStringWithLength(br, BonCreateNameCstr("missing"), &byteCount) || byteCount != 0) {
+                printf("FAIL (STRLEN): missing name\n");
+        }
+        if (!ReadBackCompareTest(br)) {
+                printf("FAIL (STRLEN): read back\n");
+        }
+
+        /* A string value without BON_STRING_FLAG_LENGTH falls back to strlen */
+        oldFormat[0] = ((uint64_t)sizeof(uint64_t) << 32) | BON_VT_STRING;
+        memcpy(&oldFormat[1], "old", 4);
+        string = BonAsStringWithLength((const BonValue*)oldFormat, &byteCount);
+        if (byteCount != 3 || 0 != strcmp(string, "old")) {
+                printf("FAIL (STRLEN): old format\n");
+        }
+
+        /* A byte count that runs past the value strings */
+        {
+                const BonValue* v       = &object.values[BonFindIndexOfName(object.names, object.count, BonCreateNameCstr("plain"))];
+                uint32_t*       count   = (uint32_t*)BonAsString(v) - 1;
+                *count = 1000;
+                if (BonValidateRecordDeep(br, br->recordSize)) {
+                        printf("FAIL (STRLEN): validate byte count\n");
+                }
+        }
+        free(br);
+}
+
+/* Diff two JSON texts, apply the patch and compare with the new record. Return the patch size. */
+static size_t
+DiffApplyCompare(const char* oldJson, const char* newJson, const BonConvertOptions* options) {
+        BonRecord*      oldRecord       = BonCreateRecordFromJsonWithOptions(oldJson, strlen(oldJson), options);
+        BonRecord*      newRecord       = BonCreateRecordFromJsonWithOptions(newJson, strlen(newJson), options);
+        size_t          patchSize       = 0;
+        void*           patch           = BonDiffRecords(oldRecord, newRecord, &patchSize);
+        BonRecord*      result          = patch ? BonApplyPatch(oldRecord, patch, patchSize) : 0;
+        BonRecord*      wrongBase       = patch ? BonApplyPatch(newRecord, patch, patchSize) : 0;
+
+        if (!result || result->recordSize != newRecord->recordSize || 0 != memcmp(result, newRecord, newRecord->recordSize)) {
+                printf("FAIL (PATCH): %s -> %s\n", oldJson, newJson);
+        } else if (wrongBase && 0 != strcmp(oldJson, newJson)) {
+                printf("FAIL (PATCH): applied to the wrong record %s\n", oldJson);
+        }
+        free(wrongBase);
+        free(result);
+        free(patch);
+        free(newRecord);
+        free(oldRecord);
+        return patchSize;
+}
+
+static void
+PatchTest(void) {
+        static const char*      pairs[] = {
+                "{\"a\":1,\"b\":[1,2,3]}",                                   "{\"a\":1,\"b\":[1,2,3]}",
+                "{\"a\":1,\"b\":{\"c\":[true,null,\"x\"]}}",                "{\"a\":1,\"b\":{\"c\":[true,false,\"y\\u0000z\"]}}",
+                "{\"a\":1,\"b\":2}",                                         "{\"b\":2,\"c\":{\"d\":[4]}}",
+                "{\"a\":[1,2,3],\"s\":\"str\"}",                             "{\"a\":[1,2,3,4],\"s\":[{\"t\":\"str\"}]}",
+                "{\"a\":{}}",                                                "[\"a\"]",
+                "[[1,2],[3,4],{\"x\":\"y\"}]",                                 "[[1,2],[3,5],{\"x\":\"z\",\"w\":[]}]",
+                "[1.5,2.5,[100,200,300]]",                                    "[1.5,2.5,[100,200,70000]]",
+                "{\"a\":1,\"a\":2}",                                         "{\"a\":1,\"a\":3}",             /* Duplicate names */
+                "{\"a\":1,\"a\":2}",                                         "{\"a\":1}",
+                "{\"x\":{\"a\":1,\"a\":2},\"y\":1}",                         "{\"x\":{\"a\":1,\"a\":3},\"y\":2}",
+                "[{\"a\":[1],\"a\":[2]},3]",                                  "[{\"a\":[1],\"a\":[2,4]},5]",
+        };
+        const char*             large   = "[{\"id\":1,\"name\":\"first\"},{\"id\":2,\"name\":\"second\"},{\"id\":3,\"name\":\"third\",\"tags\":[\"a\",\"b\",\"c\",\"d\"]}]";
+        const char*             changed = "[{\"id\":1,\"name\":\"first\"},{\"id\":2,\"name\":\"second\"},{\"id\":4,\"name\":\"third\",\"tags\":[\"a\",\"b\",\"c\",\"d\"]}]";
+        BonConvertOptions       options;
+        BonRecord*              oldRecord;
+        BonRecord*              newRecord;
+        void*                   patch;
+        size_t                  patchSize;
+        size_t                  i;
+        uint32_t                state   = 1;
+
+        memset(&options, 0, sizeof(options));
+        for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i += 2) {
+                DiffApplyCompare(pairs[i], pairs[i + 1], 0);
+                DiffApplyCompare(pairs[i + 1], pairs[i], 0);
+        }
+        options.typedArrays = BON_TYPED_ARRAYS_LOSSLESS;
+        DiffApplyCompare(pairs[12], pairs[13], &options);
+        DiffApplyCompare(pairs[13], pairs[12], &options);
+        DiffApplyCompare(large, changed, &options);
+
+        /* A changed number costs an operation, not a record */
+        oldRecord = BonCreateRecordFromJson(large, strlen(large));
+        newRecord = BonCreateRecordFromJson(changed, strlen(changed));
+        patch = BonDiffRecords(oldRecord, newRecord, &patchSize);
+        if (!patch || patchSize > 64) {
+                printf("FAIL (PATCH): patch size %u\n", (unsigned)patchSize);
+        }
+
+        /* A damaged patch fails or still produces the new record */
+        for (i = 0; patch && i < 1000; ++i) {
+                uint8_t*        bytes   = (uint8_t*)patch;
+                const size_t    offset  = NextRandom(&state) % patchSize;
+                const uint8_t   bit     = (uint8_t)(1u << (NextRandom(&state) & 7));
+                BonRecord*      result;
+                bytes[offset] ^= bit;
+                result = BonApplyPatch(oldRecord, patch, patchSize);
+                if (result && 0 != memcmp(result, newRecord, newRecord->recordSize)) {
+                        printf("FAIL (PATCH): damaged patch at %u\n", (unsigned)offset);
+                }
+                free(result);
+                bytes[offset] ^= bit;
+        }
+        free(patch);
+        free(newRecord);
+        free(oldRecord);
+}
+
+static void
+HashTest(void) {
+        const char*             objectJson      = "{\"a\":{\"x\":[1,2,\"s\"],\"y\":null},\"b\":true}";
+        const char*             arrayJson       = "[0,\"zz\",{\"y\":null,\"x\":[1,2,\"s\"]}]";
+        const char*             numbersJson     = "{\"position\":[1,2,3,200],\"x\":-1.5}";
+        const char*             names[]         = { "position", "x" };
+        BonRecord*              objectRecord    = BonCreateRecordFromJson(objectJson, strlen(objectJson));
+        BonRecord*              objectCopy      = BonCreateRecordFromJson(objectJson, strlen(objectJson));
+        BonRecord*              arrayRecord     = BonCreateRecordFromJson(arrayJson, strlen(arrayJson));
+        BonRecord*              numbersRecord   = BonCreateRecordFromJson(numbersJson, strlen(numbersJson));
+        BonRecord*              dictionary      = BonCreateNameDictionary(names, 2);
+        BonRecord*              typedRecord;
+        BonRecord*              dictionaryRecord;
+        BonConvertOptions       options;
+        BonObject               object;
+        BonArray                array;
+        char*                   json;
+        char*                   p;
+        uint64_t*               hashes;
+        int                     count           = 0;
+        int                     i, j;
+
+        memset(&options, 0, sizeof(options));
+        options.typedArrays             = BON_TYPED_ARRAYS_LOSSLESS;
+        options.typedArrayMinCount      = 2;
+        typedRecord = BonCreateRecordFromJsonWithOptions(numbersJson, strlen(numbersJson), &options);
+        memset(&options, 0, sizeof(options));
+        options.nameDictionary = dictionary;
+        dictionaryRecord = BonCreateRecordFromJsonWithOptions(numbersJson, strlen(numbersJson), &options);
+
+        if (BonHashRecord(objectRecord) != BonHashRecord(objectCopy) || BonHashRecord(objectRecord) == BonHashRecord(arrayRecord)) {
+                printf("FAIL (HASH): record hash\n");
+        }
+        ((uint8_t*)objectCopy)[objectCopy->recordSize - 1] ^= 0x10;
+        if (BonHashRecord(objectRecord) == BonHashRecord(objectCopy)) {
+                printf("FAIL (HASH): record hash after change\n");
+        }
+
+        /* The same subtree at different offsets of different records */
+        object = BonAsObject(BonGetRootValue(objectRecord));
+        array = BonAsArray(BonGetRootValue(arrayRecord));
+        i = BonFindIndexOfName(object.names, object.count, BonCreateNameCstr("a"));
+        if (BonHashValue(objectRecord, &object.values[i]) != BonHashValue(arrayRecord, &array.values[2])) {
+                printf("FAIL (HASH): subtree\n");
+        }
+        if (BonHashValue(objectRecord, BonGetRootValue(objectRecord)) == BonHashValue(objectRecord, &object.values[i])) {
+                printf("FAIL (HASH): root and subtree\n");
+        }
+
+        /* Lossless typed arrays and shared names don't change the content */
+        if (BonHashRecord(typedRecord) == BonHashRecord(numbersRecord) 
+                || BonHashValue(typedRecord, BonGetRootValue(typedRecord)) != BonHashValue(numbersRecord, BonGetRootValue(numbersRecord))) {
+                printf("FAIL (HASH): typed array\n");
+        }
+        if (BonHashValue(dictionaryRecord, BonGetRootValue(dictionaryRecord)) != BonHashValue(numbersRecord, BonGetRootValue(numbersRecord))) {
+                printf("FAIL (HASH): name dictionary\n");
+        }
+
+        /* Strings of every length up to past a few blocks and small numbers all hash differently */
+        json = (char*)malloc(400 * 1024);
+        p = json;
+        *p++ = '[';
+        for (i = 0; i < 2000; i += 7) {
+                p += sprintf(p, "%s%d,\"", i ? "," : "", i);
+                memset(p, 'a', (size_t)i);
+                p += i;
+                *p++ = '"';
+        }
+        *p++ = ']';
+        *p = 0;
+        free(arrayRecord);
+        arrayRecord = BonCreateRecordFromJson(json, strlen(json));
+        array = BonAsArray(BonGetRootValue(arrayRecord));
+        hashes = (uint64_t*)malloc((size_t)array.count * sizeof(uint64_t));
+        for (i = 0; i < array.count; ++i) {
+                hashes[count++] = BonHashValue(arrayRecord, &array.values[i]);
+        }
+        for (i = 0; i < count; ++i) {
+                for (j = 0; j < i; ++j) {
+                        if (hashes[i] == hashes[j]) {
+                                printf("FAIL (HASH): collision between items %d and %d\n", j, i);
+                        }
+                }
+        }
+        free(hashes);
+        free(json);
+        free(dictionaryRecord);
+        free(typedRecord);
+        free(dictionary);
+        free(numbersRecord);
+        free(arrayRecord);
+        free(objectCopy);
+        free(objectRecord);
+}
+
+typedef struct ChangeList {
+        const BonRecord*        oldRecord;
+        const BonRecord*        newRecord;
+        char                    text[1024];
+        size_t                  size;
+} ChangeList;
+
+/* Append "path=kind;" for a change, e.g. "a.b[1]=changed;" */
+static void
+AppendChange(void* userdata, const BonPath* path, const BonValue* oldValue, const BonValue* newValue) {
+        ChangeList*     changes = (ChangeList*)userdata;
+        char*           p       = changes->text + changes->size;
+        int             i;
+        for (i = 0; i < path->count; ++i) {
+                if (path->segments[i].index >= 0) {
+                        p += sprintf(p, "[%d]", path->segments[i].index);
+                } else {
+                        const char* name = BonGetNameString(oldValue ? changes->oldRecord : changes->newRecord, path->segments[i].name);
+                        p += sprintf(p, "%s%s", i ? "." : "", name ? name : "?");
+                }
+        }
+        p += sprintf(p, "=%s;", !oldValue ? "added" : !newValue ? "removed" : "changed");
+        changes->size = (size_t)(p - changes->text);
+}
+
+static void
+SubtreeHashTest(void) {
+        static const char*      expected[]      = { "a.b[1]=changed;", "a.b[2].c=changed;", "d=removed;", "e[1]=added;", "f=added;" };
+        const char*             oldJson         = "{\"a\":{\"b\":[1,2,{\"c\":\"x\"}],\"t\":[1,2,3]},\"d\":null,\"e\":[true],\"s\":\"same\",\"big\":{\"k\":[1,2,3]}}";
+        const char*             newJson         = "{\"a\":{\"b\":[1,5,{\"c\":\"y\"}],\"t\":[1,2,3]},\"e\":[true,false],\"f\":1,\"s\":\"same\",\"big\":{\"k\":[1,2,3]}}";
+        const char*             editedJson      = "{\"a\":{\"b\":[7,2,{\"c\":\"x\"}],\"t\":[1,2,3]},\"d\":null,\"e\":[true],\"s\":\"same\",\"big\":{\"k\":[1,2,3]}}";
+        BonConvertOptions       options;
+        BonRecord*              records[4];                                     /* old, new without and with hashes */
+        BonRecord*              edited;
+        BonRecord*              copy;
+        BonPath                 path;
+        ChangeList              changes;
+        uint64_t                hash;
+        int                     i, j, k;
+
+        memset(&options, 0, sizeof(options));
+        options.subtreeHashes = BON_TRUE;
+        records[0] = BonCreateRecordFromJson(oldJson, strlen(oldJson));
+        records[1] = BonCreateRecordFromJson(newJson, strlen(newJson));
+        records[2] = BonCreateRecordFromJsonWithOptions(oldJson, strlen(oldJson), &options);
+        records[3] = BonCreateRecordFromJsonWithOptions(newJson, strlen(newJson), &options);
+        edited = BonCreateRecordFromJsonWithOptions(editedJson, strlen(editedJson), &options);
+
+        if (!(records[2]->flags & BON_RECORD_FLAG_SUBTREE_HASHES) || !BonValidateRecordDeep(records[2], records[2]->recordSize)
+                || !ReadBackCompareTest(records[0])) {
+                printf("FAIL (SUBTREE): convert\n");
+        }
+
+        /* Stored hashes are the BonHashValue of the record without them */
+        BonCompilePath(&path, "a.b");
+        if (!BonGetSubtreeHash(records[2], BonEvaluatePath(BonGetRootValue(records[2]), &path), &hash) 
+                || hash != BonHashValue(records[0], BonEvaluatePath(BonGetRootValue(records[0]), &path))
+                || !BonGetSubtreeHash(records[2], BonGetRootValue(records[2]), &hash) || hash != BonHashValue(records[0], BonGetRootValue(records[0]))) {
+                printf("FAIL (SUBTREE): hash\n");
+        }
+        BonCompilePath(&path, "s");
+        if (BonGetSubtreeHash(records[0], BonGetRootValue(records[0]), &hash) || BonGetSubtreeHash(records[2], BonEvaluatePath(BonGetRootValue(records[2]), &path), &hash)) {
+                printf("FAIL (SUBTREE): hash of a string or a record without hashes\n");
+        }
+
+        /* The same changes with and without hashes */
+        for (i = 0; i < 4; ++i) {
+                size_t count;
+                memset(&changes, 0, sizeof(changes));
+                changes.oldRecord       = records[i & 2];
+                changes.newRecord       = records[(i & 1) ? 3 : 1];
+                count = BonFindChangedPaths(changes.oldRecord, changes.newRecord, AppendChange, &changes);
+                for (j = 0, k = 0; j < (int)(sizeof(expected) / sizeof(expected[0])); ++j) {
+                        k += strstr(changes.text, expected[j]) != 0;
+                }
+                if (count != 5 || k != 5) {
+                        printf("FAIL (SUBTREE): changed paths %d: %s\n", i, changes.text);
+                }
+        }
+        if (BonFindChangedPaths(records[2], records[2], AppendChange, &changes) != 0) {
+                printf("FAIL (SUBTREE): no changes\n");
+        }
+
+        /* Edit in place and update the hashes */
+        copy = (BonRecord*)malloc(records[2]->recordSize);
+        memcpy(copy, records[2], records[2]->recordSize);
+        BonCompilePath(&path, "a.b[0]");
+        *(BonValue*)BonEvaluatePath(BonGetRootValue(copy), &path) = *BonEvaluatePath(BonGetRootValue(edited), &path);
+        BonUpdateSubtreeHashes(copy);
+        if (copy->recordSize != edited->recordSize || 0 != memcmp(copy, edited, edited->recordSize)) {
+                printf("FAIL (SUBTREE): update\n");
+        }
+
+        /* Patches keep the hashes */
+        DiffApplyCompare(oldJson, newJson, &options);
+        DiffApplyCompare(oldJson, editedJson, &options);
+
+        /* Unsorted or out of range container offsets */
+        memcpy(copy, records[2], records[2]->recordSize);
+        {
+                const BonSubtreeHashFooter*     footer  = (const BonSubtreeHashFooter*)((uint8_t*)copy + copy->recordSize - sizeof(BonSubtreeHashFooter));
+                uint32_t*                       offsets = (uint32_t*)((uint8_t*)&footer->hashesOffset + footer->hashesOffset + footer->count * sizeof(uint64_t));
+                const uint32_t                  first   = offsets[0];
+                offsets[0] = offsets[1];
+                if (BonValidateRecordDeep(copy, copy->recordSize)) {
+                        printf("FAIL (SUBTREE): validate unsorted\n");
+                }
+                offsets[0] = first + 8;
+                if (BonValidateRecordDeep(copy, copy->recordSize)) {
+                        printf("FAIL (SUBTREE): validate container start\n");
+                }
+                offsets[0] = first;
+                ((BonSubtreeHashFooter*)footer)->count++;
+                if (BonValidateRecordDeep(copy, copy->recordSize)) {
+                        printf("FAIL (SUBTREE): validate count\n");
+                }
+        }
+        free(copy);
+        free(edited);
+        for (i = 0; i < 4; ++i) {
+                free(records[i]);
+        }
+}
+
+static const char*
+RecordNameProvider(void* userdata, BonName name, size_t* byteCount) {
+        return BonGetNameStringWithLength((const BonRecord*)userdata, name, byteCount);
+}
+
+static void
+StripNamesTest(void) {
+        const char*             json            = "{\"id\":7,\"tags\":[\"a\",\"b\"],\"inner\":{\"x\":1.5,\"shared\":true}}";
+        const char*             dictionaryNames[] = { "shared" };
+        BonConvertOptions       options;
+        BonRecord*              dictionary      = BonCreateNameDictionary(dictionaryNames, 1);
+        BonRecord*              record;
+        BonRecord*              stripped;
+        BonRecord*              again;
+        BonRecord*              reconverted;
+        uint8_t*                jsonData;
+        size_t                  size;
+        size_t                  patchSize;
+        uint64_t                hash;
+        BonPath                 path;
+        FILE*                   f;
+
+        memset(&options, 0, sizeof(options));
+        options.subtreeHashes   = BON_TRUE;
+        options.nameDictionary  = dictionary;
+        record = BonCreateRecordFromJsonWithOptions(json, strlen(json), &options);
+        stripped = BonStripNames(record);
+        if (!(stripped->flags & BON_RECORD_FLAG_NO_NAMES) || stripped->recordSize >= record->recordSize 
+                || !BonValidateRecordDeep(stripped, stripped->recordSize)) {
+                printf("FAIL (STRIP): strip\n");
+        }
+        again = BonStripNames(stripped);
+        if (again->recordSize != stripped->recordSize || 0 != memcmp(again, stripped, stripped->recordSize)) {
+                printf("FAIL (STRIP): strip twice\n");
+        }
+
+        /* Values and hashes are kept, names are gone unless the dictionary has them */
+        BonCompilePath(&path, "inner.x");
+        if (BonAsNumber(BonEvaluatePath(BonGetRootValue(stripped), &path)) != 1.5 
+                || BonHashValue(stripped, BonGetRootValue(stripped)) != BonHashValue(record, BonGetRootValue(record))
+                || !BonGetSubtreeHash(stripped, BonGetRootValue(stripped), &hash) || hash != BonHashValue(record, BonGetRootValue(record))) {
+                printf("FAIL (STRIP): values\n");
+        }
+        if (BonGetNameString(stripped, BonCreateNameCstr("id")) != 0 || BonGetNameString(record, BonCreateNameCstr("id")) == 0) {
+                printf("FAIL (STRIP): name string\n");
+        }
+        BonRegisterNameDictionary(dictionary);
+        if (BonGetNameString(stripped, BonCreateNameCstr("shared")) == 0) {
+                printf("FAIL (STRIP): dictionary name\n");
+        }
+
+        /* JSON with hex keys, and with names from the original record */
+        f = fopen("temp.json", "wb");
+        BonWriteAsJsonToStream(stripped, f);
+        fclose(f);
+        jsonData = LoadAll(&size, "temp.json");
+        if (!jsonData || !strstr((const char*)jsonData, "\"0x") || !strstr((const char*)jsonData, "\"shared\"")) {
+                printf("FAIL (STRIP): hex keys\n");
+        }
+        free(jsonData);
+        f = fopen("temp.json", "wb");
+        BonWriteAsJsonToStreamWithNames(stripped, f, RecordNameProvider, record);
+        fclose(f);
+        jsonData = LoadAll(&size, "temp.json");
+        reconverted = BonCreateRecordFromJsonWithOptions((const char*)jsonData, size, &options);
+        if (!reconverted || reconverted->recordSize != record->recordSize || 0 != memcmp(reconverted, record, record->recordSize)) {
+                printf("FAIL (STRIP): name provider\n");
+        }
+        free(reconverted);
+        free(jsonData);
+
+        /* Patches need the names of new members */
+        if (BonDiffRecords(dictionary, stripped, &patchSize) != 0) {
+                printf("FAIL (STRIP): diff without names\n");
+        }
+        BonUnregisterNameDictionary(dictionary);
+
+        /* The name lookup offset must end the value strings */
+        stripped->nameLookupTableOffset -= 8;
+        if (BonValidateRecordDeep(stripped, stripped->recordSize)) {
+                printf("FAIL (STRIP): validate offset\n");
+        }
+        free(again);
+        free(stripped);
+        free(record);
+        free(dictionary);
+}
+
+/* A string or container value stored at fromOffset that references toOffset, as the converter writes it for wide records */
+static BonValue
+MakeWideValue(int type, uint64_t toOffset, uint64_t fromOffset) {
+        const int64_t   offset  = (int64_t)(toOffset - fromOffset);
+        const int64_t   low     = (int32_t)(uint32_t)offset;
+        return ((BonValue)(uint32_t)offset << 32) | ((BonValue)((uint32_t)((offset - low) / 0x100000000ll) & 0xffffffu) << 8) | (BonValue)type;
+}
+
+static int
+SeekFile(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+        return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+/* A record over 4 GB in a sparse file: an array of zeros (0.0) between the root object and a 
+ * value string. Only the first and last pages of the file are written. */
+static void
+SparseWideRecordTest(void) {
+        const uint32_t          arrayCount      = 540000000u;
+        const uint64_t          rootOffset      = sizeof(BonRecord) + sizeof(BonWideRecordHeader);
+        const uint64_t          arrayOffset     = rootOffset + sizeof(BonContainerHeader) + 2 * sizeof(BonValue) + 2 * sizeof(BonName);
+        const uint64_t          stringsOffset   = arrayOffset + sizeof(BonContainerHeader) + (uint64_t)arrayCount * sizeof(BonValue);
+        const uint64_t          nameTableOffset = stringsOffset + 16;
+        const uint64_t          recordSize      = nameTableOffset + sizeof(BonContainerHeader);
+        const BonName           bigName         = BonCreateNameCstr("big");
+        const BonName           tailName        = BonCreateNameCstr("tail");
+        const int               bigIndex        = bigName < tailName ? 0 : 1;
+        uint64_t                head[16];                                       /* Headers, the root object and the array header */
+        uint64_t                tail[3]         = { 0 };
+        BonRecord*              header          = (BonRecord*)head;
+        BonWideRecordHeader*    wide            = (BonWideRecordHeader*)&header[1];
+        BonContainerHeader*     root            = (BonContainerHeader*)&wide[1];
+        BonValue*               values          = (BonValue*)&root[1];
+        BonName*                names           = (BonName*)&values[2];
+        BonContainerHeader*     array           = (BonContainerHeader*)&names[2];
+        BonMappedFile           file;
+        const BonRecord*        record;
+        BonObject               object;
+        BonArray                big;
+        FILE*                   f;
+
+        if (sizeof(size_t) < 8)
+                return;
+        memset(head, 0, sizeof(head));
+        header->magic                   = BON_WIDE_RECORD_MAGIC;
+        header->flags                   = BON_RECORD_FLAG_STRING_LENGTHS;
+        header->rootValue               = MakeWideValue(BON_VT_OBJECT, rootOffset, offsetof(BonRecord, rootValue));
+        wide->recordSize                = recordSize;
+        wide->valueStringOffset         = stringsOffset;
+        wide->nameLookupTableOffset     = nameTableOffset;
+        root->capacity                  = -2;
+        root->count                     = 2;
+        names[bigIndex]                 = bigName;
+        names[1 - bigIndex]             = tailName;
+        values[bigIndex]                = MakeWideValue(BON_VT_ARRAY, arrayOffset, 
+                                                rootOffset + sizeof(BonContainerHeader) + bigIndex * sizeof(BonValue)) | BON_ARRAY_FLAG_NUMBERS;
+        values[1 - bigIndex]            = MakeWideValue(BON_VT_STRING, stringsOffset + 4, 
+                                                rootOffset + sizeof(BonContainerHeader) + (1 - bigIndex) * sizeof(BonValue)) | BON_STRING_FLAG_LENGTH;
+        array->capacity                 = (int32_t)arrayCount;
+        array->count                    = (int32_t)arrayCount;
+        memcpy(tail, "\4\0\0\0tail", 8);                                        /* Byte count, string and the empty name lookup table */
+
+        f = fopen("temp_wide.bon", "wb");
+        if (!f || fwrite(head, (size_t)(arrayOffset + sizeof(BonContainerHeader)), 1, f) != 1 || SeekFile(f, stringsOffset) != 0 
+                || fwrite(tail, sizeof(tail), 1, f) != 1) {
+                printf("FAIL (WIDE): write sparse file\n");
+                if (f)
+                        fclose(f);
+                return;
+        }
+        fclose(f);
+
+        record = BonMapRecordFile(&file, "temp_wide.bon", BON_MAP_RANDOM);
+        if (!record || BonGetRecordSize(record) != recordSize || recordSize <= 0x100000000ull) {
+                printf("FAIL (WIDE): map sparse record\n");
+        } else {
+                object  = BonAsObject(BonGetRootValue(record));
+                big     = BonMemberAsArray(&object, bigName);
+                if (0 != strcmp(BonMemberAsString(&object, tailName), "tail") || big.count != (int)arrayCount 
+                        || BonAsNumber(&big.values[arrayCount - 1]) != 0.0) {
+                        printf("FAIL (WIDE): read sparse record\n");
+                }
+        }
+        BonUnmapRecord(&file);
+        remove("temp_wide.bon");
+}
+
+static void
+WideRecordTest(void) {
+        const char*             json            = "{\"name\":\"wide\",\"list\":[1,\"two\",{\"three\":3}],\"empty\":{},\"flag\":true}";
+        BonConvertOptions       options;
+        BonRecord*              narrow;
+        BonRecord*              wide;
+        BonRecord*              stripped;
+        BonRecord*              copy;
+        size_t                  patchSize;
+        size_t                  size;
+        uint8_t*                jsonData;
+        BonPath                 path;
+        FILE*                   f;
+
+        memset(&options, 0, sizeof(options));
+        options.wideOffsets     = BON_TRUE;
+        options.subtreeHashes   = BON_TRUE;                                     /* Ignored for wide records */
+        narrow  = BonCreateRecordFromJson(json, strlen(json));
+        wide    = BonCreateRecordFromJsonWithOptions(json, strlen(json), &options);
+        size    = (size_t)BonGetRecordSize(wide);
+        if (!wide || wide->magic != BON_WIDE_RECORD_MAGIC || size != narrow->recordSize + sizeof(BonWideRecordHeader) 
+                || (wide->flags & BON_RECORD_FLAG_SUBTREE_HASHES) || !BonValidateRecordDeep(wide, size)) {
+                printf("FAIL (WIDE): convert\n");
+        }
+
+        /* Same values, names and JSON as the narrow record */
+        BonCompilePath(&path, "list[2].three");
+        if (BonAsNumber(BonEvaluatePath(BonGetRootValue(wide), &path)) != 3.0 
+                || BonHashValue(wide, BonGetRootValue(wide)) != BonHashValue(narrow, BonGetRootValue(narrow))
+                || 0 != strcmp(BonGetNameString(wide, BonCreateNameCstr("three")), "three")) {
+                printf("FAIL (WIDE): read\n");
+        }
+        f = fopen("temp.json", "wb");
+        BonWriteAsJsonToStream(wide, f);
+        fclose(f);
+        jsonData = LoadAll(&size, "temp.json");
+        copy = BonCreateRecordFromJson((const char*)jsonData, size);
+        if (!copy || copy->recordSize != narrow->recordSize || 0 != memcmp(copy, narrow, narrow->recordSize)) {
+                printf("FAIL (WIDE): JSON\n");
+        }
+        free(copy);
+        free(jsonData);
+
+        /* Stripping works, patches don't */
+        stripped = BonStripNames(wide);
+        if (!stripped || !BonValidateRecordDeep(stripped, (size_t)BonGetRecordSize(stripped)) || BonGetNameString(stripped, BonCreateNameCstr("three"))) {
+                printf("FAIL (WIDE): strip\n");
+        }
+        if (BonDiffRecords(narrow, wide, &patchSize) != 0) {
+                printf("FAIL (WIDE): diff\n");
+        }
+
+        /* Narrow fields must be zero and the size must match */
+        size = (size_t)BonGetRecordSize(wide);
+        copy = (BonRecord*)malloc(size);
+        memcpy(copy, wide, size);
+        copy->recordSize = (uint32_t)size;
+        if (BonValidateRecordDeep(copy, size)) {
+                printf("FAIL (WIDE): validate narrow size\n");
+        }
+        memcpy(copy, wide, size);
+        ((BonWideRecordHeader*)&copy[1])->recordSize += 8;
+        if (BonIsAValidRecord(copy, size) || BonValidateRecordDeep(copy, size)) {
+                printf("FAIL (WIDE): validate size\n");
+        }
+        free(copy);
+        free(stripped);
+        free(wide);
+        free(narrow);
+
+        SparseWideRecordTest();
+}
+
+/* Parse the number text as the only item of an array. Return BON_FALSE if the JSON was rejected. */
+static BonBool
+ParseNumberText(const char* number, double* d) {
+        char            json[1024];
+        BonRecord*      br;
+        sprintf(json, "[%s]", number);
+        br = BonCreateRecordFromJson(json, strlen(json));
+        if (!br)
+                return BON_FALSE;
+        *d = BonAsNumber(&BonAsArray(BonGetRootValue(br)).values[0]);
+        free(br);
+        return BON_TRUE;
+}
+
+/* Every number must parse to the correctly rounded double, i.e. the same bits as strtod in the C locale,
+ * with the 3 least significant bits cleared as in every BON number */
+static void
+CheckNumberText(const char* number) {
+        double          expected        = strtod(number, 0);
+        double          d               = 0.0;
+        const BonBool   parsed          = ParseNumberText(number, &d);
+        uint64_t        bits;
+        memcpy(&bits, &expected, sizeof(bits));
+        bits &= ~0x7ull;
+        memcpy(&expected, &bits, sizeof(bits));
+        if (isinf(expected) ? parsed : !parsed || 0 != memcmp(&d, &expected, sizeof(d))) {
+                printf("FAIL (NUMBER): %s parsed as %.17g, expected %.17g\n", number, d, expected);
+        }
+}
+
+static void
+NumberParseTest(void) {
+        static const char*      hard[]  = {
+                "0", "-0", "0.0", "1", "-1", "0.1", "0.3", "9007199254740993", "9007199254740992", "18446744073709551615",
+                "1e23", "8.98846567431158e307", "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308",
+                "2.2250738585072011e-308", "2.2250738585072012e-308", "2.2250738585072014e-308", "4.9406564584124654e-324",
+                "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "-1e-400", "123456789012345678901234567890",
+                "1.00000000000000011102230246251565404236316680908203125",
+                "1.00000000000000011102230246251565404236316680908203124",
+                "1.00000000000000011102230246251565404236316680908203126",
+                "9007199254740993.000000000000000000000000000000000000000000000000000000000000000000001",
+                "0.000000000000000000000000000000000000000000000000000000000000000001234567890123456789012",
+                "7.9228162514264337593543950335e28", "3.14159265358979323846264338327950288419716939937510",
+                "12345678.12345678", "1234567812345678.5", "0.12345678123456781234", "1e-22", "1e22", "4.35679e-7"
+        };
+        char            text[128];
+        uint32_t        state   = 1;
+        size_t          i;
+        int             j, n;
+        double          d       = 0.0;
+
+        for (i = 0; i < sizeof(hard) / sizeof(hard[0]); ++i) {
+                CheckNumberText(hard[i]);
+        }
+        if (!ParseNumberText("-0", &d) || !signbit(d)) {
+                printf("FAIL (NUMBER): -0\n");
+        }
+
+        /* Random doubles printed with every precision, and random digit strings with and without truncation */
+        for (i = 0; i < 100000; ++i) {
+                uint64_t        bits    = ((uint64_t)NextRandom(&state) << 32) | NextRandom(&state);
+                double          x;
+                memcpy(&x, &bits, sizeof(x));
+                if (isnan(x) || isinf(x))
+                        continue;
+                sprintf(text, "%.*g", (int)(i % 17) + 1, x);
+                CheckNumberText(text);
+                sprintf(text, "%.17e", x);
+                CheckNumberText(text);
+
+                n = sprintf(text, "%s%u", i & 1 ? "-" : "", (NextRandom(&state) >> 8) % 1000 + 1);
+                for (j = (int)((NextRandom(&state) >> 16) % 30); j > 0; --j) {
+                        text[n++] = (char)('0' + (NextRandom(&state) >> 16) % 10);
+                        if (j == 12 && (i & 2)) {
+                                text[n++] = '.';
+                        }
+                }
+                sprintf(text + n, "e%d", (int)((NextRandom(&state) >> 8) % 700) - 350);
+                CheckNumberText(text);
+        }
+
+        /* Numbers survive a round trip through JSON text */
+        {
+                char*           json    = (char*)malloc(1000 * 32 + 2);
+                char*           p       = json;
+                BonRecord*      br;
+                *p++ = '[';
+                for (i = 0; i < 1000; ++i) {
+                        const uint64_t  bits    = ((uint64_t)NextRandom(&state) << 32) | NextRandom(&state);
+                        double          x;
+                        memcpy(&x, &bits, sizeof(x));
+                        p += sprintf(p, "%s%.17g", i ? "," : "", isnan(x) || isinf(x) ? 0.5 : x);
+                }
+                *p++ = ']';
+                br = BonCreateRecordFromJson(json, (size_t)(p - json));
+                if (!br || !ReadBackCompareTest(br)) {
+                        printf("FAIL (NUMBER): round trip\n");
+                }
+                free(br);
+                free(json);
+        }
+}
+
+static void*
+TestAlloc(void* userdata, size_t size) {
+        (void)userdata;
+        return malloc(size);
+}
+
+static void
+TestFree(void* userdata, void* p) {
+        (void)userdata;
+        free(p);
+}
+
+/* Parse with two sets of options. Both must give the same status and record. */
+static BonBool
+SameParse(const char* json, size_t size, const BonConvertOptions* optionsA, const BonConvertOptions* optionsB) {
+        struct BonParsedJson*   pa      = BonParseJsonWithOptions(TestAlloc, 0, json, size, optionsA);
+        struct BonParsedJson*   pb      = BonParseJsonWithOptions(TestAlloc, 0, json, size, optionsB);
+        BonBool                 same;
+
+        same = BonGetParsedJsonStatus(pa) == BonGetParsedJsonStatus(pb);
+        if (same && BonGetParsedJsonStatus(pa) == BON_STATUS_OK) {
+                const size_t    recordSize      = BonGetBonRecordSize(pa);
+                BonRecord*      a               = BonCreateRecordFromParsedJson(pa, malloc(recordSize));
+                BonRecord*      b               = BonCreateRecordFromParsedJson(pb, malloc(BonGetBonRecordSize(pb)));
+                same = recordSize == BonGetBonRecordSize(pb) && 0 == memcmp(a, b, recordSize);
+                free(a);
+                free(b);
+        }
+        BonFreeParsedJsonMemory(pa, TestFree, 0);
+        BonFreeParsedJsonMemory(pb, TestFree, 0);
+        return same;
+}
+
+/* Parse with and without the structural index */
+static BonBool
+SameAsScalarParse(const char* json, size_t size) {
+        BonConvertOptions       indexed;
+        BonConvertOptions       scalar;
+
+        memset(&indexed, 0, sizeof(indexed));
+        scalar                  = indexed;
+        scalar.scalarParse      = BON_TRUE;
+        return SameParse(json, size, &indexed, &scalar);
+}
+
+static char*
+AppendRandomWhitespace(char* p, uint32_t* state) {
+        static const char       whitespace[]    = " \t\n\r";
+        uint32_t                count           = (NextRandom(state) >> 16) % 4;
+        if ((NextRandom(state) >> 16) % 16 == 0) {
+                count = 70;                                                     /* Longer than a block */
+        }
+        while (count--) {
+                *p++ = whitespace[(NextRandom(state) >> 16) % 4];
+        }
+        return p;
+}
+
+/* Random valid JSON with escape runs, whitespace and strings that cross the 64 byte blocks of the index */
+static char*
+AppendRandomJson(char* p, uint32_t* state, int depth) {
+        static const char*      pieces[]        = { "a", "xyz", "\\\\", "\\\"", "\\\\\\\"", "\\n", "\\u00e9", "/", " ", 
+                                                    "abcdefghabcdefghabcdefghabcdefghabcdefghabcdefghabcdefghabcdefgh" };
+        const uint32_t          r               = NextRandom(state) >> 16;
+        uint32_t                i, count;
+
+        switch (depth > 3 ? r % 3 : r % 5) {
+        case 0:
+                p += sprintf(p, "%d.%u", (int)(r % 2001) - 1000, (NextRandom(state) >> 16) % 100);
+                break;
+        case 1:
+                p += sprintf(p, "%s", r & 8 ? "true" : r & 16 ? "false" : "null");
+                break;
+        case 2:
+                *p++ = '"';
+                for (count = (NextRandom(state) >> 16) % 6, i = 0; i < count; ++i) {
+                        p += sprintf(p, "%s", pieces[(NextRandom(state) >> 16) % (sizeof(pieces) / sizeof(pieces[0]))]);
+                }
+                *p++ = '"';
+                break;
+        default:
+                *p++ = r % 5 == 3 ? '[' : '{';
+                for (count = (NextRandom(state) >> 16) % 5, i = 0; i < count; ++i) {
+                        p = AppendRandomWhitespace(p, state);
+                        if (r % 5 == 4) {
+                                p += sprintf(p, "\"k%u\"", i);
+                                p = AppendRandomWhitespace(p, state);
+                                *p++ = ':';
+                                p = AppendRandomWhitespace(p, state);
+                        }
+                        p = AppendRandomJson(p, state, depth + 1);
+                        p = AppendRandomWhitespace(p, state);
+                        if (i + 1 < count) {
+                                *p++ = ',';
+                        }
+                }
+                *p++ = r % 5 == 3 ? ']' : '}';
+                break;
+        }
+        return p;
+}
+
+static void
+StructuralIndexTest(void) {
+        static const char       mutations[]     = "\"\\ \n{}[]:,a1\x01";
+        const size_t            capacity        = 1024 * 1024;
+        char*                   json            = (char*)malloc(capacity);
+        char*                   copy            = (char*)malloc(capacity);
+        const char*             test            = s_tests;
+        uint32_t                state           = 4711;
+        size_t                  size;
+        int                     pad, run, i;
+
+        while (*test) {
+                const size_t len = strlen(test + 1);
+                if (!SameAsScalarParse(test + 1, len)) {
+                        printf("FAIL (INDEX): %s\n", test + 1);
+                }
+                test += len + 2;
+        }
+
+        /* Backslash runs ending at and across every position of a block. Odd runs escape the quote. */
+        for (pad = 0; pad < 140; ++pad) {
+                for (run = 0; run < 6; ++run) {
+                        char* p = json;
+                        p += sprintf(p, "[%*s\"", pad % 70, "");
+                        for (i = 0; i < pad; ++i)       *p++ = 'a';
+                        for (i = 0; i < run; ++i)       *p++ = '\\';
+                        p += sprintf(p, "\", \"z\"]");
+                        if (!SameAsScalarParse(json, (size_t)(p - json))) {
+                                printf("FAIL (INDEX): pad %d run %d\n", pad, run);
+                        }
+                }
+        }
+
+        /* Random documents larger than a window of the index, and mutations of them */
+        for (run = 0; run < 4; ++run) {
+                char* p = json;
+                *p++ = '[';
+                while (p - json < 3 * 16384 && p - json < (ptrdiff_t)capacity - 65536) {
+                        p = AppendRandomJson(p, &state, 0);
+                        p = AppendRandomWhitespace(p, &state);
+                        *p++ = ',';
+                }
+                p += sprintf(p, "\"end\"]");
+                size = (size_t)(p - json);
+                if (!SameAsScalarParse(json, size)) {
+                        printf("FAIL (INDEX): random %d\n", run);
+                }
+                for (i = 0; i < 100; ++i) {
+                        memcpy(copy, json, size);
+                        copy[(NextRandom(&state) >> 8) % size] = mutations[(NextRandom(&state) >> 16) % (sizeof(mutations) - 1)];
+                        if (!SameAsScalarParse(copy, size)) {
+                                printf("FAIL (INDEX): mutation %d of random %d\n", i, run);
+                        }
+                }
+        }
+        free(copy);
+        free(json);
+}
+
+/* Parse with the list based parser and the tape engine */
+static BonBool
+SameAsTapeParse(const char* json, size_t size, const BonConvertOptions* options) {
+        BonConvertOptions       tape    = *options;
+        tape.tape                       = BON_TRUE;
+        return SameParse(json, size, options, &tape);
+}
+
+static void
+TapeTest(void) {
+        static const char*      names[]         = { "k0", "k2", "a", "member7" };
+        static const char*      extraTests[]    = {
+                "{\"a\":1,\"b\":[1,2],\"a\":\"x\",\"a\":{\"a\":2,\"a\":3}}",                /* Duplicate names are kept, last first */
+                "[\"x\",\"y\",\"x\",{\"x\":\"x\"},[\"y\",[\"x\"]],\"\",\"\"]",                   /* Shared strings */
+                "[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]",
+                "[[],{},[{}],{\"e\":[]},[1,2.5,-3,1e10,0.1],[0,255,-1],[true,1]]",
+                "{\"a\":[1,2,3],\"b\":[-40000,2],\"c\":[0.5,1.25],\"d\":[0.1,1],\"e\":[-0.0,1]}",
+        };
+        const size_t            capacity        = 1024 * 1024;
+        char*                   json            = (char*)malloc(capacity);
+        BonRecord*              dictionary      = BonCreateNameDictionary(names, 4);
+        BonConvertOptions       options[7];
+        uint32_t                state           = 1234;
+        int                     o, i, run;
+
+        memset(options, 0, sizeof(options));
+        options[1].typedArrays          = BON_TYPED_ARRAYS_LOSSLESS;
+        options[2].typedArrays          = BON_TYPED_ARRAYS_FLOAT32;
+        options[2].typedArrayMinCount   = 3;
+        options[3].subtreeHashes        = BON_TRUE;
+        options[4].wideOffsets          = BON_TRUE;
+        options[5].nameDictionary       = dictionary;
+        options[6].scalarParse          = BON_TRUE;
+
+        for (o = 0; o < 7; ++o) {
+                const char* test = s_tests;
+                while (*test) {
+                        const size_t len = strlen(test + 1);
+                        if (!SameAsTapeParse(test + 1, len, &options[o])) {
+                                printf("FAIL (TAPE): options %d: %s\n", o, test + 1);
+                        }
+                        test += len + 2;
+                }
+                for (i = 0; i < (int)(sizeof(extraTests) / sizeof(extraTests[0])); ++i) {
+                        if (!SameAsTapeParse(extraTests[i], strlen(extraTests[i]), &options[o])) {
+                                printf("FAIL (TAPE): options %d: %s\n", o, extraTests[i]);
+                        }
+                }
+        }
+
+        /* Objects that are insertion sorted and radix sorted, with and without duplicate names */
+        for (i = 17; i < 300; i += 41) {
+                char* p = json;
+                int k;
+                *p++ = '{';
+                for (k = 0; k < i; ++k) {
+                        p += sprintf(p, "%s\"member%d\":[%d,\"s%d\"]", k ? "," : "", i % 2 ? k % 7 : k, k, k % 5);
+                }
+                p += sprintf(p, "}");
+                for (o = 0; o < 7; ++o) {
+                        if (!SameAsTapeParse(json, (size_t)(p - json), &options[o])) {
+                                printf("FAIL (TAPE): options %d: object with %d members\n", o, i);
+                        }
+                }
+        }
+
+        /* Random documents, and truncated ones */
+        for (run = 0; run < 8; ++run) {
+                char*   p       = json;
+                size_t  size;
+                *p++ = run % 2 ? '{' : '[';
+                for (i = 0; p - json < 4 * 16384 && p - json < (ptrdiff_t)capacity - 65536; ++i) {
+                        if (run % 2) {
+                                p += sprintf(p, "\"k%u\":", (NextRandom(&state) >> 16) % 50);
+                        }
+                        p = AppendRandomJson(p, &state, 0);
+                        *p++ = ',';
+                }
+                p += sprintf(p, run % 2 ? "\"end\":0}" : "\"end\"]");
+                size = (size_t)(p - json);
+                for (o = 0; o < 7; ++o) {
+                        if (!SameAsTapeParse(json, size, &options[o])) {
+                                printf("FAIL (TAPE): options %d: random %d\n", o, run);
+                        }
+                }
+                for (i = 0; i < 20; ++i) {
+                        if (!SameAsTapeParse(json, (NextRandom(&state) >> 8) % size, &options[0])) {
+                                printf("FAIL (TAPE): truncated random %d\n", run);
+                        }
+                }
+        }
+        free(dictionary);
+        free(json);
+}
+
+/* Feed the text in chunks of chunkSize bytes, or of random sizes when chunkSize is 0. Must give
+ * the same status and record as parsing the whole text. */
+static BonBool
+SameAsStreamParse(const char* json, size_t size, const BonConvertOptions* options, size_t chunkSize, uint32_t* state) {
+        BonConvertOptions       tape    = *options;
+        struct BonParsedJson*   pa;
+        struct BonParsedJson*   pb      = BonParserBegin(TestAlloc, 0, options);
+        size_t                  fed     = 0;
+        BonBool                 same;
+
+        tape.tape = BON_TRUE;
+        pa = BonParseJsonWithOptions(TestAlloc, 0, json, size, &tape);
+        while (fed < size) {
+                size_t n = chunkSize ? chunkSize : 1 + (NextRandom(state) >> 16) % 100;
+                char* chunk;
+                if (n > size - fed) {
+                        n = size - fed;
+                }
+                chunk = (char*)malloc(n);                                       /* So that nothing can read the text after the call */
+                memcpy(chunk, json + fed, n);
+                BonParserFeed(pb, chunk, n);
+                free(chunk);
+                fed += n;
+        }
+        BonParserFinish(pb);
+
+        same = BonGetParsedJsonStatus(pa) == BonGetParsedJsonStatus(pb);
+        if (same && BonGetParsedJsonStatus(pa) == BON_STATUS_OK) {
+                const size_t    recordSize      = BonGetBonRecordSize(pa);
+                BonRecord*      a               = BonCreateRecordFromParsedJson(pa, malloc(recordSize));
+                BonRecord*      b               = BonCreateRecordFromParsedJson(pb, malloc(BonGetBonRecordSize(pb)));
+                same = recordSize == BonGetBonRecordSize(pb) && 0 == memcmp(a, b, recordSize);
+                free(a);
+                free(b);
+        }
+        BonFreeParsedJsonMemory(pa, TestFree, 0);
+        BonFreeParsedJsonMemory(pb, TestFree, 0);
+        return same;
+}
+
+static void
+StreamTest(void) {
+        static const char*      extraTests[]    = {
+                "\xEF\xBB\xBF[1]",                                              /* BOM */
+                "\xEF\xBB[1]",
+                "[]",
+                "{}",
+                "[1,]",
+                "[1}",
+                "{\"a\" 1}",
+                "{\"a\":1,}",
+                "[1] x",
+                "[truex]",
+                "[1x]",
+                "[\"\\\\\",\"\\\"\",\"a\\\\\\\"b\"]",
+                "{\"a\":1,\"b\":[1,2],\"a\":\"x\",\"a\":{\"a\":2,\"a\":3}}",
+                " \t\n[ -0.5e-3 , 123456789012345678901234 , 1e308 ]\r\n",
+        };
+        static const size_t     chunkSizes[]    = { 1, 2, 3, 7, 64, 0 };
+        const size_t            capacity        = 1024 * 1024;
+        char*                   json            = (char*)malloc(capacity);
+        BonConvertOptions       options[2];
+        uint32_t                state           = 4321;
+        int                     o, i, c, run;
+
+        memset(options, 0, sizeof(options));
+        options[1].typedArrays          = BON_TYPED_ARRAYS_LOSSLESS;
+        options[1].subtreeHashes        = BON_TRUE;
+
+        for (c = 0; c < (int)(sizeof(chunkSizes) / sizeof(chunkSizes[0])); ++c) {
+                const char* test = s_tests;
+                while (*test) {
+                        const size_t len = strlen(test + 1);
+                        for (o = 0; o < 2; ++o) {
+                                if (!SameAsStreamParse(test + 1, len, &options[o], chunkSizes[c], &state)) {
+                                        printf("FAIL (STREAM): chunks of %d: %s\n", (int)chunkSizes[c], test + 1);
+                                }
+                        }
+                        test += len + 2;
+                }
+                for (i = 0; i < (int)(sizeof(extraTests) / sizeof(extraTests[0])); ++i) {
+                        if (!SameAsStreamParse(extraTests[i], strlen(extraTests[i]), &options[0], chunkSizes[c], &state)) {
+                                printf("FAIL (STREAM): chunks of %d: %s\n", (int)chunkSizes[c], extraTests[i]);
+                        }
+                }
+        }
+
+        /* Random documents with every chunk boundary inside strings and escapes, and truncated ones */
+        for (run = 0; run < 4; ++run) {
+                char*   p       = json;
+                size_t  size;
+                *p++ = run % 2 ? '{' : '[';
+                for (i = 0; p - json < 16384; ++i) {
+                        if (run % 2) {
+                                p += sprintf(p, "\"k%u\":", (NextRandom(&state) >> 16) % 50);
+                        }
+                        p = AppendRandomJson(p, &state, 0);
+                        *p++ = ',';
+                }
+                p += sprintf(p, run % 2 ? "\"end\":0}" : "\"end\"]");
+                size = (size_t)(p - json);
+                for (c = 0; c < (int)(sizeof(chunkSizes) / sizeof(chunkSizes[0])); ++c) {
+                        if (!SameAsStreamParse(json, size, &options[run / 2], chunkSizes[c], &state)) {
+                                printf("FAIL (STREAM): chunks of %d: random %d\n", (int)chunkSizes[c], run);
+                        }
+                }
+                for (i = 0; i < 20; ++i) {
+                        if (!SameAsStreamParse(json, (NextRandom(&state) >> 8) % size, &options[0], 0, &state)) {
+                                printf("FAIL (STREAM): truncated random %d\n", run);
+                        }
+                }
+        }
+        free(json);
+}
+
+/* Convert on one thread and on threadCount threads */
+static BonBool
+SameAsParallelParse(const char* json, size_t size, const BonConvertOptions* options, int threadCount) {
+        BonConvertOptions       parallel        = *options;
+
+        parallel.threadCount = threadCount;
+        return SameParse(json, size, options, &parallel);
+}
+
+static void
+ParallelTest(void) {
+        static const char*      dictionaryNames[]       = { "k1", "k7", "k30" };
+        static const int        threadCounts[]          = { 2, 3, 8, 64 };
+        const size_t            capacity                = 2 * 1024 * 1024;
+        char*                   json                    = (char*)malloc(capacity);
+        BonRecord*              dictionary              = BonCreateNameDictionary(dictionaryNames, 3);
+        BonConvertOptions       options[4];
+        uint32_t                state                   = 8765;
+        int                     o, i, t, run;
+
+        memset(options, 0, sizeof(options));
+        options[1].typedArrays          = BON_TYPED_ARRAYS_LOSSLESS;
+        options[1].subtreeHashes        = BON_TRUE;
+        options[2].nameDictionary       = dictionary;
+        options[2].scalarParse          = BON_TRUE;
+        options[3].tape                 = BON_TRUE;
+        options[3].wideOffsets          = BON_TRUE;
+
+        /* Root arrays and objects of random values, with the same names and strings in many chunks */
+        for (run = 0; run < 6; ++run) {
+                char*   p       = json;
+                size_t  size;
+                *p++ = run % 2 ? '{' : '[';
+                p = AppendRandomWhitespace(p, &state);
+                for (i = 0; p - json < 1024 * 1024; ++i) {
+                        if (i) {
+                                *p++ = ',';
+                                p = AppendRandomWhitespace(p, &state);
+                        }
+                        if (run % 2) {
+                                p += sprintf(p, "\"k%u\":", (NextRandom(&state) >> 16) % 50);
+                        }
+                        if (run >= 4) {
+                                p += sprintf(p, "%u", (NextRandom(&state) >> 16) % (run == 4 ? 256 : 100000));
+                        } else {
+                                p = AppendRandomJson(p, &state, 0);
+                        }
+                }
+                *p++ = run % 2 ? '}' : ']';
+                p = AppendRandomWhitespace(p, &state);
+                size = (size_t)(p - json);
+
+                for (o = 0; o < 4; ++o) {
+                        for (t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+                                if (!SameAsParallelParse(json, size, &options[o], threadCounts[t])) {
+                                        printf("FAIL (PARALLEL): random %d, options %d, %d threads\n", run, o, threadCounts[t]);
+                                }
+                        }
+                }
+
+                /* Truncated, with a byte replaced, with trailing text and closed by the wrong bracket */
+                for (i = 0; i < 8; ++i) {
+                        const size_t    at      = (NextRandom(&state) >> 8) % size;
+                        const char      saved   = json[at];
+                        if (!SameAsParallelParse(json, at, &options[0], 4)) {
+                                printf("FAIL (PARALLEL): random %d truncated at %u\n", run, (unsigned)at);
+                        }
+                        json[at] = "{}[],:\"\\x"[i];
+                        if (!SameAsParallelParse(json, size, &options[0], 4)) {
+                                printf("FAIL (PARALLEL): random %d with '%c' at %u\n", run, json[at], (unsigned)at);
+                        }
+                        json[at] = saved;
+                }
+                json[size] = 'x';
+                if (!SameAsParallelParse(json, size + 1, &options[0], 4)) {
+                        printf("FAIL (PARALLEL): random %d with trailing text\n", run);
+                }
+                for (i = (int)size - 1; json[i] != ']' && json[i] != '}'; --i) {}
+                json[i] = json[i] == ']' ? '}' : ']';
+                if (!SameAsParallelParse(json, size, &options[0], 4)) {
+                        printf("FAIL (PARALLEL): random %d closed by '%c'\n", run, json[i]);
+                }
+        }
+        free(dictionary);
+        free(json);
+}
+
+/* Convert with the list engine, the tape engine, on threads and with the push parser */
+static BonRecord*
+CreateRecordWithEngine(const char* json, size_t size, const BonConvertOptions* options, int engine) {
+        BonConvertOptions       engineOptions   = *options;
+        struct BonParsedJson*   pj;
+        BonRecord*              br              = 0;
+
+        engineOptions.tape              = engine == 1 ? BON_TRUE : BON_FALSE;
+        engineOptions.threadCount       = engine == 2 ? 4 : 0;
+        if (engine != 3) {
+                return BonCreateRecordFromJsonWithOptions(json, size, &engineOptions);
+        }
+        pj = BonParserBegin(TestAlloc, 0, &engineOptions);
+        BonParserFeed(pj, json, size);
+        if (BonParserFinish(pj) == BON_STATUS_OK) {
+                br = BonCreateRecordFromParsedJson(pj, malloc(BonGetBonRecordSize(pj)));
+        }
+        BonFreeParsedJsonMemory(pj, TestFree, 0);
+        return br;
+}
+
+/* A root array of numbers stays an array of BonValues: a root value is always an array or an object */
+static void
+TypedRootTest(void) {
+        static const char*      engines[]       = { "list", "tape", "threads", "push" };
+        char*                   large           = MakeNumberArrayJson(300000, -1);
+        const char*             texts[4];
+        BonConvertOptions       options;
+        int                     policy, t, e;
+
+        texts[0] = "[1,2,3]";
+        texts[1] = "[0.5,1.25,-2]";
+        texts[2] = "[[1,2,3],[0.5,1.5]]";
+        texts[3] = large;
+        memset(&options, 0, sizeof(options));
+        options.typedArrayMinCount = 2;
+        for (policy = BON_TYPED_ARRAYS_LOSSLESS; policy <= BON_TYPED_ARRAYS_FLOAT32; ++policy) {
+                options.typedArrays = policy;
+                for (t = 0; t < 4; ++t) {
+                        for (e = 0; e < 4; ++e) {
+                                BonRecord* br = CreateRecordWithEngine(texts[t], strlen(texts[t]), &options, e);
+                                if (!br || BonGetValueType(BonGetRootValue(br)) != BON_VT_ARRAY || !BonValidateRecordDeep(br, (size_t)BonGetRecordSize(br))) {
+                                        printf("FAIL (TYPED ROOT): %s engine, text %d, policy %d\n", engines[e], t, policy);
+                                } else if (t == 2 && BonGetValueType(&BonAsArray(BonGetRootValue(br)).values[0]) != BON_VT_TYPED_ARRAY) {
+                                        printf("FAIL (TYPED ROOT): %s engine, nested array not typed\n", engines[e]);
+                                }
+                                free(br);
+                        }
+                }
+        }
+        free(large);
+}
+
+/* An object of numbers memberCount long with the names "name<k % nameCount>" and the values k */
+static char*
+MakeDuplicateNamesJson(int memberCount, int nameCount, BonBool inArray) {
+        char*   json    = (char*)malloc((size_t)memberCount * 32 + 16);
+        char*   p       = json;
+        int     k;
+
+        p += sprintf(p, inArray ? "[{" : "{");
+        for (k = 0; k < memberCount; ++k) {
+                p += sprintf(p, "%s\"name%d\":%d", k ? "," : "", k % nameCount, k);
+        }
+        sprintf(p, inArray ? "}]" : "}");
+        return json;
+}
+
+/* Members sorted by name, those with the same name in the order of the text, and a lookup finds the first of them */
+static BonBool
+IsSortedWithDuplicates(const BonObject* object, int memberCount, int nameCount) {
+        uint8_t*        seen    = (uint8_t*)calloc((size_t)memberCount, 1);
+        BonBool         result  = object->count == memberCount;
+        char            name[32];
+        int             i;
+
+        for (i = 0; result && i < memberCount; ++i) {
+                const int value = (int)BonAsNumber(&object->values[i]);
+                if (value < 0 || value >= memberCount || seen[value]++ || (i > 0 && (object->names[i - 1] > object->names[i] 
+                                || (object->names[i - 1] == object->names[i] && BonAsNumber(&object->values[i - 1]) > value)))) {
+                        result = BON_FALSE;
+                }
+        }
+        for (i = 0; result && i < nameCount; ++i) {
+                sprintf(name, "name%d", i);
+                if (BonMemberAsNumber(object, BonCreateNameCstr(name)) != i) {
+                        result = BON_FALSE;
+                }
+        }
+        free(seen);
+        return result;
+}
+
+/* Objects with more members than are insertion sorted and with duplicate names, from every engine */
+static void
+SortDuplicateNamesTest(void) {
+        static const char*      engines[]       = { "list", "tape", "threads", "push" };
+        static const struct {
+                int             memberCount;
+                int             nameCount;
+                BonBool         inArray;
+        } texts[] = {
+                { 100,          23,     BON_FALSE },
+                { 12000,        1000,   BON_FALSE },                            /* Large enough to be merged from several threads */
+                { 12000,        1000,   BON_TRUE },
+        };
+        BonConvertOptions       options;
+        int                     t, e;
+
+        memset(&options, 0, sizeof(options));
+        for (t = 0; t < (int)(sizeof(texts) / sizeof(texts[0])); ++t) {
+                char*           json    = MakeDuplicateNamesJson(texts[t].memberCount, texts[t].nameCount, texts[t].inArray);
+                BonRecord*      first   = 0;
+                for (e = 0; e < 4; ++e) {
+                        BonRecord*      br      = CreateRecordWithEngine(json, strlen(json), &options, e);
+                        const BonValue* root    = br ? BonGetRootValue(br) : 0;
+                        BonObject       object;
+
+                        if (!br || !BonValidateRecordDeep(br, br->recordSize)) {
+                                printf("FAIL (SORT): %s engine, text %d not converted\n", engines[e], t);
+                                free(br);
+                                continue;
+                        }
+                        object = BonAsObject(texts[t].inArray ? &BonAsArray(root).values[0] : root);
+                        if (!IsSortedWithDuplicates(&object, texts[t].memberCount, texts[t].nameCount)) {
+                                printf("FAIL (SORT): %s engine, text %d members out of order\n", engines[e], t);
+                        }
+                        if (first && (br->recordSize != first->recordSize || memcmp(br, first, br->recordSize) != 0)) {
+                                printf("FAIL (SORT): %s engine, text %d differs from the list engine\n", engines[e], t);
+                        }
+                        if (first) {
+                                free(br);
+                        } else {
+                                first = br;
+                        }
+                }
+                free(first);
+                free(json);
+        }
+}
+
+/* The texts of a BonConvertBatch test and what the batch stored for each */
+typedef struct BatchTexts {
+        const char**            texts;                                          /* Null to fail the load */
+        size_t*                 sizes;
+        BonRecord**             records;
+        int*                    statuses;
+        int*                    storeCounts;
+} BatchTexts;
+
+static BonBool
+LoadBatchText(void* userdata, BonBatchItem* item) {
+        BatchTexts*             texts           = (BatchTexts*)userdata;
+
+        item->jsonData          = texts->texts[item->index];
+        item->jsonDataSize      = texts->sizes[item->index];
+        return item->jsonData != 0;
+}
+
+static void
+StoreBatchText(void* userdata, BonBatchItem* item) {
+        BatchTexts*             texts           = (BatchTexts*)userdata;
+
+        texts->records[item->index]     = item->record;
+        texts->statuses[item->index]    = item->status;
+        texts->storeCounts[item->index] += 1;
+}
+
+static void
+BatchTest(void) {
+        static const int        threadCounts[]  = { 1, 3, 8 };
+        const size_t            capacity        = 4 * 65536;
+        char*                   random          = (char*)malloc(capacity);
+        BatchTexts              texts;
+        BonConvertOptions       options[3];
+        uint32_t                state           = 2468;
+        size_t                  count           = 0;
+        size_t                  i, expectedFailures;
+        const char*             test;
+        int                     o, t, run;
+
+        memset(&texts, 0, sizeof(texts));
+        for (test = s_tests; *test; test += strlen(test + 1) + 2) {
+                ++count;
+        }
+        count += 4 + 1;
+        texts.texts             = (const char**)calloc(count, sizeof(const char*));
+        texts.sizes             = (size_t*)calloc(count, sizeof(size_t));
+        texts.records           = (BonRecord**)calloc(count, sizeof(BonRecord*));
+        texts.statuses          = (int*)calloc(count, sizeof(int));
+        texts.storeCounts       = (int*)calloc(count, sizeof(int));
+
+        /* The parse tests, some larger texts and a text that fails to load */
+        count = 0;
+        for (test = s_tests; *test; test += strlen(test + 1) + 2) {
+                texts.texts[count]      = test + 1;
+                texts.sizes[count++]    = strlen(test + 1);
+        }
+        for (run = 0; run < 4; ++run) {
+                char*   p       = random + run * 65536;
+                texts.texts[count] = p;
+                *p++ = '[';
+                while (p - texts.texts[count] < 60000) {
+                        p = AppendRandomJson(p, &state, 0);
+                        *p++ = ',';
+                }
+                p += sprintf(p, "\"end\"]");
+                texts.sizes[count] = (size_t)(p - texts.texts[count]);
+                ++count;
+        }
+        texts.texts[count++] = 0;
+
+        memset(options, 0, sizeof(options));
+        options[1].typedArrays          = BON_TYPED_ARRAYS_LOSSLESS;
+        options[1].subtreeHashes        = BON_TRUE;
+        options[2].tape                 = BON_TRUE;
+        options[2].threadCount          = 4;                                    /* Ignored */
+
+        for (o = 0; o < 3; ++o) {
+                for (t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+                        size_t failures;
+
+                        memset(texts.storeCounts, 0, count * sizeof(int));
+                        failures                = BonConvertBatch(count, LoadBatchText, StoreBatchText, &texts, &options[o], threadCounts[t]);
+                        expectedFailures        = 0;
+                        for (i = 0; i < count; ++i) {
+                                BonRecord* expected = texts.texts[i] ? BonCreateRecordFromJsonWithOptions(texts.texts[i], texts.sizes[i], &options[o]) : 0;
+
+                                if (texts.storeCounts[i] != 1) {
+                                        printf("FAIL (BATCH): text %d stored %d times\n", (int)i, texts.storeCounts[i]);
+                                } else if (!texts.texts[i] ? texts.statuses[i] != BON_STATUS_LOAD_FAILED || texts.records[i] 
+                                        : !expected ? texts.statuses[i] == BON_STATUS_OK || texts.records[i] 
+                                        : texts.statuses[i] != BON_STATUS_OK || !texts.records[i] || texts.records[i]->recordSize != expected->recordSize 
+                                                || memcmp(texts.records[i], expected, expected->recordSize)) {
+                                        printf("FAIL (BATCH): options %d, %d threads, text %d (status %d)\n", o, threadCounts[t], (int)i, texts.statuses[i]);
+                                }
+                                expectedFailures += !expected;
+                                free(expected);
+                                free(texts.records[i]);
+                        }
+                        if (failures != expectedFailures) {
+                                printf("FAIL (BATCH): %d failures, expected %d\n", (int)failures, (int)expectedFailures);
+                        }
+                }
+        }
+        if (BonConvertBatch(0, LoadBatchText, StoreBatchText, &texts, 0, 4) != 0) {
+                printf("FAIL (BATCH): empty batch\n");
+        }
+
+        free(texts.texts);
+        free(texts.sizes);
+        free(texts.records);
+        free(texts.statuses);
+        free(texts.storeCounts);
+        free(random);
+}
+
+/*---------------------------------------------------------------------------*/
+/* :Benchmarks */
+
+static double
+NanosecondsPerIteration(clock_t start, clock_t end, double iterations) {
+        return (double)(end - start) / CLOCKS_PER_SEC * 1e9 / iterations;
+}
+
+static void
+SearchBenchmark(void) {
+        static const int        widths[]        = { 4, 8, 16, 32, 64, 128, 256 };
+        BonName                 names[256];
+        BonName                 keys[1024];
+        uint32_t                state           = 4711u;
+        const int               rounds          = 20000;
+        int                     w;
+
+        printf("BonFindIndexOfName: ns per lookup (scalar bisection / BonFindIndexOfName)\n");
+        for (w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); ++w) {
+                const int       width           = widths[w];
+                int             r, i;
+                int             sum             = 0;
+                clock_t         start, mid, end;
+
+                MakeSortedNames(names, width, &state);
+                for (i = 0; i < 1024; ++i) {
+                        keys[i] = names[NextRandom(&state) % (uint32_t)width];
+                }
+
+                start = clock();
+                for (r = 0; r < rounds; ++r) {
+                        for (i = 0; i < 1024; ++i) {
+                                sum += FindIndexOfName(names, width, keys[i]);
+                        }
+                }
+                mid = clock();
+                for (r = 0; r < rounds; ++r) {
+                        for (i = 0; i < 1024; ++i) {
+                                sum -= BonFindIndexOfName(names, width, keys[i]);
+                        }
+                }
+                end = clock();
+
+                printf("  %4d members: %6.2f / %6.2f%s\n", width,
+                        NanosecondsPerIteration(start, mid, (double)rounds * 1024),
+                        NanosecondsPerIteration(mid, end, (double)rounds * 1024),
+                        sum != 0 ? "  (MISMATCH)" : "");
+        }
+}
+
+static void
+NameStringBenchmark(void) {
+        char*                   json            = MakeWideObjectJson(5000);
+        BonRecord*              br              = BonCreateRecordFromJson(json, strlen(json));
+        BonObject               object          = BonAsObject(BonGetRootValue(br));
+        void*                   indexMemory     = malloc(BonGetNameIndexSize(br));
+        struct BonNameIndex*    index           = BonCreateNameIndex(br, indexMemory);
+        const char**            strings         = (const char**)malloc(sizeof(const char*) * object.count);
+        const int               rounds          = 200;
+        size_t                  sum             = 0;
+        int                     r, i;
+        clock_t                 t0, t1, t2, t3;
+
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                for (i = 0; i < object.count; ++i) {
+                        sum += (size_t)BonGetNameString(br, object.names[i]);
+                }
+        }
+        t1 = clock();
+        for (r = 0; r < rounds; ++r) {
+                for (i = 0; i < object.count; ++i) {
+                        sum -= (size_t)BonNameIndexGetString(index, object.names[i]);
+                }
+        }
+        t2 = clock();
+        for (r = 0; r < rounds; ++r) {
+                BonGetNameStrings(br, object.names, object.count, strings);
+                sum += (size_t)strings[r % object.count] - (size_t)strings[r % object.count];
+        }
+        t3 = clock();
+        printf("Name strings, %d names: ns per name (bsearch / index / batch): %.2f / %.2f / %.2f%s\n", object.count,
+                NanosecondsPerIteration(t0, t1, (double)rounds * object.count),
+                NanosecondsPerIteration(t1, t2, (double)rounds * object.count),
+                NanosecondsPerIteration(t2, t3, (double)rounds * object.count),
+                sum != 0 ? "  (MISMATCH)" : "");
+        free(strings);
+        free(indexMemory);
+        free(br);
+        free(json);
+}
+
+static void
+PathBenchmark(void) {
+        const int               recordCount     = 20000;
+        const int               rounds          = 50;
+        BonRecord*              br;
+        uint8_t*                buffer;
+        size_t                  recordSize;
+        const BonValue**        results;
+        BonPath                 path;
+        char                    json[512];
+        double                  sum             = 0.0;
+        int                     i, r;
+        clock_t                 t0, t1, t2;
+
+        sprintf(json, "{\"id\":1,\"scene\":{\"name\":\"x\",\"lights\":[],\"meshes\":[{},{},{},{\"material\":1,\"vertices\":[1,2,3],\"name\":\"m\"}],\"camera\":{}},\"version\":2}");
+        br = BonCreateRecordFromJson(json, strlen(json));
+        recordSize = br->recordSize;
+        buffer = (uint8_t*)malloc(recordSize * recordCount);
+        results = (const BonValue**)malloc(sizeof(const BonValue*) * recordCount);
+        for (i = 0; i < recordCount; ++i) {
+                memcpy(buffer + recordSize * i, br, recordSize);
+        }
+        BonCompilePath(&path, "scene.meshes[3].vertices");
+
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                for (i = 0; i < recordCount; ++i) {
+                        const BonRecord*        record  = (const BonRecord*)(buffer + recordSize * i);
+                        BonObject               root    = BonAsObject(BonGetRootValue(record));
+                        BonObject               scene   = BonMemberAsObject(&root, BonCreateNameCstr("scene"));
+                        BonArray                meshes  = BonMemberAsArray(&scene, BonCreateNameCstr("meshes"));
+                        BonObject               mesh    = BonAsObject(&meshes.values[3]);
+                        sum += BonMemberAsNumberArray(&mesh, BonCreateNameCstr("vertices")).values[1];
+                }
+        }
+        t1 = clock();
+        for (r = 0; r < rounds; ++r) {
+                size_t n = BonEvaluatePathInRecords(&path, buffer, recordSize * recordCount, results, recordCount);
+                for (i = 0; i < (int)n; ++i) {
+                        sum -= BonAsNumberArray(results[i]).values[1];
+                }
+        }
+        t2 = clock();
+        printf("Path \"scene.meshes[3].vertices\", %d records: ns per record (chained BonMember* / compiled batch): %.2f / %.2f, batch %.0f MB/s%s\n",
+                recordCount,
+                NanosecondsPerIteration(t0, t1, (double)rounds * recordCount),
+                NanosecondsPerIteration(t1, t2, (double)rounds * recordCount),
+                (double)recordSize * recordCount * rounds / (1024.0 * 1024.0) / ((double)(t2 - t1) / CLOCKS_PER_SEC),
+                sum != 0.0 ? "  (MISMATCH)" : "");
+        free(results);
+        free(buffer);
+        free(br);
+}
+
+static void
+LookupManyBenchmark(void) {
+        static const int        widths[]        = { 8, 16, 32, 64 };
+        static const int        keyCounts[]     = { 4, 8, 16 };
+        const int               rounds          = 500000;
+        int                     w, k;
+
+        printf("Multi-key lookup: ns per object (BonFindIndexOfName per key / BonMemberLookupMany)\n");
+        for (w = 0; w < 4; ++w) {
+                char*           json    = MakeWideObjectJson(widths[w]);
+                BonRecord*      br      = BonCreateRecordFromJson(json, strlen(json));
+                BonObject       object  = BonAsObject(BonGetRootValue(br));
+                for (k = 0; k < 3 && keyCounts[k] <= widths[w]; ++k) {
+                        const int       keyCount        = keyCounts[k];
+                        BonName         keys[20];
+                        const BonValue* values[20];
+                        double          sum             = 0.0;
+                        int             r, i;
+                        clock_t         t0, t1, t2;
+
+                        for (i = 0; i < keyCount; ++i) {
+                                keys[i] = object.names[i * widths[w] / keyCount];
+                        }
+                        t0 = clock();
+                        for (r = 0; r < rounds; ++r) {
+                                for (i = 0; i < keyCount; ++i) {
+                                        const int index = BonFindIndexOfName(object.names, object.count, keys[i]);
+                                        values[i] = index >= 0 ? &object.values[index] : 0;
+                                }
+                                for (i = 0; i < keyCount; ++i) {
+                                        sum += (double)(values[i] - object.values);
+                                }
+                        }
+                        t1 = clock();
+                        for (r = 0; r < rounds; ++r) {
+                                BonMemberLookupMany(&object, keys, keyCount, values);
+                                for (i = 0; i < keyCount; ++i) {
+                                        sum -= (double)(values[i] - object.values);
+                                }
+                        }
+                        t2 = clock();
+                        printf("  %3d members, %2d keys: %7.2f / %7.2f%s\n", widths[w], keyCount,
+                                NanosecondsPerIteration(t0, t1, rounds), NanosecondsPerIteration(t1, t2, rounds),
+                                sum != 0.0 ? "  (MISMATCH)" : "");
+                }
+                free(br);
+                free(json);
+        }
+}
+
+static void
+NumberArrayBenchmark(void) {
+        const int               count   = 1 << 20;
+        const int               rounds  = 200;
+        char*                   json    = MakeNumberArrayJson(count, -1);
+        BonRecord*              br      = BonCreateRecordFromJson(json, strlen(json));
+        BonValue*               root    = (BonValue*)BonGetRootValue(br);
+        BonNumberArray          numbers;
+        int                     r, i, checked = 0;
+        clock_t                 t0, t1, t2, t3;
+
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                BonArray array = BonAsArray(root);
+                for (i = 0; i < array.count && BonGetValueType(&array.values[i]) == BON_VT_NUMBER; ++i) {
+                }
+                checked += i == array.count;
+        }
+        t1 = clock();
+        for (r = 0; r < rounds * 1000; ++r) {
+                checked += BonTryAsNumberArray(root, &numbers);
+        }
+        t2 = clock();
+        *root &= ~(BonValue)BON_ARRAY_FLAG_NUMBERS;
+        for (r = 0; r < rounds; ++r) {
+                checked += BonTryAsNumberArray(root, &numbers);
+        }
+        t3 = clock();
+        printf("Number array check, %d items: BonGetValueType loop %.1f us, flag %.2f ns, scan %.1f us (%.2f GB/s)%s\n", count,
+                NanosecondsPerIteration(t0, t1, rounds) / 1000.0, NanosecondsPerIteration(t1, t2, rounds * 1000.0), 
+                NanosecondsPerIteration(t2, t3, rounds) / 1000.0,
+                (double)count * sizeof(BonValue) * rounds / ((double)(t3 - t2) / CLOCKS_PER_SEC) / 1e9,
+                checked != rounds * 1002 ? "  (MISMATCH)" : "");
+        free(br);
+        free(json);
+}
+
+static void
+ValidationBenchmark(void) {
+        const int               objectCount     = 20000;
+        char*                   json            = (char*)malloc((size_t)objectCount * 128 + 16);
+        char*                   p               = json;
+        BonRecord*              br;
+        int                     i, r, rounds = 50, valid = 0;
+        clock_t                 t0, t1;
+
+        *p++ = '[';
+        for (i = 0; i < objectCount; ++i) {
+                p += sprintf(p, "%s{\"id\":%d,\"name\":\"item%d\",\"pos\":[%d,1.5,2.5],\"tags\":[\"a\",true,null]}", i ? "," : "", i, i, i);
+        }
+        *p++ = ']';
+        *p = 0;
+        br = BonCreateRecordFromJson(json, strlen(json));
+
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                valid += BonValidateRecordDeep(br, br->recordSize);
+        }
+        t1 = clock();
+        printf("BonValidateRecordDeep: %u byte record, %.1f us per record, %.2f GB/s%s\n", br->recordSize,
+                NanosecondsPerIteration(t0, t1, rounds) / 1000.0,
+                (double)br->recordSize * rounds / ((double)(t1 - t0) / CLOCKS_PER_SEC) / 1e9,
+                valid != rounds ? "  (MISMATCH)" : "");
+        free(br);
+        free(json);
+}
+
+/* An array of count objects. Every changeStride:th object gets another x, or another name. */
+static char*
+MakeObjectArrayJson(int count, int changeStride, BonBool changeName) {
+        char*   json    = (char*)malloc((size_t)count * 80 + 3);
+        char*   p       = json;
+        int     i;
+        *p++ = '[';
+        for (i = 0; i < count; ++i) {
+                const BonBool   changed = changeStride && i % changeStride == 0;
+                const double    x       = changed && !changeName ? -1.0 : i * 0.5;
+                p += sprintf(p, "%s{\"id\":%d,\"x\":%g,\"name\":\"%s %d\",\"tags\":[\"a\",\"b\"]}", i ? "," : "", i, x, changed && changeName ? "renamed" : "item", i);
+        }
+        *p++ = ']';
+        *p = 0;
+        return json;
+}
+
+static void
+PatchBenchmarkCase(int count, int changes, BonBool changeName) {
+        const int               rounds          = 5;
+        char*                   oldJson         = MakeObjectArrayJson(count, 0, BON_FALSE);
+        char*                   newJson         = MakeObjectArrayJson(count, count / changes, changeName);
+        BonRecord*              oldRecord       = BonCreateRecordFromJson(oldJson, strlen(oldJson));
+        BonRecord*              newRecord       = BonCreateRecordFromJson(newJson, strlen(newJson));
+        char*                   copy            = (char*)malloc(newRecord->recordSize);
+        void*                   patch           = 0;
+        size_t                  patchSize       = 0;
+        BonBool                 identical       = BON_TRUE;
+        int                     r;
+        clock_t                 t0, t1, t2, t3, t4;
+
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                free(patch);
+                patch = BonDiffRecords(oldRecord, newRecord, &patchSize);
+        }
+        t1 = clock();
+        for (r = 0; r < rounds; ++r) {
+                BonRecord* result = BonApplyPatch(oldRecord, patch, patchSize);
+                identical = identical && result && 0 == memcmp(result, newRecord, newRecord->recordSize);
+                free(result);
+        }
+        t2 = clock();
+        for (r = 0; r < rounds; ++r) {
+                free(BonCreateRecordFromJson(newJson, strlen(newJson)));
+        }
+        t3 = clock();
+        for (r = 0; r < rounds * 10; ++r) {
+                memcpy(copy, newRecord, newRecord->recordSize);
+                copy[r % newRecord->recordSize] ^= 1;
+        }
+        t4 = clock();
+        printf("Patch, %d objects, %d %s changes: record %u bytes, patch %u bytes (%.4f%%); diff %.1f ms, apply %.1f ms, "
+                "convert JSON %.1f ms, copy record %.2f ms%s\n", count, changes, changeName ? "name" : "number", 
+                newRecord->recordSize, (unsigned)patchSize, 100.0 * patchSize / newRecord->recordSize, 
+                NanosecondsPerIteration(t0, t1, rounds) / 1e6, NanosecondsPerIteration(t1, t2, rounds) / 1e6, 
+                NanosecondsPerIteration(t2, t3, rounds) / 1e6, NanosecondsPerIteration(t3, t4, rounds * 10.0) / 1e6, 
+                identical && copy[0] != 0x7f ? "" : "  (MISMATCH)");
+        free(patch);
+        free(copy);
+        free(newRecord);
+        free(oldRecord);
+        free(newJson);
+        free(oldJson);
+}
+
+/* Number changes are applied in place, name changes rebuild the record. */
+static void
+HashBenchmark(void) {
+        const int               rounds          = 20;
+        char*                   json            = MakeObjectArrayJson(100000, 0, BON_FALSE);
+        BonRecord*              br              = BonCreateRecordFromJson(json, strlen(json));
+        BonRecord*              copy            = (BonRecord*)malloc(br->recordSize);
+        const double            size            = (double)br->recordSize * rounds;
+        uint64_t                hash            = 0;
+        int                     equal           = 0;
+        int                     r;
+        clock_t                 t0, t1, t2, t3;
+
+        memcpy(copy, br, br->recordSize);
+        t0 = clock();
+        for (r = 0; r < rounds; ++r) {
+                hash += BonHashRecord(br);
+        }
+        t1 = clock();
+        for (r = 0; r < rounds; ++r) {
+                ((uint8_t*)copy)[br->recordSize - 1] ^= 1;                      /* Differ at the end every other round */
+                equal += 0 == memcmp(br, copy, br->recordSize);
+        }
+        t2 = clock();
+        for (r = 0; r < rounds; ++r) {
+                hash += BonHashValue(br, BonGetRootValue(br));
+        }
+        t3 = clock();
+        printf("Hash, %u byte record: BonHashRecord %.2f GB/s, memcmp %.2f GB/s, BonHashValue %.2f GB/s%s\n", br->recordSize,
+                size / ((double)(t1 - t0) / CLOCKS_PER_SEC) / 1e9, size / ((double)(t2 - t1) / CLOCKS_PER_SEC) / 1e9,
+                size / ((double)(t3 - t2) / CLOCKS_PER_SEC) / 1e9, equal == rounds / 2 && hash ? "" : "  (MISMATCH)");
+        free(copy);
+        free(br);
+        free(json);
+}
+
+static void
+CountChange(void* userdata, const BonPath* path, const BonValue* oldValue, const BonValue* newValue) {
+        (void)path; (void)oldValue; (void)newValue;
+        ++*(int*)userdata;
+}
+
+/* groupCount arrays of groupSize objects. A few objects are changed. */
+static char*
+MakeGroupedJson(int groupCount, int groupSize, BonBool changed) {
+        char*   json    = (char*)malloc((size_t)groupCount * groupSize * 80 + 64);
+        char*   p       = json;
+        int     i, j;
+        p += sprintf(p, "{\"groups\":[");
+        for (i = 0; i < groupCount; ++i) {
+                p += sprintf(p, "%s[", i ? "," : "");
+                for (j = 0; j < groupSize; ++j) {
+                        const BonBool change = changed && j == 0 && i % (groupCount / 4) == 0;
+                        p += sprintf(p, "%s{\"id\":%d,\"x\":%g,\"name\":\"item %d\"}", j ? "," : "", j, change ? -1.0 : j * 0.5, j);
+                }
+                *p++ = ']';
+        }
+        p += sprintf(p, "]}");
+        return json;
+}
+
+static void
+SubtreeHashBenchmark(void) {
+        const int               rounds          = 20;
+        char*                   oldJson         = MakeGroupedJson(400, 500, BON_FALSE);
+        char*                   newJson         = MakeGroupedJson(400, 500, BON_TRUE);
+        BonConvertOptions       options;
+        BonRecord*              records[4];
+        double                  ms[2];
+        int                     counts[2]       = { 0, 0 };
+        int                     i, r;
+
+        memset(&options, 0, sizeof(options));
+        options.subtreeHashes = BON_TRUE;
+        records[0] = BonCreateRecordFromJson(oldJson, strlen(oldJson));
+        records[1] = BonCreateRecordFromJson(newJson, strlen(newJson));
+        records[2] = BonCreateRecordFromJsonWithOptions(oldJson, strlen(oldJson), &options);
+        records[3] = BonCreateRecordFromJsonWithOptions(newJson, strlen(newJson), &options);
+        for (i = 0; i < 2; ++i) {
+                const clock_t t0 = clock();
+                for (r = 0; r < rounds; ++r) {
+                        BonFindChangedPaths(records[i * 2], records[i * 2 + 1], CountChange, &counts[i]);
+                }
+                ms[i] = NanosecondsPerIteration(t0, clock(), rounds) / 1e6;
+        }
+        printf("BonFindChangedPaths, %u byte record, %d changes: %.3f ms, with subtree hashes %.3f ms (%u bytes more)%s\n",
+                records[0]->recordSize, counts[0] / rounds, ms[0], ms[1], records[2]->recordSize - records[0]->recordSize,
+                counts[0] == counts[1] && counts[0] == rounds * 4 ? "" : "  (MISMATCH)");
+        for (i = 0; i < 4; ++i) {
+                free(records[i]);
+        }
+        free(newJson);
+        free(oldJson);
+}
+
+static void
+PatchBenchmark(void) {
+        PatchBenchmarkCase(100000, 5, BON_FALSE);
+        PatchBenchmarkCase(100000, 5, BON_TRUE);
+}
+
+/* Number arrays as exported from meshes, animations and tables: integers, short decimals, full precision doubles */
+static void
+NumberParseBenchmark(void) {
+        static const char*      corpora[]       = { "integers", "short decimals", "full precision", "scientific" };
+        const int               count           = 500000;
+        const int               rounds          = 5;
+        char*                   json            = (char*)malloc((size_t)count * 32 + 2);
+        const size_t            memSize         = (size_t)count * 64 + 1024 * 1024;
+        uint32_t                state           = 99;
+        int                     c, i, r;
+
+        g_linearAllocator.mem           = (uint8_t*)malloc(memSize);
+        g_linearAllocator.memEnd        = g_linearAllocator.mem + memSize;
+
+        for (c = 0; c < 4; ++c) {
+                char*           p       = json;
+                BonRecord*      br      = 0;
+                double          sum     = 0.0;
+                const char*     q;
+                clock_t         t0, t1, t2;
+                size_t          size;
+
+                *p++ = '[';
+                for (i = 0; i < count; ++i) {
+                        const uint32_t  x       = NextRandom(&state);
+                        const double    d       = (double)x / 4294967296.0 * 2000.0 - 1000.0;
+                        if (i) {
+                                *p++ = ',';
+                        }
+                        switch (c) {
+                        case 0: p += sprintf(p, "%d", (int)(x >> 12));          break;
+                        case 1: p += sprintf(p, "%.3f", d);                     break;
+                        case 2: p += sprintf(p, "%.17g", d);                    break;
+                        case 3: p += sprintf(p, "%.6e", d * 1e-9);              break;
+                        }
+                }
+                *p++ = ']';
+                size = (size_t)(p - json);
+
+                /* A linear allocator, so that the time is spent parsing rather than in malloc */
+                t0 = clock();
+                for (r = 0; r < rounds; ++r) {
+                        struct BonParsedJson* pj;
+                        g_linearAllocator.cursor = g_linearAllocator.mem;
+                        pj = BonParseJson(LinearAlloc, &g_linearAllocator, json, size);
+                        free(br);
+                        br = BonGetParsedJsonStatus(pj) == BON_STATUS_OK ? BonCreateRecordFromParsedJson(pj, malloc(BonGetBonRecordSize(pj))) : 0;
+                }
+                t1 = clock();
+                for (r = 0; r < rounds; ++r) {
+                        for (q = json + 1; q < json + size; ++q) {
+                                sum += strtod(q, (char**)&q);
+                        }
+                }
+                t2 = clock();
+                printf("Numbers, %s: %.1f ns per number, %.0f MB/s JSON to BON with a linear allocator (strtod alone %.1f ns)%s\n", corpora[c],
+                        NanosecondsPerIteration(t0, t1, (double)count * rounds),
+                        (double)size * rounds / ((double)(t1 - t0) / CLOCKS_PER_SEC) / 1e6,
+                        NanosecondsPerIteration(t1, t2, (double)count * rounds),
+                        !br || BonAsArray(BonGetRootValue(br)).count != count || sum == 0.5 ? "  (MISMATCH)" : "");
+                free(br);
+        }
+        free(g_linearAllocator.mem);
+        free(json);
+}
+
+/* Pretty printed JSON as written by most exporters: indentation, long strings with escapes, one number per line */
+static char*
+MakeExporterJson(int objectCount, size_t* size) {
+        char*                   json            = (char*)malloc((size_t)objectCount * 12000 + 16);
+        char*                   p               = json;
+        int                     i, k;
+
+        p += sprintf(p, "[\n");
+        for (i = 0; i < objectCount; ++i) {
+                p += sprintf(p, "%s        {\n                \"id\": %d,\n                \"text\": \"", i ? ",\n" : "", i);
+                for (k = 0; k < 60; ++k) {
+                        p += sprintf(p, "Line %d of the dialogue for scene %d. The captain says: \\\"Hold the line!\\\"\\n", k, i);
+                }
+                p += sprintf(p, "\",\n                \"weights\": [\n");
+                for (k = 0; k < 40; ++k) {
+                        p += sprintf(p, "                        %d%s\n", k * 7, k < 39 ? "," : "");
+                }
+                p += sprintf(p, "                ]\n        }");
+        }
+        p += sprintf(p, "\n]\n");
+        *size = (size_t)(p - json);
+        return json;
+}
+
+static void
+ParseBenchmark(void) {
+        size_t                  size;
+        char*                   json            = MakeExporterJson(2000, &size);
+        BonConvertOptions       options;
+        BonRecord*              br[2];
+        int                     i, r, rounds = 10;
+        clock_t                 t[3];
+
+        memset(&options, 0, sizeof(options));
+        for (r = 0; r < 2; ++r) {
+                options.scalarParse = r == 0 ? BON_TRUE : BON_FALSE;
+                t[r] = clock();
+                for (i = 0; i < rounds; ++i) {
+                        br[r] = BonCreateRecordFromJsonWithOptions(json, size, &options);
+                        if (i + 1 < rounds) {
+                                free(br[r]);
+                        }
+                }
+        }
+        t[2] = clock();
+        printf("JSON to BON: %u MB, byte by byte %.0f MB/s, structural index %.0f MB/s%s\n", (unsigned)(size >> 20),
+                (double)size * rounds / ((double)(t[1] - t[0]) / CLOCKS_PER_SEC) / 1e6,
+                (double)size * rounds / ((double)(t[2] - t[1]) / CLOCKS_PER_SEC) / 1e6,
+                !br[0] || !br[1] || br[0]->recordSize != br[1]->recordSize || memcmp(br[0], br[1], br[0]->recordSize) ? "  (MISMATCH)" : "");
+        free(br[0]);
+        free(br[1]);
+        free(json);
+}
+
+/* Canonicalization of wide objects and many strings, which is mostly sorting, on both engines */
+static void
+SortBenchmarkCase(const char* name, const char* json, size_t size, int rounds) {
+        BonConvertOptions       options;
+        BonRecord*              br[2];
+        clock_t                 t[3];
+        int                     e, r;
+
+        memset(&options, 0, sizeof(options));
+        for (e = 0; e < 2; ++e) {
+                options.tape = e == 1 ? BON_TRUE : BON_FALSE;
+                t[e] = clock();
+                for (r = 0; r < rounds; ++r) {
+                        br[e] = BonCreateRecordFromJsonWithOptions(json, size, &options);
+                        if (r + 1 < rounds) {
+                                free(br[e]);
+                        }
+                }
+        }
+        t[2] = clock();
+        printf("JSON to BON, %s: list %.0f MB/s, tape %.0f MB/s%s\n", name,
+                (double)size * rounds / ((double)(t[1] - t[0]) / CLOCKS_PER_SEC) / 1e6,
+                (double)size * rounds / ((double)(t[2] - t[1]) / CLOCKS_PER_SEC) / 1e6,
+                !br[0] || !br[1] || br[0]->recordSize != br[1]->recordSize || memcmp(br[0], br[1], br[0]->recordSize) ? "  (MISMATCH)" : "");
+        free(br[0]);
+        free(br[1]);
+}
+
+static void
+SortBenchmark(void) {
+        char*                   json;
+        char*                   p;
+        int                     i;
+
+        json = MakeWideObjectJson(200000);
+        SortBenchmarkCase("one object of 200000 members", json, strlen(json), 10);
+        free(json);
+
+        json = (char*)malloc(2000 * 1000 * 32 + 16);
+        p = json;
+        *p++ = '[';
+        for (i = 0; i < 2000; ++i) {
+                char* object = MakeWideObjectJson(1000);
+                p += sprintf(p, "%s%s", i ? "," : "", object);
+                free(object);
+        }
+        *p++ = ']';
+        *p = 0;
+        SortBenchmarkCase("2000 objects of 1000 members", json, (size_t)(p - json), 3);
+
+        p = json;
+        *p++ = '[';
+        for (i = 0; i < 1000000; ++i) {
+                p += sprintf(p, "%s\"string %d\"", i ? "," : "", i % 4 ? i : i / 4);
+        }
+        *p++ = ']';
+        *p = 0;
+        SortBenchmarkCase("1000000 strings", json, (size_t)(p - json), 3);
+        free(json);
+}
+
+typedef struct CountingAllocator {
+        size_t                  current;
+        size_t                  peak;
+        size_t                  count;
+} CountingAllocator;
+
+/* malloc with a size header, to measure the peak temp memory of a conversion */
+static void*
+CountingAlloc(void* userdata, size_t size) {
+        CountingAllocator*      allocator       = (CountingAllocator*)userdata;
+        size_t*                 block           = (size_t*)malloc(size + 8);
+        if (!block) {
+                return 0;
+        }
+        *block = size;
+        allocator->current += size;
+        if (allocator->current > allocator->peak) {
+                allocator->peak = allocator->current;
+        }
+        ++allocator->count;
+        return (uint8_t*)block + 8;
+}
+
+static void
+CountingFree(void* userdata, void* p) {
+        CountingAllocator*      allocator       = (CountingAllocator*)userdata;
+        size_t*                 block           = (size_t*)((uint8_t*)p - 8);
+        allocator->current -= *block;
+        free(block);
+}
+
+/* Convert with the linked lists and with the tape: peak temp memory, and throughput with malloc and with a linear allocator */
+static void
+TapeBenchmarkCase(const char* name, const char* json, size_t size) {
+        static const char*      engines[]       = { "lists", "tape " };
+        const int               rounds          = 5;
+        BonConvertOptions       options;
+        BonRecord*              br[2];
+        int                     e, r;
+
+        memset(&options, 0, sizeof(options));
+        for (e = 0; e < 2; ++e) {
+                CountingAllocator       counter;
+                struct BonParsedJson*   pj;
+                size_t                  peak, allocationCount, linearSize;
+                clock_t                 t0, t1, t2;
+
+                memset(&counter, 0, sizeof(counter));
+                options.tape    = e ? BON_TRUE : BON_FALSE;
+                pj              = BonParseJsonWithOptions(CountingAlloc, &counter, json, size, &options);
+                br[e]           = BonGetParsedJsonStatus(pj) == BON_STATUS_OK ? BonCreateRecordFromParsedJson(pj, malloc(BonGetBonRecordSize(pj))) : 0;
+                BonFreeParsedJsonMemory(pj, CountingFree, &counter);
+                peak            = counter.peak;
+                allocationCount = counter.count;
+                linearSize      = peak + allocationCount * 8 + 1024;           /* The linear allocator rounds up to 8 bytes */
+
+                t0 = clock();
+                for (r = 0; r < rounds; ++r) {
+                        pj = BonParseJsonWithOptions(CountingAlloc, &counter, json, size, &options);
+                        free(BonCreateRecordFromParsedJson(pj, malloc(BonGetBonRecordSize(pj))));
+                        BonFreeParsedJsonMemory(pj, CountingFree, &counter);
+                }
+                t1 = clock();
+                g_linearAllocator.mem           = (uint8_t*)malloc(linearSize);
+                g_linearAllocator.memEnd        = g_linearAllocator.mem + linearSize;
+                for (r = 0; r < rounds; ++r) {
+                        g_linearAllocator.cursor = g_linearAllocator.mem;
+                        pj = BonParseJsonWithOptions(LinearAlloc, &g_linearAllocator, json, size, &options);
+                        free(BonCreateRecordFromParsedJson(pj, malloc(BonGetBonRecordSize(pj))));
+                }
+                t2 = clock();
+                free(g_linearAllocator.mem);
+
+                printf("JSON to BON, %s, %s: %4.0f MB/s with malloc, %4.0f MB/s with a linear allocator, temp memory %.1fx the JSON in %u allocations\n", 
+                        name, engines[e],
+                        (double)size * rounds / ((double)(t1 - t0) / CLOCKS_PER_SEC) / 1e6,
+                        (double)size * rounds / ((double)(t2 - t1) / CLOCKS_PER_SEC) / 1e6,
+                        (double)peak / (double)size, (unsigned)allocationCount);
+        }
+        if (!br[0] || !br[1] || br[0]->recordSize != br[1]->recordSize || memcmp(br[0], br[1], br[0]->recordSize)) {
+                printf("JSON to BON, %s: MISMATCH\n", name);
+        }
+        free(br[0]);
+        free(br[1]);
+}
+
+static void
+TapeBenchmark(void) {
+        const int               count           = 300000;
+        uint32_t                state           = 17;
+        char*                   json;
+        char*                   p;
+        size_t                  size;
+        int                     i;
+
+        json = MakeExporterJson(1000, &size);
+        TapeBenchmarkCase("exported text", json, size);
+        free(json);
+
+        json = MakeObjectArrayJson(count, 0, BON_FALSE);
+        TapeBenchmarkCase("small objects", json, strlen(json));
+        free(json);
+
+        json = p = (char*)malloc((size_t)count * 16 + 2);
+        *p++ = '[';
+        for (i = 0; i < count; ++i) {
+                p += sprintf(p, "%s%.3f", i ? "," : "", (double)NextRandom(&state) / 4294967296.0 * 2000.0 - 1000.0);
+        }
+        *p++ = ']';
+        TapeBenchmarkCase("numbers", json, (size_t)(p - json));
+        free(json);
+}
+
+/* Wall clock seconds. Outside Windows clock() adds up the time of all threads. */
+static double
+WallSeconds(void) {
+#if defined(_WIN32)
+        return (double)clock() / CLOCKS_PER_SEC;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Convert on 1 to 32 threads. The speedup is against the tape engine on the calling thread. */
+static void
+ParallelBenchmarkCase(const char* name, const char* json, size_t size) {
+        static const int        threadCounts[]  = { 1, 2, 4, 8, 16, 32 };
+        const int               rounds          = 3;
+        BonConvertOptions       options;
+        BonRecord*              reference       = 0;
+        double                  single          = 0.0;
+        int                     t, r;
+
+        memset(&options, 0, sizeof(options));
+        options.tape = BON_TRUE;
+        for (t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+                BonRecord*      br      = 0;
+                double          t0, seconds;
+
+                options.threadCount = threadCounts[t];
+                t0 = WallSeconds();
+                for (r = 0; r < rounds; ++r) {
+                        free(br);
+                        br = BonCreateRecordFromJsonWithOptions(json, size, &options);
+                }
+                seconds = (WallSeconds() - t0) / rounds;
+                if (t == 0) {
+                        single          = seconds;
+                        reference       = br;
+                } else {
+                        if (!br || br->recordSize != reference->recordSize || memcmp(br, reference, br->recordSize)) {
+                                printf("JSON to BON on %d threads, %s: MISMATCH\n", threadCounts[t], name);
+                        }
+                        free(br);
+                }
+                printf("JSON to BON on %2d threads, %s: %5.0f MB/s, %.2fx\n", threadCounts[t], name, (double)size / seconds / 1e6, single / seconds);
+        }
+        free(reference);
+}
+
+static void
+ParallelBenchmark(void) {
+        size_t                  size;
+        char*                   json;
+
+        json = MakeExporterJson(10000, &size);
+        ParallelBenchmarkCase("exported text", json, size);
+        free(json);
+
+        json = MakeObjectArrayJson(1000000, 0, BON_FALSE);
+        ParallelBenchmarkCase("small objects", json, strlen(json));
+        free(json);
+}
+
+static BonBool
+LoadBenchmarkText(void* userdata, BonBatchItem* item) {
+        BatchTexts*             texts           = (BatchTexts*)userdata;
+
+        item->jsonData          = texts->texts[0];
+        item->jsonDataSize      = texts->sizes[0];
+        return BON_TRUE;
+}
+
+static void
+StoreBenchmarkText(void* userdata, BonBatchItem* item) {
+        (void)userdata;
+        free(item->record);
+}
+
+/* Convert many copies of a text one at a time and as a batch on 1 to 8 threads */
+static void
+BatchBenchmarkCase(const char* name, const char* json, size_t size, int count) {
+        static const int        threadCounts[]  = { 1, 2, 4, 8 };
+        BatchTexts              texts;
+        double                  t0, seconds, single;
+        int                     i, t;
+
+        memset(&texts, 0, sizeof(texts));
+        texts.texts     = &json;
+        texts.sizes     = &size;
+
+        t0 = WallSeconds();
+        for (i = 0; i < count; ++i) {
+                free(BonCreateRecordFromJson(json, size));
+        }
+        single = WallSeconds() - t0;
+        printf("JSON to BON one at a time, %d %s: %7.0f texts/s, %5.0f MB/s\n", count, name, count / single, (double)size * count / single / 1e6);
+
+        for (t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+                t0 = WallSeconds();
+                if (BonConvertBatch((size_t)count, LoadBenchmarkText, StoreBenchmarkText, &texts, 0, threadCounts[t]) != 0) {
+                        printf("JSON to BON as a batch, %s: FAILED\n", name);
+                }
+                seconds = WallSeconds() - t0;
+                printf("JSON to BON as a batch on %d threads, %d %s: %7.0f texts/s, %5.0f MB/s, %.2fx\n", threadCounts[t], count, name, 
+                        count / seconds, (double)size * count / seconds / 1e6, single / seconds);
+        }
+}
+
+static void
+BatchBenchmark(void) {
+        size_t                  size;
+        char*                   json;
+
+        json = MakeObjectArrayJson(20, 0, BON_FALSE);
+        BatchBenchmarkCase("small texts", json, strlen(json), 20000);
+        free(json);
+
+        json = MakeExporterJson(100, &size);
+        BatchBenchmarkCase("exported texts", json, size, 200);
+        free(json);
+}
+
+static void
+Benchmarks(void) {
+        SearchBenchmark();
+        NameStringBenchmark();
+        PathBenchmark();
+        LookupManyBenchmark();
+        NumberArrayBenchmark();
+        ValidationBenchmark();
+        PatchBenchmark();
+        HashBenchmark();
+        SubtreeHashBenchmark();
+        ParseBenchmark();
+        NumberParseBenchmark();
+        SortBenchmark();
+        TapeBenchmark();
+        ParallelBenchmark();
+        BatchBenchmark();
+}
+
 int 
 main(int argc, char** argv) {
 	SearchTest();
+        WideSearchTest();
         ParseTests();
+        NameStringTest();
+        LookupManyTest();
+        PathTest();
+        TypedArrayTest();
+        NumberArrayTest();
+        ValidationTest();
+        MapTest();
+        PackTest();
+        NameDictionaryTest();
+        StringLengthTest();
+        PatchTest();
+        HashTest();
+        SubtreeHashTest();
+        StripNamesTest();
+        WideRecordTest();
+        StructuralIndexTest();
+        NumberParseTest();
+        TapeTest();
+        StreamTest();
+        ParallelTest();
+        TypedRootTest();
+        SortDuplicateNamesTest();
+        BatchTest();
         /*BigTest();*/
+        if (argc > 1 && 0 == strcmp(argv[1], "-bench")) {
+                Benchmarks();
+        }
 #ifdef _WIN32
         _CrtDumpMemoryLeaks();
 #endif
@@ -1,6 +1,8 @@
 /* vi: set ts=8 sts=8 sw=8 et: */
 #include "Bon.h"
 #include "BonConvert.h"
+#include "BonMap.h"
+#include "BonPack.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -8,6 +10,21 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <time.h>
+#if defined(BONTOOL_BONPACK)
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+#endif
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
 
 static uint8_t* 
 LoadAll(size_t* filesizeOut, const char* fn) {
@@ -51,7 +68,7 @@ WriteRecordToDisk(const BonRecord* br, const char* fn) {
         FILE* f = fopen(fn, "wb");
         if (!f)
                 return BON_FALSE;
-        fwrite(br, br->recordSize, 1, f);
+        fwrite(br, (size_t)BonGetRecordSize(br), 1, f);
         fclose(f);
         return BON_TRUE;
 }
@@ -62,22 +79,309 @@ Usage(const char* msg) {
         exit(-1);
 }
 
+static void*
+TempAlloc(void* userdata, size_t size) {
+        (void)userdata;
+        return malloc(size);
+}
+
+static void
+TempFree(void* userdata, void* p) {
+        (void)userdata;
+        free(p);
+}
+
+/* Convert JSON from a stream with the push parser, a chunk at a time */
+static BonRecord*
+StreamRecordFromJson(FILE* input, const BonConvertOptions* options) {
+        struct BonParsedJson*   pj              = BonParserBegin(TempAlloc, 0, options);
+        BonRecord*              record          = 0;
+        char*                   chunk           = (char*)malloc(64 * 1024);
+        size_t                  n;
+
+#if defined(_WIN32)
+        _setmode(_fileno(input), _O_BINARY);
+#endif
+        if (pj && chunk) {
+                while ((n = fread(chunk, 1, 64 * 1024, input)) > 0) {
+                        if (BonParserFeed(pj, chunk, n) != BON_STATUS_OK)
+                                break;
+                }
+                if (BonParserFinish(pj) == BON_STATUS_OK) {
+                        record = (BonRecord*)malloc(BonGetBonRecordSize(pj));
+                        if (record) {
+                                BonCreateRecordFromParsedJson(pj, record);
+                        }
+                }
+        }
+        free(chunk);
+        BonFreeParsedJsonMemory(pj, TempFree, 0);
+        return record;
+}
+
+/* The texts of Json2Bon -b: one input and output file per line of the list */
+typedef struct BatchFiles {
+        char**                  inputs;
+        char**                  outputs;
+        size_t                  fileCount;
+        size_t*                 byteCounts;
+        double*                 seconds;
+} BatchFiles;
+
+static BonBool
+LoadBatchFile(void* userdata, BonBatchItem* item) {
+        BatchFiles*             files           = (BatchFiles*)userdata;
+        uint8_t*                jsonData        = LoadAll(&item->jsonDataSize, files->inputs[item->index]);
+
+        item->jsonData = (const char*)jsonData;
+        return jsonData != 0;
+}
+
+static void
+StoreBatchFile(void* userdata, BonBatchItem* item) {
+        BatchFiles*             files           = (BatchFiles*)userdata;
+        const char*             input           = files->inputs[item->index];
+
+        if (item->status == BON_STATUS_LOAD_FAILED) {
+                fprintf(stderr, "%s: failed to load\n", input);
+        } else if (!item->record) {
+                fprintf(stderr, "%s: failed to parse JSON (status %d)\n", input, item->status);
+        } else if (!WriteRecordToDisk(item->record, files->outputs[item->index])) {
+                fprintf(stderr, "%s: failed to write %s\n", input, files->outputs[item->index]);
+        } else {
+                files->byteCounts[item->index]  = item->jsonDataSize;
+                files->seconds[item->index]     = item->seconds;
+                printf("%s: %lu bytes in %.3f ms, %.1f MB/s\n", input, (unsigned long)item->jsonDataSize, item->seconds * 1000.0, 
+                        item->seconds > 0.0 ? (double)item->jsonDataSize / item->seconds / (1024.0 * 1024.0) : 0.0);
+        }
+        free(item->record);
+        free((void*)item->jsonData);
+}
+
+/* Wall clock seconds, also when other threads run (clock() is process time on POSIX) */
+static double
+WallSeconds(void) {
+#if defined(_WIN32)
+        return (double)clock() / CLOCKS_PER_SEC;
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* Copy the file name with its extension replaced, or appended. A null extension keeps the name as is. */
+static char*
+ReplaceExtension(const char* path, const char* extension) {
+        const char*             dot             = strrchr(path, '.');
+        const char*             slash           = strrchr(path, '/');
+        const char*             backslash       = strrchr(path, '\\');
+        size_t                  length          = strlen(path);
+        char*                   result;
+
+        if (!extension)
+                extension = "";
+        if (backslash && (!slash || backslash > slash))
+                slash = backslash;
+        if (*extension && dot && dot > path && (!slash || dot > slash + 1))
+                length = (size_t)(dot - path);
+        result = (char*)malloc(length + strlen(extension) + 1);
+        if (result) {
+                memcpy(result, path, length);
+                strcpy(result + length, extension);
+        }
+        return result;
+}
+
+/* Split a list file into lines of "input<TAB>output" or just "input", which is written to input.bon */
+static BonBool
+ReadBatchList(BatchFiles* files, char* list, size_t listSize) {
+        size_t                  lineCount       = 1;
+        size_t                  i;
+        char*                   line;
+
+        for (i = 0; i < listSize; ++i) {
+                lineCount += list[i] == '\n';
+        }
+        files->inputs           = (char**)calloc(lineCount, sizeof(char*));
+        files->outputs          = (char**)calloc(lineCount, sizeof(char*));
+        files->byteCounts       = (size_t*)calloc(lineCount, sizeof(size_t));
+        files->seconds          = (double*)calloc(lineCount, sizeof(double));
+        if (!files->inputs || !files->outputs || !files->byteCounts || !files->seconds)
+                return BON_FALSE;
+
+        for (line = list; line < list + listSize; ) {
+                char*           end             = (char*)memchr(line, '\n', (size_t)(list + listSize - line));
+                char*           next            = end ? end + 1 : list + listSize;
+                char*           tab;
+
+                if (!end)
+                        end = list + listSize;
+                while (end > line && (end[-1] == '\r' || end[-1] == ' '))
+                        --end;
+                *end = 0;
+                if (end > line) {
+                        tab = strchr(line, '\t');
+                        if (tab) {
+                                *tab = 0;
+                                files->outputs[files->fileCount] = ReplaceExtension(tab + 1, 0);
+                        } else {
+                                files->outputs[files->fileCount] = ReplaceExtension(line, ".bon");
+                        }
+                        if (!files->outputs[files->fileCount])
+                                return BON_FALSE;
+                        files->inputs[files->fileCount++] = line;
+                }
+                line = next;
+        }
+        return BON_TRUE;
+}
+
+/* Convert the files of a list on a pool of threads, printing the throughput of each and of all */
+static int
+Json2BonBatch(const char* listFileName, const BonConvertOptions* options, int threadCount) {
+        BatchFiles              files;
+        size_t                  listSize;
+        char*                   list;
+        size_t                  failureCount;
+        size_t                  byteCount       = 0;
+        double                  seconds         = 0.0;
+        double                  wallSeconds;
+        double                  start;
+        size_t                  i;
+
+        memset(&files, 0, sizeof(files));
+        list = (char*)LoadAll(&listSize, listFileName);
+        if (!list) {
+                fprintf(stderr, "Failed to load file list %s\n", listFileName);
+                exit(-2);
+        }
+        list = (char*)realloc(list, listSize + 1);                              /* Room for the terminator of the last line */
+        if (!list || !ReadBatchList(&files, list, listSize)) {
+                fprintf(stderr, "Out of memory\n");
+                exit(-2);
+        }
+
+        start           = WallSeconds();
+        failureCount    = BonConvertBatch(files.fileCount, LoadBatchFile, StoreBatchFile, &files, options, threadCount);
+        wallSeconds     = WallSeconds() - start;
+        for (i = 0; i < files.fileCount; ++i) {
+                byteCount       += files.byteCounts[i];
+                seconds         += files.seconds[i];
+        }
+        printf("%lu files, %.1f MB in %.3f s on %d threads: %.1f MB/s, %.1f files/s (%.1f MB/s per conversion)\n",
+                (unsigned long)files.fileCount, (double)byteCount / (1024.0 * 1024.0), wallSeconds, threadCount,
+                wallSeconds > 0.0 ? (double)byteCount / wallSeconds / (1024.0 * 1024.0) : 0.0,
+                wallSeconds > 0.0 ? (double)files.fileCount / wallSeconds : 0.0,
+                seconds > 0.0 ? (double)byteCount / seconds / (1024.0 * 1024.0) : 0.0);
+        if (failureCount) {
+                fprintf(stderr, "%lu files failed\n", (unsigned long)failureCount);
+        }
+
+        for (i = 0; i < files.fileCount; ++i) {
+                free(files.outputs[i]);
+        }
+        free(files.inputs);
+        free(files.outputs);
+        free(files.byteCounts);
+        free(files.seconds);
+        free(list);
+        return failureCount ? -2 : 0;
+}
+
 static int 
 Json2Bon(int argc, char** argv) {
-        const char*             usage           = "Convert a JSON file to a BON record.\nUsage: Json2Bon <input json-file> <output bon-file>\n";
+        const char*             usage           = "Convert a JSON file to a BON record.\n"
+                                                  "Usage: Json2Bon [-t lossless|float32] [-d <dictionary-file>] [-j <threads>] [-h] [-w] [-l] <input json-file> <output bon-file>\n"
+                                                  "       Json2Bon [options] -b <list-file>\n"
+                                                  "  An input of - reads the JSON from stdin as it arrives, without holding all of it.\n"
+                                                  "  -b    Convert the files in the list on a pool of threads (see -j) and print the throughput.\n"
+                                                  "        Each line is <input json-file>[<TAB><output bon-file>], by default the input with .bon.\n"
+                                                  "  -t    Write homogeneous number arrays as packed typed arrays.\n"
+                                                  "        float32 also rounds arrays that doesn't fit any type exactly.\n"
+                                                  "  -d    Leave out names that are in a shared name dictionary (see BonNameDict).\n"
+                                                  "  -j    Convert a large file on up to this many threads. The same record.\n"
+                                                  "        With -b, the number of files converted at once instead.\n"
+                                                  "  -h    Store a hash of every object and array for fast change detection.\n"
+                                                  "  -w    Write a wide record with 64-bit offsets, as for records over 2 GB.\n"
+                                                  "  -l    Convert through a flat tape: the same record with less temporary memory.\n";
         uint8_t*                jsonData;
         size_t                  jsonDataSize;
         BonRecord*              record;
+        BonConvertOptions       options;
+        BonMappedFile           dictionaryFile;
+        const char*             listFileName    = 0;
+        int                     result;
 
+        memset(&options, 0, sizeof(options));
+        memset(&dictionaryFile, 0, sizeof(dictionaryFile));
+        while (argc > 2 && argv[1][0] == '-' && argv[1][1]) {
+                if (0 == strcmp(argv[1], "-h")) {
+                        options.subtreeHashes = BON_TRUE;
+                        argc -= 1;
+                        argv += 1;
+                        continue;
+                }
+                if (0 == strcmp(argv[1], "-w")) {
+                        options.wideOffsets = BON_TRUE;
+                        argc -= 1;
+                        argv += 1;
+                        continue;
+                }
+                if (0 == strcmp(argv[1], "-l")) {
+                        options.tape = BON_TRUE;
+                        argc -= 1;
+                        argv += 1;
+                        continue;
+                }
+                if (0 == strcmp(argv[1], "-t")) {
+                        if (0 == strcmp(argv[2], "lossless")) {
+                                options.typedArrays = BON_TYPED_ARRAYS_LOSSLESS;
+                        } else if (0 == strcmp(argv[2], "float32")) {
+                                options.typedArrays = BON_TYPED_ARRAYS_FLOAT32;
+                        } else {
+                                Usage(usage);
+                        }
+                        options.typedArrayMinCount = 2;
+                } else if (0 == strcmp(argv[1], "-j")) {
+                        options.threadCount = atoi(argv[2]);
+                        if (options.threadCount < 1) {
+                                Usage(usage);
+                        }
+                } else if (0 == strcmp(argv[1], "-b")) {
+                        listFileName = argv[2];
+                } else if (0 == strcmp(argv[1], "-d")) {
+                        options.nameDictionary = BonMapRecordFile(&dictionaryFile, argv[2], BON_MAP_VALIDATE_DEEP);
+                        if (!options.nameDictionary) {
+                                fprintf(stderr, "Failed to load name dictionary %s\n", argv[2]);
+                                exit(-2);
+                        }
+                } else {
+                        Usage(usage);
+                }
+                argc -= 2;
+                argv += 2;
+        }
+        if (listFileName) {
+                if (argc != 1)
+                        Usage(usage);
+                result = Json2BonBatch(listFileName, &options, options.threadCount > 0 ? options.threadCount : 1);
+                BonUnmapRecord(&dictionaryFile);
+                return result;
+        }
         if (argc != 3) 
                 Usage(usage);
-        jsonData = LoadAll(&jsonDataSize, argv[1]);
-        if (!jsonData)
-                Usage(usage);
-        
-        record = BonCreateRecordFromJson((const char*)jsonData, jsonDataSize);
-        
-        free(jsonData);
+        if (0 == strcmp(argv[1], "-")) {
+                record = StreamRecordFromJson(stdin, &options);
+        } else {
+                jsonData = LoadAll(&jsonDataSize, argv[1]);
+                if (!jsonData)
+                        Usage(usage);
+                
+                record = BonCreateRecordFromJsonWithOptions((const char*)jsonData, jsonDataSize, &options);
+                
+                free(jsonData);
+        }
 
         if (!record) {
                 fprintf(stderr, "Failed to parse JSON file\n");
@@ -87,25 +391,57 @@ Json2Bon(int argc, char** argv) {
                 Usage(usage);
 
         free(record);
+        BonUnmapRecord(&dictionaryFile);
 
         return 0;
 }
 
+static const char*
+RecordNameProvider(void* userdata, BonName name, size_t* byteCount) {
+        return BonGetNameStringWithLength((const BonRecord*)userdata, name, byteCount);
+}
+
 static int 
 Bon2Json(int argc, char** argv) {
-        const char*             usage           = "Convert a BON record to a JSON file.\nUsage: Bon2Json <input bon-file> [<output json-file>]\n";
-        uint8_t*                bonData;
-        size_t                  bonDataSize;
+        const char*             usage           = "Convert a BON record to a JSON file.\n"
+                                                  "Usage: Bon2Json [-d <dictionary-file>] [-n <names bon-file>] <input bon-file> [<output json-file>]\n"
+                                                  "  -d    Shared name dictionary the record was converted with.\n"
+                                                  "  -n    Record to take missing names from, e.g. the original of a BonStrip:ed record.\n";
+        BonMappedFile           file;
+        BonMappedFile           dictionaryFile;
+        BonMappedFile           namesFile;
+        const BonRecord*        record;
+        const BonRecord*        dictionary      = 0;
+        const BonRecord*        names           = 0;
         FILE*                   output          = stdout;
 
+        memset(&dictionaryFile, 0, sizeof(dictionaryFile));
+        memset(&namesFile, 0, sizeof(namesFile));
+        while (argc > 3 && argv[1][0] == '-') {
+                if (0 == strcmp(argv[1], "-d") && !dictionary) {
+                        dictionary = BonMapRecordFile(&dictionaryFile, argv[2], BON_MAP_VALIDATE_DEEP);
+                        if (!dictionary) {
+                                fprintf(stderr, "Failed to load name dictionary %s\n", argv[2]);
+                                exit(-2);
+                        }
+                        BonRegisterNameDictionary(dictionary);
+                } else if (0 == strcmp(argv[1], "-n") && !names) {
+                        names = BonMapRecordFile(&namesFile, argv[2], BON_MAP_VALIDATE_DEEP);
+                        if (!names) {
+                                fprintf(stderr, "Failed to load names from %s\n", argv[2]);
+                                exit(-2);
+                        }
+                } else {
+                        Usage(usage);
+                }
+                argc -= 2;
+                argv += 2;
+        }
         if (argc < 2 || argc > 3) 
                 Usage(usage);
-        bonData = LoadAll(&bonDataSize, argv[1]);
-        if (!bonData)
-                Usage(usage);
-
-        if (!BonIsAValidRecord((const BonRecord*)bonData, bonDataSize)) {
-                fprintf(stderr, "Input file is not a valid BON record.\n");
+        record = BonMapRecordFile(&file, argv[1], BON_MAP_WILLNEED | BON_MAP_VALIDATE_DEEP);
+        if (!record) {
+                fprintf(stderr, "Input file is missing or is not a valid BON record.\n");
                 exit(-2);
         }
 
@@ -117,39 +453,468 @@ Bon2Json(int argc, char** argv) {
                 }
         }
 
-        BonWriteAsJsonToStream((const BonRecord*)bonData, output);
+        BonWriteAsJsonToStreamWithNames(record, output, names ? RecordNameProvider : 0, (void*)names);
         
         if (argc == 3) {
                 fclose(output);
         }
 
-        free(bonData);
+        BonUnmapRecord(&file);
+        if (names) {
+                BonUnmapRecord(&namesFile);
+        }
+        if (dictionary) {
+                BonUnregisterNameDictionary(dictionary);
+                BonUnmapRecord(&dictionaryFile);
+        }
         return 0;
 }
 
 static int 
 DumpBon(int argc, char** argv) {
         const char* usage = "Dump a BON record in a raw format.\nUsage: BonDump <input bon-file>\n";
-        uint8_t* bonData = 0;
-        size_t bonDataSize;
-        BonRecord* record = 0;
+        BonMappedFile file;
+        const BonRecord* record = 0;
 
         if (argc != 2) 
                 Usage(usage);
-        bonData = LoadAll(&bonDataSize, argv[1]);
-        if (!bonData)
+        record = BonMapRecordFile(&file, argv[1], BON_MAP_SEQUENTIAL);
+        if (!record) {
+                fprintf(stderr, "Missing or invalid BON record\n");
+                exit(-2);
+        }
+
+        BonDebugWrite(record, stdout);
+        BonUnmapRecord(&file);
+        return 0;
+}
+
+#if defined(BONTOOL_BONPACK)
+typedef void (*FileNameCallback)(void* userdata, const char* fileName);
+
+static BonBool
+ForEachFileInDirectory(const char* directory, FileNameCallback callback, void* userdata) {
+#if defined(_WIN32)
+        char                    pattern[4096];
+        WIN32_FIND_DATAA        data;
+        HANDLE                  find;
+        snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+        find = FindFirstFileA(pattern, &data);
+        if (find == INVALID_HANDLE_VALUE)
+                return BON_FALSE;
+        do {
+                if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+                        callback(userdata, data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+#else
+        struct dirent*          entry;
+        DIR*                    dir     = opendir(directory);
+        if (!dir)
+                return BON_FALSE;
+        while ((entry = readdir(dir)) != 0) {
+                if (entry->d_name[0] != '.')
+                        callback(userdata, entry->d_name);
+        }
+        closedir(dir);
+#endif
+        return BON_TRUE;
+}
+
+typedef struct PackInput {
+        const char*             directory;
+        BonPackItem*            items;
+        BonMappedFile*          files;                                          /* Mapped .bon files, to unmap when done */
+        BonRecord**             records;                                        /* Converted .json files, to free when done */
+        int                     count;
+        int                     capacity;
+        int                     failed;
+} PackInput;
+
+static void
+AddFileToPack(void* userdata, const char* fileName) {
+        PackInput*              input   = (PackInput*)userdata;
+        const char*             ext     = strrchr(fileName, '.');
+        char                    path[4096];
+        const BonRecord*        record  = 0;
+        int                     i       = input->count;
+
+        if (!ext || (0 != strcmp(ext, ".bon") && 0 != strcmp(ext, ".json")))
+                return;
+        if (input->count == input->capacity) {
+                input->capacity = input->capacity ? input->capacity * 2 : 256;
+                input->items    = (BonPackItem*)realloc(input->items, input->capacity * sizeof(BonPackItem));
+                input->files    = (BonMappedFile*)realloc(input->files, input->capacity * sizeof(BonMappedFile));
+                input->records  = (BonRecord**)realloc(input->records, input->capacity * sizeof(BonRecord*));
+                if (!input->items || !input->files || !input->records) {
+                        fprintf(stderr, "Out of memory\n");
+                        exit(-4);
+                }
+        }
+        snprintf(path, sizeof(path), "%s/%s", input->directory, fileName);
+        memset(&input->files[i], 0, sizeof(BonMappedFile));
+        input->records[i] = 0;
+        if (0 == strcmp(ext, ".bon")) {
+                record = BonMapRecordFile(&input->files[i], path, BON_MAP_SEQUENTIAL | BON_MAP_VALIDATE_DEEP);
+        } else {
+                size_t          jsonDataSize;
+                uint8_t*        jsonData        = LoadAll(&jsonDataSize, path);
+                if (jsonData) {
+                        input->records[i] = BonCreateRecordFromJson((const char*)jsonData, jsonDataSize);
+                        record = input->records[i];
+                        free(jsonData);
+                }
+        }
+        if (!record) {
+                fprintf(stderr, "Skipping %s: not a valid record\n", path);
+                input->failed++;
+                return;
+        }
+        input->items[i].key     = BonCreateName(fileName, (size_t)(ext - fileName));
+        input->items[i].record  = record;
+        input->count++;
+}
+
+static int
+PackBon(int argc, char** argv) {
+        const char*             usage   = "Pack all .bon and .json files in a directory into one pack file.\n"
+                                          "A record's key is its file name without extension.\n"
+                                          "Usage: BonPack <input directory> <output pack-file>\n";
+        PackInput               input;
+        FILE*                   output;
+        BonBool                 written;
+        int                     i;
+
+        if (argc != 3)
                 Usage(usage);
+        memset(&input, 0, sizeof(input));
+        input.directory = argv[1];
+        if (!ForEachFileInDirectory(argv[1], AddFileToPack, &input)) {
+                fprintf(stderr, "Failed to read directory %s\n", argv[1]);
+                exit(-2);
+        }
+        output = fopen(argv[2], "wb");
+        if (!output) {
+                fprintf(stderr, "Failed to open output file\n");
+                exit(-3);
+        }
+        written = BonWritePack(input.items, input.count, output);
+        fclose(output);
+        if (!written) {
+                fprintf(stderr, "Failed to write pack (two file names may have the same key hash)\n");
+                exit(-2);
+        }
+        printf("Packed %d records (%d skipped)\n", input.count, input.failed);
 
-        record = (BonRecord*)bonData;
-        
-        if (!BonIsAValidRecord(record, bonDataSize)) {
-                fprintf(stderr, "Invalid BON record\n");
+        for (i = 0; i < input.count; ++i) {
+                BonUnmapRecord(&input.files[i]);
+                free(input.records[i]);
+        }
+        free(input.items);
+        free(input.files);
+        free(input.records);
+        return 0;
+}
+#endif
+
+#if defined(BONTOOL_BONNAMEDICT)
+typedef struct NameCount {
+        BonName                 name;
+        int                     recordCount;                                    /* Number of records that use the name */
+        int                     lastRecord;                                     /* Index + 1 of the last record that counted the name */
+        const char*             string;
+} NameCount;
+
+typedef struct NameCounter {
+        NameCount*              slots;
+        uint32_t                mask;
+        uint32_t                used;
+} NameCounter;
+
+static const char*
+CopyString(const char* string) {
+        const size_t    size    = strlen(string) + 1;
+        char*           copy    = (char*)malloc(size);
+        if (!copy) {
+                fprintf(stderr, "Out of memory\n");
+                exit(-4);
+        }
+        return (const char*)memcpy(copy, string, size);
+}
+
+static void
+CountName(NameCounter* counter, const BonRecord* record, int recordIndex, BonName name) {
+        uint32_t slot;
+
+        if (counter->used * 2 >= counter->mask) {
+                NameCounter     grown;
+                uint32_t        i;
+                grown.mask      = counter->mask ? counter->mask * 2 + 1 : 1023;
+                grown.used      = counter->used;
+                grown.slots     = (NameCount*)calloc(grown.mask + 1, sizeof(NameCount));
+                if (!grown.slots) {
+                        fprintf(stderr, "Out of memory\n");
+                        exit(-4);
+                }
+                for (i = 0; counter->slots && i <= counter->mask; ++i) {
+                        if (counter->slots[i].string) {
+                                slot = counter->slots[i].name & grown.mask;
+                                while (grown.slots[slot].string) {
+                                        slot = (slot + 1) & grown.mask;
+                                }
+                                grown.slots[slot] = counter->slots[i];
+                        }
+                }
+                free(counter->slots);
+                *counter = grown;
+        }
+
+        slot = name & counter->mask;
+        while (counter->slots[slot].string && counter->slots[slot].name != name) {
+                slot = (slot + 1) & counter->mask;
+        }
+        if (!counter->slots[slot].string) {
+                const char* string = BonGetNameString(record, name);
+                if (!string)
+                        return;
+                counter->slots[slot].name       = name;
+                counter->slots[slot].string     = CopyString(string);
+                counter->used++;
+        }
+        if (counter->slots[slot].lastRecord != recordIndex + 1) {
+                counter->slots[slot].lastRecord = recordIndex + 1;
+                counter->slots[slot].recordCount++;
+        }
+}
+
+static void
+CountNamesInValue(NameCounter* counter, const BonRecord* record, int recordIndex, const BonValue* value) {
+        int i;
+        if (BonGetValueType(value) == BON_VT_OBJECT) {
+                BonObject object = BonAsObject(value);
+                for (i = 0; i < object.count; ++i) {
+                        CountName(counter, record, recordIndex, object.names[i]);
+                        CountNamesInValue(counter, record, recordIndex, &object.values[i]);
+                }
+        } else if (BonGetValueType(value) == BON_VT_ARRAY) {
+                BonArray array = BonAsArray(value);
+                for (i = 0; i < array.count; ++i) {
+                        CountNamesInValue(counter, record, recordIndex, &array.values[i]);
+                }
+        }
+}
+
+static size_t
+NameCost(const char* string) {
+        return sizeof(BonNameAndOffset) + ((strlen(string) + 1 + 7) & ~(size_t)7);   /* Table entry and padded string */
+}
+
+static int
+NameDict(int argc, char** argv) {
+        const char*             usage           = "Build a shared name dictionary from a set of records.\n"
+                                                  "Names used by at least two of the records go into the dictionary.\n"
+                                                  "Usage: BonNameDict <output dictionary-file> <input bon- or json-file>...\n";
+        NameCounter             counter;
+        const char**            names;
+        BonRecord*              dictionary;
+        uint64_t                totalSize       = 0;
+        uint64_t                savedSize       = 0;
+        int                     nameCount       = 0;
+        int                     recordCount     = 0;
+        int                     i;
+        uint32_t                slot;
+
+        if (argc < 3)
+                Usage(usage);
+        memset(&counter, 0, sizeof(counter));
+        for (i = 2; i < argc; ++i) {
+                const char*     ext     = strrchr(argv[i], '.');
+                BonMappedFile   file;
+                BonRecord*      converted       = 0;
+                const BonRecord* record;
+                if (ext && 0 == strcmp(ext, ".json")) {
+                        size_t          jsonDataSize;
+                        uint8_t*        jsonData        = LoadAll(&jsonDataSize, argv[i]);
+                        record = converted = jsonData ? BonCreateRecordFromJson((const char*)jsonData, jsonDataSize) : 0;
+                        free(jsonData);
+                } else {
+                        record = BonMapRecordFile(&file, argv[i], BON_MAP_SEQUENTIAL | BON_MAP_VALIDATE_DEEP);
+                }
+                if (!record) {
+                        fprintf(stderr, "Skipping %s: not a valid record\n", argv[i]);
+                        continue;
+                }
+                totalSize += BonGetRecordSize(record);
+                CountNamesInValue(&counter, record, recordCount++, BonGetRootValue(record));
+                if (converted) {
+                        free(converted);
+                } else {
+                        BonUnmapRecord(&file);
+                }
+        }
+
+        /* A name used by n records costs n table entries and strings. In the dictionary it costs one. */
+        names = (const char**)malloc((counter.used + 1) * sizeof(const char*));
+        for (slot = 0; counter.slots && slot <= counter.mask; ++slot) {
+                const NameCount* c = &counter.slots[slot];
+                if (c->string && c->recordCount >= 2) {
+                        names[nameCount++] = c->string;
+                        savedSize += (uint64_t)(c->recordCount - 1) * NameCost(c->string);
+                }
+        }
+        dictionary = BonCreateNameDictionary(names, nameCount);
+        if (!dictionary || !WriteRecordToDisk(dictionary, argv[1])) {
+                fprintf(stderr, "Failed to write dictionary\n");
+                exit(-3);
+        }
+        printf("%d records, %u distinct names, %d in the dictionary (%u bytes)\n", recordCount, counter.used, nameCount, dictionary->recordSize);
+        printf("Records: %llu bytes, saved %llu bytes (%.1f%%) less the dictionary\n", (unsigned long long)totalSize, 
+                (unsigned long long)savedSize, totalSize ? 100.0 * (double)savedSize / (double)totalSize : 0.0);
+
+        for (slot = 0; counter.slots && slot <= counter.mask; ++slot) {
+                free((void*)counter.slots[slot].string);
+        }
+        free(counter.slots);
+        free(names);
+        free(dictionary);
+        return 0;
+}
+#endif
+
+#if defined(BONTOOL_BONDIFF)
+static int
+DiffBon(int argc, char** argv) {
+        const char*             usage           = "Create a patch between two BON records, or apply one.\n"
+                                                  "Usage: BonDiff [-d <dictionary-file>] <old bon-file> <new bon-file> <output patch-file>\n"
+                                                  "       BonDiff [-d <dictionary-file>] -a <old bon-file> <patch-file> <output bon-file>\n"
+                                                  "  -d    Shared name dictionary the records were converted with.\n"
+                                                  "  -a    Apply the patch to the old record and write the new record.\n";
+        BonMappedFile           oldFile;
+        BonMappedFile           dictionaryFile;
+        const BonRecord*        oldRecord;
+        const BonRecord*        dictionary      = 0;
+        BonBool                 apply           = BON_FALSE;
+        clock_t                 t0, t1;
+
+        memset(&dictionaryFile, 0, sizeof(dictionaryFile));
+        while (argc > 4 && argv[1][0] == '-') {
+                if (0 == strcmp(argv[1], "-a")) {
+                        apply = BON_TRUE;
+                        argc -= 1;
+                        argv += 1;
+                } else if (0 == strcmp(argv[1], "-d") && !dictionary) {
+                        dictionary = BonMapRecordFile(&dictionaryFile, argv[2], BON_MAP_VALIDATE_DEEP);
+                        if (!dictionary) {
+                                fprintf(stderr, "Failed to load name dictionary %s\n", argv[2]);
+                                exit(-2);
+                        }
+                        BonRegisterNameDictionary(dictionary);
+                        argc -= 2;
+                        argv += 2;
+                } else {
+                        Usage(usage);
+                }
+        }
+        if (argc != 4)
+                Usage(usage);
+        oldRecord = BonMapRecordFile(&oldFile, argv[1], BON_MAP_WILLNEED | BON_MAP_VALIDATE_DEEP);
+        if (!oldRecord) {
+                fprintf(stderr, "%s is missing or is not a valid BON record.\n", argv[1]);
                 exit(-2);
         }
 
-        BonDebugWrite(record, stdout);
+        if (apply) {
+                BonMappedFile   patchFile;
+                BonRecord*      newRecord;
+                if (!BonMapFile(&patchFile, argv[2], BON_MAP_SEQUENTIAL)) {
+                        fprintf(stderr, "Failed to load patch %s\n", argv[2]);
+                        exit(-2);
+                }
+                t0 = clock();
+                newRecord = BonApplyPatch(oldRecord, patchFile.data, patchFile.size);
+                t1 = clock();
+                if (!newRecord) {
+                        fprintf(stderr, "The patch is invalid or was made for another record\n");
+                        exit(-2);
+                }
+                if (!WriteRecordToDisk(newRecord, argv[3])) {
+                        fprintf(stderr, "Failed to write %s\n", argv[3]);
+                        exit(-3);
+                }
+                printf("Applied %u byte patch in %.1f ms: %u byte record\n", (unsigned)patchFile.size, 
+                        1000.0 * (double)(t1 - t0) / CLOCKS_PER_SEC, newRecord->recordSize);
+                free(newRecord);
+                BonUnmapFile(&patchFile);
+        } else {
+                BonMappedFile           newFile;
+                const BonRecord*        newRecord       = BonMapRecordFile(&newFile, argv[2], BON_MAP_WILLNEED | BON_MAP_VALIDATE_DEEP);
+                void*                   patch;
+                size_t                  patchSize;
+                FILE*                   f;
+                if (!newRecord) {
+                        fprintf(stderr, "%s is missing or is not a valid BON record.\n", argv[2]);
+                        exit(-2);
+                }
+                t0 = clock();
+                patch = BonDiffRecords(oldRecord, newRecord, &patchSize);
+                t1 = clock();
+                if (!patch) {
+                        fprintf(stderr, "Failed to create patch\n");
+                        exit(-2);
+                }
+                f = fopen(argv[3], "wb");
+                if (!f || fwrite(patch, patchSize, 1, f) != 1) {
+                        fprintf(stderr, "Failed to write %s\n", argv[3]);
+                        exit(-3);
+                }
+                fclose(f);
+                printf("Patch %u bytes, new record %u bytes (%.2f%%), diff %.1f ms\n", (unsigned)patchSize, newRecord->recordSize,
+                        100.0 * (double)patchSize / (double)newRecord->recordSize, 1000.0 * (double)(t1 - t0) / CLOCKS_PER_SEC);
+                free(patch);
+                BonUnmapRecord(&newFile);
+        }
+
+        BonUnmapRecord(&oldFile);
+        if (dictionary) {
+                BonUnregisterNameDictionary(dictionary);
+                BonUnmapRecord(&dictionaryFile);
+        }
         return 0;
 }
+#endif
+
+#if defined(BONTOOL_BONSTRIP)
+static int
+StripBon(int argc, char** argv) {
+        const char*             usage           = "Remove the name strings of a BON record. Members keep their names as hashes.\n"
+                                                  "Usage: BonStrip <input bon-file> <output bon-file>\n";
+        BonMappedFile           file;
+        const BonRecord*        record;
+        BonRecord*              stripped;
+
+        if (argc != 3)
+                Usage(usage);
+        record = BonMapRecordFile(&file, argv[1], BON_MAP_SEQUENTIAL | BON_MAP_VALIDATE_DEEP);
+        if (!record) {
+                fprintf(stderr, "Input file is missing or is not a valid BON record.\n");
+                exit(-2);
+        }
+        stripped = BonStripNames(record);
+        if (!stripped) {
+                fprintf(stderr, "Out of memory\n");
+                exit(-2);
+        }
+        if (!WriteRecordToDisk(stripped, argv[2])) {
+                fprintf(stderr, "Failed to write %s\n", argv[2]);
+                exit(-3);
+        }
+        printf("%llu -> %llu bytes (%.1f%%)\n", (unsigned long long)BonGetRecordSize(record), (unsigned long long)BonGetRecordSize(stripped), 
+                100.0 * (double)BonGetRecordSize(stripped) / (double)BonGetRecordSize(record));
+        free(stripped);
+        BonUnmapRecord(&file);
+        return 0;
+}
+#endif
 
 int
 main(int argc, char** argv) {
@@ -162,6 +927,18 @@ main(int argc, char** argv) {
 #ifdef BONTOOL_DUMPBON
         return DumpBon(argc, argv);
 #endif
+#ifdef BONTOOL_BONPACK
+        return PackBon(argc, argv);
+#endif
+#ifdef BONTOOL_BONNAMEDICT
+        return NameDict(argc, argv);
+#endif
+#ifdef BONTOOL_BONDIFF
+        return DiffBon(argc, argv);
+#endif
+#ifdef BONTOOL_BONSTRIP
+        return StripBon(argc, argv);
+#endif
 }
 
 
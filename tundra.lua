@@ -23,6 +23,13 @@ Build {
 			"/wd4100", "/wd4127", 
 			{ "/O2", "/d2Zi+"; Config = "*-vs2013-release" },
 		},
+		CXXOPTS = {
+			{ "-std=c++17"; Config = { "*-gcc-*", "*-clang-*" } },
+			{ "/std:c++17"; Config = "*-vs2013-*" },
+		},
+		LIBS = {
+			{ "pthread"; Config = { "*-gcc-*", "*-clang-*" } },
+		},
 		GENERATE_PDB = {
 			{ "1"; Config = { "*-vs2013-*" } },
 		}
@@ -30,7 +37,7 @@ Build {
 	Units = function()
 		StaticLibrary {
 			Name = "Bon",
-			Sources = { "src/Bon.c", "src/BonConvert.c" },
+			Sources = { "src/Bon.c", "src/BonConvert.c", "src/BonMap.c", "src/BonPack.c" },
 		}
 		Program {
 			Name = "BonTest",
@@ -38,6 +45,12 @@ Build {
 			Includes = { "src" },
 			Depends = { "Bon" },
 		}
+		Program {
+			Name = "BonCppTest",
+			Sources = { "test/BonCppTest.cpp" },
+			Includes = { "src" },
+			Depends = { "Bon" },
+		}
 		Program {
 			Name = "Json2Bon",
 			Sources = { "tools/BonTools.c" },
@@ -59,11 +72,46 @@ Build {
 			Depends = { "Bon" },
 			Defines = { "BONTOOL_DUMPBON" },
 		}
+		Program {
+			Name = "BonPack",
+			Sources = { "tools/BonTools.c" },
+			Includes = { "src" },
+			Depends = { "Bon" },
+			Defines = { "BONTOOL_BONPACK" },
+		}
+		Program {
+			Name = "BonNameDict",
+			Sources = { "tools/BonTools.c" },
+			Includes = { "src" },
+			Depends = { "Bon" },
+			Defines = { "BONTOOL_BONNAMEDICT" },
+		}
+
+		Program {
+			Name = "BonDiff",
+			Sources = { "tools/BonTools.c" },
+			Includes = { "src" },
+			Depends = { "Bon" },
+			Defines = { "BONTOOL_BONDIFF" },
+		}
+
+		Program {
+			Name = "BonStrip",
+			Sources = { "tools/BonTools.c" },
+			Includes = { "src" },
+			Depends = { "Bon" },
+			Defines = { "BONTOOL_BONSTRIP" },
+		}
 
 		Default "BonTest"
+		Default "BonCppTest"
 		Default "Json2Bon"
 		Default "Bon2Json"
 		Default "DumpBon"
+		Default "BonPack"
+		Default "BonNameDict"
+		Default "BonDiff"
+		Default "BonStrip"
 	end,
 	IdeGenerationHints = {
 		Msvc = {